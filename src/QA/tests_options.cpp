@@ -209,3 +209,103 @@ TEST_CASE( "tests_options.cpp/from_pmtmrc_file", "Test whether putting a option
     
 }
 
+
+/**
+ * @ingroup tests_opts
+ * 
+ * Tests that choosing a clock backend with \ref PMTM_set_option, or with a \c PMTM_CLOCK line in a .pmtmrc file, names that clock on the \c clock-read overhead line, and that the timers still measure sensible times with it.
+ * 
+ */
+TEST_CASE( "tests_options.cpp/clock_backend", "Choosing a clock with PMTM_set_option or a PMTM_CLOCK line in .pmtmrc should name that clock in the clock-read overhead line" )
+{
+    {
+        CHECKED_PMTM_CALL( PMTM_set_option(PMTM_OPTION_CLOCK_COARSE, PMTM_TRUE) );
+        PmtmWrapper pmtm("test_timing_file_");
+
+        PMTM_timer_t timer;
+        CHECKED_PMTM_CALL( PMTM_create_timer(PMTM_DEFAULT_GROUP, &timer, "Timer", PMTM_TIMER_NONE) );
+        PMTM_timer_start(timer);
+        sleep(1);
+        PMTM_timer_stop(timer);
+        pmtm.finalize();
+
+        if (rank == 0) {
+            std::vector<std::string> lines = pmtm.read_output_file();
+            lines = check_header(lines);
+            std::vector<std::string> tokens = tokenize(lines.at(4));
+            REQUIRE( tokens.at(4) == "clock-read" );
+            REQUIRE( tokens.at(10) == "clock" );
+            REQUIRE( tokens.at(11) == "coarse" );
+            REQUIRE( tokens.at(12) == "resolution" );
+
+            lines = check_overheads(lines);
+            check_timer(lines.at(0), 0, 0, "Timer", 1, 0, 1);
+        }
+    }
+
+    CHECKED_PMTM_CALL( PMTM_set_option(PMTM_OPTION_CLOCK_COARSE, PMTM_FALSE) );
+    if (rank == 0) { system("echo \"PMTM_CLOCK mpi\" > .pmtmrc"); }
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    {
+        PmtmWrapper pmtm("test_timing_file_");
+        pmtm.finalize();
+
+        if (rank == 0) {
+            std::vector<std::string> lines = check_header(pmtm.read_output_file());
+            std::vector<std::string> tokens = tokenize(lines.at(4));
+            REQUIRE( tokens.at(4) == "clock-read" );
+            REQUIRE( tokens.at(11) == "mpi" );
+        }
+    }
+
+    if (rank == 0) { system("rm .pmtmrc"); }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+/**
+ * @ingroup tests_opts
+ * 
+ * Tests that setting \c PMTM_OPTION_WRITER_THREAD using the \ref PMTM_set_option function still writes everything to the output file, in order, when it is more than one buffer of the writer thread.
+ * 
+ */
+TEST_CASE( "tests_options.cpp/writer_thread", "Writing the output file from a writer thread should write all of the output in order" )
+{
+    const int num_params = 30000;
+
+    CHECKED_PMTM_CALL( PMTM_set_option(PMTM_OPTION_WRITER_THREAD, PMTM_TRUE) );
+    PmtmWrapper pmtm("test_timing_file_");
+    CHECKED_PMTM_CALL( PMTM_set_option(PMTM_OPTION_WRITER_THREAD, PMTM_FALSE) );
+
+    PMTM_timer_t timer;
+    CHECKED_PMTM_CALL( PMTM_create_timer(PMTM_DEFAULT_GROUP, &timer, "Timer", PMTM_TIMER_NONE) );
+    PMTM_timer_start(timer);
+    PMTM_timer_stop(timer);
+
+    for (int idx = 0; idx < num_params; ++idx) {
+        std::stringstream name_ss;
+        name_ss << "param" << idx;
+        CHECKED_PMTM_CALL( PMTM_parameter_output(PMTM_DEFAULT_INSTANCE, name_ss.str().c_str(), PMTM_OUTPUT_ALWAYS, PMTM_FALSE, "%d", idx) );
+    }
+
+    pmtm.finalize();
+
+    if (rank == 0) {
+        std::vector<std::string> lines = check_overheads(check_header(pmtm.read_output_file()));
+
+        REQUIRE( lines.size() == num_params + nprocs + 2 );
+        for (int idx = 0; idx < num_params; ++idx) {
+            std::stringstream name_ss;
+            name_ss << "param" << idx;
+            check_param(lines.at(idx), 0, name_ss.str(), idx);
+        }
+        for (int idx = 0; idx < nprocs; ++idx) {
+            check_timer(lines.at(num_params + idx), idx, 0, "Timer", 1);
+        }
+        REQUIRE( lines.at(num_params + nprocs) == "" );
+        REQUIRE( lines.at(num_params + nprocs + 1) == "End of File" );
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+}
@@ -9,12 +9,15 @@
 #include <vector>
 #include <string>
 
+#include <stdint.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "catch.hpp"
 
 #include "pmtm.h"
+#include "pmtm_fast.h"
 
 #include <omp.h>
 
@@ -37,7 +40,7 @@ TEST_CASE( "tests_threads.cpp/parallel_timing", "Timing a one second wait should
     PMTM_timer_t * timer_id = NULL;
     PMTM_error_t * error_code = NULL;
 
-    #pragma omp parallel default(none) shared(threads, timer_id, error_code)
+    #pragma omp parallel default(none) shared(threads, timer_id, error_code, PMTM_DEFAULT_GROUP, PMTM_TIMER_NONE)
     {
         #pragma omp master
         {
@@ -61,7 +64,7 @@ TEST_CASE( "tests_threads.cpp/parallel_timing", "Timing a one second wait should
 
     const int num_seconds = 1;
 
-    #pragma omp parallel default(none) shared(timer_id)
+    #pragma omp parallel default(none) shared(timer_id, num_seconds)
     {
         int thr = omp_get_thread_num();
         PMTM_timer_start(timer_id[thr]);
@@ -87,3 +90,252 @@ TEST_CASE( "tests_threads.cpp/parallel_timing", "Timing a one second wait should
     MPI_Barrier(MPI_COMM_WORLD);
 }
 
+
+/**
+ * Return the CPU time used by the calling thread.
+ */
+static double thread_cpu_time()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1.0E-9;
+}
+
+/**
+ * @ingroup tests_thrds
+ * 
+ * Tests that the CPU time of each thread timer is the CPU time of that thread alone, and that the efficiency of a sleeping thread is low.
+ * 
+ */
+TEST_CASE( "tests_threads.cpp/thread_cpu_time", "The CPU time of a thread timer should not include the CPU time of other threads" )
+{
+    PmtmWrapper pmtm("test_timing_file_");
+
+    const int threads = 2;
+    const double busy_cpu = 0.2;
+    PMTM_timer_t timer_id[threads];
+    double cpu_time[threads];
+
+    #pragma omp parallel num_threads(threads) shared(timer_id, cpu_time)
+    {
+        int thr = omp_get_thread_num();
+        PMTM_create_timer(PMTM_DEFAULT_GROUP, &timer_id[thr], "Timer1", PMTM_TIMER_NONE);
+
+        PMTM_timer_start(timer_id[thr]);
+        if (thr == 0) {
+            double start = thread_cpu_time();
+            while (thread_cpu_time() - start < busy_cpu) {
+            }
+        } else {
+            usleep(300000);
+        }
+        PMTM_timer_stop(timer_id[thr]);
+
+        cpu_time[thr] = PMTM_get_total_cpu_time(timer_id[thr]);
+    }
+
+    REQUIRE( cpu_time[0] >= busy_cpu );
+    REQUIRE( cpu_time[1] < 1E-2 );
+
+    pmtm.finalize();
+
+    if (rank == 0) {
+        std::vector<std::string> lines = check_header(pmtm.read_output_file());
+        lines = check_overheads(lines);
+
+        REQUIRE( lines.size() == nprocs*threads + 2 );
+        for (int idx = 0; idx < nprocs; ++idx) {
+            check_timer(lines.at(idx*threads + 1), idx, 1, "Timer1", 1);
+
+            std::vector<std::string> tokens = tokenize(lines.at(idx*threads + 1));
+            REQUIRE( tokens.at(14) == "cpu" );
+            REQUIRE( tokens.at(16) == "efficiency" );
+
+            std::stringstream efficiency_ss(tokens.at(17));
+            double efficiency;
+            efficiency_ss >> efficiency;
+            REQUIRE( efficiency < 0.1 );
+        }
+    }
+        
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+
+/**
+ * @ingroup tests_thrds
+ * 
+ * Tests that timers created concurrently by each thread, including a thread beyond those the timer group was created for, are merged by name when they are output.
+ * 
+ */
+TEST_CASE( "tests_threads.cpp/parallel_create", "Timers created concurrently by each thread should be output together by name" )
+{
+    PmtmWrapper pmtm("test_timing_file_");
+
+    const int threads = omp_get_max_threads() + 1;
+    const int num_timers = 20;
+    int failures = 0;
+
+    #pragma omp parallel num_threads(threads) shared(failures)
+    {
+        int thr = omp_get_thread_num();
+        for (int timer_idx = 0; timer_idx < num_timers; ++timer_idx) {
+            std::stringstream name_ss;
+            name_ss << "Timer" << timer_idx;
+
+            PMTM_timer_t timer_id, same_id;
+            if (PMTM_create_timer(PMTM_DEFAULT_GROUP, &timer_id, name_ss.str().c_str(), PMTM_TIMER_NONE) != PMTM_SUCCESS
+                    || PMTM_get_or_create_timer(PMTM_DEFAULT_GROUP, &same_id, name_ss.str().c_str(), PMTM_TIMER_NONE) != PMTM_SUCCESS
+                    || same_id != timer_id) {
+                #pragma omp atomic
+                ++failures;
+                continue;
+            }
+
+            for (int count = 0; count <= thr; ++count) {
+                PMTM_timer_start(timer_id);
+                PMTM_timer_stop(timer_id);
+            }
+        }
+    }
+
+    REQUIRE( failures == 0 );
+
+    pmtm.finalize();
+
+    if (rank == 0) {
+        std::vector<std::string> lines = check_header(pmtm.read_output_file());
+        lines = check_overheads(lines);
+
+        REQUIRE( lines.size() == num_timers*nprocs*threads + 2 );
+        for (int timer_idx = 0; timer_idx < num_timers; ++timer_idx) {
+            std::stringstream name_ss;
+            name_ss << "Timer" << timer_idx;
+            for (int idx = 0; idx < nprocs; ++idx) {
+                for (int thr = 0; thr < threads; ++thr) {
+                    check_timer(lines.at((timer_idx*nprocs + idx)*threads + thr), idx, thr, name_ss.str(), thr + 1);
+                }
+            }
+        }
+        REQUIRE( lines.at(num_timers*nprocs*threads) == "" );
+    }
+        
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+
+/**
+ * @ingroup tests_thrds
+ * 
+ * Tests that the timers of different threads are cache line aligned and that no cache line holds the hot fields of timers from two threads.
+ * 
+ */
+TEST_CASE( "tests_threads.cpp/false_sharing", "The hot fields of timers created by different threads should never share a cache line" )
+{
+    PmtmWrapper pmtm("test_timing_file_");
+
+    const int threads = omp_get_max_threads() + 1;
+    const int num_timers = 8;
+    const uintptr_t line_size = 64;
+    std::vector<PMTM_timer_t> timer_ids(threads * num_timers);
+    int failures = 0;
+
+    #pragma omp parallel num_threads(threads) shared(timer_ids, failures)
+    {
+        int thr = omp_get_thread_num();
+        for (int timer_idx = 0; timer_idx < num_timers; ++timer_idx) {
+            std::stringstream name_ss;
+            name_ss << "Timer" << timer_idx;
+
+            PMTM_timer_t & timer_id = timer_ids[thr * num_timers + timer_idx];
+            if (PMTM_create_timer(PMTM_DEFAULT_GROUP, &timer_id, name_ss.str().c_str(), PMTM_TIMER_NONE) != PMTM_SUCCESS) {
+                #pragma omp atomic
+                ++failures;
+                continue;
+            }
+            PMTM_timer_start(timer_id);
+            PMTM_timer_stop(timer_id);
+        }
+    }
+
+    REQUIRE( failures == 0 );
+
+    for (int idx = 0; idx < threads * num_timers; ++idx) {
+        uintptr_t offset = (uintptr_t) timer_ids[idx] % line_size;
+        REQUIRE( offset == 0 );
+    }
+
+    for (int idx = 0; idx < threads * num_timers; ++idx) {
+        uintptr_t first_line = (uintptr_t) timer_ids[idx] / line_size;
+        uintptr_t last_line = ((uintptr_t) timer_ids[idx] + sizeof(struct PMTM_timer_hot) - 1) / line_size;
+
+        for (int other_idx = 0; other_idx < threads * num_timers; ++other_idx) {
+            if (other_idx / num_timers == idx / num_timers) continue;
+
+            uintptr_t other_first_line = (uintptr_t) timer_ids[other_idx] / line_size;
+            uintptr_t other_last_line = ((uintptr_t) timer_ids[other_idx] + sizeof(struct PMTM_timer_hot) - 1) / line_size;
+            REQUIRE( (last_line < other_first_line || other_last_line < first_line) );
+        }
+    }
+
+    pmtm.finalize();
+
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+/**
+ * @ingroup tests_thrds
+ * 
+ * Tests that the IO rank formatting the timers with several threads prints the same bytes, in the same order, as formatting them with one.
+ * 
+ */
+TEST_CASE( "tests_threads.cpp/parallel_format", "Formatting the timers with several threads should print the same lines as with one thread" )
+{
+    const int max_threads = omp_get_max_threads();
+    const int thread_counts[] = { 1, (max_threads > 1) ? max_threads : 4 };
+    const PMTM_timer_type_t types[] = { PMTM_TIMER_NONE, PMTM_TIMER_ALL, PMTM_TIMER_MMA };
+    const int num_timers = 30;
+    const pmtm_tick_t tenth = PMTM_TICKS_PER_SECOND / 10;
+    std::vector<std::string> outputs[2];
+
+    for (int mode = 0; mode < 2; ++mode) {
+        PmtmWrapper pmtm("test_timing_file_");
+
+        // Set the counts and times of the timers so that both runs print the
+        // same numbers.
+
+        for (int timer_idx = 0; timer_idx < num_timers; ++timer_idx) {
+            std::stringstream name_ss;
+            name_ss << "Timer" << timer_idx;
+
+            PMTM_timer_t timer_id;
+            CHECKED_PMTM_CALL( PMTM_create_timer(PMTM_DEFAULT_GROUP, &timer_id, name_ss.str().c_str(), types[timer_idx % 3] | PMTM_MEASURE_WC) );
+
+            struct PMTM_timer_hot * hot = (struct PMTM_timer_hot *) timer_id;
+            const uint64_t count = (uint64_t) (timer_idx + rank + 1);
+            hot->timer_count = count;
+            hot->total_wc = count * tenth;
+            pmtm_set_timer_square(hot, (pmtm_square_t) tenth * tenth * count);
+        }
+
+        omp_set_num_threads(thread_counts[mode]);
+        pmtm.finalize();
+        omp_set_num_threads(max_threads);
+
+        if (rank == 0) {
+            outputs[mode] = check_overheads(check_header(pmtm.read_output_file()));
+        }
+
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+
+    if (rank == 0) {
+        REQUIRE( outputs[0].size() > (size_t) num_timers * nprocs );
+        REQUIRE( outputs[1].size() == outputs[0].size() );
+        for (size_t idx = 0; idx < outputs[0].size(); ++idx) {
+            REQUIRE( outputs[1].at(idx) == outputs[0].at(idx) );
+        }
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+}
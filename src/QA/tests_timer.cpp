@@ -8,13 +8,22 @@
 
 #include <vector>
 #include <string>
+#include <fstream>
 
+#include <inttypes.h>
+#include <math.h>
+#include <stddef.h>
 #include <string.h>
 #include <unistd.h>
 
 #include "catch.hpp"
 
 #include "pmtm.h"
+#include "pmtm_fast.h"
+#include "pmtm.hpp"
+#include "pmtm_internal.h"
+
+#include <stdexcept>
 
 int main(int argc, char** argv)
 {
@@ -501,3 +510,1348 @@ TEST_CASE( "tests_timer.cpp/sampling_maximum", "Specifying the maximum samples s
 }
 
 
+/**
+ * @ingroup tests_timer
+ * 
+ * Tests that a negative maximum number of samples, other than \c PMTM_NO_MAX, is rejected and leaves the sample mode of the timer unchanged
+ * 
+ */
+TEST_CASE( "tests_timer.cpp/sampling_negative", "Specifying a negative maximum samples should be rejected" )
+{
+    PmtmWrapper pmtm("test_timing_file_");
+
+    PMTM_timer_t timer_id = ((PMTM_timer_t) -1);
+    CHECKED_PMTM_CALL( PMTM_create_timer(PMTM_DEFAULT_GROUP, &timer_id, "Timer1", PMTM_TIMER_NONE) );
+    REQUIRE( PMTM_set_sample_mode(timer_id, PMTM_DEFAULT_FREQ, -1) == PMTM_ERROR_INVALID_SAMPLE_MODE );
+    CHECKED_PMTM_CALL( PMTM_set_sample_mode(timer_id, PMTM_DEFAULT_FREQ, PMTM_NO_MAX) );
+
+    const int num_timings = 3;
+
+    for (int timing_idx = 0; timing_idx < num_timings; ++timing_idx) {
+        PMTM_timer_start(timer_id);
+        PMTM_timer_stop(timer_id);
+    }
+
+    pmtm.finalize();
+
+    if (rank == 0) {
+        std::vector<std::string> lines = check_header(pmtm.read_output_file());
+        lines = check_overheads(lines);
+
+        REQUIRE( lines.size() == nprocs + 2 );
+        for (int idx = 0; idx < nprocs; ++idx) {
+            check_timer(lines.at(idx), idx, 0, "Timer1", num_timings);
+        }
+        REQUIRE( lines.at(nprocs) == "" );
+    }
+        
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+
+/**
+ * Spin for the given wallclock time so that both the CPU and wallclock time
+ * advance.
+ */
+static void busy_wait(double seconds)
+{
+    double start = MPI_Wtime();
+    while (MPI_Wtime() - start < seconds) {
+    }
+}
+
+/**
+ * @ingroup tests_timer
+ * 
+ * Tests that a timer created with \c PMTM_MEASURE_WC measures the wallclock time but reports no CPU time
+ * 
+ */
+TEST_CASE( "tests_timer.cpp/measure_wc", "A timer created with PMTM_MEASURE_WC should measure the wallclock time but no CPU time" )
+{
+    PmtmWrapper pmtm("test_timing_file_");
+
+    PMTM_timer_t wc_timer = ((PMTM_timer_t) -1);
+    PMTM_timer_t all_timer = ((PMTM_timer_t) -1);
+    CHECKED_PMTM_CALL( PMTM_create_timer(PMTM_DEFAULT_GROUP, &wc_timer, "Timer1", PMTM_TIMER_NONE | PMTM_MEASURE_WC) );
+    CHECKED_PMTM_CALL( PMTM_create_timer(PMTM_DEFAULT_GROUP, &all_timer, "Timer2", PMTM_TIMER_NONE) );
+
+    PMTM_timer_start(wc_timer);
+    PMTM_timer_start(all_timer);
+    busy_wait(0.1);
+    PMTM_timer_stop(all_timer);
+    PMTM_timer_stop(wc_timer);
+
+    REQUIRE( PMTM_get_total_wc_time(wc_timer) > 0.05 );
+    REQUIRE( PMTM_get_total_cpu_time(wc_timer) == 0 );
+    REQUIRE( PMTM_get_total_wc_time(all_timer) > 0.05 );
+    REQUIRE( PMTM_get_total_cpu_time(all_timer) > 0 );
+
+    pmtm.finalize();
+
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+/**
+ * @ingroup tests_timer
+ * 
+ * Tests that after \ref PMTM_set_default_measure sets \c PMTM_MEASURE_WC on a group its timers measure no CPU time, unless they ask for it in their timer type
+ * 
+ */
+TEST_CASE( "tests_timer.cpp/default_measure", "Timers created in a group whose default is PMTM_MEASURE_WC should measure no CPU time, unless they ask for it" )
+{
+    PmtmWrapper pmtm("test_timing_file_");
+
+    PMTM_timer_group_t group_id = -1;
+    CHECKED_PMTM_CALL( PMTM_create_timer_group(PMTM_DEFAULT_INSTANCE, &group_id, "Group1") );
+    CHECKED_PMTM_CALL( PMTM_set_default_measure(group_id, PMTM_MEASURE_WC) );
+    REQUIRE( PMTM_set_default_measure(-1, PMTM_MEASURE_WC) == PMTM_ERROR_INVALID_TIMER_GROUP_ID );
+
+    PMTM_timer_t wc_timer = ((PMTM_timer_t) -1);
+    PMTM_timer_t all_timer = ((PMTM_timer_t) -1);
+    CHECKED_PMTM_CALL( PMTM_create_timer(group_id, &wc_timer, "Timer1", PMTM_TIMER_NONE) );
+    CHECKED_PMTM_CALL( PMTM_create_timer(group_id, &all_timer, "Timer2", PMTM_TIMER_NONE | PMTM_MEASURE_ALL) );
+
+    PMTM_timer_start(wc_timer);
+    PMTM_timer_start(all_timer);
+    busy_wait(0.1);
+    PMTM_timer_stop(all_timer);
+    PMTM_timer_stop(wc_timer);
+
+    REQUIRE( PMTM_get_total_wc_time(wc_timer) > 0.05 );
+    REQUIRE( PMTM_get_total_cpu_time(wc_timer) == 0 );
+    REQUIRE( PMTM_get_total_cpu_time(all_timer) > 0 );
+
+    pmtm.finalize();
+
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+/**
+ * @ingroup tests_timer
+ *
+ * Tests that the timers of every group are gathered from every rank and printed with their counts and pauses
+ *
+ */
+TEST_CASE( "tests_timer.cpp/group_output", "The timers of every group should be printed for every rank" )
+{
+    PmtmWrapper pmtm("test_timing_file_");
+
+    PMTM_timer_group_t group_id = -1;
+    CHECKED_PMTM_CALL( PMTM_create_timer_group(PMTM_DEFAULT_INSTANCE, &group_id, "Group1") );
+
+    PMTM_timer_t timer1 = ((PMTM_timer_t) -1);
+    PMTM_timer_t timer2 = ((PMTM_timer_t) -1);
+    CHECKED_PMTM_CALL( PMTM_create_timer(PMTM_DEFAULT_GROUP, &timer1, "Timer1", PMTM_TIMER_NONE | PMTM_MEASURE_WC) );
+    CHECKED_PMTM_CALL( PMTM_create_timer(group_id, &timer2, "Timer2", PMTM_TIMER_NONE | PMTM_MEASURE_WC) );
+
+    PMTM_timer_start(timer1);
+    PMTM_timer_stop(timer1);
+    for (int idx = 0; idx < 3; ++idx) {
+        PMTM_timer_start(timer2);
+        PMTM_timer_pause(timer2);
+        PMTM_timer_continue(timer2);
+        PMTM_timer_stop(timer2);
+    }
+
+    pmtm.finalize();
+
+    if (rank == 0) {
+        std::vector<std::string> lines = check_header(pmtm.read_output_file());
+        lines = check_overheads(lines);
+
+        REQUIRE( lines.size() == 2 * nprocs + 2 );
+        for (int idx = 0; idx < nprocs; ++idx) {
+            check_timer(lines.at(idx), idx, 0, "Timer1", 1);
+            check_timer(lines.at(nprocs + idx), idx, 0, "Timer2", 3, 1);
+        }
+        REQUIRE( lines.at(2 * nprocs) == "" );
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+/**
+ * @ingroup tests_timer
+ *
+ * Tests that timers only created on some ranks are printed after the timers common to all ranks, in the order of the ranks that created them
+ *
+ */
+TEST_CASE( "tests_timer.cpp/rank_timers", "Timers created on only one rank should be printed in rank order" )
+{
+    PmtmWrapper pmtm("test_timing_file_");
+
+    PMTM_timer_t common_timer = ((PMTM_timer_t) -1);
+    PMTM_timer_t rank_timer = ((PMTM_timer_t) -1);
+    CHECKED_PMTM_CALL( PMTM_create_timer(PMTM_DEFAULT_GROUP, &common_timer, "Common", PMTM_TIMER_NONE | PMTM_MEASURE_WC) );
+
+    std::stringstream name_ss;
+    name_ss << "Rank" << rank;
+    CHECKED_PMTM_CALL( PMTM_create_timer(PMTM_DEFAULT_GROUP, &rank_timer, name_ss.str().c_str(), PMTM_TIMER_NONE | PMTM_MEASURE_WC) );
+
+    PMTM_timer_start(common_timer);
+    PMTM_timer_stop(common_timer);
+    for (int idx = 0; idx <= rank; ++idx) {
+        PMTM_timer_start(rank_timer);
+        PMTM_timer_stop(rank_timer);
+    }
+
+    pmtm.finalize();
+
+    if (rank == 0) {
+        std::vector<std::string> lines = check_header(pmtm.read_output_file());
+        lines = check_overheads(lines);
+
+        REQUIRE( lines.size() == 2 * nprocs + 2 );
+        for (int idx = 0; idx < nprocs; ++idx) {
+            check_timer(lines.at(idx), idx, 0, "Common", 1);
+
+            std::stringstream rank_name_ss;
+            rank_name_ss << "Rank" << idx;
+            check_timer(lines.at(nprocs + idx), idx, 0, rank_name_ss.str(), idx + 1);
+        }
+        REQUIRE( lines.at(2 * nprocs) == "" );
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+/**
+ * @ingroup tests_timer
+ *
+ * Tests that the timers are printed in the same order whatever order each rank created them in, as each rank sorts its timers before sending them, and that a timer created on only the last rank is printed just for that rank
+ *
+ */
+TEST_CASE( "tests_timer.cpp/creation_order", "Timers created in a different order on some ranks should be printed in the order of the first rank" )
+{
+    PmtmWrapper pmtm("test_timing_file_");
+
+    PMTM_timer_t first_timer = ((PMTM_timer_t) -1);
+    PMTM_timer_t second_timer = ((PMTM_timer_t) -1);
+    PMTM_timer_t last_timer = ((PMTM_timer_t) -1);
+    if (rank % 2 == 0) {
+        CHECKED_PMTM_CALL( PMTM_create_timer(PMTM_DEFAULT_GROUP, &first_timer, "First", PMTM_TIMER_NONE | PMTM_MEASURE_WC) );
+        CHECKED_PMTM_CALL( PMTM_create_timer(PMTM_DEFAULT_GROUP, &second_timer, "Second", PMTM_TIMER_NONE | PMTM_MEASURE_WC) );
+    } else {
+        CHECKED_PMTM_CALL( PMTM_create_timer(PMTM_DEFAULT_GROUP, &second_timer, "Second", PMTM_TIMER_NONE | PMTM_MEASURE_WC) );
+        CHECKED_PMTM_CALL( PMTM_create_timer(PMTM_DEFAULT_GROUP, &first_timer, "First", PMTM_TIMER_NONE | PMTM_MEASURE_WC) );
+    }
+    if (rank == nprocs - 1) {
+        CHECKED_PMTM_CALL( PMTM_create_timer(PMTM_DEFAULT_GROUP, &last_timer, "Last", PMTM_TIMER_NONE | PMTM_MEASURE_WC) );
+        PMTM_timer_start(last_timer);
+        PMTM_timer_stop(last_timer);
+    }
+
+    PMTM_timer_start(first_timer);
+    PMTM_timer_stop(first_timer);
+    for (int idx = 0; idx <= rank; ++idx) {
+        PMTM_timer_start(second_timer);
+        PMTM_timer_stop(second_timer);
+    }
+
+    pmtm.finalize();
+
+    if (rank == 0) {
+        std::vector<std::string> lines = check_header(pmtm.read_output_file());
+        lines = check_overheads(lines);
+
+        REQUIRE( lines.size() == 2 * nprocs + 3 );
+        for (int idx = 0; idx < nprocs; ++idx) {
+            check_timer(lines.at(idx), idx, 0, "First", 1);
+            check_timer(lines.at(nprocs + idx), idx, 0, "Second", idx + 1);
+        }
+        check_timer(lines.at(2 * nprocs), nprocs - 1, 0, "Last", 1);
+        REQUIRE( lines.at(2 * nprocs + 1) == "" );
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+/**
+ * @ingroup tests_timer
+ *
+ * Tests that the average, maximum and minimum of \c PMTM_TIMER_MMA timers created on only some ranks are reduced over just those ranks, and printed among the gathered timers in the order the timers were created
+ *
+ */
+TEST_CASE( "tests_timer.cpp/reduced_timers", "Max, Min and Average timers created on only some ranks should be summarised over those ranks" )
+{
+    PmtmWrapper pmtm("test_timing_file_");
+
+    create_rank_timers();
+
+    pmtm.finalize();
+
+    if (rank == 0) {
+        std::vector<std::string> lines = check_header(pmtm.read_output_file());
+        lines = check_overheads(lines);
+
+        REQUIRE( lines.size() == 2 * nprocs + 8 );
+        REQUIRE( lines.at(check_rank_timers(lines, 0)) == "" );
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+/**
+ * @ingroup tests_timer
+ *
+ * Tests that setting \c PMTM_OPTION_NODE_STATS prints the average, maximum and minimum of each node after those over all ranks, for both gathered and reduced timers
+ *
+ */
+TEST_CASE( "tests_timer.cpp/node_stats", "With PMTM_OPTION_NODE_STATS set the stats of each node should be printed after the stats over all ranks" )
+{
+    // Number the nodes as PMTM does, in the order of their lowest rank.
+    MPI_Comm node_comm;
+    int node_leader;
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &node_comm);
+    MPI_Allreduce(&rank, &node_leader, 1, MPI_INT, MPI_MIN, node_comm);
+    MPI_Comm_free(&node_comm);
+
+    std::vector<int> leaders(nprocs);
+    MPI_Allgather(&node_leader, 1, MPI_INT, &leaders[0], 1, MPI_INT, MPI_COMM_WORLD);
+    std::vector<int> node_sizes;
+    std::vector<int> leader_nodes(nprocs, -1);
+    for (int idx = 0; idx < nprocs; ++idx) {
+        if (leaders[idx] == idx) {
+            leader_nodes[idx] = node_sizes.size();
+            node_sizes.push_back(0);
+        }
+    }
+    for (int idx = 0; idx < nprocs; ++idx) {
+        node_sizes.at(leader_nodes[leaders[idx]])++;
+    }
+    int num_nodes = node_sizes.size();
+
+    CHECKED_PMTM_CALL( PMTM_set_option(PMTM_OPTION_NODE_STATS, PMTM_TRUE) );
+    PmtmWrapper pmtm("test_timing_file_");
+
+    PMTM_timer_t all_timer = ((PMTM_timer_t) -1);
+    PMTM_timer_t mma_timer = ((PMTM_timer_t) -1);
+    CHECKED_PMTM_CALL( PMTM_create_timer(PMTM_DEFAULT_GROUP, &all_timer, "Timer1", PMTM_TIMER_ALL | PMTM_MEASURE_WC) );
+    CHECKED_PMTM_CALL( PMTM_create_timer(PMTM_DEFAULT_GROUP, &mma_timer, "Timer2", PMTM_TIMER_MMA | PMTM_MEASURE_WC) );
+
+    PMTM_timer_start(all_timer);
+    PMTM_timer_stop(all_timer);
+    PMTM_timer_start(mma_timer);
+    PMTM_timer_stop(mma_timer);
+
+    pmtm.finalize();
+    PMTM_set_option(PMTM_OPTION_NODE_STATS, PMTM_FALSE);
+
+    if (rank == 0) {
+        std::vector<std::string> lines = check_header(pmtm.read_output_file());
+        lines = check_overheads(lines);
+
+        REQUIRE( lines.size() == nprocs + 6 * num_nodes + 8 );
+        int line = 0;
+        for (int idx = 0; idx < nprocs; ++idx) {
+            check_timer(lines.at(line++), idx, 0, "Timer1", 1);
+        }
+        check_timer(lines.at(line++), "Rank Average", "Timer1", nprocs);
+        check_timer(lines.at(line++), "Rank Maximum", "Timer1", 1);
+        check_timer(lines.at(line++), "Rank Minimum", "Timer1", 1);
+        for (int node = 0; node < num_nodes; ++node) {
+            std::stringstream node_ss;
+            node_ss << "Node " << node << " ";
+            check_timer(lines.at(line++), node_ss.str() + "Average", "Timer1", node_sizes.at(node));
+            check_timer(lines.at(line++), node_ss.str() + "Maximum", "Timer1", 1);
+            check_timer(lines.at(line++), node_ss.str() + "Minimum", "Timer1", 1);
+        }
+
+        check_timer(lines.at(line++), "Rank Average", "Timer2", nprocs);
+        check_timer(lines.at(line++), "Rank Maximum", "Timer2", 1);
+        check_timer(lines.at(line++), "Rank Minimum", "Timer2", 1);
+        for (int node = 0; node < num_nodes; ++node) {
+            std::stringstream node_ss;
+            node_ss << "Node " << node << " ";
+            check_timer(lines.at(line++), node_ss.str() + "Average", "Timer2", node_sizes.at(node));
+            check_timer(lines.at(line++), node_ss.str() + "Maximum", "Timer2", 1);
+            check_timer(lines.at(line++), node_ss.str() + "Minimum", "Timer2", 1);
+        }
+        REQUIRE( lines.at(line) == "" );
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+/**
+ * @ingroup tests_timer
+ *
+ * Tests that streaming the timers to the IO rank a window of ranks at a time, with \c PMTM_STREAM_BUFFER so small that each window holds one rank, prints the same lines as gathering them all at once
+ *
+ */
+TEST_CASE( "tests_timer.cpp/stream_output", "Streaming the timers through a one rank window should print the same lines as gathering them" )
+{
+    setenv("PMTM_STREAM_BUFFER", "1", 1);
+    PmtmWrapper pmtm("test_timing_file_");
+
+    create_rank_timers();
+
+    pmtm.finalize();
+    unsetenv("PMTM_STREAM_BUFFER");
+
+    if (rank == 0) {
+        std::vector<std::string> lines = check_header(pmtm.read_output_file());
+        lines = check_overheads(lines);
+
+        REQUIRE( lines.size() == 2 * nprocs + 8 );
+        REQUIRE( lines.at(check_rank_timers(lines, 0)) == "" );
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+/**
+ * @ingroup tests_timer
+ * 
+ * Tests that with \c PMTM_OPTION_COLLECTIVE_WRITE, where each rank writes its own lines with MPI-IO, the timers are printed in the same order as when they are gathered, and the IO rank carries on printing after them
+ * 
+ */
+TEST_CASE( "tests_timer.cpp/collective_write", "Writing the timers with MPI-IO from every rank should print the same lines as gathering them" )
+{
+    CHECKED_PMTM_CALL( PMTM_set_option(PMTM_OPTION_COLLECTIVE_WRITE, PMTM_TRUE) );
+    PmtmWrapper pmtm("test_timing_file_");
+
+    create_rank_timers();
+
+    CHECKED_PMTM_CALL( PMTM_timer_output(PMTM_DEFAULT_INSTANCE) );
+    CHECKED_PMTM_CALL( PMTM_parameter_output(PMTM_DEFAULT_INSTANCE, "After", PMTM_OUTPUT_ALWAYS, PMTM_FALSE, "%d", 1) );
+    CHECKED_PMTM_CALL( PMTM_set_option(PMTM_OPTION_COLLECTIVE_WRITE, PMTM_FALSE) );
+    pmtm.finalize();
+
+    if (rank == 0) {
+        std::vector<std::string> lines = check_header(pmtm.read_output_file());
+        lines = check_overheads(lines);
+
+        REQUIRE( lines.size() == 4 * nprocs + 15 );
+        size_t line = check_rank_timers(lines, 0);
+        check_param(lines.at(line++), 0, "After", 1);
+        line = check_rank_timers(lines, line);
+        REQUIRE( lines.at(line) == "" );
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+/**
+ * @ingroup tests_timer
+ * 
+ * Tests that with \c PMTM_OPTION_COLLECTIVE_WRITE the ranks with no lines to write still take part in the write, and the lines of the ranks that have some are printed
+ * 
+ */
+TEST_CASE( "tests_timer.cpp/collective_write_empty", "Writing the timers with MPI-IO should work when some ranks have no lines to write" )
+{
+    CHECKED_PMTM_CALL( PMTM_set_option(PMTM_OPTION_COLLECTIVE_WRITE, PMTM_TRUE) );
+    PmtmWrapper pmtm("test_timing_file_");
+
+    PMTM_timer_t timer_id = ((PMTM_timer_t) -1);
+    if (rank == 0) {
+        CHECKED_PMTM_CALL( PMTM_create_timer(PMTM_DEFAULT_GROUP, &timer_id, "Rank0", PMTM_TIMER_NONE | PMTM_MEASURE_WC) );
+        PMTM_timer_start(timer_id);
+        PMTM_timer_stop(timer_id);
+    }
+
+    CHECKED_PMTM_CALL( PMTM_timer_output(PMTM_DEFAULT_INSTANCE) );
+    CHECKED_PMTM_CALL( PMTM_set_option(PMTM_OPTION_COLLECTIVE_WRITE, PMTM_FALSE) );
+    pmtm.finalize();
+
+    if (rank == 0) {
+        std::vector<std::string> lines = check_header(pmtm.read_output_file());
+        lines = check_overheads(lines);
+
+        REQUIRE( lines.size() == 4 );
+        check_timer(lines.at(0), 0, 0, "Rank0", 1);
+        check_timer(lines.at(1), 0, 0, "Rank0", 1);
+        REQUIRE( lines.at(2) == "" );
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+/**
+ * @ingroup tests_timer
+ *
+ * Tests that with \c PMTM_OPTION_RANK_FILES each rank appends a section holding the names and records of its timers, apart from the \c PMTM_TIMER_INT ones, to a rank file of its own at every output, and the IO rank prints a line for each section in place of the timers
+ *
+ */
+TEST_CASE( "tests_timer.cpp/rank_files", "With PMTM_OPTION_RANK_FILES each rank should write its timers to a rank file of its own, and the IO rank should say where they belong" )
+{
+    CHECKED_PMTM_CALL( PMTM_set_option(PMTM_OPTION_RANK_FILES, PMTM_TRUE) );
+    PmtmWrapper pmtm("test_timing_file_");
+    CHECKED_PMTM_CALL( PMTM_set_option(PMTM_OPTION_RANK_FILES, PMTM_FALSE) );
+
+    PMTM_timer_t common_timer = ((PMTM_timer_t) -1);
+    PMTM_timer_t int_timer = ((PMTM_timer_t) -1);
+    CHECKED_PMTM_CALL( PMTM_create_timer(PMTM_DEFAULT_GROUP, &common_timer, "Common", PMTM_TIMER_ALL | PMTM_MEASURE_WC) );
+    CHECKED_PMTM_CALL( PMTM_create_timer(PMTM_DEFAULT_GROUP, &int_timer, "Internal", PMTM_TIMER_INT | PMTM_MEASURE_WC) );
+
+    for (int idx = 0; idx <= rank; ++idx) {
+        PMTM_timer_start(common_timer);
+        PMTM_timer_stop(common_timer);
+    }
+    PMTM_timer_start(int_timer);
+    PMTM_timer_stop(int_timer);
+
+    CHECKED_PMTM_CALL( PMTM_timer_output(PMTM_DEFAULT_INSTANCE) );
+    pmtm.finalize();
+
+    std::stringstream file_ss;
+    file_ss << "test_timing_file_0.pmtm." << rank;
+    FILE * fid = fopen(file_ss.str().c_str(), "r");
+    REQUIRE( fid != NULL );
+
+    for (uint32_t section = 0; section < 2; ++section) {
+        struct PMTM_rank_file_header header;
+        REQUIRE( fread(&header, sizeof(header), 1, fid) == 1 );
+        REQUIRE( header.magic == PMTM_RANK_FILE_MAGIC );
+        REQUIRE( header.version == PMTM_WIRE_VERSION );
+        REQUIRE( header.record_size == sizeof(struct PMTM_timer_record) );
+        REQUIRE( header.rank == rank );
+        REQUIRE( header.nranks == nprocs );
+        REQUIRE( header.section == section );
+        REQUIRE( header.num_names == 1 );
+
+        std::vector<char> names(header.names_size + 1);
+        std::vector<char> timers(header.timers_size + 1);
+        REQUIRE( fread(&names[0], 1, header.names_size, fid) == header.names_size );
+        REQUIRE( fread(&timers[0], 1, header.timers_size, fid) == header.timers_size );
+
+        const std::string group_name(&names[0]);
+        const std::string timer_name(&names[group_name.size() + 1]);
+        REQUIRE( group_name == DEFAULT_GROUP_NAME );
+        REQUIRE( timer_name == "Common" );
+
+        uint32_t threadcount;
+        struct PMTM_timer_record record;
+        REQUIRE( header.timers_size == sizeof(threadcount) + sizeof(record) + header.num_counters * sizeof(int64_t) );
+        memcpy(&threadcount, &timers[0], sizeof(threadcount));
+        memcpy(&record, &timers[sizeof(threadcount)], sizeof(record));
+        REQUIRE( threadcount == 1 );
+        REQUIRE( record.rank == rank );
+        REQUIRE( record.timer_count == (uint64_t) (rank + 1) );
+    }
+
+    REQUIRE( fgetc(fid) == EOF );
+    fclose(fid);
+    remove(file_ss.str().c_str());
+
+    if (rank == 0) {
+        std::vector<std::string> lines = check_header(pmtm.read_output_file());
+        lines = check_overheads(lines);
+
+        std::stringstream marker_ss;
+        marker_ss << "Rank Files, =, " << nprocs << ", ";
+        REQUIRE( lines.size() == 4 );
+        REQUIRE( lines.at(0) == marker_ss.str() + "0, test_timing_file_0.pmtm" );
+        REQUIRE( lines.at(1) == marker_ss.str() + "1, test_timing_file_0.pmtm" );
+        REQUIRE( lines.at(2) == "" );
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+/**
+ * The label of the collapsed line of the ranks first to last, thread 0.
+ */
+static std::string rank_range(int first, int last)
+{
+    std::stringstream ss;
+    ss << first;
+    if (last != first) ss << "-" << last;
+    ss << ".0";
+    return ss.str();
+}
+
+/**
+ * @ingroup tests_timer
+ * 
+ * Tests that with \c PMTM_COLLAPSE_RANKS set the lines of consecutive ranks whose timers agree are printed as one line for the range, and a rank that disagrees keeps its own, whether the timers are gathered or streamed
+ * 
+ */
+TEST_CASE( "tests_timer.cpp/collapse_ranks", "With PMTM_COLLAPSE_RANKS set consecutive ranks that agree should be printed as one line and outliers on their own" )
+{
+    const char * stream_buffers[] = { "", "1" };
+
+    for (int mode = 0; mode < 2; ++mode) {
+        setenv("PMTM_COLLAPSE_RANKS", "1", 1);
+        setenv("PMTM_STREAM_BUFFER", stream_buffers[mode], 1);
+        PmtmWrapper pmtm("test_timing_file_");
+
+        // With a tolerance of 1 any times agree, so only the counts tell the
+        // ranks apart, and rank 1 starts its timer twice.
+
+        PMTM_timer_t same_timer = ((PMTM_timer_t) -1);
+        PMTM_timer_t outlier_timer = ((PMTM_timer_t) -1);
+        CHECKED_PMTM_CALL( PMTM_create_timer(PMTM_DEFAULT_GROUP, &same_timer, "Same", PMTM_TIMER_NONE | PMTM_MEASURE_WC) );
+        CHECKED_PMTM_CALL( PMTM_create_timer(PMTM_DEFAULT_GROUP, &outlier_timer, "Outlier", PMTM_TIMER_NONE | PMTM_MEASURE_WC) );
+
+        PMTM_timer_start(same_timer);
+        PMTM_timer_stop(same_timer);
+        for (int idx = 0; idx < ((rank == 1) ? 2 : 1); ++idx) {
+            PMTM_timer_start(outlier_timer);
+            PMTM_timer_stop(outlier_timer);
+        }
+
+        pmtm.finalize();
+        unsetenv("PMTM_COLLAPSE_RANKS");
+        unsetenv("PMTM_STREAM_BUFFER");
+
+        if (rank == 0) {
+            std::vector<std::string> lines = check_header(pmtm.read_output_file());
+            lines = check_overheads(lines);
+
+            size_t line_idx = 0;
+            check_timer(lines.at(line_idx++), rank_range(0, nprocs - 1), "Same", 1);
+            check_timer(lines.at(line_idx++), rank_range(0, 0), "Outlier", 1);
+            if (nprocs > 1) {
+                check_timer(lines.at(line_idx++), rank_range(1, 1), "Outlier", 2);
+            }
+            if (nprocs > 2) {
+                check_timer(lines.at(line_idx++), rank_range(2, nprocs - 1), "Outlier", 1);
+            }
+            REQUIRE( lines.at(line_idx) == "" );
+        }
+
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+}
+
+/**
+ * @ingroup tests_timer
+ * 
+ * Tests that with \c PMTM_COLLAPSE_RANKS set ranks with the same counts and total times but different sums of squared times, and so different standard deviations, are not collapsed
+ * 
+ */
+TEST_CASE( "tests_timer.cpp/collapse_spread", "With PMTM_COLLAPSE_RANKS set ranks whose spread of times disagrees should not be printed as one line" )
+{
+    const char * stream_buffers[] = { "", "1" };
+
+    for (int mode = 0; mode < 2; ++mode) {
+        setenv("PMTM_COLLAPSE_RANKS", "0.1", 1);
+        setenv("PMTM_STREAM_BUFFER", stream_buffers[mode], 1);
+        PmtmWrapper pmtm("test_timing_file_");
+
+        PMTM_timer_t spread_timer = ((PMTM_timer_t) -1);
+        CHECKED_PMTM_CALL( PMTM_create_timer(PMTM_DEFAULT_GROUP, &spread_timer, "Spread", PMTM_TIMER_NONE | PMTM_MEASURE_WC) );
+
+        // Two blocks of one second each, except on rank 1 where they take half
+        // a second and one and a half seconds.
+        const pmtm_tick_t second = PMTM_TICKS_PER_SECOND;
+        struct PMTM_timer_hot * hot = (struct PMTM_timer_hot *) spread_timer;
+        hot->timer_count = 2;
+        hot->total_wc = 2 * second;
+        if (rank == 1) {
+            pmtm_set_timer_square(hot, (pmtm_square_t) (second / 2) * (second / 2) + (pmtm_square_t) (3 * second / 2) * (3 * second / 2));
+        } else {
+            pmtm_set_timer_square(hot, (pmtm_square_t) second * second * 2);
+        }
+
+        pmtm.finalize();
+        unsetenv("PMTM_COLLAPSE_RANKS");
+        unsetenv("PMTM_STREAM_BUFFER");
+
+        if (rank == 0) {
+            std::vector<std::string> lines = check_header(pmtm.read_output_file());
+            lines = check_overheads(lines);
+
+            size_t line_idx = 0;
+            check_timer(lines.at(line_idx++), rank_range(0, 0), "Spread", 2);
+            if (nprocs > 1) {
+                check_timer(lines.at(line_idx++), rank_range(1, 1), "Spread", 2);
+            }
+            if (nprocs > 2) {
+                check_timer(lines.at(line_idx++), rank_range(2, nprocs - 1), "Spread", 2);
+            }
+            REQUIRE( lines.at(line_idx) == "" );
+        }
+
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+}
+
+#ifdef PMTM_MERGE
+
+/**
+ * Create the timers of the merge tests, setting their counts and times so that
+ * every run prints the same lines, and print them once before finalize prints
+ * them again. The Common timer differs on every rank, the Same timer on none
+ * and the Outlier timer on rank 1 only.
+ */
+static void create_merge_timers()
+{
+    const char * names[] = { "Common", "Same", "Outlier" };
+    const PMTM_timer_type_t types[] = { PMTM_TIMER_ALL, PMTM_TIMER_ALL, PMTM_TIMER_NONE };
+    const uint64_t counts[] = { (uint64_t) (rank + 1), 2, (uint64_t) ((rank == 1) ? 2 : 1) };
+    const pmtm_tick_t tenth = PMTM_TICKS_PER_SECOND / 10;
+
+    for (int idx = 0; idx < 3; ++idx) {
+        PMTM_timer_t timer = ((PMTM_timer_t) -1);
+        CHECKED_PMTM_CALL( PMTM_create_timer(PMTM_DEFAULT_GROUP, &timer, names[idx], types[idx] | PMTM_MEASURE_WC) );
+
+        struct PMTM_timer_hot * hot = (struct PMTM_timer_hot *) timer;
+        hot->timer_count = counts[idx];
+        hot->total_wc = counts[idx] * tenth;
+        pmtm_set_timer_square(hot, (pmtm_square_t) tenth * tenth * counts[idx]);
+    }
+
+    CHECKED_PMTM_CALL( PMTM_timer_output(PMTM_DEFAULT_INSTANCE) );
+}
+
+/**
+ * @ingroup tests_timer
+ * 
+ * Tests that running pmtm-merge on the output file and rank files of a run with \c PMTM_OPTION_RANK_FILES prints the same lines, the Max, Min and Average lines included, as a run that gathers the same timers, both as they are and collapsed with \c -c as \c PMTM_COLLAPSE_RANKS collapses them
+ * 
+ */
+TEST_CASE( "tests_timer.cpp/merge_rank_files", "pmtm-merge should print the timers of the rank files as PMTM prints them when it gathers them" )
+{
+    const char * tolerances[] = { NULL, "0.1" };
+
+    for (int mode = 0; mode < 2; ++mode) {
+        std::vector<std::string> gathered;
+        {
+            if (tolerances[mode] != NULL) setenv("PMTM_COLLAPSE_RANKS", tolerances[mode], 1);
+            PmtmWrapper pmtm("test_timing_file_");
+
+            create_merge_timers();
+
+            pmtm.finalize();
+            unsetenv("PMTM_COLLAPSE_RANKS");
+
+            if (rank == 0) {
+                gathered = check_overheads(check_header(pmtm.read_output_file()));
+            }
+            MPI_Barrier(MPI_COMM_WORLD);
+        }
+
+        CHECKED_PMTM_CALL( PMTM_set_option(PMTM_OPTION_RANK_FILES, PMTM_TRUE) );
+        PmtmWrapper pmtm("test_timing_file_");
+        CHECKED_PMTM_CALL( PMTM_set_option(PMTM_OPTION_RANK_FILES, PMTM_FALSE) );
+
+        create_merge_timers();
+
+        pmtm.finalize();
+        MPI_Barrier(MPI_COMM_WORLD);
+
+        if (rank == 0) {
+            std::stringstream command_ss;
+            command_ss << PMTM_MERGE << " -t 2";
+            if (tolerances[mode] != NULL) command_ss << " -c " << tolerances[mode];
+            command_ss << " test_timing_file_0.pmtm test_merged_file.pmtm";
+            REQUIRE( system(command_ss.str().c_str()) == 0 );
+
+            std::vector<std::string> lines;
+            std::ifstream ifs("test_merged_file.pmtm");
+            std::string line;
+            while (std::getline(ifs, line)) lines.push_back(line);
+            ifs.close();
+            remove("test_merged_file.pmtm");
+
+            std::vector<std::string> merged = check_overheads(check_header(lines));
+            REQUIRE( merged.size() == gathered.size() );
+            REQUIRE( merged.size() > 7 );
+            for (size_t idx = 0; idx < merged.size(); ++idx) {
+                REQUIRE( merged.at(idx) == gathered.at(idx) );
+            }
+        }
+        MPI_Barrier(MPI_COMM_WORLD);
+
+        std::stringstream file_ss;
+        file_ss << "test_timing_file_0.pmtm." << rank;
+        remove(file_ss.str().c_str());
+
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+}
+
+#endif
+
+/**
+ * @ingroup tests_timer
+ * 
+ * Tests that with \c PMTM_SAMPLE_RANKS and \c PMTM_OUTLIER_RANKS set only the lines of the sampled ranks and of the slowest and fastest ranks are printed, each once, while the statistics are over all ranks and printed for every timer
+ * 
+ */
+TEST_CASE( "tests_timer.cpp/sample_ranks", "With PMTM_SAMPLE_RANKS set only the sampled and outlier ranks should be printed, with statistics over all ranks" )
+{
+    std::stringstream every_ss;
+    every_ss << nprocs;
+    setenv("PMTM_SAMPLE_RANKS", every_ss.str().c_str(), 1);
+    setenv("PMTM_OUTLIER_RANKS", "1", 1);
+    PmtmWrapper pmtm("test_timing_file_");
+
+    // Only rank 0 is sampled. The last rank is the slowest, and rank 1, which
+    // never starts its timer, the fastest. Nobody starts the Idle timer, so
+    // its fastest rank is rank 0, which is sampled already.
+
+    PMTM_timer_t sampled_timer = ((PMTM_timer_t) -1);
+    PMTM_timer_t idle_timer = ((PMTM_timer_t) -1);
+    CHECKED_PMTM_CALL( PMTM_create_timer(PMTM_DEFAULT_GROUP, &sampled_timer, "Sampled", PMTM_TIMER_ALL | PMTM_MEASURE_WC) );
+    CHECKED_PMTM_CALL( PMTM_create_timer(PMTM_DEFAULT_GROUP, &idle_timer, "Idle", PMTM_TIMER_NONE | PMTM_MEASURE_WC) );
+
+    if (rank != 1) {
+        PMTM_timer_start(sampled_timer);
+        usleep((rank == nprocs - 1) ? 100000 : 1000);
+        PMTM_timer_stop(sampled_timer);
+    }
+
+    pmtm.finalize();
+    unsetenv("PMTM_SAMPLE_RANKS");
+    unsetenv("PMTM_OUTLIER_RANKS");
+
+    if (rank == 0) {
+        std::vector<std::string> lines = check_header(pmtm.read_output_file());
+        lines = check_overheads(lines);
+
+        size_t line_idx = 0;
+        int sampled_count = (nprocs > 1) ? nprocs - 1 : 1;
+        check_timer(lines.at(line_idx++), 0, 0, "Sampled", 1);
+        if (nprocs > 1) {
+            check_timer(lines.at(line_idx++), 1, 0, "Sampled", 0);
+        }
+        if (nprocs > 2) {
+            check_timer(lines.at(line_idx++), nprocs - 1, 0, "Sampled", 1);
+        }
+        check_timer(lines.at(line_idx++), "Rank Average", "Sampled", sampled_count);
+        check_timer(lines.at(line_idx++), "Rank Maximum", "Sampled", 1);
+        check_timer(lines.at(line_idx++), "Rank Minimum", "Sampled", (nprocs > 1) ? 0 : 1);
+
+        check_timer(lines.at(line_idx++), 0, 0, "Idle", 0);
+        check_timer(lines.at(line_idx++), "Rank Average", "Idle", 0);
+        check_timer(lines.at(line_idx++), "Rank Maximum", "Idle", 0);
+        check_timer(lines.at(line_idx++), "Rank Minimum", "Idle", 0);
+        REQUIRE( lines.at(line_idx) == "" );
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+/**
+ * @ingroup tests_timer
+ * 
+ * Tests that \ref PMTM_timer_output_begin prints the timers as they were when it was called, even though they are used again before \ref PMTM_timer_output_end
+ * 
+ */
+TEST_CASE( "tests_timer.cpp/timer_output_begin", "Timers started and stopped after PMTM_timer_output_begin should not change the output it finishes" )
+{
+    PmtmWrapper pmtm("test_timing_file_");
+
+    PMTM_timer_t rank_timer = ((PMTM_timer_t) -1);
+    PMTM_timer_t mma_timer = ((PMTM_timer_t) -1);
+    CHECKED_PMTM_CALL( PMTM_create_timer(PMTM_DEFAULT_GROUP, &rank_timer, "Timer1", PMTM_TIMER_NONE | PMTM_MEASURE_WC) );
+    CHECKED_PMTM_CALL( PMTM_create_timer(PMTM_DEFAULT_GROUP, &mma_timer, "Timer2", PMTM_TIMER_MMA | PMTM_MEASURE_WC) );
+
+    const int num_before = 3;
+    const int num_after = 5;
+
+    for (int idx = 0; idx < num_before; ++idx) {
+        PMTM_timer_start(rank_timer);
+        PMTM_timer_stop(rank_timer);
+        PMTM_timer_start(mma_timer);
+        PMTM_timer_stop(mma_timer);
+    }
+
+    CHECKED_PMTM_CALL( PMTM_timer_output_begin(PMTM_DEFAULT_INSTANCE) );
+
+    for (int idx = 0; idx < num_after; ++idx) {
+        PMTM_timer_start(rank_timer);
+        PMTM_timer_stop(rank_timer);
+        PMTM_timer_start(mma_timer);
+        PMTM_timer_stop(mma_timer);
+    }
+
+    CHECKED_PMTM_CALL( PMTM_timer_output_end(PMTM_DEFAULT_INSTANCE) );
+    CHECKED_PMTM_CALL( PMTM_timer_output_end(PMTM_DEFAULT_INSTANCE) );
+
+    pmtm.finalize();
+
+    if (rank == 0) {
+        std::vector<std::string> lines = check_header(pmtm.read_output_file());
+        lines = check_overheads(lines);
+
+        REQUIRE( lines.size() == 2 * (nprocs + 3) + 2 );
+        const int counts[] = { num_before, num_before + num_after };
+        for (int output = 0; output < 2; ++output) {
+            int first = output * (nprocs + 3);
+            for (int idx = 0; idx < nprocs; ++idx) {
+                check_timer(lines.at(first + idx), idx, 0, "Timer1", counts[output]);
+            }
+            check_timer(lines.at(first + nprocs), "Rank Average", "Timer2", nprocs * counts[output]);
+            check_timer(lines.at(first + nprocs + 1), "Rank Maximum", "Timer2", counts[output]);
+            check_timer(lines.at(first + nprocs + 2), "Rank Minimum", "Timer2", counts[output]);
+        }
+        REQUIRE( lines.at(2 * (nprocs + 3)) == "" );
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+/**
+ * @ingroup tests_timer
+ * 
+ * Tests that the numbers of the output lines are formatted by \ref format_sci, \ref format_fixed, \ref format_int and \ref format_uint exactly as printf would, for awkward values and values spread over the range of doubles
+ * 
+ */
+TEST_CASE( "tests_timer.cpp/format_numbers", "The output lines should format numbers exactly as printf does" )
+{
+    char text[64], expected[64];
+
+    const double awkward[] = { 0.0, -0.0, 1.0, -1.0, 0.5, 9.9999995, 9.99999949999, 1.0000005, 1.0000015,
+                               123456.75, 1e-300, 1e300, 4.9e-324, 2.2250738585072014e-308, 1.7976931348623157e308,
+                               1e-5, 1e-4, 1e-3, 0.1, 1e22, 1e23, 99999995.0, 0.00012345675 };
+    for (size_t idx = 0; idx < sizeof(awkward) / sizeof(awkward[0]); ++idx) {
+        format_sci(text, awkward[idx]);
+        sprintf(expected, "%12.6E", awkward[idx]);
+        REQUIRE( std::string(text) == std::string(expected) );
+    }
+
+    uint64_t state = 12345;
+    for (int idx = 0; idx < 100000; ++idx) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        double value = ldexp((double) (state >> 11), (int) (state % 200) - 153);
+
+        format_sci(text, value);
+        sprintf(expected, "%12.6E", value);
+        REQUIRE( std::string(text) == std::string(expected) );
+
+        double efficiency = value - floor(value) + (double) (state % 3);
+        if (format_fixed(text, efficiency) > 0) {
+            sprintf(expected, "%6.4f", efficiency);
+            REQUIRE( std::string(text) == std::string(expected) );
+        }
+
+        format_uint(text, state);
+        sprintf(expected, "%" PRIu64, state);
+        REQUIRE( std::string(text) == std::string(expected) );
+
+        format_int(text, (int64_t) state);
+        sprintf(expected, "%" PRId64, (int64_t) state);
+        REQUIRE( std::string(text) == std::string(expected) );
+    }
+
+    // The values format_fixed leaves to printf should still print the same in a line.
+
+    const double fallbacks[] = { 0.99995, -0.5, 1e30 };
+    for (size_t idx = 0; idx < sizeof(fallbacks) / sizeof(fallbacks[0]); ++idx) {
+        char line_text[64] = "";
+        FILE * fid = fmemopen(line_text, sizeof(line_text), "w");
+        struct PMTM_line line;
+        line_start(&line, fid);
+        line_put(&line, "efficiency, ");
+        line_put_fixed(&line, fallbacks[idx]);
+        line_end(&line);
+        fclose(fid);
+
+        sprintf(expected, "efficiency, %6.4f\n", fallbacks[idx]);
+        REQUIRE( std::string(line_text) == std::string(expected) );
+    }
+}
+
+/**
+ * @ingroup tests_timer
+ * 
+ * Tests that a timer which measures the wallclock and thread CPU times reports its CPU time and CPU/wallclock efficiency, and that a timer which only measures the wallclock time does not
+ * 
+ */
+TEST_CASE( "tests_timer.cpp/efficiency", "A timer measuring the thread CPU time should report its CPU time and efficiency" )
+{
+    PmtmWrapper pmtm("test_timing_file_");
+
+    PMTM_timer_t all_timer = ((PMTM_timer_t) -1);
+    PMTM_timer_t wc_timer = ((PMTM_timer_t) -1);
+    CHECKED_PMTM_CALL( PMTM_create_timer(PMTM_DEFAULT_GROUP, &all_timer, "Timer1", PMTM_TIMER_NONE | PMTM_MEASURE_WC | PMTM_MEASURE_THREAD_CPU) );
+    CHECKED_PMTM_CALL( PMTM_create_timer(PMTM_DEFAULT_GROUP, &wc_timer, "Timer2", PMTM_TIMER_NONE | PMTM_MEASURE_WC) );
+
+    PMTM_timer_start(all_timer);
+    PMTM_timer_start(wc_timer);
+    usleep(200000);
+    PMTM_timer_stop(wc_timer);
+    PMTM_timer_stop(all_timer);
+
+    pmtm.finalize();
+
+    if (rank == 0) {
+        std::vector<std::string> lines = check_header(pmtm.read_output_file());
+        lines = check_overheads(lines);
+
+        REQUIRE( lines.size() == 2 * nprocs + 2 );
+        for (int idx = 0; idx < nprocs; ++idx) {
+            check_timer(lines.at(idx), idx, 0, "Timer1", 1);
+            std::vector<std::string> tokens = tokenize(lines.at(idx));
+            REQUIRE( tokens.size() == 18 );
+            REQUIRE( tokens.at(14) == "cpu" );
+            REQUIRE( tokens.at(16) == "efficiency" );
+
+            std::stringstream efficiency_ss(tokens.at(17));
+            double efficiency;
+            efficiency_ss >> efficiency;
+            REQUIRE( efficiency < 0.5 );
+        }
+        for (int idx = 0; idx < nprocs; ++idx) {
+            check_timer(lines.at(nprocs + idx), idx, 0, "Timer2", 1);
+            REQUIRE( tokenize(lines.at(nprocs + idx)).size() == 14 );
+        }
+        REQUIRE( lines.at(2 * nprocs) == "" );
+    }
+        
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+/**
+ * @ingroup tests_timer
+ * 
+ * Tests that the inline timer calls of \c pmtm_fast.h count and time a timer as the library calls do, and that the two can be mixed on one timer
+ * 
+ */
+TEST_CASE( "tests_timer.cpp/fast_timing", "The inline timer calls should count and time a timer as the library calls do" )
+{
+    PmtmWrapper pmtm("test_timing_file_");
+
+    PMTM_timer_t timer_id = ((PMTM_timer_t) -1);
+    CHECKED_PMTM_CALL( PMTM_create_timer(PMTM_DEFAULT_GROUP, &timer_id, "Timer1", PMTM_TIMER_NONE) );
+
+    const int num_seconds = 1;
+
+    PMTM_fast_timer_start(timer_id);
+    PMTM_fast_timer_pause(timer_id);
+    PMTM_fast_timer_continue(timer_id);
+    sleep(num_seconds);
+    PMTM_fast_timer_stop(timer_id);
+
+    PMTM_timer_start(timer_id);
+    PMTM_fast_timer_pause(timer_id);
+    PMTM_timer_continue(timer_id);
+    PMTM_fast_timer_stop(timer_id);
+
+    REQUIRE( PMTM_get_last_wc_time(timer_id) < 0.5 );
+    REQUIRE( fabs(PMTM_get_total_wc_time(timer_id) - num_seconds) < 2E-2 );
+
+    pmtm.finalize();
+
+    if (rank == 0) {
+        std::vector<std::string> lines = check_header(pmtm.read_output_file());
+        lines = check_overheads(lines);
+
+        REQUIRE( lines.size() == nprocs + 2 );
+        for (int idx = 0; idx < nprocs; ++idx) {
+            check_timer(lines.at(idx), idx, 0, "Timer1", 2, 1);
+        }
+        REQUIRE( lines.at(nprocs) == "" );
+    }
+        
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+/**
+ * @ingroup tests_timer
+ * 
+ * Tests that stopping a stopped timer counts its last block again, extended to the second stop from the last start, as it always has
+ * 
+ */
+TEST_CASE( "tests_timer.cpp/stop_stopped", "Stopping a stopped timer should count its last block again, extended from its last start" )
+{
+    PmtmWrapper pmtm("test_timing_file_");
+
+    PMTM_timer_t timer_id = ((PMTM_timer_t) -1);
+    CHECKED_PMTM_CALL( PMTM_create_timer(PMTM_DEFAULT_GROUP, &timer_id, "Timer1", PMTM_TIMER_NONE | PMTM_MEASURE_WC) );
+
+    const struct PMTM_timer_hot * hot = (const struct PMTM_timer_hot *) timer_id;
+
+    PMTM_timer_start(timer_id);
+    usleep(100000);
+    PMTM_timer_stop(timer_id);
+    double block_time = PMTM_get_last_wc_time(timer_id);
+    REQUIRE( block_time >= 0.1 );
+
+    usleep(100000);
+    PMTM_timer_stop(timer_id);
+    REQUIRE( hot->timer_count == 2 );
+    REQUIRE( PMTM_get_last_wc_time(timer_id) >= 2 * block_time + 0.1 );
+    REQUIRE( fabs(PMTM_get_total_wc_time(timer_id) - block_time - PMTM_get_last_wc_time(timer_id)) < 1E-6 );
+
+    pmtm.finalize();
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+/**
+ * @ingroup tests_timer
+ * 
+ * Tests that the pause count of a timer goes past 2^32 rather than wrapping, and that the sum of the squared ticks carries into its top bits
+ * 
+ */
+TEST_CASE( "tests_timer.cpp/wide_counts", "The counts of a timer should not wrap at 32 bits and the sum of the squared ticks should keep its top bits" )
+{
+    PmtmWrapper pmtm("test_timing_file_");
+
+    PMTM_timer_t timer_id = ((PMTM_timer_t) -1);
+    CHECKED_PMTM_CALL( PMTM_create_timer(PMTM_DEFAULT_GROUP, &timer_id, "Timer1", PMTM_TIMER_NONE | PMTM_MEASURE_WC) );
+
+    struct PMTM_timer_hot * hot = (struct PMTM_timer_hot *) timer_id;
+    hot->pause_count = UINT32_MAX;
+    PMTM_timer_start(timer_id);
+    PMTM_timer_pause(timer_id);
+    PMTM_timer_continue(timer_id);
+    PMTM_timer_stop(timer_id);
+    REQUIRE( hot->pause_count == (uint64_t) UINT32_MAX + 1 );
+
+    // An hour in nanoseconds squared is more than 2^64.
+    struct PMTM_timer_hot sum;
+    memset(&sum, 0, sizeof(sum));
+    const pmtm_tick_t hour = 3600ULL * PMTM_TICKS_PER_SECOND;
+    pmtm_add_timer_square(&sum, hour);
+    pmtm_add_timer_square(&sum, hour);
+    pmtm_add_timer_square(&sum, 12345);
+    const bool square_matches = pmtm_timer_square(&sum) == (pmtm_square_t) hour * hour * 2 + 12345 * 12345;
+    REQUIRE( square_matches );
+
+    pmtm.finalize();
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+/**
+ * @ingroup tests_timer
+ * 
+ * Tests that the hot fields of a timer fit in a cache line, followed by the clocks of its last start or continue, that \ref PMTM_get_wc_time returns the time since the timer was last started or continued, pauses included, and that \ref PMTM_get_last_wc_time returns the block up to its last pause, or the whole block once stopped, without its pauses
+ * 
+ */
+TEST_CASE( "tests_timer.cpp/block_time", "The time since the last start or continue should include pauses, the time of a block should not, and the hot fields of a timer should fit in a cache line" )
+{
+    REQUIRE( sizeof(struct PMTM_timer_hot) <= 64 );
+    REQUIRE( offsetof(struct PMTM_timer, mark) == sizeof(struct PMTM_timer_hot) );
+
+    PmtmWrapper pmtm("test_timing_file_");
+
+    PMTM_timer_t timer_id = ((PMTM_timer_t) -1);
+    CHECKED_PMTM_CALL( PMTM_create_timer(PMTM_DEFAULT_GROUP, &timer_id, "Timer1", PMTM_TIMER_NONE | PMTM_MEASURE_WC) );
+
+    const int num_seconds = 1;
+
+    REQUIRE( PMTM_get_last_wc_time(timer_id) == 0 );
+
+    PMTM_timer_start(timer_id);
+    REQUIRE( PMTM_get_last_wc_time(timer_id) == 0 );
+    usleep(300000);
+
+    PMTM_timer_pause(timer_id);
+    sleep(num_seconds);
+    double paused_time = PMTM_get_last_wc_time(timer_id);
+    REQUIRE( paused_time >= 0.3 );
+    REQUIRE( paused_time < num_seconds );
+    REQUIRE( PMTM_get_wc_time(timer_id) >= num_seconds + 0.3 );
+
+    PMTM_timer_continue(timer_id);
+    REQUIRE( PMTM_get_last_wc_time(timer_id) == paused_time );
+    REQUIRE( PMTM_get_wc_time(timer_id) < num_seconds );
+    usleep(300000);
+
+    PMTM_timer_stop(timer_id);
+    double block_time = PMTM_get_last_wc_time(timer_id);
+    REQUIRE( block_time >= paused_time + 0.3 );
+    REQUIRE( block_time < num_seconds + 0.3 );
+    REQUIRE( block_time == PMTM_get_total_wc_time(timer_id) );
+    REQUIRE( PMTM_get_wc_time(timer_id) >= 0.3 );
+    REQUIRE( PMTM_get_wc_time(timer_id) < block_time );
+
+    pmtm.finalize();
+
+    if (rank == 0) {
+        std::vector<std::string> lines = check_header(pmtm.read_output_file());
+        lines = check_overheads(lines);
+
+        REQUIRE( lines.size() == nprocs + 2 );
+        for (int idx = 0; idx < nprocs; ++idx) {
+            check_timer(lines.at(idx), idx, 0, "Timer1", 1, 1);
+        }
+        REQUIRE( lines.at(nprocs) == "" );
+    }
+        
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+/**
+ * @ingroup tests_timer
+ * 
+ * Tests that \ref PMTM_get_or_create_timer returns the existing timer of the same name, whether it was created by \ref PMTM_create_timer or not
+ * 
+ */
+TEST_CASE( "tests_timer.cpp/get_or_create", "Getting a timer of the same name twice should return the same timer, whether it was created by PMTM_create_timer or not" )
+{
+    PmtmWrapper pmtm("test_timing_file_");
+
+    PMTM_timer_t created = ((PMTM_timer_t) -1);
+    PMTM_timer_t first   = ((PMTM_timer_t) -1);
+    PMTM_timer_t second  = ((PMTM_timer_t) -1);
+    PMTM_timer_t other   = ((PMTM_timer_t) -1);
+    CHECKED_PMTM_CALL( PMTM_create_timer(PMTM_DEFAULT_GROUP, &created, "Timer1", PMTM_TIMER_NONE) );
+    CHECKED_PMTM_CALL( PMTM_get_or_create_timer(PMTM_DEFAULT_GROUP, &first, "Timer1", PMTM_TIMER_NONE) );
+    REQUIRE( first == created );
+
+    CHECKED_PMTM_CALL( PMTM_get_or_create_timer(PMTM_DEFAULT_GROUP, &first, "Timer2", PMTM_TIMER_NONE) );
+    CHECKED_PMTM_CALL( PMTM_get_or_create_timer(PMTM_DEFAULT_GROUP, &second, "Timer2", PMTM_TIMER_NONE) );
+    CHECKED_PMTM_CALL( PMTM_get_or_create_timer(PMTM_DEFAULT_GROUP, &other, "Timer3", PMTM_TIMER_NONE) );
+    REQUIRE( first == second );
+    REQUIRE( first != created );
+    REQUIRE( other != first );
+
+    PMTM_timer_t invalid = ((PMTM_timer_t) -1);
+    REQUIRE( PMTM_get_or_create_timer(-1, &invalid, "Timer1", PMTM_TIMER_NONE) == PMTM_ERROR_INVALID_TIMER_GROUP_ID );
+
+    pmtm.finalize();
+
+    if (rank == 0) {
+        std::vector<std::string> lines = check_header(pmtm.read_output_file());
+        lines = check_overheads(lines);
+
+        REQUIRE( lines.size() == 3 * nprocs + 2 );
+        for (int idx = 0; idx < nprocs; ++idx) {
+            check_timer(lines.at(idx), idx, 0, "Timer1");
+            check_timer(lines.at(nprocs + idx), idx, 0, "Timer2");
+            check_timer(lines.at(2 * nprocs + idx), idx, 0, "Timer3");
+        }
+        REQUIRE( lines.at(3 * nprocs) == "" );
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+/**
+ * Start and stop the timer of a PMTM_CACHED_TIMER call site.
+ */
+static PMTM_timer_t cached_work()
+{
+    PMTM_timer_t timer = PMTM_NULL_TIMER;
+    PMTM_CACHED_TIMER(PMTM_DEFAULT_GROUP, &timer, "Cached", PMTM_TIMER_NONE);
+    PMTM_timer_start(timer);
+    PMTM_timer_stop(timer);
+    return timer;
+}
+
+/**
+ * @ingroup tests_timer
+ * 
+ * Tests that a \c PMTM_CACHED_TIMER call site returns the same timer until PMTM is re-initialised
+ * 
+ */
+TEST_CASE( "tests_timer.cpp/cached_timer", "A PMTM_CACHED_TIMER call site should return the same timer until PMTM is re-initialised" )
+{
+    {
+        PmtmWrapper pmtm("test_timing_file_");
+
+        PMTM_timer_t timer = cached_work();
+        REQUIRE( cached_work() == timer );
+        REQUIRE( cached_work() == timer );
+
+        pmtm.finalize();
+
+        if (rank == 0) {
+            std::vector<std::string> lines = check_header(pmtm.read_output_file());
+            lines = check_overheads(lines);
+
+            REQUIRE( lines.size() == nprocs + 2 );
+            for (int idx = 0; idx < nprocs; ++idx) {
+                check_timer(lines.at(idx), idx, 0, "Cached", 3);
+            }
+        }
+
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+
+    {
+        PmtmWrapper pmtm("test_timing_file_");
+
+        cached_work();
+
+        pmtm.finalize();
+
+        if (rank == 0) {
+            std::vector<std::string> lines = check_header(pmtm.read_output_file());
+            lines = check_overheads(lines);
+
+            REQUIRE( lines.size() == nprocs + 2 );
+            for (int idx = 0; idx < nprocs; ++idx) {
+                check_timer(lines.at(idx), idx, 0, "Cached", 1);
+            }
+        }
+
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+}
+
+/**
+ * Time the body with PMTM_SCOPE, leaving it by a normal return, an early
+ * return or an exception.
+ */
+static int scoped_work(int exit_path)
+{
+    PMTM_SCOPE("Scoped");
+    if (exit_path == 1) {
+        return 1;
+    }
+    if (exit_path == 2) {
+        throw std::runtime_error("scoped_work");
+    }
+    return 0;
+}
+
+/**
+ * @ingroup tests_timer
+ * 
+ * Tests that a \c PMTM_SCOPE timer is created once and stopped on every way out of its scope
+ * 
+ */
+TEST_CASE( "tests_timer.cpp/scope", "A PMTM_SCOPE timer should be stopped on a return, an early return and an exception" )
+{
+    PmtmWrapper pmtm("test_timing_file_");
+
+    scoped_work(0);
+    scoped_work(1);
+    REQUIRE_THROWS( scoped_work(2) );
+
+    pmtm.finalize();
+
+    if (rank == 0) {
+        std::vector<std::string> lines = check_header(pmtm.read_output_file());
+        lines = check_overheads(lines);
+
+        REQUIRE( lines.size() == nprocs + 2 );
+        for (int idx = 0; idx < nprocs; ++idx) {
+            check_timer(lines.at(idx), idx, 0, "Scoped", 3);
+        }
+        REQUIRE( lines.at(nprocs) == "" );
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+/**
+ * @ingroup tests_timer
+ * 
+ * Tests that \c PMTM_SCOPE sites with the same name share a timer, that disabled sites create no timer and that two sites fit on one line
+ * 
+ */
+TEST_CASE( "tests_timer.cpp/scope_policies", "PMTM_SCOPE sites with the same name should share a timer and disabled sites should not create one" )
+{
+    PmtmWrapper pmtm("test_timing_file_");
+
+    {
+        PMTM_SCOPE_T("Shared", pmtm::wallclock, pmtm::rank_stats); PMTM_SCOPE_T("Disabled", pmtm::disabled, pmtm::rank_stats);
+    }
+    {
+        PMTM_SCOPE_T("Shared", pmtm::wallclock, pmtm::rank_stats);
+    }
+
+    pmtm.finalize();
+
+    if (rank == 0) {
+        std::vector<std::string> lines = check_header(pmtm.read_output_file());
+        lines = check_overheads(lines);
+
+        REQUIRE( lines.size() == nprocs + 2 );
+        for (int idx = 0; idx < nprocs; ++idx) {
+            check_timer(lines.at(idx), idx, 0, "Shared", 2);
+            REQUIRE( tokenize(lines.at(idx)).size() == 14 );
+        }
+        REQUIRE( lines.at(nprocs) == "" );
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+}
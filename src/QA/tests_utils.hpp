@@ -264,6 +264,9 @@ std::vector<std::string> check_overheads(
         switch (line_idx) {
             case 0: REQUIRE( line == "Overhead, (, 0, ), start-stop, " ); break;
             case 1: REQUIRE( line == "Overhead, (, 0, ), pause-continue, " ); break;
+            case 2: REQUIRE( line == "Overhead, (, 0, ), start-stop-wc, " ); break;
+            case 3: REQUIRE( line == "Overhead, (, 0, ), pause-continue-wc, " ); break;
+            case 4: REQUIRE( line == "Overhead, (, 0, ), clock-read, " ); break;
             default: return_vec.push_back(*iter);
         }
         ++line_idx;
@@ -430,5 +433,71 @@ void check_param(
     check_param(line, rank, param_name, buffer);
 }
 
+/**
+ * Create and time the timers whose lines check_rank_timers expects: "Common"
+ * on every rank with all its statistics, "Even" with only the average, maximum
+ * and minimum over the even ranks, which time it twice, and "Rank<N>" on rank
+ * N only, timed N + 1 times.
+ */
+void create_rank_timers()
+{
+    PMTM_timer_t common_timer = ((PMTM_timer_t) -1);
+    PMTM_timer_t mma_timer = ((PMTM_timer_t) -1);
+    PMTM_timer_t rank_timer = ((PMTM_timer_t) -1);
+    CHECKED_PMTM_CALL( PMTM_create_timer(PMTM_DEFAULT_GROUP, &common_timer, "Common", PMTM_TIMER_ALL | PMTM_MEASURE_WC) );
+    if (rank % 2 == 0) {
+        CHECKED_PMTM_CALL( PMTM_create_timer(PMTM_DEFAULT_GROUP, &mma_timer, "Even", PMTM_TIMER_MMA | PMTM_MEASURE_WC) );
+    }
+
+    std::stringstream name_ss;
+    name_ss << "Rank" << rank;
+    CHECKED_PMTM_CALL( PMTM_create_timer(PMTM_DEFAULT_GROUP, &rank_timer, name_ss.str().c_str(), PMTM_TIMER_NONE | PMTM_MEASURE_WC) );
+
+    PMTM_timer_start(common_timer);
+    PMTM_timer_stop(common_timer);
+    if (rank % 2 == 0) {
+        for (int idx = 0; idx < 2; ++idx) {
+            PMTM_timer_start(mma_timer);
+            PMTM_timer_stop(mma_timer);
+        }
+    }
+    for (int idx = 0; idx <= rank; ++idx) {
+        PMTM_timer_start(rank_timer);
+        PMTM_timer_stop(rank_timer);
+    }
+}
+
+/**
+ * Check the lines printed for the timers of create_rank_timers, which take
+ * 2 * nprocs + 6 lines.
+ *
+ * @param lines The lines of the output file.
+ * @param first The index of the first line of the timers.
+ * @returns The index of the line after them.
+ */
+size_t check_rank_timers(
+        const std::vector<std::string>& lines,
+        size_t first)
+{
+    size_t line = first;
+
+    for (int idx = 0; idx < nprocs; ++idx) {
+        check_timer(lines.at(line++), idx, 0, "Common", 1);
+    }
+    check_timer(lines.at(line++), "Rank Average", "Common", nprocs);
+    check_timer(lines.at(line++), "Rank Maximum", "Common", 1);
+    check_timer(lines.at(line++), "Rank Minimum", "Common", 1);
+    check_timer(lines.at(line++), "Rank Average", "Even", 2 * ((nprocs + 1) / 2));
+    check_timer(lines.at(line++), "Rank Maximum", "Even", 2);
+    check_timer(lines.at(line++), "Rank Minimum", "Even", 2);
+    for (int idx = 0; idx < nprocs; ++idx) {
+        std::stringstream rank_name_ss;
+        rank_name_ss << "Rank" << idx;
+        check_timer(lines.at(line++), idx, 0, rank_name_ss.str(), idx + 1);
+    }
+
+    return line;
+}
+
 #endif	/* _TESTS_UTILS_HPP */
 
@@ -0,0 +1,167 @@
+/*
+ * File:   bench_format.c
+ * Author: AWE Plc.
+ *
+ * Measures how many "Timer" lines a second the IO rank can format, with one
+ * fprintf per line as PMTM used to and with the line_put functions it uses
+ * now, writing to /dev/null so that only the formatting is timed. The lines
+ * are also formatted into memory both ways and compared, and any line that
+ * differs is counted, as the output must be byte for byte the same.
+ *
+ * Usage: mpirun -n 1 bench_format.x [lines]
+ */
+
+#include "mpi.h"
+
+#include "pmtm.h"
+#include "pmtm_internal.h"
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define REPEATS 3
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1.0E-9;
+}
+
+/*
+ * The values of a line, spread over the range of times a timer sees.
+ */
+struct values {
+    int rank;
+    double avg;
+    double std_dev;
+    uint64_t count;
+    uint64_t paused;
+    double cpu;
+    double efficiency;
+};
+
+static void make_values(struct values * values, long num_lines)
+{
+    long idx;
+    srand(12345);
+    for (idx = 0; idx < num_lines; ++idx) {
+        double scale = pow(10.0, rand() % 16 - 10);
+        values[idx].rank = idx % 100000;
+        values[idx].avg = scale * rand() / RAND_MAX;
+        values[idx].std_dev = scale * rand() / RAND_MAX / 10;
+        values[idx].count = rand() % 1000000;
+        values[idx].paused = rand() % 10;
+        values[idx].cpu = values[idx].avg * rand() / RAND_MAX;
+        values[idx].efficiency = (double) rand() / RAND_MAX;
+    }
+}
+
+static void printf_line(FILE * fid, const struct values * values)
+{
+    char rank_text[20];
+    sprintf(rank_text, "%d.%d", values->rank, 0);
+    fprintf(fid,
+            "Timer, : (, %s, ), %s, =, %12.6E, (, %12.6E, ), count, %" PRIu64 ", paused, %" PRIu64,
+            rank_text, "timer name", values->avg, values->std_dev, values->count, values->paused);
+    fprintf(fid, ", cpu, %12.6E, efficiency, %6.4f", values->cpu, values->efficiency);
+    fputc('\n', fid);
+}
+
+static void line_put_line(FILE * fid, const struct values * values)
+{
+    struct PMTM_line line;
+    line_start(&line, fid);
+    line_put(&line, "Timer, : (, ");
+    line_put_int(&line, values->rank);
+    line_put(&line, ".0, ), ");
+    line_put(&line, "timer name");
+    line_put(&line, ", =, ");
+    line_put_sci(&line, values->avg);
+    line_put(&line, ", (, ");
+    line_put_sci(&line, values->std_dev);
+    line_put(&line, ", ), count, ");
+    line_put_uint(&line, values->count);
+    line_put(&line, ", paused, ");
+    line_put_uint(&line, values->paused);
+    line_put(&line, ", cpu, ");
+    line_put_sci(&line, values->cpu);
+    line_put(&line, ", efficiency, ");
+    line_put_fixed(&line, values->efficiency);
+    line_end(&line);
+}
+
+static double time_lines(void (*format)(FILE *, const struct values *),
+                         const struct values * values, long num_lines)
+{
+    double best = 0;
+    int repeat;
+    for (repeat = 0; repeat < REPEATS; ++repeat) {
+        FILE * fid = fopen("/dev/null", "w");
+        setvbuf(fid, NULL, _IOFBF, PMTM_OUTPUT_BUFFER_SIZE);
+
+        double start = now();
+        long idx;
+        for (idx = 0; idx < num_lines; ++idx) {
+            format(fid, &values[idx]);
+        }
+        fflush(fid);
+        double rate = num_lines / (now() - start);
+        fclose(fid);
+
+        if (rate > best) best = rate;
+    }
+    return best;
+}
+
+static long count_differences(const struct values * values, long num_lines)
+{
+    long differences = 0;
+    long idx;
+    for (idx = 0; idx < num_lines; ++idx) {
+        char printf_text[256], line_text[256];
+        FILE * printf_fid = fmemopen(printf_text, sizeof(printf_text), "w");
+        FILE * line_fid = fmemopen(line_text, sizeof(line_text), "w");
+        printf_line(printf_fid, &values[idx]);
+        line_put_line(line_fid, &values[idx]);
+        fclose(printf_fid);
+        fclose(line_fid);
+        if (strcmp(printf_text, line_text) != 0) ++differences;
+    }
+    return differences;
+}
+
+int main(int argc, char ** argv)
+{
+    MPI_Init(&argc, &argv);
+
+    long num_lines = (argc > 1) ? atol(argv[1]) : 2000000;
+
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    struct values * values = malloc(num_lines * sizeof(struct values));
+    if (values == NULL) {
+        fprintf(stderr, "Failed to allocate %ld lines\n", num_lines);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    make_values(values, num_lines);
+
+    if (rank == 0) {
+        double printf_rate = time_lines(printf_line, values, num_lines);
+        double line_rate = time_lines(line_put_line, values, num_lines);
+        long differences = count_differences(values, num_lines);
+
+        printf("%10s %16s %16s %8s %12s\n", "lines", "fprintf", "line_put", "speedup", "differences");
+        printf("%10ld %10.3e /s %10.3e /s %7.2fx %12ld\n", num_lines, printf_rate, line_rate,
+               line_rate / printf_rate, differences);
+    }
+
+    free(values);
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,114 @@
+/*
+ * File:   bench_registry.c
+ * Author: AWE Plc.
+ *
+ * Stress test of the bookkeeping of PMTM with many groups, timers and
+ * parameters: creating them, looking timers up by name and setting parameters
+ * that are checked against their stored values with PMTM_OUTPUT_ON_CHANGE.
+ * Each step should cost about the same per call whatever the number of
+ * objects, so the costs reported for each size should stay flat.
+ *
+ * Usage: mpirun -n 1 bench_registry.x [objects]
+ */
+
+#include "mpi.h"
+
+#include "pmtm.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define GROUPS 100
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1.0E-9;
+}
+
+static void check(PMTM_error_t err_code, const char * what)
+{
+    if (err_code != PMTM_SUCCESS) {
+        fprintf(stderr, "%s failed: %d\n", what, err_code);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    MPI_Init(&argc, &argv);
+
+    long max_objects = (argc > 1) ? atol(argv[1]) : 10000;
+
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    if (rank == 0) {
+        printf("%10s %14s %14s %14s %14s %14s %14s\n", "objects", "group",
+               "create", "lookup", "new param", "same param", "output");
+    }
+
+    long num_objects;
+    for (num_objects = 1000; num_objects <= max_objects; num_objects *= 10) {
+        PMTM_set_option(PMTM_OPTION_OUTPUT_ENV, PMTM_FALSE);
+        check(PMTM_init("bench_registry_", "bench_registry"), "PMTM_init");
+
+        PMTM_timer_group_t groups[GROUPS];
+        char name[64];
+        long idx;
+
+        double start = now();
+        for (idx = 0; idx < GROUPS; ++idx) {
+            sprintf(name, "group %ld", idx);
+            check(PMTM_create_timer_group(PMTM_DEFAULT_INSTANCE, &groups[idx], name), "PMTM_create_timer_group");
+        }
+        double group_time = (now() - start) / GROUPS;
+
+        start = now();
+        for (idx = 0; idx < num_objects; ++idx) {
+            PMTM_timer_t timer;
+            sprintf(name, "timer %ld", idx);
+            check(PMTM_create_timer(groups[idx % GROUPS], &timer, name, PMTM_TIMER_INT | PMTM_MEASURE_WC), "PMTM_create_timer");
+        }
+        double create_time = (now() - start) / num_objects;
+
+        start = now();
+        for (idx = 0; idx < num_objects; ++idx) {
+            PMTM_timer_t timer;
+            sprintf(name, "timer %ld", idx);
+            check(PMTM_get_or_create_timer(groups[idx % GROUPS], &timer, name, PMTM_TIMER_INT | PMTM_MEASURE_WC), "PMTM_get_or_create_timer");
+        }
+        double lookup_time = (now() - start) / num_objects;
+
+        start = now();
+        for (idx = 0; idx < num_objects; ++idx) {
+            sprintf(name, "parameter %ld", idx);
+            check(PMTM_parameter_output(PMTM_DEFAULT_INSTANCE, name, PMTM_OUTPUT_ON_CHANGE, PMTM_FALSE, "%ld", idx), "PMTM_parameter_output");
+        }
+        double new_param_time = (now() - start) / num_objects;
+
+        /* Unchanged values are only looked up, not written. */
+        start = now();
+        for (idx = 0; idx < num_objects; ++idx) {
+            sprintf(name, "parameter %ld", idx);
+            check(PMTM_parameter_output(PMTM_DEFAULT_INSTANCE, name, PMTM_OUTPUT_ON_CHANGE, PMTM_FALSE, "%ld", idx), "PMTM_parameter_output");
+        }
+        double same_param_time = (now() - start) / num_objects;
+
+        PMTM_set_option(PMTM_OPTION_NO_LOCAL_COPY, PMTM_TRUE);
+        start = now();
+        check(PMTM_finalize(), "PMTM_finalize");
+        double output_time = now() - start;
+
+        if (rank == 0) {
+            printf("%10ld %11.2f us %11.2f us %11.2f us %11.2f us %11.2f us %11.3f s\n",
+                   num_objects, group_time * 1.0E6, create_time * 1.0E6, lookup_time * 1.0E6,
+                   new_param_time * 1.0E6, same_param_time * 1.0E6, output_time);
+        }
+    }
+
+    MPI_Finalize();
+    return 0;
+}
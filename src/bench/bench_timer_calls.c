@@ -0,0 +1,143 @@
+/*
+ * File:   bench_timer_calls.c
+ * Author: AWE Plc.
+ *
+ * Measures the cost of a start/stop and a pause/continue pair on a timer,
+ * through the library calls (PMTM_timer_start, etc.) and through the inline
+ * calls of pmtm_fast.h (PMTM_fast_timer_start, etc.), for each clock backend
+ * and for timers measuring both clocks and only the wallclock.
+ *
+ * Usage: mpirun -n 1 bench_timer_calls.x [calls]
+ */
+
+#include "mpi.h"
+
+#include "pmtm.h"
+#include "pmtm_fast.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1.0E-9;
+}
+
+/*
+ * Each function times the given number of calls on one timer and returns the
+ * cost of a call pair in nanoseconds.
+ */
+
+static double library_start_stop(PMTM_timer_t timer, long calls)
+{
+    double start = now();
+    long call_idx;
+    for (call_idx = 0; call_idx < calls; ++call_idx) {
+        PMTM_timer_start(timer);
+        PMTM_timer_stop(timer);
+    }
+    return (now() - start) / calls * 1.0E9;
+}
+
+static double fast_start_stop(PMTM_timer_t timer, long calls)
+{
+    double start = now();
+    long call_idx;
+    for (call_idx = 0; call_idx < calls; ++call_idx) {
+        PMTM_fast_timer_start(timer);
+        PMTM_fast_timer_stop(timer);
+    }
+    return (now() - start) / calls * 1.0E9;
+}
+
+static double library_pause_continue(PMTM_timer_t timer, long calls)
+{
+    PMTM_timer_start(timer);
+    double start = now();
+    long call_idx;
+    for (call_idx = 0; call_idx < calls; ++call_idx) {
+        PMTM_timer_pause(timer);
+        PMTM_timer_continue(timer);
+    }
+    double elapsed = now() - start;
+    PMTM_timer_stop(timer);
+    return elapsed / calls * 1.0E9;
+}
+
+static double fast_pause_continue(PMTM_timer_t timer, long calls)
+{
+    PMTM_fast_timer_start(timer);
+    double start = now();
+    long call_idx;
+    for (call_idx = 0; call_idx < calls; ++call_idx) {
+        PMTM_fast_timer_pause(timer);
+        PMTM_fast_timer_continue(timer);
+    }
+    double elapsed = now() - start;
+    PMTM_fast_timer_stop(timer);
+    return elapsed / calls * 1.0E9;
+}
+
+int main(int argc, char ** argv)
+{
+    MPI_Init(&argc, &argv);
+
+    long calls = (argc > 1) ? atol(argv[1]) : 1000000;
+
+    const PMTM_option_t clock_options[] = {
+        PMTM_OPTION_CLOCK_MONOTONIC, PMTM_OPTION_CLOCK_COARSE, PMTM_OPTION_CLOCK_TSC
+    };
+    const char * clock_names[] = { "monotonic", "coarse", "tsc" };
+    const int num_clocks = sizeof(clock_options) / sizeof(clock_options[0]);
+
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    if (rank == 0) {
+        printf("%-10s %-8s %14s %14s %14s %14s\n", "clock", "measure",
+               "start-stop", "fast", "pause-cont", "fast");
+    }
+
+    int clock_idx;
+    for (clock_idx = 0; clock_idx < num_clocks; ++clock_idx) {
+        PMTM_set_option(PMTM_OPTION_OUTPUT_ENV, PMTM_FALSE);
+        PMTM_set_option(clock_options[clock_idx], PMTM_TRUE);
+        PMTM_init("bench_timer_calls_", "bench_timer_calls");
+
+        PMTM_timer_t all_timer, wc_timer;
+        PMTM_create_timer(PMTM_DEFAULT_GROUP, &all_timer, "all", PMTM_TIMER_INT | PMTM_MEASURE_ALL);
+        PMTM_create_timer(PMTM_DEFAULT_GROUP, &wc_timer, "wc", PMTM_TIMER_INT | PMTM_MEASURE_WC);
+
+        PMTM_timer_t timers[] = { all_timer, wc_timer };
+        const char * measures[] = { "all", "wc" };
+
+        int timer_idx;
+        for (timer_idx = 0; timer_idx < 2; ++timer_idx) {
+            PMTM_timer_t timer = timers[timer_idx];
+
+            /* Warm up before timing. */
+            library_start_stop(timer, calls / 10);
+            fast_start_stop(timer, calls / 10);
+
+            double lib_ss  = library_start_stop(timer, calls);
+            double fast_ss = fast_start_stop(timer, calls);
+            double lib_pc  = library_pause_continue(timer, calls);
+            double fast_pc = fast_pause_continue(timer, calls);
+
+            if (rank == 0) {
+                printf("%-10s %-8s %11.1f ns %11.1f ns %11.1f ns %11.1f ns\n",
+                       clock_names[clock_idx], measures[timer_idx],
+                       lib_ss, fast_ss, lib_pc, fast_pc);
+            }
+        }
+
+        PMTM_set_option(PMTM_OPTION_NO_LOCAL_COPY, PMTM_TRUE);
+        PMTM_finalize();
+    }
+
+    MPI_Finalize();
+    return 0;
+}
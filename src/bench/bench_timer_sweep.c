@@ -0,0 +1,162 @@
+/*
+ * File:   bench_timer_sweep.c
+ * Author: AWE Plc.
+ *
+ * Measures the cost of a start/stop pair when cycling through many timers, as
+ * an application does when it times every routine of a large code. Once the
+ * timers no longer fit in the caches each pair misses on the memory of its
+ * timer, so the cost shows how much of each timer start and stop touch.
+ *
+ * The timers are visited in a shuffled order so that the hardware prefetcher
+ * cannot hide the misses. Each size is timed through the library calls and the
+ * inline calls of pmtm_fast.h, using the TSC clock (where available) and
+ * wallclock only timers to keep the cost of reading the clocks small. The best
+ * of a few repeats is reported.
+ *
+ * The memory column rewrites every word of struct PMTM_timer_hot instead, with
+ * a fence after each timer so that the misses are not overlapped. It reads no
+ * clocks, so it shows the cost of the memory a start/stop pair touches on its
+ * own. The start-stop and fast columns also depend on how the clock reads wait
+ * for that memory, and may not follow it.
+ *
+ * Usage: mpirun -n 1 bench_timer_sweep.x [calls]
+ */
+
+#include "mpi.h"
+
+#include "pmtm.h"
+#include "pmtm_fast.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define REPEATS 3
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1.0E-9;
+}
+
+/*
+ * Each function makes the given number of start/stop pairs, cycling through
+ * the timers in order, and returns the cost of a pair in nanoseconds.
+ */
+
+static double library_sweep(const PMTM_timer_t * order, long num_timers, long calls)
+{
+    double start = now();
+    long call_idx;
+    for (call_idx = 0; call_idx < calls; ++call_idx) {
+        PMTM_timer_t timer = order[call_idx % num_timers];
+        PMTM_timer_start(timer);
+        PMTM_timer_stop(timer);
+    }
+    return (now() - start) / calls * 1.0E9;
+}
+
+static double fast_sweep(const PMTM_timer_t * order, long num_timers, long calls)
+{
+    double start = now();
+    long call_idx;
+    for (call_idx = 0; call_idx < calls; ++call_idx) {
+        PMTM_timer_t timer = order[call_idx % num_timers];
+        PMTM_fast_timer_start(timer);
+        PMTM_fast_timer_stop(timer);
+    }
+    return (now() - start) / calls * 1.0E9;
+}
+
+static double memory_sweep(const PMTM_timer_t * order, long num_timers, long calls)
+{
+    double start = now();
+    long call_idx;
+    for (call_idx = 0; call_idx < calls; ++call_idx) {
+        volatile uint64_t * words = (volatile uint64_t *) order[call_idx % num_timers];
+        size_t word_idx;
+        for (word_idx = 0; word_idx < sizeof(struct PMTM_timer_hot) / sizeof(uint64_t); ++word_idx) {
+            words[word_idx] = words[word_idx];
+        }
+        __sync_synchronize();
+    }
+    return (now() - start) / calls * 1.0E9;
+}
+
+int main(int argc, char ** argv)
+{
+    MPI_Init(&argc, &argv);
+
+    long calls = (argc > 1) ? atol(argv[1]) : 2000000;
+
+    const long sizes[] = { 16, 256, 4096, 16384, 65536, 262144 };
+    const int num_sizes = sizeof(sizes) / sizeof(sizes[0]);
+
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    if (rank == 0) {
+        printf("%10s %14s %14s %14s\n", "timers", "start-stop", "fast", "memory");
+    }
+
+    int size_idx;
+    for (size_idx = 0; size_idx < num_sizes; ++size_idx) {
+        long num_timers = sizes[size_idx];
+
+        PMTM_set_option(PMTM_OPTION_OUTPUT_ENV, PMTM_FALSE);
+        PMTM_set_option(PMTM_OPTION_CLOCK_TSC, PMTM_TRUE);
+        PMTM_init("bench_timer_sweep_", "bench_timer_sweep");
+
+        PMTM_timer_t * order = malloc(num_timers * sizeof(PMTM_timer_t));
+        if (order == NULL) {
+            fprintf(stderr, "Failed to allocate %ld timers\n", num_timers);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+
+        long timer_idx;
+        for (timer_idx = 0; timer_idx < num_timers; ++timer_idx) {
+            char name[32];
+            sprintf(name, "timer %ld", timer_idx);
+            PMTM_create_timer(PMTM_DEFAULT_GROUP, &order[timer_idx], name, PMTM_TIMER_INT | PMTM_MEASURE_WC);
+        }
+
+        /* Shuffle the visiting order, with a fixed seed so runs compare. */
+        srand(12345);
+        for (timer_idx = num_timers - 1; timer_idx > 0; --timer_idx) {
+            long swap_idx = rand() % (timer_idx + 1);
+            PMTM_timer_t tmp = order[timer_idx];
+            order[timer_idx] = order[swap_idx];
+            order[swap_idx] = tmp;
+        }
+
+        /* Visit every timer at least a few times, warm up before timing and
+         * keep the best of several repeats, as the misses make this noisy. */
+        long sweep_calls = (calls > 4 * num_timers) ? calls : 4 * num_timers;
+        library_sweep(order, num_timers, num_timers);
+
+        double lib_ss = 0, fast_ss = 0, memory_ss = 0;
+        int repeat;
+        for (repeat = 0; repeat < REPEATS; ++repeat) {
+            double lib_time  = library_sweep(order, num_timers, sweep_calls);
+            double fast_time = fast_sweep(order, num_timers, sweep_calls);
+            double memory_time = memory_sweep(order, num_timers, sweep_calls);
+            if (repeat == 0 || lib_time < lib_ss)       lib_ss = lib_time;
+            if (repeat == 0 || fast_time < fast_ss)     fast_ss = fast_time;
+            if (repeat == 0 || memory_time < memory_ss) memory_ss = memory_time;
+        }
+
+        if (rank == 0) {
+            printf("%10ld %11.1f ns %11.1f ns %11.1f ns\n", num_timers, lib_ss, fast_ss, memory_ss);
+        }
+
+        free(order);
+
+        PMTM_set_option(PMTM_OPTION_NO_LOCAL_COPY, PMTM_TRUE);
+        PMTM_finalize();
+    }
+
+    MPI_Finalize();
+    return 0;
+}
@@ -193,6 +193,14 @@
 /// To create additional timer groups use the @ref PMTM_create_timer_group routine and the
 /// @ref PMTM_create_timer routine to create the /// timers themselves.
 ///
+/// A routine that is called many times, such as a library function, should not call
+/// @ref PMTM_create_timer on every call as each call adds another timer. It can
+/// instead use @ref PMTM_get_or_create_timer, which returns the existing timer of the
+/// same name in the group (for the calling thread under OpenMP) and only creates one
+/// the first time. In C the macro
+/// <code>PMTM_CACHED_TIMER(group, &timer, "name", type)</code> also keeps the handle
+/// at the call site so that later calls do not look it up again.
+///
 /// Once a timer has been created you can modify some of its sampling prop-
 /// erties via the @ref PMTM_set_sample_mode routine. This routine allows
 /// you to modify how often the timer will sample and how many times it will sample
@@ -202,6 +210,25 @@
 /// is not used the default sample mode is used which is to sample every time, and
 /// to have no maximum sample limit.
 ///
+/// By default every timer reads both the wallclock and the CPU clock, and reading
+/// the CPU clock is often the more expensive of the two. A timer can be restricted
+/// to one of them by adding @c PMTM_MEASURE_WC or @c PMTM_MEASURE_CPU to its timer
+/// type, e.g. <code>PMTM_TIMER_MAX | PMTM_MEASURE_WC</code> (@c IOR in Fortran).
+/// The @ref PMTM_set_default_measure routine sets which clocks are read by the
+/// timers of a group that are created without either flag. A time that is not
+/// measured is reported as zero. The @c Overhead lines in the output file give the
+/// cost of the timer calls for each of these choices.
+///
+/// In the OpenMP library each thread has its own timer and the CPU time of a timer
+/// is that of the thread which uses it (@c CLOCK_THREAD_CPUTIME_ID), rather than
+/// that of the whole process. @c PMTM_MEASURE_THREAD_CPU asks for this in the
+/// serial library too. The @c Timer line of a timer which measures the wallclock
+/// and thread CPU times ends, after any hardware counters, with its average CPU
+/// time and its efficiency, the ratio of CPU to wallclock time.
+/// An efficiency well below one means the thread was blocked or descheduled, e.g.
+/// when a node is oversubscribed, while a thread spin-waiting in a barrier shows an
+/// efficiency near one without doing useful work.
+///
 /// @b OpenMP:
 /// Under OpenMP, for timers expected to have separate counts for each
 /// thread, it is best to make the stored ID a thread private variable, as demonstrated
@@ -232,6 +259,31 @@
 /// multiple access is needed a serialisation mechanism like a barrier or critical
 /// region should separate the actions
 ///
+/// @subsubsection fasttimers Inline Timer Control
+/// In C and C++ the header @c pmtm_fast.h provides inline versions of the timer
+/// control routines, @c PMTM_fast_timer_start, @c PMTM_fast_timer_stop,
+/// @c PMTM_fast_timer_pause and @c PMTM_fast_timer_continue, which read the clock
+/// and update the timer without a call into the library. They give the same results
+/// as the library routines and the two can be mixed on the same timer. Defining
+/// @c PMTM_FAST_TIMERS before including @c pmtm_fast.h makes the @c PMTM_timer_*
+/// calls in that file use them. They do not check the timer states, so when
+/// @c PMTM_DEBUG is defined they call the library routines instead. Everything a
+/// start or stop updates is kept in one cache line per timer, so code that cycles
+/// through many timers takes at most one cache miss on each. The cost of each call,
+/// and of cycling through thousands of timers, can be measured with the benchmarks
+/// built by <code>make bench</code>.
+///
+/// @subsubsection scopetimers Scoped Timers in C++
+/// In C++ the header @c pmtm.hpp provides @c pmtm::scoped_timer, which starts a
+/// timer when it is constructed and stops it when it goes out of scope, so the timer
+/// is stopped on an early return or when an exception is thrown. The macro
+/// <code>PMTM_SCOPE("name")</code> also creates the timer, in the default timer
+/// group, the first time each thread reaches it, and keeps its handle at the call
+/// site so later entries only cost a start and a stop. @c PMTM_SCOPE_T takes the clock
+/// (e.g. @c pmtm::wallclock) and statistics (e.g. @c pmtm::max_stats) policies as
+/// extra arguments. Defining @c PMTM_DISABLE_SCOPES before including @c pmtm.hpp
+/// compiles every @c PMTM_SCOPE to nothing.
+///
 /// @subsection timeout Outputting Timers
 /// 
 /// The results of the timers will be output when PMTM is finalised with
@@ -240,10 +292,21 @@
 /// directly from the timers for general use with the calling code, i.e. to output to
 /// the results file.
 ///
-/// The @ref PMTM_get_cpu_time and @ref PMTM_get_wc_time routines retrieve the current
-/// timer CPU time and wall-clock time respectively, i.e. the times recorded for all
-/// timing blocks so far. The @ref PMTM_get_last_cpu_time and @ref PMTM_get_last_wc_time
-/// routines retrieve the times for the last timing block only.
+/// @ref PMTM_timer_output makes every rank wait while the IO rank writes the file.
+/// To output the timers part way through a run without waiting, call
+/// @ref PMTM_timer_output_begin, which sends a snapshot of the timers to the IO rank
+/// in the background, carry on computing, and then call @ref PMTM_timer_output_end
+/// to write them. If MPI was initialised with @c MPI_THREAD_MULTIPLE the IO rank
+/// formats the timers on a thread of its own in the meantime. These outputs gather
+/// the timers straight to the IO rank, so @c PMTM_OPTION_NODE_STATS and
+/// @c PMTM_STREAM_BUFFER do not apply to them.
+///
+/// The @ref PMTM_get_cpu_time and @ref PMTM_get_wc_time routines retrieve the CPU
+/// time and wall-clock time respectively since the timer was last started or
+/// continued. The @ref PMTM_get_total_cpu_time and @ref PMTM_get_total_wc_time
+/// routines retrieve the times recorded for all timing blocks so far, and the
+/// @ref PMTM_get_last_cpu_time and @ref PMTM_get_last_wc_time routines the times for
+/// the last timing block only, or for the block in progress up to its last pause.
 ///
 /// @subsection paramout Outputting Parameters
 ///
@@ -285,8 +348,10 @@
 /// etc. \n
 /// 
 /// It can also be used to set the options @c PMTM_DATA_STORE, @c PMTM_OPTION_OUTPUT_ENV,
-/// @c PMTM_OPTION_NO_LOCAL_COPY and @c PMTM_OPTION_NO_STORED_COPY. To set one of these
-/// variables add a line to the @c .pmtmrc file in either of the following formats:
+/// @c PMTM_OPTION_NO_LOCAL_COPY, @c PMTM_OPTION_NO_STORED_COPY, @c PMTM_OPTION_NODE_STATS,
+/// @c PMTM_OPTION_WRITER_THREAD, @c PMTM_OPTION_COLLECTIVE_WRITE, @c PMTM_OPTION_RANK_FILES
+/// and @c PMTM_CLOCK. To set one of these variables add a line to the @c .pmtmrc file in
+/// either of the following formats:
 ///
 /// \c `VARIABLE \c VALUE`
 /// 
@@ -294,6 +359,123 @@
 ///
 /// \c `VARIABLE=VALUE`
 ///
+/// @subsection clocks Choosing the Clock
+///
+/// Wallclock times are measured with @c CLOCK_MONOTONIC by default. Timers in
+/// tight loops can instead use a cheaper clock, chosen at initialisation by
+/// calling @ref PMTM_set_option before @ref PMTM_init with one of
+/// @c PMTM_OPTION_CLOCK_MONOTONIC, @c PMTM_OPTION_CLOCK_COARSE,
+/// @c PMTM_OPTION_CLOCK_TSC or @c PMTM_OPTION_CLOCK_MPI. A @c PMTM_CLOCK line in a
+/// @c .pmtmrc file overrides this, and the @c PMTM_CLOCK environment variable
+/// overrides both. Each takes the clock name:
+///
+/// - @b monotonic @c CLOCK_MONOTONIC.
+/// - @b coarse @c CLOCK_MONOTONIC_COARSE, cheap but only as fine as the kernel tick.
+/// - @b tsc The invariant time stamp counter, calibrated against @c CLOCK_MONOTONIC (x86-64 only).
+/// - @b mpi @c MPI_Wtime.
+///
+/// If the chosen clock is not available PMTM warns and uses @b monotonic. The
+/// portable build, for systems without @c clock_gettime, only has @b gettimeofday,
+/// which it uses in place of @b monotonic and warns if another clock was chosen.
+/// The clock in use, its measured resolution and the cost of one read are written
+/// to the output file on the @c clock-read @c Overhead line.
+///
+/// @subsection node_stats Node Statistics
+///
+/// The timers are brought together in two steps: the ranks sharing a node send
+/// their timers to the lowest rank on the node, which merges them and passes them
+/// on. Setting @c PMTM_OPTION_NODE_STATS also prints the average, maximum and
+/// minimum of each timer over the ranks of each node, after the lines over all
+/// ranks, labelled e.g. @c "Node 1 Maximum". Comparing these shows whether an
+/// imbalance is within the nodes or between them. Nodes are numbered in the order
+/// of their lowest rank.
+///
+/// @subsection streaming Streaming the Timers
+///
+/// By default the IO rank holds the timers of every rank while it writes them,
+/// which needs memory in proportion to the size of the job and is limited to 2 GB.
+/// A @c PMTM_STREAM_BUFFER line in a @c .pmtmrc file, or the @c PMTM_STREAM_BUFFER
+/// environment variable which overrides it, gives the IO rank a fixed amount of
+/// memory instead, in bytes or with a @c K, @c M or @c G suffix, e.g. @c 64M. The
+/// timers are then streamed to it one name at a time, in windows of as many ranks
+/// as fit in that memory, keeping only running statistics between windows. This
+/// needs more messages, so is slower, and does not print the statistics of each
+/// node.
+///
+/// @subsection writer_thread Writer Thread
+///
+/// On a slow file system the IO rank can stall while it writes the output file,
+/// and the other ranks then wait for it at the next collective. Setting
+/// @c PMTM_OPTION_WRITER_THREAD, before @ref PMTM_init or in a @c .pmtmrc file,
+/// makes PMTM copy everything it prints into 1 MB buffers instead, which a thread
+/// of its own writes to the file while the next buffer is filled. The file is only
+/// complete once the instance is finalised, which waits for the last buffer to be
+/// written. It needs the GNU C library, elsewhere PMTM warns and writes directly.
+///
+/// @subsection collective_write Collective Write
+///
+/// The line of every rank of a @c PMTM_TIMER_NONE or @c PMTM_TIMER_ALL timer is
+/// normally sent to the IO rank, which prints them all. Setting
+/// @c PMTM_OPTION_COLLECTIVE_WRITE, with @ref PMTM_set_option or in a @c .pmtmrc
+/// file, has each rank format its own lines and write them into the output file
+/// with MPI-IO instead, while the IO rank only writes the summary lines. The file
+/// is the same as without the option. It is ignored when the output goes to
+/// @c stdout, and if the file cannot be opened with MPI-IO the timers are gathered
+/// as usual. @c PMTM_STREAM_BUFFER is ignored while it is set.
+///
+/// @subsection rank_files Rank Files
+///
+/// Even a single gather of the timers takes a long time on a few hundred thousand
+/// ranks. Setting @c PMTM_OPTION_RANK_FILES, with @ref PMTM_set_option before
+/// @ref PMTM_init or in a @c .pmtmrc file, has every rank append its timers to a
+/// binary rank file of its own at each output instead, named after the output file
+/// with the rank added, e.g. @c my_app0.pmtm.17, without communicating at all. The
+/// IO rank writes a @c Rank @c Files line into the output file where the timers
+/// would have been printed. Once the run has finished
+///
+/// \c pmtm-merge \c [-t \c threads] \c [-m \c megabytes] \c [-d \c directory] \c [-c \c tolerance] \c my_app0.pmtm \c merged.pmtm
+///
+/// copies the output file, printing the timers of the rank files in place of
+/// each @c Rank @c Files line, including the average, maximum and minimum over
+/// the ranks, with as many threads as asked for and using about as much memory as
+/// asked for. The rank files are looked for in the directory of the output file
+/// unless another is given. @c PMTM_OPTION_NODE_STATS is ignored while it is set,
+/// and it is ignored when the output goes to @c stdout. The option is read when
+/// an instance is created, so the file name given to @ref PMTM_set_file_name later
+/// only changes where the @c Rank @c Files lines are written.
+///
+/// @subsection sample_ranks Sampling the Ranks
+///
+/// Most of the time the line of every rank is not needed. A @c PMTM_SAMPLE_RANKS line
+/// in a @c .pmtmrc file, or the @c PMTM_SAMPLE_RANKS environment variable which
+/// overrides it, only sends the lines of a sample of the ranks to the IO rank: a
+/// number @c N samples every Nth rank, counting from rank 0, and @c node the lowest
+/// rank of each node. The other ranks only take part in the reduction of the
+/// average, maximum and minimum, which are then printed for every timer, whatever
+/// its type, over all the ranks. @c PMTM_OUTLIER_RANKS, set in the same ways, adds
+/// the lines of the given number of slowest and of fastest ranks of each timer, by
+/// total wallclock time, up to 100, so @c PMTM_SAMPLE_RANKS @c 0 with it prints
+/// just the outliers. The lines keep their rank numbers and are printed in rank
+/// order. The hardware counters of an outlier that was not sampled print as zero.
+/// @c PMTM_STREAM_BUFFER and @c PMTM_OPTION_COLLECTIVE_WRITE are ignored while it is
+/// set, and @ref PMTM_timer_output_begin gathers every rank.
+///
+/// @subsection collapse_ranks Collapsing Rank Lines
+///
+/// On many ranks the line of every rank makes the output file large and hard to
+/// read, even when most ranks measured the same. A @c PMTM_COLLAPSE_RANKS line in a
+/// @c .pmtmrc file, or the @c PMTM_COLLAPSE_RANKS environment variable which
+/// overrides it, prints consecutive ranks whose timers agree as one line for the
+/// range instead, e.g. @c 0-1023.0, with the values of the first rank of the range.
+/// Its value is the relative tolerance the wallclock and CPU times, the sums of the
+/// squared wallclock times behind the standard deviations and any hardware counters
+/// must agree within, e.g. @c 0.01 for 1%, or @c 0 for exactly the same, and the
+/// counts must be equal. A rank that disagrees with its neighbours, an outlier, keeps a line
+/// of its own. The average, maximum and minimum lines are not affected. Each rank
+/// writes only its own lines with @c PMTM_OPTION_COLLECTIVE_WRITE, so that option
+/// is ignored while it is set, and @c pmtm-merge collapses the lines of rank files
+/// within the tolerance given with @c -c or by the environment variable.
+///
 /// @section constants PMTM Constants
 /// 
 /// | Fortran Type | C Type                | Name                     | Description |
@@ -309,6 +491,10 @@
 /// | \c integer   | \c PMTM_timer_type_t  | \c PMTM_TIMER_MMA        | Used in the \ref PMTM_create_timer routine. This specifies to output average, maximum and minimum times across all ranks for the given timer, but no information from the individual ranks. Version 2.5.0 onwards. |
 /// | \c integer   | \c PMTM_timer_type_t  | \c PMTM_TIMER_AVO        | Used in the \ref PMTM_create_timer routine. This specifies to output average times across all ranks for the given timer but no information from the individual ranks. Version 2.5.0 onwards. | 
 /// | \c integer   | \c PMTM_timer_type_t  | \c PMTM_TIMER_INT        | Used in the \ref PMTM_create_timer routine. This specifies to no timing information for the given timer. Version 2.5.0 onwards. |
+/// | \c integer   | \c PMTM_timer_type_t  | \c PMTM_MEASURE_WC       | Added to the timer type in the \ref PMTM_create_timer routine, or passed to \ref PMTM_set_default_measure. This specifies to measure only the wallclock time for the given timer.  |
+/// | \c integer   | \c PMTM_timer_type_t  | \c PMTM_MEASURE_CPU      | Added to the timer type in the \ref PMTM_create_timer routine, or passed to \ref PMTM_set_default_measure. This specifies to measure only the CPU time for the given timer.  |
+/// | \c integer   | \c PMTM_timer_type_t  | \c PMTM_MEASURE_THREAD_CPU | Added to the timer type in the \ref PMTM_create_timer routine, or passed to \ref PMTM_set_default_measure. This specifies to measure only the CPU time of the calling thread for the given timer (what \c PMTM_MEASURE_CPU measures under OpenMP).  |
+/// | \c integer   | \c PMTM_timer_type_t  | \c PMTM_MEASURE_ALL      | Added to the timer type in the \ref PMTM_create_timer routine, or passed to \ref PMTM_set_default_measure. This specifies to measure both the wallclock and CPU time for the given timer (the default).  |
 /// | \c integer   | \c PMTM_output_type_t | \c PMTM_OUTPUT_ALWAYS    | Used in the \ref PMTM_parameter_output routine. This specifies to output the parameter on every call to this routine.  |   
 /// | \c integer   | \c PMTM_output_type_t | \c PMTM_OUTPUT_ON_CHANGE | Used in the \ref PMTM_parameter_output routine. This specifies to output the parameter whenever the value of the parameter is different to the last time the routine was called.  |   
 /// | \c integer   | \c PMTM_output_type_t | \c PMTM_OUTPUT_ONCE      | Used in the \ref PMTM_parameter_output routine. This specifies to output the parameter on the first call to the routine and then to ignore all later calls with the same parameter name.  |   
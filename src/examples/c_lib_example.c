@@ -18,7 +18,7 @@ double lib_function()
         PMTM_init("c_lib_example_", "Example Library");
     }
     
-    PMTM_create_timer(PMTM_DEFAULT_INSTANCE, &loop_timer, "Loop Timer", PMTM_TIMER_ALL);
+    PMTM_CACHED_TIMER(PMTM_DEFAULT_GROUP, &loop_timer, "Loop Timer", PMTM_TIMER_ALL);
 
     PMTM_timer_start(loop_timer);
     double res = 1;
@@ -18,7 +18,7 @@ subroutine lib_routine(res)
         call PMTM_init("f_lib_example_", "Example Library", err_code)
     end if
 
-    call PMTM_create_timer(PMTM_DEFAULT_INSTANCE, loop_timer, "Loop Timer", PMTM_TIMER_ALL, err_code)
+    call PMTM_get_or_create_timer(PMTM_DEFAULT_GROUP, loop_timer, "Loop Timer", PMTM_TIMER_ALL, err_code)
 
     call PMTM_timer_start(loop_timer)
     res = 1
@@ -4,27 +4,305 @@
  *
  * Implementation of set_timers which gets the CPU and Elapsed time on systems
  * running the GNU Linux operating system.
+ *
+ * The elapsed time comes from one of the following clock backends, chosen at
+ * initialisation with select_clock:
+ *
+ * - monotonic : clock_gettime(CLOCK_MONOTONIC), a vDSO call on most kernels.
+ * - coarse    : clock_gettime(CLOCK_MONOTONIC_COARSE), cheaper still but only
+ *               updated once per kernel tick.
+ * - tsc       : the invariant time stamp counter read with rdtscp (or rdtsc),
+ *               calibrated against CLOCK_MONOTONIC. x86-64 only.
+ * - mpi       : MPI_Wtime, for comparison with timings taken by the
+ *               application itself.
  */
 
+#ifndef SERIAL
+#  include "mpi.h"
+#endif
+
 #include "timers.h"
+#include "pmtm_defines.h"
 
 #include <time.h>
 #include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#if defined(__x86_64__)
+#  include <cpuid.h>
+#  include <x86intrin.h>
+#  define PMTM_HAVE_TSC
+#endif
 
 #ifdef	__cplusplus
 extern "C" {
 #endif
 
-void set_timers(double * cpu_time, double * elapsed_time)
+/**
+ * A clock backend. Each backend returns the elapsed time in ticks of
+ * PMTM_TICKS_PER_SECOND.
+ */
+struct pmtm_clock
+{
+    const char * name;          /**< The name used in .pmtmrc/PMTM_CLOCK and in the output file. */
+    int (*init)();              /**< Prepare the backend, returns 0 if it can be used. */
+    pmtm_tick_t (*read)();      /**< Read the current elapsed time. */
+};
+
+static pmtm_tick_t read_timespec(clockid_t clock_id)
 {
     struct timespec ts;
+    clock_gettime(clock_id, &ts);
+    return (pmtm_tick_t) ts.tv_sec * PMTM_TICKS_PER_SECOND + ts.tv_nsec;
+}
+
+static int init_monotonic()
+{
+    return 0;
+}
+
+static pmtm_tick_t read_monotonic()
+{
+    return read_timespec(CLOCK_MONOTONIC);
+}
+
+static int init_coarse()
+{
+#ifdef CLOCK_MONOTONIC_COARSE
+    struct timespec ts;
+    return clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+#else
+    return -1;
+#endif
+}
+
+static pmtm_tick_t read_coarse()
+{
+#ifdef CLOCK_MONOTONIC_COARSE
+    return read_timespec(CLOCK_MONOTONIC_COARSE);
+#else
+    return read_timespec(CLOCK_MONOTONIC);
+#endif
+}
+
+struct pmtm_clock_state pmtm_clock_state = { INTERNAL__CLOCK_MONOTONIC, 0, 0 };
+
+#ifdef PMTM_HAVE_TSC
+#define TSC_CALIBRATION_NS 10000000
+
+static inline uint64_t read_tsc_raw()
+{
+    if (pmtm_clock_state.use_rdtscp) {
+        unsigned int aux;
+        return __rdtscp(&aux);
+    }
+    return __rdtsc();
+}
+#endif
+
+static int init_tsc()
+{
+#ifdef PMTM_HAVE_TSC
+    unsigned int eax, ebx, ecx, edx;
+
+    /* Only an invariant TSC runs at a constant rate across P/C states. */
+    if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) == 0 || !(edx & (1 << 8))) {
+        return -1;
+    }
+    if (__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx) != 0) {
+        pmtm_clock_state.use_rdtscp = (edx & (1 << 27)) != 0;
+    }
+
+    pmtm_tick_t ns_start = read_monotonic();
+    uint64_t tsc_start = read_tsc_raw();
+    pmtm_tick_t ns_end;
+    do {
+        ns_end = read_monotonic();
+    } while (ns_end - ns_start < TSC_CALIBRATION_NS);
+    uint64_t tsc_end = read_tsc_raw();
+
+    if (tsc_end <= tsc_start) {
+        return -1;
+    }
+
+    pmtm_clock_state.tsc_mult = (uint64_t) ((((unsigned __int128) (ns_end - ns_start)) << PMTM_TSC_SHIFT) / (tsc_end - tsc_start));
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+static pmtm_tick_t read_tsc()
+{
+#ifdef PMTM_HAVE_TSC
+    return (pmtm_tick_t) (((unsigned __int128) read_tsc_raw() * pmtm_clock_state.tsc_mult) >> PMTM_TSC_SHIFT);
+#else
+    return read_monotonic();
+#endif
+}
+
+static int init_mpi()
+{
+#ifndef SERIAL
+    int flag;
+    MPI_Initialized(&flag);
+    return flag ? 0 : -1;
+#else
+    return -1;
+#endif
+}
+
+static pmtm_tick_t read_mpi()
+{
+#ifndef SERIAL
+    return (pmtm_tick_t) (MPI_Wtime() * PMTM_TICKS_PER_SECOND);
+#else
+    return read_monotonic();
+#endif
+}
+
+/* Indexed by the INTERNAL__CLOCK_* ids. */
+static const struct pmtm_clock clocks[INTERNAL__NUM_CLOCKS] = {
+    { "monotonic", init_monotonic, read_monotonic },
+    { "coarse",    init_coarse,    read_coarse    },
+    { "tsc",       init_tsc,       read_tsc       },
+    { "mpi",       init_mpi,       read_mpi       }
+};
+
+static pmtm_tick_t (*current_read)() = read_monotonic;
+static double current_resolution = -1;
+
+void set_timers(double * cpu_time, double * elapsed_time)
+{
     struct timespec cpu_ts;
 
     clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_ts);
     *cpu_time = cpu_ts.tv_sec + cpu_ts.tv_nsec * 1.0E-9;
 
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-    *elapsed_time = ts.tv_sec + ts.tv_nsec * 1.0E-9; 
+    *elapsed_time = current_read() * (1.0 / PMTM_TICKS_PER_SECOND);
+}
+
+/**
+ * Read the CPU time used by the process.
+ *
+ * @returns the CPU time in ticks of PMTM_TICKS_PER_SECOND.
+ */
+pmtm_tick_t read_cpu_clock()
+{
+    return read_timespec(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+/**
+ * Read the CPU time used by the calling thread.
+ *
+ * @returns the CPU time in ticks of PMTM_TICKS_PER_SECOND.
+ */
+pmtm_tick_t read_thread_cpu_clock()
+{
+    return read_timespec(CLOCK_THREAD_CPUTIME_ID);
+}
+
+/**
+ * Read the elapsed time from the selected clock backend.
+ *
+ * @returns the elapsed time in ticks of PMTM_TICKS_PER_SECOND.
+ */
+pmtm_tick_t read_clock()
+{
+    return current_read();
+}
+
+/**
+ * Select the clock backend used for all elapsed time measurements. If the
+ * requested backend is not available on this system the monotonic clock is
+ * used instead. Selecting the clock that is already in use does nothing, so
+ * the TSC is only calibrated once.
+ *
+ * @param clock_id [IN] One of the INTERNAL__CLOCK_* ids.
+ * @returns the id of the clock that was actually selected.
+ */
+int select_clock(int clock_id)
+{
+    if (clock_id == pmtm_clock_state.clock_id) {
+        return clock_id;
+    }
+
+    if (clock_id < 0 || clock_id >= INTERNAL__NUM_CLOCKS || clocks[clock_id].init() != 0) {
+        clock_id = INTERNAL__CLOCK_MONOTONIC;
+    }
+
+    pmtm_clock_state.clock_id = clock_id;
+    current_read = clocks[clock_id].read;
+    current_resolution = -1;
+
+    return clock_id;
+}
+
+/**
+ * @returns the id of the selected clock backend.
+ */
+int get_clock_id()
+{
+    return pmtm_clock_state.clock_id;
+}
+
+/**
+ * Look up a clock backend by name (case insensitive).
+ *
+ * @param clock_name [IN] The name of the clock, e.g. "tsc".
+ * @returns the id of the clock, or -1 if there is no clock with that name.
+ */
+int get_clock_id_from_name(const char * clock_name)
+{
+    int clock_id;
+    for (clock_id = 0; clock_id < INTERNAL__NUM_CLOCKS; ++clock_id) {
+        if (strcasecmp(clock_name, clocks[clock_id].name) == 0) {
+            return clock_id;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @param clock_id [IN] One of the INTERNAL__CLOCK_* ids.
+ * @returns the name of the given clock backend.
+ */
+const char * get_clock_name(int clock_id)
+{
+    if (clock_id < 0 || clock_id >= INTERNAL__NUM_CLOCKS) {
+        return "unknown";
+    }
+    return clocks[clock_id].name;
+}
+
+/**
+ * Measure the resolution of the selected clock as the smallest step seen
+ * between two successive different readings. The measurement is made on
+ * the first call after the clock is selected.
+ *
+ * @returns the resolution in seconds.
+ */
+double get_clock_resolution()
+{
+    if (current_resolution < 0) {
+        const int trials = 5;
+        pmtm_tick_t best = 0;
+        int trial;
+
+        for (trial = 0; trial < trials; ++trial) {
+            pmtm_tick_t start = current_read();
+            pmtm_tick_t now;
+            do {
+                now = current_read();
+            } while (now == start);
+            if (best == 0 || now - start < best) {
+                best = now - start;
+            }
+        }
+        current_resolution = (double) best / PMTM_TICKS_PER_SECOND;
+    }
+    return current_resolution;
 }
 
 #ifdef	__cplusplus
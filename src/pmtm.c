@@ -33,6 +33,46 @@ extern "C" {
 static MPI_Comm PMTM_COMM;
 #endif
 
+/**
+ * With PMTM_OPTION_RANK_FILES every rank writes its timers to a rank file of
+ * its own, named after the output file, which only the IO_RANK creates. The
+ * IO_RANK, which reads the .pmtmrc files, decides whether they are written
+ * and tells the other ranks the name while they are still in step, so that
+ * the outputs need not communicate at all. This must be called on all ranks.
+ *
+ * @param instance [IN] The instance just constructed.
+ */
+static void share_rank_file_name(struct PMTM_instance * instance)
+{
+    // create_file keeps the names of the output files shorter than this.
+    char name[256];
+    int length = -1;
+
+    if (instance->rank == IO_RANK && instance->initialised && rank_files
+            && instance->fid != NULL && instance->fid != stdout) {
+        length = (int) strlen(instance->file_name);
+        if (length < (int) sizeof(name)) {
+            memcpy(name, instance->file_name, length + 1);
+        } else {
+            length = -1;
+        }
+    }
+#ifdef NOLOCAL
+    length = -1;
+#endif
+
+#ifndef SERIAL
+    MPI_Bcast(&length, 1, MPI_INT, IO_RANK, PMTM_COMM);
+    if (length >= 0) {
+        MPI_Bcast(name, length + 1, MPI_CHAR, IO_RANK, PMTM_COMM);
+    }
+#endif
+
+    if (length >= 0 && instance->initialised) {
+        copy_string(&instance->rank_file_name, name);
+    }
+}
+
 /**
  * Initialises PMTM creating all the require state for the creation of timers
  * and opening the output file ready for writing to. The output file is only
@@ -93,6 +133,16 @@ PMTM_error_t PMTM_init(
     struct PMTM_instance * instance = get_instance(PMTM_DEFAULT_INSTANCE);
     err_code = construct_instance(instance, file_name, app_name, rank, nranks);
 
+#ifndef SERIAL
+    /* The clock is chosen on the IO_RANK, where the .pmtmrc files are read, so
+     * that every rank measures with the same clock backend. */
+    int clock_id = get_clock_id();
+    MPI_Bcast(&clock_id, 1, MPI_INT, IO_RANK, PMTM_COMM);
+    select_clock(clock_id);
+#endif
+
+    share_rank_file_name(instance);
+
     // Andy - bug currently. There seems to be a number of reasons that ranks can destruct their instance
     // and or report error codes. Currently they can end up a bit inconsistent if this occurs. I think it
     // needs a review throughout, but basically I think once an instance is up it should stay up no matter
@@ -231,6 +281,8 @@ PMTM_error_t PMTM_create_instance(
     MPI_Bcast(&err_code, 1, MPI_INT, IO_RANK, PMTM_COMM);
 #endif
 
+    share_rank_file_name(get_instance(*instance_id));
+
     return err_code;
 }
 
@@ -385,50 +437,162 @@ PMTM_error_t PMTM_create_timer_group(
 }
 
 /**
- * Creates a timer.
+ * Add a timer to a timer list, or with reuse set return the existing timer of
+ * the same name in the list if there is one.
  *
- * @param timer_group_id [IN]  The timer group to which this timer will be
- *                             associated.
- * @param timer_id       [OUT] The ID of the timer created.
+ * @param list       [IN]     The timer list of the calling thread.
+ * @param timer_name [IN]     The name of the timer.
+ * @param reuse      [IN/OUT] Whether to return an existing timer, set to
+ *                            whether an existing timer was returned.
+ * @returns the timer, or FAILED_TIMER_ADD if it could not be created.
+ */
+static PMTM_timer_t find_or_new_timer(
+        struct PMTM_timer_list * list,
+        const char * timer_name,
+        PMTM_BOOL * reuse)
+{
+    PMTM_timer_t id = NULL;
+
+    if (*reuse) {
+        id = find_timer(list, timer_name);
+    }
+    *reuse = (id != NULL);
+
+    return (id != NULL) ? id : new_timer(list, timer_name);
+}
+
+/**
+ * Create a timer, or with reuse set return the existing timer of the same name
+ * and thread in the group if there is one.
+ *
+ * @param timer_group_id [IN]  The timer group of the timer.
+ * @param timer_id       [OUT] The ID of the timer.
  * @param timer_name     [IN]  The name of the timer.
- * @param timer_type     [IN]  The type of the timer, i.e. whether the timer
- *                             will report the max across all ranks, or the
- *                             average.
+ * @param timer_type     [IN]  The type of the timer, see PMTM_create_timer.
+ * @param reuse          [IN]  Whether to return an existing timer.
  * @returns PMTM_SUCCESS if successful, or one of PMTM_ERROR_* codes if not.
  */
-PMTM_error_t PMTM_create_timer(
+static PMTM_error_t create_timer(
         PMTM_timer_group_t timer_group_id,
         PMTM_timer_t * timer_id,
         const char * timer_name,
-        PMTM_timer_type_t timer_type)
+        PMTM_timer_type_t timer_type,
+        PMTM_BOOL reuse)
 {
     struct PMTM_timer_group * group = get_timer_group(timer_group_id);
     if (group == NULL) {
         return PMTM_ERROR_INVALID_TIMER_GROUP_ID;
     }
 
-    PMTM_timer_t id;
+    PMTM_timer_t id = NULL;
+
+    // Each thread adds its timers to its own list in the group, so only a
+    // thread using the shared list needs to take the lock.
 
+    PMTM_BOOL shared;
+    struct PMTM_timer_list * list = get_timer_list(group, &shared);
+
+    if (shared) {
 #ifdef _OPENMP
 #pragma omp critical(pmtm)
 #endif
-    {
-        id = new_timer(group, timer_name);
+        id = find_or_new_timer(list, timer_name, &reuse);
+    } else {
+        id = find_or_new_timer(list, timer_name, &reuse);
     }
 
     if (id == FAILED_TIMER_ADD) {
         return PMTM_ERROR_CREATE_TIMER_FAILED;
     }
 
-    int err_code = construct_timer(get_timer(id), NULL, timer_type);
-    if (err_code != 0) {
-        return err_code;
+    if (!reuse) {
+        if ((timer_type & MEASURE_MASK) == 0) {
+            timer_type |= group->measure;
+        }
+
+        int err_code = construct_timer(get_timer(id), NULL, timer_type);
+        if (err_code != 0) {
+            return err_code;
+        }
     }
 
     *timer_id = id;
     return PMTM_SUCCESS;
 }
 
+/**
+ * Creates a timer.
+ *
+ * @param timer_group_id [IN]  The timer group to which this timer will be
+ *                             associated.
+ * @param timer_id       [OUT] The ID of the timer created.
+ * @param timer_name     [IN]  The name of the timer.
+ * @param timer_type     [IN]  The type of the timer, i.e. whether the timer
+ *                             will report the max across all ranks, or the
+ *                             average, optionally OR'd with PMTM_MEASURE_*
+ *                             flags. If no PMTM_MEASURE_* flag is given the
+ *                             default of the timer group is used.
+ * @returns PMTM_SUCCESS if successful, or one of PMTM_ERROR_* codes if not.
+ */
+PMTM_error_t PMTM_create_timer(
+        PMTM_timer_group_t timer_group_id,
+        PMTM_timer_t * timer_id,
+        const char * timer_name,
+        PMTM_timer_type_t timer_type)
+{
+    return create_timer(timer_group_id, timer_id, timer_name, timer_type, INTERNAL__FALSE);
+}
+
+/**
+ * Returns the timer of the given name in a timer group, creating it if it does
+ * not exist. Under OpenMP each thread gets its own timer, as if it had called
+ * PMTM_create_timer. A routine that is called many times can use this in
+ * place of PMTM_create_timer without adding a timer on every call; the
+ * PMTM_CACHED_TIMER macro also avoids the lookup after the first call.
+ *
+ * @param timer_group_id [IN]  The timer group of the timer.
+ * @param timer_id       [OUT] The ID of the timer.
+ * @param timer_name     [IN]  The name of the timer.
+ * @param timer_type     [IN]  The type of the timer if it is created, see
+ *                             PMTM_create_timer. An existing timer keeps its
+ *                             type.
+ * @returns PMTM_SUCCESS if successful, or one of PMTM_ERROR_* codes if not.
+ */
+PMTM_error_t PMTM_get_or_create_timer(
+        PMTM_timer_group_t timer_group_id,
+        PMTM_timer_t * timer_id,
+        const char * timer_name,
+        PMTM_timer_type_t timer_type)
+{
+    return create_timer(timer_group_id, timer_id, timer_name, timer_type, INTERNAL__TRUE);
+}
+
+/**
+ * Set which clocks are read by timers created in the given group when no
+ * PMTM_MEASURE_* flag is passed to PMTM_create_timer. Timers that only measure
+ * the wallclock time avoid the cost of reading the CPU clock on every start,
+ * stop, pause and continue.
+ *
+ * @param timer_group_id [IN] The timer group to modify.
+ * @param measure        [IN] PMTM_MEASURE_WC, PMTM_MEASURE_CPU or
+ *                            PMTM_MEASURE_ALL (the default).
+ * @returns PMTM_SUCCESS if successful, or one of PMTM_ERROR_* codes if not.
+ */
+PMTM_error_t PMTM_set_default_measure(
+        PMTM_timer_group_t timer_group_id,
+        PMTM_timer_type_t measure)
+{
+    struct PMTM_timer_group * group = get_timer_group(timer_group_id);
+    if (group == NULL) {
+        return PMTM_ERROR_INVALID_TIMER_GROUP_ID;
+    }
+
+    measure &= MEASURE_MASK;
+    group->measure = (measure != 0) ? measure : MEASURE_DEFAULT;
+
+    return PMTM_SUCCESS;
+}
+
 /**
  * Set the sample mode of the timer. This allows the setting of how often the
  * timer should sample and whether it should stop sampling after a given number
@@ -436,8 +600,10 @@ PMTM_error_t PMTM_create_timer(
  *
  * @param timer_id    [IN] The ID of the timer to modify.
  * @param frequency   [IN] The sample frequency to set on the timer.
- * @param max_samples [IN] The maximum sample value to set on the timer.
- * @returns PMTM_SUCCESS if successful, or one of PMTM_ERROR_* codes if not.
+ * @param max_samples [IN] The maximum sample value to set on the timer, or
+ *                         PMTM_NO_MAX for no maximum.
+ * @returns PMTM_SUCCESS if successful, PMTM_ERROR_INVALID_SAMPLE_MODE if
+ *          max_samples is negative, or one of PMTM_ERROR_* codes if not.
  */
 PMTM_error_t PMTM_set_sample_mode(
         PMTM_timer_t timer_id,
@@ -446,8 +612,13 @@ PMTM_error_t PMTM_set_sample_mode(
 {
     struct PMTM_timer * timer = get_timer(timer_id);
 
+    if (max_samples < 0 && max_samples != PMTM_NO_MAX) {
+        return PMTM_ERROR_INVALID_SAMPLE_MODE;
+    }
+
     timer->frequency = frequency;
-    timer->max_samples = max_samples;
+    timer->max_samples = (max_samples == PMTM_NO_MAX) ? (uint32_t) SAMPLES_UNLIMITED : (uint32_t) max_samples;
+    timer->hot.sampled = (timer->frequency != 1 || timer->max_samples != SAMPLES_UNLIMITED);
     
     return PMTM_SUCCESS;
 }
@@ -771,6 +942,46 @@ PMTM_error_t PMTM_timer_output(PMTM_instance_t instance_id)
     return PMTM_internal_timer_output(instance, PMTM_COMM);
 }
 
+/**
+ * Start printing the results of the timers associated with the given instance,
+ * as PMTM_timer_output would, but without waiting for them to be written. The
+ * timers are printed as they are at this call, and can be started and stopped
+ * again straight away. The output must be finished with PMTM_timer_output_end,
+ * which is also done by the next PMTM_timer_output, PMTM_destroy_instance or
+ * PMTM_finalize. All ranks must call this together.
+ *
+ * @param instance_id [IN] The ID of the instance for whom we are printing the
+ *                         timers.
+ * @returns PMTM_SUCCESS if successful, or one of PMTM_ERROR_* codes if not.
+ */
+PMTM_error_t PMTM_timer_output_begin(PMTM_instance_t instance_id)
+{
+    struct PMTM_instance * instance = get_instance(instance_id);
+    if (instance == NULL || instance->initialised == 0) {
+        return PMTM_ERROR_INVALID_INSTANCE_ID;
+    }
+
+    return PMTM_internal_timer_output_begin(instance, PMTM_COMM);
+}
+
+/**
+ * Finish the output started by PMTM_timer_output_begin, writing the timers to
+ * the output file. Does nothing if there is no output to finish.
+ *
+ * @param instance_id [IN] The ID of the instance for whom we are printing the
+ *                         timers.
+ * @returns PMTM_SUCCESS if successful, or one of PMTM_ERROR_* codes if not.
+ */
+PMTM_error_t PMTM_timer_output_end(PMTM_instance_t instance_id)
+{
+    struct PMTM_instance * instance = get_instance(instance_id);
+    if (instance == NULL || instance->initialised == 0) {
+        return PMTM_ERROR_INVALID_INSTANCE_ID;
+    }
+
+    return PMTM_internal_timer_output_end(instance);
+}
+
 /**
  * Returns whether or not the PMTM library has already been initialised.
  *
@@ -829,6 +1040,7 @@ const char * PMTM_get_error_message(PMTM_error_t err_code)
         case PMTM_ERROR_MPI_COMM_SIZE_FAILED:   return "MPI error whilst getting comm size";
         case PMTM_ERROR_MPI_GATHER_FAILED:      return "MPI error whilst performing gather across ranks";
         case PMTM_ERROR_UNKNOWN_OPTION:         return "Unknown option passed to PMTM_set_option";
+        case PMTM_ERROR_INVALID_SAMPLE_MODE:    return "Negative maximum samples passed to PMTM_set_sample_mode";
         default: return "Unknown error";
     }
 }
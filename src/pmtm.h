@@ -48,6 +48,7 @@ extern "C" {
  * |  PMTM_ERROR_HW_COUNTERS_INIT_FAILED | -24 | Error whilst trying to initialise hardware counters. |
  * |  PMTM_ERROR_HW_COUNTERS_READ_FAILED | -25 | Error whilst trying to read hardware counters. |
  * |  PMTM_ERROR_UNKNOWN_OPTION          | -26 | Unknown PMTM Error - Should never return this. |
+ * |  PMTM_ERROR_INVALID_SAMPLE_MODE     | -27 | Negative maximum number of samples passed to \ref PMTM_set_sample_mode. |
  @{ */
 #define PMTM_SUCCESS                        0
 #define PMTM_ERROR_ALREADY_INITIALISED     -1
@@ -76,6 +77,7 @@ extern "C" {
 #define PMTM_ERROR_HW_COUNTERS_INIT_FAILED -24
 #define PMTM_ERROR_HW_COUNTERS_READ_FAILED -25
 #define PMTM_ERROR_UNKNOWN_OPTION          -26
+#define PMTM_ERROR_INVALID_SAMPLE_MODE     -27
 /* @} */
 
 #ifdef __cplusplus
@@ -105,6 +107,8 @@ PMTM_error_t PMTM_destroy_instance(PMTM_instance_t instance_id);
 PMTM_error_t PMTM_create_instance(PMTM_instance_t * instance_id, const char * file_name, const char * application_name);
 PMTM_error_t PMTM_create_timer_group(PMTM_instance_t instance_id, PMTM_timer_group_t * timer_group_id, const char * group_name);
 PMTM_error_t PMTM_create_timer(PMTM_timer_group_t timer_group_id, PMTM_timer_t * timer, const char * timer_name, PMTM_timer_type_t timer_type);
+PMTM_error_t PMTM_get_or_create_timer(PMTM_timer_group_t timer_group_id, PMTM_timer_t * timer, const char * timer_name, PMTM_timer_type_t timer_type);
+PMTM_error_t PMTM_set_default_measure(PMTM_timer_group_t timer_group_id, PMTM_timer_type_t measure);
 PMTM_error_t PMTM_log_flags(const char * flags);
 PMTM_error_t PMTM_set_file_name(PMTM_instance_t instance_id, const char * file_name);
 /* @} */
@@ -116,6 +120,8 @@ void PMTM_timer_stop(PMTM_timer_t timer_id);
 void PMTM_timer_pause(PMTM_timer_t timer_id);
 void PMTM_timer_continue(PMTM_timer_t timer_id);
 PMTM_error_t PMTM_timer_output(PMTM_instance_t instance_id);
+PMTM_error_t PMTM_timer_output_begin(PMTM_instance_t instance_id);
+PMTM_error_t PMTM_timer_output_end(PMTM_instance_t instance_id);
 PMTM_error_t PMTM_set_sample_mode(PMTM_timer_t timer_id, int sample_freq, int sample_max);
 double PMTM_get_cpu_time(PMTM_timer_t timer);
 double PMTM_get_total_cpu_time(PMTM_timer_t timer);
@@ -154,6 +160,11 @@ extern const PMTM_timer_type_t PMTM_TIMER_MMA;  /*!< Print the maximum, minimum
 extern const PMTM_timer_type_t PMTM_TIMER_INT;  /*!< Do no print anything to the output file. Used for internal timers only. */
 extern const PMTM_timer_type_t PMTM_TIMER_AVO;  /*!< Only print the average time for a timer. */
 
+extern const PMTM_timer_type_t PMTM_MEASURE_WC;  /*!< Added to a timer type, measure only the wallclock time. */
+extern const PMTM_timer_type_t PMTM_MEASURE_CPU; /*!< Added to a timer type, measure only the CPU time. */
+extern const PMTM_timer_type_t PMTM_MEASURE_THREAD_CPU; /*!< Added to a timer type, measure only the CPU time of the calling thread (the default CPU time under OpenMP). */
+extern const PMTM_timer_type_t PMTM_MEASURE_ALL; /*!< Added to a timer type, measure both the wallclock and CPU time (the default). */
+
 extern const PMTM_output_type_t PMTM_OUTPUT_ALWAYS;    /*!< Always output the parameter. */
 extern const PMTM_output_type_t PMTM_OUTPUT_ON_CHANGE; /*!< Only output the parameter if it has changed since the last output. */
 extern const PMTM_output_type_t PMTM_OUTPUT_ONCE;      /*!< Only output the parameter on the first call of the function. */
@@ -173,8 +184,51 @@ extern const int PMTM_DEFAULT_MAX;  /*!< Specify the timer should stop after the
 #define PMTM_OPTION_OUTPUT_ENV INTERNAL__OPTION_OUTPUT_ENV
 #define PMTM_OPTION_NO_LOCAL_COPY INTERNAL__OPTION_NO_LOCAL_COPY
 #define PMTM_OPTION_NO_STORED_COPY INTERNAL__OPTION_NO_STORED_COPY
+#define PMTM_OPTION_CLOCK_MONOTONIC INTERNAL__OPTION_CLOCK_MONOTONIC /*!< Measure wallclock time with CLOCK_MONOTONIC (the default). */
+#define PMTM_OPTION_CLOCK_COARSE INTERNAL__OPTION_CLOCK_COARSE       /*!< Measure wallclock time with CLOCK_MONOTONIC_COARSE. */
+#define PMTM_OPTION_CLOCK_TSC INTERNAL__OPTION_CLOCK_TSC             /*!< Measure wallclock time with the invariant time stamp counter. */
+#define PMTM_OPTION_CLOCK_MPI INTERNAL__OPTION_CLOCK_MPI             /*!< Measure wallclock time with MPI_Wtime. */
+#define PMTM_OPTION_NODE_STATS INTERNAL__OPTION_NODE_STATS           /*!< Also print the average, maximum and minimum of each node. */
+#define PMTM_OPTION_WRITER_THREAD INTERNAL__OPTION_WRITER_THREAD     /*!< Write the output file from a thread of its own. */
+#define PMTM_OPTION_COLLECTIVE_WRITE INTERNAL__OPTION_COLLECTIVE_WRITE /*!< Have every rank write its own timer lines with MPI-IO. */
+#define PMTM_OPTION_RANK_FILES INTERNAL__OPTION_RANK_FILES           /*!< Have every rank write its timers to a binary file of its own, for pmtm-merge. */
 /* @} */
 
+extern unsigned int pmtm_timer_generation; /*!< Changes whenever timers are destroyed, used by PMTM_CACHED_TIMER. */
+
+#ifdef _OPENMP
+#  if defined(__cplusplus) && __cplusplus >= 201103L
+#    define PMTM_THREAD_LOCAL thread_local
+#  elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#    define PMTM_THREAD_LOCAL _Thread_local
+#  else
+#    define PMTM_THREAD_LOCAL __thread
+#  endif
+#else
+#  define PMTM_THREAD_LOCAL
+#endif
+
+/**
+ * Set timer_id to the timer of the given name, as PMTM_get_or_create_timer,
+ * caching the handle at the call site so that later calls (by the same thread)
+ * do not look the timer up again. The handle is looked up again after PMTM has
+ * been finalised and re-initialised. Each call at one call site must give the
+ * same group and name.
+ */
+#define PMTM_CACHED_TIMER(timer_group_id, timer_id, timer_name, timer_type) \
+    do { \
+        static PMTM_THREAD_LOCAL PMTM_timer_t pmtm_cached_timer_ = NULL; \
+        static PMTM_THREAD_LOCAL unsigned int pmtm_cached_generation_ = 0; \
+        if (pmtm_cached_generation_ != pmtm_timer_generation) { \
+            if (PMTM_get_or_create_timer((timer_group_id), &pmtm_cached_timer_, (timer_name), (timer_type)) == PMTM_SUCCESS) { \
+                pmtm_cached_generation_ = pmtm_timer_generation; \
+            } else { \
+                pmtm_cached_timer_ = PMTM_NULL_TIMER; \
+            } \
+        } \
+        *(timer_id) = pmtm_cached_timer_; \
+    } while (0)
+
 #ifdef	__cplusplus
 }
 #endif
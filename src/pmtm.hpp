@@ -0,0 +1,187 @@
+/**
+ * @file   pmtm.hpp
+ * @author AWE Plc.
+ *
+ * This file defines a C++ interface to the PMTM timers, on top of the C API in
+ * pmtm.h and the inline timer control of pmtm_fast.h.
+ *
+ * pmtm::scoped_timer starts a timer when it is constructed and stops it when
+ * it goes out of scope, so the timer is stopped on every return path and when
+ * an exception is thrown. The PMTM_SCOPE macro creates the timer as well:
+ *
+ * @code
+ * void solve()
+ * {
+ *     PMTM_SCOPE("solve");
+ *     ...
+ * }
+ * @endcode
+ *
+ * The timer is found or created in the default timer group, with
+ * PMTM_get_or_create_timer, the first time each thread reaches a PMTM_SCOPE,
+ * and its handle is kept in a static of that call site so later entries only
+ * cost a start and a stop. Sites with the same name share the timer. Entries
+ * before PMTM is initialised are not timed.
+ *
+ * The clocks read and the statistics printed by the timer are chosen by the
+ * Clock and Stats template parameters (PMTM_SCOPE_T). Defining
+ * PMTM_DISABLE_SCOPES before including this file makes every PMTM_SCOPE use
+ * the pmtm::disabled policy, which creates no timer and compiles to nothing.
+ *
+ * The interface needs C++11, for the lambda that gives each PMTM_SCOPE its
+ * handle.
+ */
+
+#ifndef _PMTM_INCLUDE_PMTM_HPP
+#define	_PMTM_INCLUDE_PMTM_HPP
+
+#if __cplusplus < 201103L
+#error "pmtm.hpp requires C++11 or later"
+#endif
+
+#include "pmtm.h"
+#include "pmtm_fast.h"
+
+namespace pmtm {
+
+/**
+ * @name Clock policies
+ * The clocks read by a timer, as the PMTM_MEASURE_* flags of PMTM_create_timer.
+ * @{ */
+struct group_clocks      { static const bool enabled = true;  static const PMTM_timer_type_t measure = 0; };
+struct wallclock         { static const bool enabled = true;  static const PMTM_timer_type_t measure = INTERNAL__MEASURE_WC; };
+struct all_clocks        { static const bool enabled = true;  static const PMTM_timer_type_t measure = INTERNAL__MEASURE_WC | INTERNAL__MEASURE_CPU; };
+struct thread_cpu_clocks { static const bool enabled = true;  static const PMTM_timer_type_t measure = INTERNAL__MEASURE_WC | INTERNAL__MEASURE_CPU | INTERNAL__MEASURE_THREAD_CPU; };
+struct disabled          { static const bool enabled = false; static const PMTM_timer_type_t measure = 0; };
+/** @} */
+
+/**
+ * @name Statistics policies
+ * The statistics printed for a timer, as the PMTM_TIMER_* types of
+ * PMTM_create_timer.
+ * @{ */
+struct rank_stats    { static const PMTM_timer_type_t type = INTERNAL__TIMER_NONE; };
+struct max_stats     { static const PMTM_timer_type_t type = INTERNAL__TIMER_MAX; };
+struct min_stats     { static const PMTM_timer_type_t type = INTERNAL__TIMER_MIN; };
+struct avg_stats     { static const PMTM_timer_type_t type = INTERNAL__TIMER_AVG; };
+struct all_stats     { static const PMTM_timer_type_t type = INTERNAL__TIMER_MAX | INTERNAL__TIMER_MIN | INTERNAL__TIMER_AVG; };
+struct summary_stats { static const PMTM_timer_type_t type = INTERNAL__TIMER_MMA; };
+struct average_only  { static const PMTM_timer_type_t type = INTERNAL__TIMER_AVO; };
+struct no_stats      { static const PMTM_timer_type_t type = INTERNAL__TIMER_INT; };
+/** @} */
+
+#ifdef PMTM_DISABLE_SCOPES
+typedef disabled default_clocks;
+#else
+typedef group_clocks default_clocks;
+#endif
+typedef rank_stats default_stats;
+
+/**
+ * Starts a timer on construction and stops it on destruction. A null timer is
+ * ignored, so a scope whose timer could not be created is not timed.
+ */
+template <class Clock = default_clocks>
+class basic_scoped_timer
+{
+public:
+    /**
+     * @param timer [IN] The timer to start, which must be stopped.
+     */
+    explicit basic_scoped_timer(PMTM_timer_t timer) : m_timer(timer)
+    {
+        if (m_timer) PMTM_fast_timer_start(m_timer);
+    }
+
+    ~basic_scoped_timer()
+    {
+        if (m_timer) PMTM_fast_timer_stop(m_timer);
+    }
+
+private:
+    basic_scoped_timer(const basic_scoped_timer &);
+    basic_scoped_timer & operator=(const basic_scoped_timer &);
+
+    PMTM_timer_t m_timer;
+};
+
+/**
+ * A disabled scoped timer does nothing.
+ */
+template <>
+class basic_scoped_timer<disabled>
+{
+public:
+    explicit basic_scoped_timer(PMTM_timer_t) {}
+};
+
+typedef basic_scoped_timer<> scoped_timer;
+
+/**
+ * The timer handle of one PMTM_SCOPE site. PMTM_SCOPE_T keeps one in a static
+ * of the call site, so the handle is looked up on the first call by each thread
+ * and kept, as PMTM_CACHED_TIMER does.
+ */
+template <class Clock, class Stats>
+struct scope_site
+{
+    PMTM_timer_t handle;     /**< The timer, or a null timer. */
+    unsigned int generation; /**< The pmtm_timer_generation handle was looked up in. */
+
+    /**
+     * @param name [IN] The name of the timer, the same on every call.
+     * @returns the timer, or a null timer if it could not be created.
+     */
+    PMTM_timer_t timer(const char * name)
+    {
+        if (generation != pmtm_timer_generation) {
+            if (PMTM_get_or_create_timer(INTERNAL__DEFAULT_GROUP, &handle, name,
+                                         Stats::type | Clock::measure) == PMTM_SUCCESS) {
+                generation = pmtm_timer_generation;
+            } else {
+                handle = 0;
+            }
+        }
+        return handle;
+    }
+};
+
+/**
+ * A disabled site creates no timer.
+ */
+template <class Stats>
+struct scope_site<disabled, Stats>
+{
+    PMTM_timer_t timer(const char *) { return 0; }
+};
+
+} /* namespace pmtm */
+
+#define PMTM_HPP_CONCAT_(a, b) a ## b
+#define PMTM_HPP_CONCAT(a, b)  PMTM_HPP_CONCAT_(a, b)
+
+/* __COUNTER__ keeps the names of two scopes on one line apart. */
+#ifdef __COUNTER__
+#define PMTM_HPP_UNIQUE(prefix) PMTM_HPP_CONCAT(prefix, __COUNTER__)
+#else
+#define PMTM_HPP_UNIQUE(prefix) PMTM_HPP_CONCAT(prefix, __LINE__)
+#endif
+
+/**
+ * Time the rest of the enclosing scope with the timer of the given name,
+ * reading the clocks of the Clock policy and printing the statistics of the
+ * Stats policy. The lambda gives each call site a handle of its own.
+ */
+#define PMTM_SCOPE_T(name, Clock, Stats) \
+    ::pmtm::basic_scoped_timer< Clock > PMTM_HPP_UNIQUE(pmtm_scope_)( \
+        [](const char * pmtm_scope_name) { \
+            static PMTM_THREAD_LOCAL ::pmtm::scope_site< Clock, Stats > pmtm_scope_site; \
+            return pmtm_scope_site.timer(pmtm_scope_name); \
+        }(name))
+
+/**
+ * Time the rest of the enclosing scope with the timer of the given name.
+ */
+#define PMTM_SCOPE(name) PMTM_SCOPE_T(name, ::pmtm::default_clocks, ::pmtm::default_stats)
+
+#endif	/* _PMTM_INCLUDE_PMTM_HPP */
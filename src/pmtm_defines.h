@@ -31,6 +31,10 @@
 #define INTERNAL__TIMER_INT  16
 #define INTERNAL__TIMER_AVO  32
 
+#define INTERNAL__MEASURE_WC  64
+#define INTERNAL__MEASURE_CPU 128
+#define INTERNAL__MEASURE_THREAD_CPU 256
+
 #define INTERNAL__OUTPUT_ALL_RANKS 1
 #define INTERNAL__OUTPUT_ALWAYS    2
 #define INTERNAL__OUTPUT_ON_CHANGE 4
@@ -39,12 +43,28 @@
 #define INTERNAL__OPTION_OUTPUT_ENV 1
 #define INTERNAL__OPTION_NO_LOCAL_COPY 2
 #define INTERNAL__OPTION_NO_STORED_COPY 3
+#define INTERNAL__OPTION_CLOCK_MONOTONIC 4
+#define INTERNAL__OPTION_CLOCK_COARSE 5
+#define INTERNAL__OPTION_CLOCK_TSC 6
+#define INTERNAL__OPTION_CLOCK_MPI 7
+#define INTERNAL__OPTION_NODE_STATS 8
+#define INTERNAL__OPTION_WRITER_THREAD 9
+#define INTERNAL__OPTION_COLLECTIVE_WRITE 10
+#define INTERNAL__OPTION_RANK_FILES 11
 /*#define PMTM_OPTION_OUTPUT_ENV INTERNAL__OPTION_OUTPUT_ENV
 #define PMTM_OPTION_NO_LOCAL_COPY INTERNAL__OPTION_NO_LOCAL_COPY
 #define PMTM_OPTION_NO_STORED_COPY INTERNAL__OPTION_NO_STORED_COPY*/
 
 #define INTERNAL__NO_MAX 2147483647
 
+#define INTERNAL__CLOCK_MONOTONIC 0
+#define INTERNAL__CLOCK_COARSE    1
+#define INTERNAL__CLOCK_TSC       2
+#define INTERNAL__CLOCK_MPI       3
+#define INTERNAL__NUM_CLOCKS      4
+/* The only clock of the portable posix_timers.c backend. */
+#define INTERNAL__CLOCK_GETTIMEOFDAY INTERNAL__NUM_CLOCKS
+
 #define INTERNAL__RCFILENAME "/.pmtmrc"
 
 #endif	/* _PMTM_INCLUDE_PMTM_DEFINES_H */
@@ -0,0 +1,389 @@
+/**
+ * @file   pmtm_fast.h
+ * @author AWE Plc.
+ *
+ * This file provides inline versions of the timer control routines, for timers
+ * in loops where the cost of a call into the library matters. Each call reads
+ * the clock inline and updates the timer directly, rather than going through
+ * PMTM_timer_start, etc. which are still provided and give the same results,
+ * so the two can be mixed on the same timer.
+ *
+ * Defining PMTM_FAST_TIMERS before including this file replaces the
+ * PMTM_timer_start/stop/pause/continue calls in the including file with the
+ * inline versions.
+ *
+ * The inline versions do not do the state checks of a debug (PMTM_DEBUG) build
+ * of PMTM or read hardware counters (HW_COUNTERS), so if either of these is
+ * defined they call the library routines instead.
+ */
+
+#ifndef _PMTM_INCLUDE_PMTM_FAST_H
+#define	_PMTM_INCLUDE_PMTM_FAST_H
+
+#include "pmtm.h"
+#include "timers.h"
+
+#include <stdint.h>
+
+#ifdef __linux__
+#  include <time.h>
+#endif
+
+#if defined(__x86_64__) && defined(__SIZEOF_INT128__)
+#  include <x86intrin.h>
+#  define PMTM_FAST_HAVE_TSC
+#endif
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/** @name Timer phases
+ * The phase of a timer, as kept in struct PMTM_timer_hot.
+ @{ */
+#define PMTM_PHASE_STOPPED 0 /**< Not timing a block. */
+#define PMTM_PHASE_RUNNING 1 /**< Timing a block. */
+#define PMTM_PHASE_PAUSED  2 /**< Timing a block, but paused. */
+#define PMTM_PHASE_IGNORED 3 /**< Started, or stopped, in a block skipped by the sample mode. */
+/* @} */
+
+/**
+ * The fields of a timer that are used by the timer control routines. This is
+ * the first member of struct PMTM_timer, so a PMTM_timer_t can be used to
+ * reach it without any lookup, and it fits in one cache line so that starting
+ * and stopping a timer touches only that line. Everything else about a timer,
+ * including the sample mode, is kept after it in struct PMTM_timer.
+ *
+ * The current block is kept as a single count per clock: starting the timer
+ * sets it to minus the clock, pausing adds the clock and continuing subtracts
+ * it again, so when the timer is stopped (or paused) it holds the ticks timed
+ * in the block.
+ *
+ * The counts are 64 bits, as a hot timer can be started more than 2^32 times
+ * in a long run. To fit the line, the flags share a word with the top of the
+ * sum of the squared ticks, which keeps 116 bits: enough for 10^9 blocks of an
+ * hour each. Use pmtm_timer_square to read the sum.
+ */
+struct PMTM_timer_hot
+{
+    pmtm_tick_t block_wc;           /**< The wallclock ticks of the current or last block, see above. */
+    pmtm_tick_t block_cpu;          /**< The cpu ticks of the current or last block, see above. */
+    pmtm_tick_t total_wc;           /**< The total wallclock ticks that have been counted. */
+    pmtm_tick_t total_cpu;          /**< The total cpu ticks that have been counted. */
+    uint64_t timer_count;           /**< The number of times this timer has been started & stopped. */
+    uint64_t pause_count;           /**< The number of times this timer has been paused. */
+    uint64_t total_square_wc_lo;    /**< The bottom 64 bits of the sum of the squared wallclock ticks (for stddev). */
+    uint64_t total_square_wc_hi : 52; /**< The top 52 bits of the sum of the squared wallclock ticks. */
+    uint64_t measure : 9;           /**< The clocks this timer reads, see the PMTM_MEASURE_* constants in pmtm.h. */
+    uint64_t phase : 2;             /**< One of the PMTM_PHASE_* constants. */
+    uint64_t sampled : 1;           /**< Whether this timer has a sample mode, see pmtm_sample_timer. */
+};
+
+/**
+ * The clocks of a timer when it was last started or continued. Only the
+ * PMTM_get_cpu_time and PMTM_get_wc_time queries, and a stop of a stopped timer,
+ * read them, so they follow the hot fields in struct PMTM_timer, on the next
+ * cache line, rather than taking space in it.
+ */
+struct PMTM_timer_mark
+{
+    pmtm_tick_t wc;                 /**< The wallclock ticks when the timer was last started or continued. */
+    pmtm_tick_t cpu;                /**< The cpu ticks when the timer was last started or continued. */
+};
+
+/**
+ * @returns the clocks of the last start or continue of a timer, which follow
+ *          its hot fields.
+ */
+static inline struct PMTM_timer_mark * pmtm_timer_mark(struct PMTM_timer_hot * timer)
+{
+    return (struct PMTM_timer_mark *) (timer + 1);
+}
+
+/**
+ * @returns the sum of the squared wallclock ticks of a timer.
+ */
+static inline pmtm_square_t pmtm_timer_square(const struct PMTM_timer_hot * timer)
+{
+#ifdef __SIZEOF_INT128__
+    return ((pmtm_square_t) timer->total_square_wc_hi << 64) | timer->total_square_wc_lo;
+#else
+    return timer->total_square_wc_hi * 18446744073709551616.0L + timer->total_square_wc_lo;
+#endif
+}
+
+/**
+ * Set the sum of the squared wallclock ticks of a timer.
+ *
+ * @param timer  [IN/OUT] The timer.
+ * @param square [IN]     The sum.
+ */
+static inline void pmtm_set_timer_square(struct PMTM_timer_hot * timer, pmtm_square_t square)
+{
+#ifdef __SIZEOF_INT128__
+    timer->total_square_wc_hi = (uint64_t) (square >> 64);
+    timer->total_square_wc_lo = (uint64_t) square;
+#else
+    const long double word = 18446744073709551616.0L;
+    uint64_t hi = (uint64_t) (square / word);
+    timer->total_square_wc_hi = hi;
+    timer->total_square_wc_lo = (uint64_t) (square - hi * word);
+#endif
+}
+
+/**
+ * Add the square of the ticks of a block to the sum of a timer.
+ *
+ * @param timer [IN/OUT] The timer.
+ * @param ticks [IN]     The wallclock ticks of the block.
+ */
+static inline void pmtm_add_timer_square(struct PMTM_timer_hot * timer, pmtm_tick_t ticks)
+{
+#ifdef __SIZEOF_INT128__
+    unsigned __int128 square = (unsigned __int128) ticks * ticks;
+    uint64_t square_lo = (uint64_t) square;
+    uint64_t square_hi = (uint64_t) (square >> 64);
+#else
+    /* The 128 bit square from four 32 bit products. */
+    uint64_t lo = ticks & 0xFFFFFFFFu, hi = ticks >> 32;
+    uint64_t cross = lo * hi;
+    uint64_t square_lo = lo * lo + (cross << 33);
+    uint64_t square_hi = hi * hi + (cross >> 31) + (square_lo < (cross << 33));
+#endif
+    timer->total_square_wc_lo += square_lo;
+    timer->total_square_wc_hi += square_hi + (timer->total_square_wc_lo < square_lo);
+}
+
+PMTM_BOOL pmtm_sample_timer(struct PMTM_timer_hot * timer);
+
+#ifdef __linux__
+static inline pmtm_tick_t pmtm_fast_read_timespec(clockid_t clock_id)
+{
+    struct timespec ts;
+    clock_gettime(clock_id, &ts);
+    return (pmtm_tick_t) ts.tv_sec * PMTM_TICKS_PER_SECOND + ts.tv_nsec;
+}
+#endif
+
+/**
+ * Read the elapsed time from the selected clock backend, as read_clock does.
+ *
+ * @returns the elapsed time in ticks of PMTM_TICKS_PER_SECOND.
+ */
+static inline pmtm_tick_t pmtm_fast_read_clock()
+{
+    switch (pmtm_clock_state.clock_id) {
+#ifdef __linux__
+        case INTERNAL__CLOCK_MONOTONIC:
+            return pmtm_fast_read_timespec(CLOCK_MONOTONIC);
+#  ifdef CLOCK_MONOTONIC_COARSE
+        case INTERNAL__CLOCK_COARSE:
+            return pmtm_fast_read_timespec(CLOCK_MONOTONIC_COARSE);
+#  endif
+#endif
+#ifdef PMTM_FAST_HAVE_TSC
+        case INTERNAL__CLOCK_TSC: {
+            unsigned int aux;
+            uint64_t tsc = pmtm_clock_state.use_rdtscp ? __rdtscp(&aux) : __rdtsc();
+            return (pmtm_tick_t) (((unsigned __int128) tsc * pmtm_clock_state.tsc_mult) >> PMTM_TSC_SHIFT);
+        }
+#endif
+        default:
+            return read_clock();
+    }
+}
+
+/**
+ * Read the CPU clock of a timer, as the library does.
+ *
+ * @param timer [IN] The timer whose CPU clock to read.
+ * @returns the CPU time in ticks of PMTM_TICKS_PER_SECOND.
+ */
+static inline pmtm_tick_t pmtm_fast_read_cpu_clock(const struct PMTM_timer_hot * timer)
+{
+#ifdef __linux__
+    if (pmtm_clock_state.clock_id >= 0) {
+        return pmtm_fast_read_timespec((timer->measure & INTERNAL__MEASURE_THREAD_CPU)
+                                       ? CLOCK_THREAD_CPUTIME_ID : CLOCK_PROCESS_CPUTIME_ID);
+    }
+#endif
+    return (timer->measure & INTERNAL__MEASURE_THREAD_CPU) ? read_thread_cpu_clock() : read_cpu_clock();
+}
+
+/**
+ * Read the clocks measured by a timer. A clock which the timer does not measure
+ * is not read and is returned as zero.
+ *
+ * @param timer    [IN]  The timer whose clocks to read.
+ * @param cpu_time [OUT] The CPU time in ticks.
+ * @param wc_time  [OUT] The wallclock time in ticks.
+ */
+static inline void pmtm_fast_read_timer_clocks(
+        const struct PMTM_timer_hot * timer,
+        pmtm_tick_t * cpu_time,
+        pmtm_tick_t * wc_time)
+{
+    *cpu_time = (timer->measure & INTERNAL__MEASURE_CPU) ? pmtm_fast_read_cpu_clock(timer) : 0;
+    *wc_time  = (timer->measure & INTERNAL__MEASURE_WC)  ? pmtm_fast_read_clock()          : 0;
+}
+
+/**
+ * Start a timer, unless its sample mode says this call should be skipped.
+ *
+ * @param timer [IN] The timer to start.
+ * @returns INTERNAL__TRUE if the timer was started.
+ */
+static inline PMTM_BOOL pmtm_fast_start(struct PMTM_timer_hot * timer)
+{
+    if (timer->sampled && !pmtm_sample_timer(timer)) {
+        timer->phase = PMTM_PHASE_IGNORED;
+        return INTERNAL__FALSE;
+    }
+
+    struct PMTM_timer_mark * mark = pmtm_timer_mark(timer);
+    pmtm_fast_read_timer_clocks(timer, &mark->cpu, &mark->wc);
+
+    timer->block_wc  = 0 - mark->wc;
+    timer->block_cpu = 0 - mark->cpu;
+    timer->phase = PMTM_PHASE_RUNNING;
+    return INTERNAL__TRUE;
+}
+
+/**
+ * Stop a timer, adding the time of the block to its totals. Everything is kept
+ * in ticks, it is converted to seconds when the timer is printed.
+ *
+ * Stopping a stopped timer counts the last block again, extended to now from
+ * the last start or continue, as it always has.
+ *
+ * @param timer [IN] The timer to stop.
+ * @returns INTERNAL__TRUE if the timer was counted.
+ */
+static inline PMTM_BOOL pmtm_fast_stop(struct PMTM_timer_hot * timer)
+{
+    PMTM_BOOL counted = (timer->phase != PMTM_PHASE_IGNORED);
+
+    if (counted) {
+        if (timer->phase != PMTM_PHASE_PAUSED) {
+            pmtm_tick_t cpu_time, wc_time;
+            pmtm_fast_read_timer_clocks(timer, &cpu_time, &wc_time);
+
+            if (timer->phase == PMTM_PHASE_STOPPED) {
+                const struct PMTM_timer_mark * mark = pmtm_timer_mark(timer);
+                timer->block_wc  -= mark->wc;
+                timer->block_cpu -= mark->cpu;
+            }
+            timer->block_wc  += wc_time;
+            timer->block_cpu += cpu_time;
+        }
+
+        timer->total_wc        += timer->block_wc;
+        pmtm_add_timer_square(timer, timer->block_wc);
+        timer->total_cpu       += timer->block_cpu;
+
+        ++timer->timer_count;
+        timer->phase = PMTM_PHASE_STOPPED;
+    }
+
+    return counted;
+}
+
+/**
+ * Pause a timer, adding the time since it was started or continued to the
+ * current block.
+ *
+ * @param timer [IN] The timer to pause.
+ */
+static inline void pmtm_fast_pause(struct PMTM_timer_hot * timer)
+{
+    if (timer->phase == PMTM_PHASE_RUNNING) {
+        pmtm_tick_t cpu_time, wc_time;
+        pmtm_fast_read_timer_clocks(timer, &cpu_time, &wc_time);
+
+        timer->block_wc  += wc_time;
+        timer->block_cpu += cpu_time;
+        ++timer->pause_count;
+        timer->phase = PMTM_PHASE_PAUSED;
+    }
+}
+
+/**
+ * Continue a paused timer.
+ *
+ * @param timer [IN] The timer to continue.
+ */
+static inline void pmtm_fast_continue(struct PMTM_timer_hot * timer)
+{
+    if (timer->phase == PMTM_PHASE_PAUSED) {
+        struct PMTM_timer_mark * mark = pmtm_timer_mark(timer);
+        pmtm_fast_read_timer_clocks(timer, &mark->cpu, &mark->wc);
+
+        timer->block_wc  -= mark->wc;
+        timer->block_cpu -= mark->cpu;
+        timer->phase = PMTM_PHASE_RUNNING;
+    }
+}
+
+#if defined(PMTM_DEBUG) || defined(HW_COUNTERS)
+
+static inline void PMTM_fast_timer_start(PMTM_timer_t timer)    { PMTM_timer_start(timer); }
+static inline void PMTM_fast_timer_stop(PMTM_timer_t timer)     { PMTM_timer_stop(timer); }
+static inline void PMTM_fast_timer_pause(PMTM_timer_t timer)    { PMTM_timer_pause(timer); }
+static inline void PMTM_fast_timer_continue(PMTM_timer_t timer) { PMTM_timer_continue(timer); }
+
+#else
+
+/**
+ * Inline version of PMTM_timer_start.
+ *
+ * @param timer [IN] The timer to start.
+ */
+static inline void PMTM_fast_timer_start(PMTM_timer_t timer)
+{
+    pmtm_fast_start((struct PMTM_timer_hot *) timer);
+}
+
+/**
+ * Inline version of PMTM_timer_stop.
+ *
+ * @param timer [IN] The timer to stop.
+ */
+static inline void PMTM_fast_timer_stop(PMTM_timer_t timer)
+{
+    pmtm_fast_stop((struct PMTM_timer_hot *) timer);
+}
+
+/**
+ * Inline version of PMTM_timer_pause.
+ *
+ * @param timer [IN] The timer to pause.
+ */
+static inline void PMTM_fast_timer_pause(PMTM_timer_t timer)
+{
+    pmtm_fast_pause((struct PMTM_timer_hot *) timer);
+}
+
+/**
+ * Inline version of PMTM_timer_continue.
+ *
+ * @param timer [IN] The timer to continue.
+ */
+static inline void PMTM_fast_timer_continue(PMTM_timer_t timer)
+{
+    pmtm_fast_continue((struct PMTM_timer_hot *) timer);
+}
+
+#endif
+
+#ifdef PMTM_FAST_TIMERS
+#  define PMTM_timer_start    PMTM_fast_timer_start
+#  define PMTM_timer_stop     PMTM_fast_timer_stop
+#  define PMTM_timer_pause    PMTM_fast_timer_pause
+#  define PMTM_timer_continue PMTM_fast_timer_continue
+#endif
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _PMTM_INCLUDE_PMTM_FAST_H */
@@ -13,15 +13,18 @@
 #include "pmtm_internal.h"
 #include "pmtm_defines.h"
 
+#include <ctype.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
+#include <strings.h>
 #include <math.h>
 #include <time.h>
 #include <float.h>
 #include <limits.h>
 #include <stdarg.h>
+#include <inttypes.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
@@ -46,6 +49,11 @@ const PMTM_timer_type_t PMTM_TIMER_MMA  = INTERNAL__TIMER_MMA | INTERNAL__TIMER_
 const PMTM_timer_type_t PMTM_TIMER_INT  = INTERNAL__TIMER_INT;
 const PMTM_timer_type_t PMTM_TIMER_AVO  = INTERNAL__TIMER_AVO;
 
+const PMTM_timer_type_t PMTM_MEASURE_WC  = INTERNAL__MEASURE_WC;
+const PMTM_timer_type_t PMTM_MEASURE_CPU = INTERNAL__MEASURE_CPU;
+const PMTM_timer_type_t PMTM_MEASURE_THREAD_CPU = INTERNAL__MEASURE_CPU | INTERNAL__MEASURE_THREAD_CPU;
+const PMTM_timer_type_t PMTM_MEASURE_ALL = INTERNAL__MEASURE_WC | INTERNAL__MEASURE_CPU;
+
 
 const PMTM_output_type_t PMTM_OUTPUT_ALL_RANKS = INTERNAL__OUTPUT_ALL_RANKS;
 const PMTM_output_type_t PMTM_OUTPUT_ALWAYS    = INTERNAL__OUTPUT_ALWAYS;
@@ -63,52 +71,74 @@ const int PMTM_DEFAULT_MAX  = INTERNAL__NO_MAX;
 // const PMTM_option_t PMTM_OPTION_NO_LOCAL_COPY = INTERNAL__OPTION_NO_LOCAL_COPY;
 // const PMTM_option_t PMTM_OPTION_NO_STORED_COPY = INTERNAL__OPTION_NO_STORED_COPY;
 
-size_t instance_count = 0;
-size_t group_count    = 0;
-size_t timer_count    = 0;
+// Bumped whenever timers are destroyed, so handles cached by PMTM_CACHED_TIMER
+// before then are known to be stale. Starts at 1 so an unset cache never matches.
+unsigned int pmtm_timer_generation = 1;
 
 //struct PMTM_instance       * instance_array = NULL;
 //struct PMTM_timer_group    * group_array    = NULL;
 //struct PMTM_timer       * timer_array    = NULL;
 
-// Making these three containers lists allows the data items to stay in a fixed
-// location after creation and as such there is no need to lock the structures other
-// than during the addition of extra objects. Modification to the contained objects
-// does not require locking providing the calling process can guarantee two threads
-// will not try to update the same object simultaneously.
-// 
-// The only problem is potentially for anything accessing the group_ids and timer_ids
-// arrays in the instance and timer group objects which can move when new entries are
-// added. However, the only thing that does that beyond creation is the print routine,
-// which I think only happens when the instance is shutting down anyway, I hope...
+// The instances and groups are found through ID tables, arrays of pointers indexed
+// by the integer IDs handed back to the application, so get_instance and
+// get_timer_group are a bounds check and a load. The objects themselves are
+// allocated one at a time and stay in a fixed location after creation, so there is
+// no need to lock them other than during the addition of extra objects. Modification
+// to the contained objects does not require locking providing the calling process
+// can guarantee two threads will not try to update the same object simultaneously.
+//
+// A table doubles in size when it is full. The arrays it outgrows are kept until
+// finalize rather than freed, so a thread looking up an ID while another adds a
+// group under the pmtm lock never reads freed memory.
 //
-// Linked lists aren't very efficient for searches typically. That does happen for the
-// instance and group lists as their IDs are returned are integer place holders. The
-// expectation is that there is unlikely to be many of them, in many cases may be only
-// one of each or single figures worth. Also, they only really get accessed during
-// timer creation and not at all after until printing and destruction.
+// The group_ids and parameters arrays of an instance grow geometrically with
+// grow_array and so can move when new entries are added. The only things that use
+// them beyond creation are the parameter routines, which hold the instance, and the
+// print routine, which only happens when the instance is shutting down anyway.
+// The parameters are also found by name through the parameter_index of the
+// instance, rather than by comparing every stored name.
 //
 // There will be more timers, but their ID is the actual object pointer so no lookups
-// are needed. A side benefit for the timers of the linked list is that each thread
-// gets to allocate its own timers in memory. This means each will keep its timers in
-// local memory if possible where as an array or bucket scheme would be more likely
-// to position things remotely and likely lead to some false sharing. If a linked
-// list becomes wasteful of space, then some kind of chunking scheme with thread
-// specific pools is probably best. However, there is unlikely to be many more than
-// a few hundred timers in most cases which should not create a problem.
-
-struct PMTM_instance       * instance_head = NULL;
-struct PMTM_instance       ** instance_tail = &instance_head;
-struct PMTM_timer_group    * group_head = NULL;
-struct PMTM_timer_group    ** group_tail = &group_head;
-struct PMTM_timer          * timer_head = NULL;
-struct PMTM_timer          ** timer_tail = &timer_head;
+// are needed. Each timer group keeps a timer list for each thread (its PMTM_timer_store),
+// so a thread adds its timers to its own list without taking a lock and allocates them
+// itself, keeping them in its local memory. Each list has its own hashed name index
+// for find_timer. The lists are only merged into the group timer_ids array by
+// merge_timer_store when the timers are output, by which time all activity in the
+// threads should have ceased.
+
+/**
+ * A table of objects indexed by their integer IDs.
+ */
+struct PMTM_id_table
+{
+    void ** entries;                        /**< The objects, indexed by ID. */
+    size_t count;                           /**< The number of IDs handed out. */
+    size_t capacity;                        /**< The number of entries there is room for. */
+    int num_retired;                        /**< The number of arrays in retired. */
+    void ** retired[sizeof(size_t) * CHAR_BIT]; /**< The entries arrays outgrown, freed by id_table_free. */
+};
+
+struct PMTM_id_table instance_table = { NULL, 0, 0, 0, { NULL } };
+struct PMTM_id_table group_table    = { NULL, 0, 0, 0, { NULL } };
+
+static int  id_table_add(struct PMTM_id_table * table, void * entry);
+static void id_table_free(struct PMTM_id_table * table);
+static uint32_t hash_name(const char * name);
 
 const char ** flag_array = NULL;
 uint flag_array_sz       = 0;
 PMTM_BOOL output_env     = PMTM_TRUE;
 PMTM_BOOL no_local_copy  = PMTM_FALSE;
 PMTM_BOOL no_stored_copy = PMTM_FALSE;
+PMTM_BOOL node_stats     = PMTM_FALSE;
+PMTM_BOOL writer_thread  = PMTM_FALSE;
+PMTM_BOOL collective_write = PMTM_FALSE;
+PMTM_BOOL rank_files     = PMTM_FALSE;
+size_t stream_buffer     = 0;
+double collapse_ranks    = -1;
+struct PMTM_rank_sample rank_sample = { -1, 0, 0 };
+int clock_request        = INTERNAL__CLOCK_MONOTONIC;
+PMTM_BOOL clock_chosen   = PMTM_FALSE;
 
 char * pmtm_file_store = NULL; 
 
@@ -160,12 +190,252 @@ PMTM_error_t set_option(PMTM_option_t option, PMTM_BOOL value)
 	case PMTM_OPTION_NO_STORED_COPY:
 	    no_stored_copy = value;
 	    break;
+        case PMTM_OPTION_NODE_STATS:
+            node_stats = value;
+            break;
+        case PMTM_OPTION_WRITER_THREAD:
+            writer_thread = value;
+            break;
+        case PMTM_OPTION_COLLECTIVE_WRITE:
+            collective_write = value;
+            break;
+        case PMTM_OPTION_RANK_FILES:
+            rank_files = value;
+            break;
+        case PMTM_OPTION_CLOCK_MONOTONIC:
+            request_clock(INTERNAL__CLOCK_MONOTONIC, value);
+            break;
+        case PMTM_OPTION_CLOCK_COARSE:
+            request_clock(INTERNAL__CLOCK_COARSE, value);
+            break;
+        case PMTM_OPTION_CLOCK_TSC:
+            request_clock(INTERNAL__CLOCK_TSC, value);
+            break;
+        case PMTM_OPTION_CLOCK_MPI:
+            request_clock(INTERNAL__CLOCK_MPI, value);
+            break;
         default:
             return PMTM_ERROR_UNKNOWN_OPTION;
     }
     return PMTM_SUCCESS;
 }
 
+/**
+ * Request (or withdraw the request for) a clock backend. The request only
+ * takes effect at the next PMTM_init, see choose_clock.
+ *
+ * @param clock_id [IN] One of the INTERNAL__CLOCK_* ids.
+ * @param value    [IN] Whether to use this clock, turning off the requested
+ *                      clock goes back to the monotonic clock.
+ */
+void request_clock(int clock_id, PMTM_BOOL value)
+{
+    if (value == PMTM_TRUE) {
+        clock_request = clock_id;
+    } else if (clock_request == clock_id) {
+        clock_request = INTERNAL__CLOCK_MONOTONIC;
+    }
+}
+
+/**
+ * Select the clock backend used for wallclock times. The clock requested with
+ * PMTM_set_option can be overridden by a PMTM_CLOCK line in a .pmtmrc file,
+ * which can in turn be overridden by the PMTM_CLOCK environment variable. The
+ * clock is only chosen once per initialisation so that no timer is ever
+ * measured against two different clocks.
+ */
+void choose_clock()
+{
+    if (clock_chosen == PMTM_TRUE) {
+        return;
+    }
+
+    const char * clock_name = getenv("PMTM_CLOCK");
+    if (clock_name != NULL && clock_name[0] != '\0') {
+        int clock_id = get_clock_id_from_name(clock_name);
+        if (clock_id < 0) {
+            pmtm_warn("Unknown clock in PMTM_CLOCK: %s", clock_name);
+        } else {
+            clock_request = clock_id;
+        }
+    }
+
+    /* The portable backend stands in gettimeofday for the default monotonic
+     * clock, which only deserves a warning if another clock was asked for. */
+    int clock_id = select_clock(clock_request);
+    if (clock_id != clock_request
+            && (clock_request != INTERNAL__CLOCK_MONOTONIC || clock_id != INTERNAL__CLOCK_GETTIMEOFDAY)) {
+        pmtm_warn("The %s clock is not available, using the %s clock instead",
+                get_clock_name(clock_request), get_clock_name(clock_id));
+    }
+    clock_chosen = PMTM_TRUE;
+}
+
+/**
+ * Read a buffer size in bytes, which may end in K, M or G.
+ *
+ * @param text [IN]  The size, e.g. "64M".
+ * @param size [OUT] The size in bytes, unchanged if the text is bad.
+ * @returns 0 if successful, 1 if the text is not a size.
+ */
+int parse_buffer_size(const char * text, size_t * size)
+{
+    char * end;
+    unsigned long long value = strtoull(text, &end, 10);
+
+    if (end == text) {
+        return 1;
+    }
+
+    switch (toupper((unsigned char) *end)) {
+        case 'G': value *= 1024; /* fall through */
+        case 'M': value *= 1024; /* fall through */
+        case 'K': value *= 1024; ++end; /* fall through */
+        case '\0': break;
+        default: return 1;
+    }
+    if (*end != '\0') {
+        return 1;
+    }
+
+    *size = (size_t) value;
+    return 0;
+}
+
+/**
+ * Get the size of the buffer for streaming the timers to the IO_RANK, set by
+ * a PMTM_STREAM_BUFFER line in a .pmtmrc file, which can be overridden by the
+ * PMTM_STREAM_BUFFER environment variable.
+ *
+ * @returns the size in bytes, or 0 to gather all the timers at once.
+ */
+size_t get_stream_buffer()
+{
+    const char * buffer_size = getenv("PMTM_STREAM_BUFFER");
+    size_t size = stream_buffer;
+
+    if (buffer_size != NULL && buffer_size[0] != '\0' && parse_buffer_size(buffer_size, &size) != 0) {
+        pmtm_warn("Bad buffer size in PMTM_STREAM_BUFFER: %s", buffer_size);
+        size = stream_buffer;
+    }
+
+    return size;
+}
+
+/**
+ * Parse the relative tolerance of a PMTM_COLLAPSE_RANKS setting, e.g. "0.01"
+ * for 1%.
+ *
+ * @param text      [IN]  The text to parse.
+ * @param tolerance [OUT] The tolerance parsed, unchanged if the text is bad.
+ * @returns 0 if successful, or 1 if the text is not a tolerance of 0 or more.
+ */
+static int parse_tolerance(const char * text, double * tolerance)
+{
+    char * end;
+    double value = strtod(text, &end);
+
+    if (end == text || *end != '\0' || !(value >= 0) || isinf(value)) {
+        return 1;
+    }
+
+    *tolerance = value;
+    return 0;
+}
+
+/**
+ * Get the relative tolerance within which the timers of consecutive ranks are
+ * printed as one line, set by a PMTM_COLLAPSE_RANKS line in a .pmtmrc file,
+ * which can be overridden by the PMTM_COLLAPSE_RANKS environment variable.
+ *
+ * @returns the tolerance, or a negative value to print every rank.
+ */
+double get_collapse_tolerance()
+{
+    const char * tolerance_text = getenv("PMTM_COLLAPSE_RANKS");
+    double tolerance = collapse_ranks;
+
+    if (tolerance_text != NULL && tolerance_text[0] != '\0' && parse_tolerance(tolerance_text, &tolerance) != 0) {
+        pmtm_warn("Bad tolerance in PMTM_COLLAPSE_RANKS: %s", tolerance_text);
+        tolerance = collapse_ranks;
+    }
+
+    return tolerance;
+}
+
+/**
+ * Parse a PMTM_SAMPLE_RANKS setting: a number N to sample every Nth rank, 0
+ * for none but the outliers, or "node" for the lowest rank of each node.
+ *
+ * @param text   [IN]     The text to parse.
+ * @param sample [IN/OUT] The sample, whose ranks are set if the text is good.
+ * @returns 0 if successful, or 1 if the text is bad.
+ */
+static int parse_rank_sample(const char * text, struct PMTM_rank_sample * sample)
+{
+    char * end;
+    long every;
+
+    if (strcasecmp(text, "node") == 0) {
+        sample->every = 0;
+        sample->per_node = 1;
+        return 0;
+    }
+
+    every = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || every < 0 || every > INT_MAX) {
+        return 1;
+    }
+
+    sample->every = (int) every;
+    sample->per_node = 0;
+    return 0;
+}
+
+/**
+ * Parse a PMTM_OUTLIER_RANKS setting, the number of slowest and of fastest
+ * ranks printed for each timer when sampling the ranks.
+ *
+ * @param text     [IN]  The text to parse.
+ * @param outliers [OUT] The number parsed, unchanged if the text is bad.
+ * @returns 0 if successful, or 1 if the text is bad.
+ */
+static int parse_outlier_ranks(const char * text, int * outliers)
+{
+    char * end;
+    long value = strtol(text, &end, 10);
+
+    if (end == text || *end != '\0' || value < 0 || value > PMTM_MAX_OUTLIERS) {
+        return 1;
+    }
+
+    *outliers = (int) value;
+    return 0;
+}
+
+/**
+ * Get which ranks send their timer lines, set by PMTM_SAMPLE_RANKS and
+ * PMTM_OUTLIER_RANKS lines in a .pmtmrc file, which can be overridden by the
+ * environment variables of the same names.
+ *
+ * @param sample [OUT] The ranks sampled, every is negative to gather them all.
+ */
+void get_rank_sample(struct PMTM_rank_sample * sample)
+{
+    const char * sample_text = getenv("PMTM_SAMPLE_RANKS");
+    const char * outlier_text = getenv("PMTM_OUTLIER_RANKS");
+
+    *sample = rank_sample;
+
+    if (sample_text != NULL && sample_text[0] != '\0' && parse_rank_sample(sample_text, sample) != 0) {
+        pmtm_warn("Bad sample in PMTM_SAMPLE_RANKS: %s", sample_text);
+        *sample = rank_sample;
+    }
+    if (outlier_text != NULL && outlier_text[0] != '\0' && parse_outlier_ranks(outlier_text, &sample->outliers) != 0) {
+        pmtm_warn("Bad number of ranks in PMTM_OUTLIER_RANKS: %s", outlier_text);
+    }
+}
+
 /**
  * Get a library option.
  *
@@ -275,9 +545,18 @@ PMTM_error_t construct_instance(
     instance->nranks = nranks;
     instance->rank = rank;
     instance->num_groups = 0;
+    instance->groups_capacity = 0;
     instance->group_ids = NULL;
     instance->num_parameters = 0;
+    instance->parameters_capacity = 0;
     instance->parameters = NULL;
+    instance->parameter_index = NULL;
+    instance->parameter_index_size = 0;
+    memset(&instance->names, 0, sizeof(instance->names));
+    instance->pending_output = NULL;
+    instance->rank_file_name = NULL;
+    instance->rank_file_sections = 0;
+    instance->collapse_tolerance = -1;
 
     copy_string(&instance->application_name, app_name);
     check_for_commas(instance->application_name);
@@ -339,6 +618,8 @@ PMTM_error_t set_file(
         if (err_code != 0) {
             return err_code;
         }
+        choose_clock();
+        instance->collapse_tolerance = get_collapse_tolerance();
     }
 
     if (instance->fid != NULL) {
@@ -414,7 +695,81 @@ PMTM_error_t create_file(
 #endif
     }
     
-    return write_file_header(instance);
+    // The lines are written to the file a few bytes at a time, so give it a
+    // buffer large enough to take many of them per write.
+
+    if (instance->fid != stdout) {
+        setvbuf(instance->fid, NULL, _IOFBF, PMTM_OUTPUT_BUFFER_SIZE);
+    }
+
+    PMTM_error_t err_code = write_file_header(instance);
+
+    // The header is written first, as it reads the .pmtmrc files that can
+    // ask for the writer thread.
+
+    if (err_code == PMTM_SUCCESS && writer_thread && instance->fid != stdout) {
+        FILE * writer = open_writer(instance->fid);
+        if (writer != NULL) {
+            instance->fid = writer;
+        } else {
+            pmtm_warn("Could not start the writer thread, writing %s directly", instance->file_name);
+        }
+    }
+
+    return err_code;
+}
+
+/**
+ * Close the output file of an instance for a while, so that the ranks can
+ * write to it with MPI-IO, see resume_file. Everything printed so far is
+ * written first, including by the writer thread.
+ *
+ * @param instance [IN]  The instance whose file is closed, at the IO_RANK.
+ * @param size     [OUT] The size of the file.
+ * @returns PMTM_SUCCESS, or PMTM_ERROR_CANNOT_CREATE_FILE if the file could
+ *          not be written, in which case it is left closed.
+ */
+PMTM_error_t suspend_file(
+        struct PMTM_instance * instance,
+        long * size)
+{
+    struct stat buf;
+    int status = fclose(instance->fid);
+
+    instance->fid = NULL;
+    if (status != 0 || stat(instance->file_name, &buf) != 0) {
+        return PMTM_ERROR_CANNOT_CREATE_FILE;
+    }
+
+    *size = (long) buf.st_size;
+    return PMTM_SUCCESS;
+}
+
+/**
+ * Open the output file of an instance again after suspend_file, to carry on
+ * printing at its end.
+ *
+ * @param instance [IN] The instance whose file is opened, at the IO_RANK.
+ * @returns PMTM_SUCCESS, or PMTM_ERROR_CANNOT_CREATE_FILE if the file could
+ *          not be opened, in which case nothing more is printed to it.
+ */
+PMTM_error_t resume_file(struct PMTM_instance * instance)
+{
+    instance->fid = fopen(instance->file_name, "a");
+    if (instance->fid == NULL) {
+        return PMTM_ERROR_CANNOT_CREATE_FILE;
+    }
+
+    setvbuf(instance->fid, NULL, _IOFBF, PMTM_OUTPUT_BUFFER_SIZE);
+
+    if (writer_thread) {
+        FILE * writer = open_writer(instance->fid);
+        if (writer != NULL) {
+            instance->fid = writer;
+        }
+    }
+
+    return PMTM_SUCCESS;
 }
 
 /**
@@ -506,9 +861,73 @@ PMTM_error_t write_file_header(struct PMTM_instance * instance)
     return PMTM_SUCCESS;
 }
 
+/**
+ * Measure the start/stop and pause/continue overheads of a timer which reads
+ * the given clocks, and print them to the output file of the given instance.
+ *
+ * @param instance         [IN] The instance to whose output file we are writing.
+ * @param measure          [IN] The PMTM_MEASURE_* flags of the timer to measure.
+ * @param suffix           [IN] The suffix added to the names of the overhead lines.
+ * @param overhead_repeats [IN] The number of timed blocks.
+ * @param timer_repeats    [IN] The number of timer calls in each timed block.
+ * @returns PMTM_SUCCESS if successful, or one of PMTM_ERROR_* codes if not.
+ */
+static PMTM_error_t calc_timer_overhead(
+        const struct PMTM_instance * instance,
+        PMTM_timer_type_t measure,
+        const char * suffix,
+        uint overhead_repeats,
+        uint timer_repeats)
+{
+    struct PMTM_timer timer[3];
+    char name[32];
+
+    RETURN_ON_ERR(construct_timer(&timer[0], "", INTERNAL__TIMER_NONE | measure));
+    snprintf(name, sizeof(name), "start-stop%s", suffix);
+    RETURN_ON_ERR(construct_timer(&timer[1], name, INTERNAL__TIMER_NONE));
+    snprintf(name, sizeof(name), "pause-continue%s", suffix);
+    RETURN_ON_ERR(construct_timer(&timer[2], name, INTERNAL__TIMER_NONE));
+
+    uint repeat_idx;
+    for (repeat_idx = 0; repeat_idx < overhead_repeats; ++repeat_idx) {
+        /* Start/Stop overhead. */
+        start_timer(&timer[1]);
+        uint ss_idx;
+        for (ss_idx = 0; ss_idx < timer_repeats; ++ss_idx) {
+            start_timer(&timer[0]);
+            stop_timer(&timer[0]);
+        }
+        stop_timer(&timer[1]);
+
+        start_timer(&timer[0]);
+
+        /* Pause/Continue overhead. */
+        start_timer(&timer[2]);
+        uint pc_idx;
+        for (pc_idx = 0; pc_idx < timer_repeats; ++pc_idx) {
+            pause_timer(&timer[0]);
+            continue_timer(&timer[0]);
+        }
+        stop_timer(&timer[2]);
+
+        stop_timer(&timer[0]);
+    }
+
+    print_overhead(instance, &timer[1], timer_repeats);
+    print_overhead(instance, &timer[2], timer_repeats);
+
+    destruct_timer(&timer[0]);
+    destruct_timer(&timer[1]);
+    destruct_timer(&timer[2]);
+
+    return PMTM_SUCCESS;
+}
+
 /**
  * Perform the overhead calculations and print the times to the output file of
- * the given instance.
+ * the given instance. The timer overheads depend on which clocks a timer reads
+ * so they are given for each measurement mask, the default mask keeping the
+ * original line names. They are followed by the cost of a single clock read.
  *
  * @param instance [IN] The instance for which to perform the calculations.
  * @returns PMTM_SUCCESS if successful, or one of PMTM_ERROR_* codes if not.
@@ -516,46 +935,37 @@ PMTM_error_t write_file_header(struct PMTM_instance * instance)
 PMTM_error_t calc_overhead(const struct PMTM_instance * instance)
 {
     if (instance->rank == IO_RANK) {
-        struct PMTM_timer timer[3];
-
-        RETURN_ON_ERR(construct_timer(&timer[0], "", INTERNAL__TIMER_NONE));
-        RETURN_ON_ERR(construct_timer(&timer[1], "start-stop", INTERNAL__TIMER_NONE));
-        RETURN_ON_ERR(construct_timer(&timer[2], "pause-continue", INTERNAL__TIMER_NONE));
+        const PMTM_timer_type_t measures[] = { MEASURE_DEFAULT, INTERNAL__MEASURE_WC };
+        const char * suffixes[]            = { "",              "-wc" };
+        const uint num_measures = sizeof(measures) / sizeof(measures[0]);
 
         const uint overhead_repeats = 20;
         const uint timer_repeats    = 10000;
 
-        uint repeat_idx;
-        for (repeat_idx = 0; repeat_idx < overhead_repeats; ++repeat_idx) {
-            /* Start/Stop overhead. */
-            start_timer(&timer[1]);
-            uint ss_idx;
-            for (ss_idx = 0; ss_idx < timer_repeats; ++ss_idx) {
-                start_timer(&timer[0]);
-                stop_timer(&timer[0]);
-            }
-            stop_timer(&timer[1]);
+        uint measure_idx;
+        for (measure_idx = 0; measure_idx < num_measures; ++measure_idx) {
+            RETURN_ON_ERR(calc_timer_overhead(instance, measures[measure_idx], suffixes[measure_idx],
+                                              overhead_repeats, timer_repeats));
+        }
 
-            start_timer(&timer[0]);
+        volatile pmtm_tick_t clock_sink = 0;
+        struct PMTM_timer timer;
 
-            /* Pause/Continue overhead. */
-            start_timer(&timer[2]);
-            uint pc_idx;
-            for (pc_idx = 0; pc_idx < timer_repeats; ++pc_idx) {
-                pause_timer(&timer[0]);
-                continue_timer(&timer[0]);
-            }
-            stop_timer(&timer[2]);
+        RETURN_ON_ERR(construct_timer(&timer, "clock-read", INTERNAL__TIMER_NONE));
 
-            stop_timer(&timer[0]);
+        uint repeat_idx;
+        for (repeat_idx = 0; repeat_idx < overhead_repeats; ++repeat_idx) {
+            start_timer(&timer);
+            uint cr_idx;
+            for (cr_idx = 0; cr_idx < timer_repeats; ++cr_idx) {
+                clock_sink += read_clock();
+            }
+            stop_timer(&timer);
         }
 
-        print_overhead(instance, &timer[1], timer_repeats);
-        print_overhead(instance, &timer[2], timer_repeats);
+        print_clock_overhead(instance, &timer, timer_repeats);
 
-        destruct_timer(&timer[0]);
-        destruct_timer(&timer[1]);
-        destruct_timer(&timer[2]);
+        destruct_timer(&timer);
     }
 
     return PMTM_SUCCESS;
@@ -644,6 +1054,75 @@ PMTM_BOOL isVariable(char * line, ssize_t lsize)
 	      no_stored_copy = PMTM_TRUE;
 	    }
 	}
+	else if(strncmp(line,"PMTM_OPTION_NODE_STATS", 22) == 0)
+	{
+	    if(   parseVal[0] != '\0'
+	       && strncmp(parseVal,"0",1)  != 0
+	       && strncmp(toUpper(parseVal),"FALSE",5) != 0)
+	    {
+	      node_stats = PMTM_TRUE;
+	    }
+	}
+	else if(strncmp(line,"PMTM_OPTION_WRITER_THREAD", 25) == 0)
+	{
+	    if(   parseVal[0] != '\0'
+	       && strncmp(parseVal,"0",1)  != 0
+	       && strncmp(toUpper(parseVal),"FALSE",5) != 0)
+	    {
+	      writer_thread = PMTM_TRUE;
+	    }
+	}
+	else if(strncmp(line,"PMTM_OPTION_COLLECTIVE_WRITE", 28) == 0)
+	{
+	    if(   parseVal[0] != '\0'
+	       && strncmp(parseVal,"0",1)  != 0
+	       && strncmp(toUpper(parseVal),"FALSE",5) != 0)
+	    {
+	      collective_write = PMTM_TRUE;
+	    }
+	}
+	else if(strncmp(line,"PMTM_OPTION_RANK_FILES", 22) == 0)
+	{
+	    if(   parseVal[0] != '\0'
+	       && strncmp(parseVal,"0",1)  != 0
+	       && strncmp(toUpper(parseVal),"FALSE",5) != 0)
+	    {
+	      rank_files = PMTM_TRUE;
+	    }
+	}
+	else if(strncmp(line,"PMTM_STREAM_BUFFER", 18) == 0)
+	{
+	    if (parse_buffer_size(parseVal, &stream_buffer) != 0) {
+	      pmtm_warn("Bad buffer size in .pmtmrc: %s", parseVal);
+	    }
+	}
+	else if(strncmp(line,"PMTM_COLLAPSE_RANKS", 19) == 0)
+	{
+	    if (parse_tolerance(parseVal, &collapse_ranks) != 0) {
+	      pmtm_warn("Bad tolerance in .pmtmrc: %s", parseVal);
+	    }
+	}
+	else if(strncmp(line,"PMTM_SAMPLE_RANKS", 17) == 0)
+	{
+	    if (parse_rank_sample(parseVal, &rank_sample) != 0) {
+	      pmtm_warn("Bad sample in .pmtmrc: %s", parseVal);
+	    }
+	}
+	else if(strncmp(line,"PMTM_OUTLIER_RANKS", 18) == 0)
+	{
+	    if (parse_outlier_ranks(parseVal, &rank_sample.outliers) != 0) {
+	      pmtm_warn("Bad number of ranks in .pmtmrc: %s", parseVal);
+	    }
+	}
+	else if(strncmp(line,"PMTM_CLOCK", 10) == 0)
+	{
+	    int clock_id = get_clock_id_from_name(parseVal);
+	    if (clock_id < 0) {
+	      pmtm_warn("Unknown clock in .pmtmrc: %s", parseVal);
+	    } else {
+	      clock_request = clock_id;
+	    }
+	}
 	else if(strncmp(line,"PMTM_OPTION_OUTPUT_ENV", 22) == 0)
 	{
 	    if(   parseVal[0] == '\0'
@@ -785,6 +1264,7 @@ void destruct_instance(struct PMTM_instance * instance)
 
         free(instance->application_name);
         free(instance->file_name);
+        free(instance->rank_file_name);
 
         uint group_idx;
         for (group_idx = 0; group_idx < instance->num_groups; ++group_idx) {
@@ -792,6 +1272,9 @@ void destruct_instance(struct PMTM_instance * instance)
             destruct_timer_group(group);
         }
         free(instance->group_ids);
+        instance->group_ids = NULL;
+        instance->num_groups = 0;
+        instance->groups_capacity = 0;
 
         uint param_idx;
         for (param_idx = 0; param_idx < instance->num_parameters; ++param_idx) {
@@ -799,6 +1282,15 @@ void destruct_instance(struct PMTM_instance * instance)
             destruct_parameter(param);
         }
         free(instance->parameters);
+        instance->parameters = NULL;
+        instance->num_parameters = 0;
+        instance->parameters_capacity = 0;
+
+        free(instance->parameter_index);
+        instance->parameter_index = NULL;
+        instance->parameter_index_size = 0;
+
+        destruct_name_dictionary(&instance->names);
     }
 }
 
@@ -821,6 +1313,31 @@ PMTM_error_t construct_timer_group(
     group->num_timers = 0;
     group->timer_ids = NULL;
     group->total_timers = 0;
+    group->measure = MEASURE_DEFAULT;
+
+#ifdef _OPENMP
+    int threads = omp_get_max_threads();
+    if (omp_get_num_threads() > threads) threads = omp_get_num_threads();
+#else
+    int threads = 1;
+#endif
+
+    group->store.threads = -1;
+    group->store.thread = NULL;
+
+    void * lists;
+    size_t lists_size = (threads + 1) * sizeof(struct PMTM_timer_list);
+    if (posix_memalign(&lists, CACHE_LINE_SIZE, lists_size) != 0) {
+        return PMTM_ERROR_FAILED_ALLOCATION;
+    }
+    memset(lists, 0, lists_size);
+    group->store.thread = lists;
+    group->store.threads = threads;
+
+    int thread_idx;
+    for (thread_idx = 0; thread_idx <= threads; ++thread_idx) {
+        group->store.thread[thread_idx].tail = &group->store.thread[thread_idx].head;
+    }
 
     return PMTM_SUCCESS;
 }
@@ -835,12 +1352,26 @@ void destruct_timer_group(struct PMTM_timer_group * group)
 {
     free(group->group_name);
 
-    uint timer_idx;
-    for (timer_idx = 0; timer_idx < group->num_timers; ++timer_idx) {
-        struct PMTM_timer * timer = get_timer(group->timer_ids[timer_idx]);
-        destruct_timer(timer);
+    int thread_idx;
+    for (thread_idx = 0; thread_idx <= group->store.threads; ++thread_idx) {
+        struct PMTM_timer_list * list = &group->store.thread[thread_idx];
+        struct PMTM_arena_chunk * chunk = list->chunks;
+        while (chunk != NULL) {
+            struct PMTM_arena_chunk * next_chunk = chunk->next;
+            free(chunk);
+            chunk = next_chunk;
+        }
+        free(list->table);
     }
+    free(group->store.thread);
+    group->store.thread = NULL;
+    group->store.threads = -1;
+
     free(group->timer_ids);
+    group->timer_ids = NULL;
+    group->num_timers = 0;
+    group->total_timers = 0;
+    ++pmtm_timer_generation;
 }
 
 /**
@@ -849,10 +1380,14 @@ void destruct_timer_group(struct PMTM_timer_group * group)
  *
  * @param timer      [IN] The timer to construct, the memory for which should
  *                        already be allocated.
- * @param timer_name [IN] The name of the timer, or NULL if the timer is already named.
+ * @param timer_name [IN] The name of the timer, or NULL if the timer was allocated by
+ *                        new_timer, which names it and allocates its counters.
  *                        Do not specify timer_name to this if this timer might be part of
  *                        a thread group and already active.
- * @param timer_type [IN] The type of the timer, e.g. PMTM_TIMER_MAX.
+ * @param timer_type [IN] The type of the timer, e.g. PMTM_TIMER_MAX, optionally
+ *                        combined with PMTM_MEASURE_* flags. Without any
+ *                        flags both clocks are measured. Under OpenMP the
+ *                        CPU time is always that of the calling thread.
  * @returns PMTM_SUCCESS if successful, or one of PMTM_ERROR_* codes if not.
  */
 PMTM_error_t construct_timer(
@@ -860,34 +1395,43 @@ PMTM_error_t construct_timer(
         const char * timer_name,
         PMTM_timer_type_t timer_type)
 {   
+    if (timer_name != NULL) {
 #ifdef HW_COUNTERS
-    timer->start_counters = (hw_counter_t *) calloc(get_num_hw_events(), sizeof(hw_counter_t));
-    timer->stop_counters  = (hw_counter_t *) calloc(get_num_hw_events(), sizeof(hw_counter_t));
-    timer->total_counters = (hw_counter_t *) calloc(get_num_hw_events(), sizeof(hw_counter_t));
+        timer->start_counters = (hw_counter_t *) calloc(get_num_hw_events(), sizeof(hw_counter_t));
+        timer->stop_counters  = (hw_counter_t *) calloc(get_num_hw_events(), sizeof(hw_counter_t));
+        timer->total_counters = (hw_counter_t *) calloc(get_num_hw_events(), sizeof(hw_counter_t));
 #endif
-
-    if (timer_name != NULL) {
         copy_string(&timer->timer_name, timer_name);
         check_for_commas(timer->timer_name);
     }
 
-    timer->timer_type = timer_type;
-    timer->last_wc = 0;
-    timer->last_cpu = 0;
-    timer->current_wc = 0;
-    timer->current_cpu = 0;
-    timer->total_wc = 0;
-    timer->total_square_wc = 0;
-    timer->total_cpu = 0;
-    timer->total_square_cpu = 0;
-    timer->timer_count = 0;
-    timer->pause_count = 0;
+    timer->timer_type = timer_type & ~MEASURE_MASK;
+    timer->hot.measure = timer_type & MEASURE_MASK;
+    if (timer->hot.measure == 0) {
+        timer->hot.measure = MEASURE_DEFAULT;
+    }
+#ifdef _OPENMP
+    /* Each thread has its own timer, so the process CPU time would count the
+     * work of every thread against each of them. */
+    if (timer->hot.measure & INTERNAL__MEASURE_CPU) {
+        timer->hot.measure |= INTERNAL__MEASURE_THREAD_CPU;
+    }
+#endif
+    timer->hot.block_wc = 0;
+    timer->hot.block_cpu = 0;
+    timer->mark.wc = 0;
+    timer->mark.cpu = 0;
+    timer->hot.total_wc = 0;
+    timer->hot.total_cpu = 0;
+    pmtm_set_timer_square(&timer->hot, 0);
+    timer->hot.timer_count = 0;
+    timer->hot.pause_count = 0;
+    timer->hot.phase = PMTM_PHASE_STOPPED;
+    timer->hot.sampled = INTERNAL__FALSE;
     timer->frequency = 1;
-    timer->max_samples = PMTM_NO_MAX;
+    timer->max_samples = SAMPLES_UNLIMITED;
     timer->num_samples = 0;
-    timer->ignore = INTERNAL__FALSE;
     timer->rank = -1;
-    timer->is_printed = INTERNAL__FALSE;
 #ifdef PMTM_DEBUG
     timer->state = TIMER_STOPPED;
 #endif
@@ -897,7 +1441,9 @@ PMTM_error_t construct_timer(
 
 /**
  * Destroy a given timer, reclaiming any memory allocated in its construction
- * and use, and wiping out all data stored within it.
+ * and use, and wiping out all data stored within it. Only for timers that
+ * were constructed with a name, those from new_timer are freed with their
+ * timer group.
  *
  * @param timer The timer to destroy.
  */
@@ -950,6 +1496,24 @@ void destruct_parameter(struct parameter * param)
     memset(param, '\0', sizeof(struct parameter));
 }
 
+/**
+ * Destroy a name dictionary, freeing the names in it, and leave it empty.
+ *
+ * @param dictionary The dictionary to destroy.
+ */
+void destruct_name_dictionary(struct PMTM_name_dictionary * dictionary)
+{
+    size_t name_idx;
+    for (name_idx = 0; name_idx < dictionary->num_names; ++name_idx) {
+        free(dictionary->names[name_idx].group_name);
+        free(dictionary->names[name_idx].timer_name);
+    }
+    free(dictionary->names);
+    free(dictionary->index);
+
+    memset(dictionary, '\0', sizeof(struct PMTM_name_dictionary));
+}
+
 /**
  * Finalize the PMTM library, destroying all remaining instances and cleaning up
  * any memory that it has been using. This function should leave the library in
@@ -957,74 +1521,118 @@ void destruct_parameter(struct parameter * param)
  */
 void finalize()
 {    
-    struct PMTM_instance * curr_instance = instance_head;
-
-    while (curr_instance != NULL) {
-        struct PMTM_instance * next_instance = curr_instance->next;
-        destruct_instance(curr_instance);
-        free(curr_instance);
-        curr_instance = next_instance;
-    }
-
-    instance_head = NULL;
-    instance_tail = &instance_head;
-    instance_count = 0;
-
-    struct PMTM_timer_group * curr_tg = group_head;
-
-    while (curr_tg != NULL) {
-        struct PMTM_timer_group * next_tg = curr_tg->next;
-        free(curr_tg);
-        curr_tg = next_tg;
+    size_t instance_id;
+    for (instance_id = 0; instance_id < instance_table.count; ++instance_id) {
+        struct PMTM_instance * instance = instance_table.entries[instance_id];
+        destruct_instance(instance);
+        free(instance);
     }
+    id_table_free(&instance_table);
 
-    group_head = NULL;
-    group_tail = &group_head;
-    group_count = 0;
-
-    struct PMTM_timer * curr_timer = timer_head;
-
-    while (curr_timer != NULL) {
-        struct PMTM_timer * next_timer = curr_timer->next;
-        free(curr_timer);
-        curr_timer = next_timer;
+    size_t group_id;
+    for (group_id = 0; group_id < group_table.count; ++group_id) {
+        free(group_table.entries[group_id]);
     }
+    id_table_free(&group_table);
 
-    timer_head = NULL;
-    timer_tail = &timer_head;
-    timer_count = 0;
+    clock_chosen = PMTM_FALSE;
 }
 
 
 /**
- * Expand the memory of an array to fit in exactly one more element and return
- * a pointer to the new allocated memory.
+ * Make sure an array has room for at least the given number of elements,
+ * doubling its capacity as often as needed so that adding elements one at a
+ * time costs amortised constant time. Any new elements are zeroed.
  *
- * @param array        [IN/OUT] The array to expand.
- * @param num_elements [IN]     The number of elements currently in the array.
+ * @param array        [IN/OUT] The array to expand, may be NULL if the
+ *                              capacity is 0.
+ * @param capacity     [IN/OUT] The number of elements the array has room for.
+ * @param needed       [IN]     The number of elements needed.
  * @param element_size [IN]     The size of a single element.
+ * @returns 0 if successful, -1 if the memory could not be allocated, in which
+ * case the array is left as it was.
  */
-
-void * add_array_element(
+int grow_array(
         void ** array,
-        int num_elements,
+        size_t * capacity,
+        size_t needed,
         size_t element_size)
 {
-    const size_t old_size = num_elements * element_size;
-    const size_t new_size = (num_elements + 1) * element_size;
-    
-    void * tmp_array = malloc(old_size);
-    memcpy(tmp_array, *array, old_size);
-    free(*array);
+    if (needed <= *capacity) {
+        return 0;
+    }
+
+    size_t new_capacity = (*capacity > 0) ? *capacity : 8;
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
+
+    void * new_array = realloc(*array, new_capacity * element_size);
+    if (new_array == NULL) {
+        return -1;
+    }
+
+    memset((char *) new_array + *capacity * element_size, '\0', (new_capacity - *capacity) * element_size);
 
-    *array = malloc(new_size);
-    if (*array == NULL) return NULL;
+    *array = new_array;
+    *capacity = new_capacity;
+    return 0;
+}
 
-    memset(*array, '\0', new_size);
-    memcpy(*array, tmp_array, old_size);
-    free(tmp_array);
+/**
+ * Add an object to an ID table and return its new ID. The table doubles in
+ * size when full; the old entries array is retired rather than freed, as
+ * other threads may be reading it. This needs the pmtm lock under OpenMP.
+ *
+ * @param table [IN/OUT] The table to add to.
+ * @param entry [IN]     The object to add.
+ * @returns the ID of the object, or FAILED_ARRAY_ADD.
+ */
+static int id_table_add(struct PMTM_id_table * table, void * entry)
+{
+    if (table->count >= INT_MAX) {
+        return FAILED_ARRAY_ADD;
+    }
+
+    if (table->count == table->capacity) {
+        size_t new_capacity = (table->capacity > 0) ? 2 * table->capacity : 8;
+        void ** new_entries = malloc(new_capacity * sizeof(void *));
+        if (new_entries == NULL) {
+            return FAILED_ARRAY_ADD;
+        }
+        if (table->count > 0) {
+            memcpy(new_entries, table->entries, table->count * sizeof(void *));
+        }
+        if (table->entries != NULL) {
+            table->retired[table->num_retired++] = table->entries;
+        }
+        table->entries = new_entries;
+        table->capacity = new_capacity;
+    }
+
+    // Store the entry before publishing the new count.
+    table->entries[table->count] = entry;
+    return (int) table->count++;
+}
+
+/**
+ * Free the arrays of an ID table, but not the objects in it, and leave it
+ * empty.
+ *
+ * @param table [IN/OUT] The table to free.
+ */
+static void id_table_free(struct PMTM_id_table * table)
+{
+    int retired_idx;
+    for (retired_idx = 0; retired_idx < table->num_retired; ++retired_idx) {
+        free(table->retired[retired_idx]);
+    }
+    free(table->entries);
 
-    return ((char *)(*array) + old_size);
+    table->entries = NULL;
+    table->count = 0;
+    table->capacity = 0;
+    table->num_retired = 0;
 }
 
 
@@ -1036,8 +1644,6 @@ void * add_array_element(
  */
 PMTM_instance_t new_instance()
 {
-    PMTM_instance_t new_id;
-
     struct PMTM_instance * instance = malloc(sizeof(struct PMTM_instance));
 
     if (instance == NULL) {
@@ -1045,19 +1651,18 @@ PMTM_instance_t new_instance()
     }
 
     instance->initialised = 0;
-    instance->next = NULL;
-    *instance_tail = instance;
-    instance_tail = &instance->next;
 
-    new_id = instance_count;
-    ++instance_count;
+    PMTM_instance_t new_id = id_table_add(&instance_table, instance);
+    if (new_id == FAILED_ARRAY_ADD) {
+        free(instance);
+    }
     
     return new_id;
 }
 
 /**
  * Allocate the memory for a new timer group structure and return the ID to this
- * newly created group. For OpenMP, this routine needs locking of the group list
+ * newly created group. For OpenMP, this routine needs locking of the group table
  * and parent instance.
  *
  * @param instance [IN] The instance to associate this new group with.
@@ -1065,120 +1670,308 @@ PMTM_instance_t new_instance()
  */
 PMTM_timer_group_t new_timer_group(struct PMTM_instance * instance)
 {
-    PMTM_timer_group_t group_id;
-
     struct PMTM_timer_group * group = malloc(sizeof(struct PMTM_timer_group));
 
     if (group == NULL) {
         return FAILED_ARRAY_ADD;
     }
 
-    PMTM_timer_group_t * id = (PMTM_timer_group_t *)
-        add_array_element((void **) &instance->group_ids, instance->num_groups, sizeof(PMTM_timer_group_t));
-
-    if (id == NULL) {
+    if (grow_array((void **) &instance->group_ids, &instance->groups_capacity,
+                   instance->num_groups + 1, sizeof(PMTM_timer_group_t)) != 0) {
         free(group);
         return FAILED_ARRAY_ADD;
     }
 
-    
     group->instance = instance;
-    group->next = NULL;
-    *group_tail = group;
-    group_tail = &group->next;
 
-    group_id = group_count;
-    ++group_count;
+    PMTM_timer_group_t group_id = id_table_add(&group_table, group);
+    if (group_id == FAILED_ARRAY_ADD) {
+        free(group);
+        return FAILED_ARRAY_ADD;
+    }
+
+    instance->group_ids[instance->num_groups] = group_id;
     ++(instance->num_groups);
-    *id = group_id;
 
     return group_id;
 }
 
+/**
+ * Hash a timer or parameter name with 64 bit FNV-1a, folded to the 32 bits
+ * kept in each timer. Commas hash as spaces, since check_for_commas replaces
+ * them in the stored timer names.
+ *
+ * @param name [IN] The name to hash.
+ * @returns the hash of the name.
+ */
+static uint32_t hash_name(const char * name)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    const char * ch;
+    for (ch = name; *ch != '\0'; ++ch) {
+        hash ^= (unsigned char) ((*ch == ',') ? ' ' : *ch);
+        hash *= 1099511628211ULL;
+    }
+    return (uint32_t) (hash ^ (hash >> 32));
+}
+
+/**
+ * Compare a stored timer name with a name as passed to PMTM_create_timer,
+ * i.e. that may still contain commas.
+ *
+ * @param stored_name [IN] The name of an existing timer.
+ * @param timer_name  [IN] The name to compare it with.
+ * @returns INTERNAL__TRUE if the names match.
+ */
+static PMTM_BOOL timer_name_matches(const char * stored_name, const char * timer_name)
+{
+    while (*stored_name != '\0' && *stored_name == ((*timer_name == ',') ? ' ' : *timer_name)) {
+        ++stored_name;
+        ++timer_name;
+    }
+    return (*stored_name == '\0' && *timer_name == '\0');
+}
+
+/**
+ * Make room in the hash table of a timer list for one more timer, doubling the
+ * table when it holds as many timers as buckets.
+ *
+ * @param list [IN] The timer list to which a timer will be added.
+ * @returns 0 if successful, -1 if the table could not be allocated.
+ */
+static int reserve_timer_table(struct PMTM_timer_list * list)
+{
+    if (list->num_timers >= list->table_size) {
+        size_t new_size = (list->table_size == 0) ? 16 : 2 * list->table_size;
+        struct PMTM_timer ** new_table = calloc(new_size, sizeof(struct PMTM_timer *));
+        if (new_table == NULL) return -1;
+
+        size_t bucket;
+        for (bucket = 0; bucket < list->table_size; ++bucket) {
+            struct PMTM_timer * entry = list->table[bucket];
+            while (entry != NULL) {
+                struct PMTM_timer * next_entry = entry->hash_next;
+                struct PMTM_timer ** head = &new_table[entry->name_hash & (new_size - 1)];
+                entry->hash_next = *head;
+                *head = entry;
+                entry = next_entry;
+            }
+        }
+
+        free(list->table);
+        list->table = new_table;
+        list->table_size = new_size;
+    }
+    return 0;
+}
+
+/**
+ * Allocate memory from the arena of a timer list. The arena is made of chunks
+ * which are allocated and zeroed by the thread that owns the list, so the
+ * memory is placed local to it, and which are only freed, all together, when
+ * the timer group is destroyed.
+ *
+ * @param list  [IN] The timer list whose arena to allocate from.
+ * @param size  [IN] The number of bytes required.
+ * @param align [IN] The alignment required, a power of two no larger than
+ *                   CACHE_LINE_SIZE.
+ * @returns the zeroed memory, or NULL if it could not be allocated.
+ */
+static void * arena_alloc(struct PMTM_timer_list * list, size_t size, size_t align)
+{
+    uintptr_t next = ((uintptr_t) list->arena_next + align - 1) & ~((uintptr_t) align - 1);
+
+    if (list->arena_next == NULL || next + size > (uintptr_t) list->arena_end) {
+        size_t chunk_size = CACHE_LINE_SIZE + size;
+        if (chunk_size < ARENA_CHUNK_SIZE) chunk_size = ARENA_CHUNK_SIZE;
+
+        void * memory;
+        if (posix_memalign(&memory, CACHE_LINE_SIZE, chunk_size) != 0) return NULL;
+        memset(memory, 0, chunk_size);
+
+        struct PMTM_arena_chunk * chunk = memory;
+        chunk->next = list->chunks;
+        list->chunks = chunk;
+        list->arena_end = (char *) memory + chunk_size;
+        next = (uintptr_t) memory + CACHE_LINE_SIZE;
+    }
+
+    list->arena_next = (char *) next + size;
+    return (void *) next;
+}
+
+/**
+ * Return the timer list to which the calling thread adds its timers in a
+ * group. Outside of a parallel region, or in the first level of parallel
+ * regions, each thread has its own list which it can use without locking.
+ * Any other thread, e.g. in a nested parallel region, gets the shared list
+ * which needs locking of the group.
+ *
+ * @param group  [IN]  The timer group.
+ * @param shared [OUT] Whether the returned list is the shared list.
+ * @returns the timer list of the calling thread.
+ */
+struct PMTM_timer_list * get_timer_list(struct PMTM_timer_group * group, PMTM_BOOL * shared)
+{
+    int thread_idx = 0;
+#ifdef _OPENMP
+    if (omp_get_level() > 1) {
+        thread_idx = group->store.threads;
+    } else {
+        thread_idx = omp_get_thread_num();
+        if (thread_idx >= group->store.threads) thread_idx = group->store.threads;
+    }
+#endif
+    *shared = (thread_idx == group->store.threads);
+    return &group->store.thread[thread_idx];
+}
+
 /**
  * Allocate the memory for a new timer structure and return the ID to this
- * newly created timer. For OpenMP, this routine needs locking of the
- * timer list and parent group.
+ * newly created timer. The timer is added to the given timer list, so no
+ * locking is needed unless the list is shared with other threads. The timer
+ * takes whole cache lines of the list arena, so the timers of different
+ * threads never share a cache line.
  *
- * @param group [IN] The timer group to associate this new timer with.
+ * @param list       [IN] The timer list of the calling thread, see
+ *                        get_timer_list.
  * @param timer_name [IN] The name of the timer.
  * @returns The ID of the new timer.
  */
-PMTM_timer_t new_timer(struct PMTM_timer_group * group, const char * timer_name)
+PMTM_timer_t new_timer(struct PMTM_timer_list * list, const char * timer_name)
 {
-    PMTM_timer_t result = FAILED_TIMER_ADD;
+    if (reserve_timer_table(list) != 0) return FAILED_TIMER_ADD;
 
-    struct PMTM_timer * timer = malloc(sizeof(struct PMTM_timer));
+    size_t slot_size = sizeof(struct PMTM_timer);
+#ifdef HW_COUNTERS
+    size_t counters_size = get_num_hw_events() * sizeof(hw_counter_t);
+    slot_size += 3 * counters_size;
+#endif
+    slot_size = (slot_size + CACHE_LINE_SIZE - 1) & ~((size_t) CACHE_LINE_SIZE - 1);
+
+    struct PMTM_timer * timer = arena_alloc(list, slot_size, CACHE_LINE_SIZE);
     if (timer == NULL) return FAILED_TIMER_ADD;
 
+#ifdef HW_COUNTERS
+    timer->start_counters = (hw_counter_t *) (timer + 1);
+    timer->stop_counters  = timer->start_counters + get_num_hw_events();
+    timer->total_counters = timer->stop_counters + get_num_hw_events();
+#endif
+
     // Put in the name of the timer
 
-    char * copy_timer_name;
+    size_t name_len = strlen(timer_name);
+    char * copy_timer_name = arena_alloc(list, name_len + 1, 1);
+    if (copy_timer_name == NULL) return FAILED_TIMER_ADD;
 
-    copy_string(&copy_timer_name, timer_name);
+    memcpy(copy_timer_name, timer_name, name_len + 1);
     check_for_commas(copy_timer_name);
     timer->timer_name = copy_timer_name;
+    timer->name_hash = hash_name(copy_timer_name);
 
 #ifdef _OPENMP
     // Put in the thread ID
 
-    int thread_id = omp_get_thread_num();
-    timer->thread_id = thread_id;
+    timer->thread_id = omp_get_thread_num();
 #endif
 
-    // Based on the name, find its position in the group timer_ids array or add a
-    // new entry if not found.
-
-    int position = 0;
-    int num_timers = group->num_timers;
+    // Insert the new entry into the thread's list and its hash table, which
+    // has room for it.
 
-#ifdef _OPENMP
-    struct PMTM_timer ** timer_ids = group->timer_ids;
-
-    while (position < num_timers && strcmp(copy_timer_name, timer_ids[position]->timer_name) != 0) {
-        ++position;
-    }
-#else
-    position = num_timers;
-#endif
+    timer->next = NULL;
+    timer->thread_next = NULL;
+    *list->tail = timer;
+    list->tail = &timer->next;
 
-    if (position == num_timers) {
-        struct PMTM_timer ** id = (struct PMTM_timer **)
-            add_array_element((void **) &group->timer_ids, num_timers, sizeof(PMTM_timer_t));
+    struct PMTM_timer ** bucket = &list->table[timer->name_hash & (list->table_size - 1)];
+    timer->hash_next = *bucket;
+    *bucket = timer;
+    ++list->num_timers;
 
-        if (id == NULL) {
-            free(copy_timer_name);
-            free(timer);
-            return FAILED_TIMER_ADD;
-        }
+    return timer;
+}
 
-        *id = NULL;
-        ++(group->num_timers);
+/**
+ * Merge the timer lists of all the threads in a group into the group
+ * timer_ids array, with one entry for each timer name in the order in which
+ * the names were first created and the timers of the same name chained
+ * through thread_next in thread order. This is done when the timers are
+ * output, when all activity in the threads should have ceased.
+ *
+ * @param group [IN] The timer group to merge.
+ * @returns 0 if successful, -1 if memory could not be allocated.
+ */
+int merge_timer_store(struct PMTM_timer_group * group)
+{
+    size_t total_timers = 0;
+    int thread_idx;
+    for (thread_idx = 0; thread_idx <= group->store.threads; ++thread_idx) {
+        total_timers += group->store.thread[thread_idx].num_timers;
     }
 
-    ++(group->total_timers);
+    free(group->timer_ids);
+    group->timer_ids = NULL;
+    group->num_timers = 0;
+    group->total_timers = 0;
 
-    // Insert the new entry into the timer_ids list.
+    if (total_timers == 0) return 0;
+
+    // An open addressing table from name to timer_ids position + 1, at most
+    // half full.
+
+    size_t table_size = 16;
+    while (table_size < 2 * total_timers) table_size *= 2;
+
+    struct PMTM_timer ** timer_ids = malloc(total_timers * sizeof(struct PMTM_timer *));
+    size_t * positions = calloc(table_size, sizeof(size_t));
+    if (timer_ids == NULL || positions == NULL) {
+        free(timer_ids);
+        free(positions);
+        return -1;
+    }
+
+    size_t num_timers = 0;
+    for (thread_idx = 0; thread_idx <= group->store.threads; ++thread_idx) {
+        struct PMTM_timer * timer;
+        for (timer = group->store.thread[thread_idx].head; timer != NULL; timer = timer->next) {
+            size_t slot = timer->name_hash & (table_size - 1);
+            while (positions[slot] != 0) {
+                struct PMTM_timer * first = timer_ids[positions[slot] - 1];
+                if (first->name_hash == timer->name_hash && strcmp(first->timer_name, timer->timer_name) == 0) {
+                    break;
+                }
+                slot = (slot + 1) & (table_size - 1);
+            }
 
-    struct PMTM_timer ** id = &group->timer_ids[position];
+            timer->thread_next = NULL;
 
+            if (positions[slot] == 0) {
+                positions[slot] = ++num_timers;
+                timer_ids[num_timers - 1] = timer;
+            } else {
+                struct PMTM_timer ** id = &timer_ids[positions[slot] - 1];
 #ifdef _OPENMP
-    while (*id != NULL && (*id)->thread_id <= thread_id) {
-        id = &(*id)->thread_next;
-    }
+                while (*id != NULL && (*id)->thread_id <= timer->thread_id) {
+                    id = &(*id)->thread_next;
+                }
+#else
+                while (*id != NULL) {
+                    id = &(*id)->thread_next;
+                }
 #endif
+                timer->thread_next = *id;
+                *id = timer;
+            }
+        }
+    }
 
-    timer->thread_next = *id;
-    *id = timer;
-
-    // Insert the new entry into the timer list.
+    free(positions);
 
-    timer->next = NULL;
-    *timer_tail = timer;
-    timer_tail = &timer->next;
-    ++timer_count;
+    group->timer_ids = timer_ids;
+    group->num_timers = num_timers;
+    group->total_timers = total_timers;
 
-    return timer;
+    return 0;
 }
 
 
@@ -1190,7 +1983,7 @@ PMTM_timer_t new_timer(struct PMTM_timer_group * group, const char * timer_name)
  * @returns the number of PMTM instances.
  */
 int get_instance_count() {
-    return instance_count;
+    return (int) instance_table.count;
 }
 
 /**
@@ -1202,15 +1995,10 @@ int get_instance_count() {
  */
 struct PMTM_instance * get_instance(PMTM_instance_t instance_id)
 {
-    struct PMTM_instance * instance = instance_head;
-    int id = 0;
-
-    while (instance != NULL && instance_id != id) {
-        instance = instance->next;
-        ++id;
+    if (instance_id < 0 || (size_t) instance_id >= instance_table.count) {
+        return NULL;
     }
-
-    return instance;
+    return instance_table.entries[instance_id];
 }
 
 /**
@@ -1222,15 +2010,10 @@ struct PMTM_instance * get_instance(PMTM_instance_t instance_id)
  */
 struct PMTM_timer_group * get_timer_group(PMTM_timer_group_t group_id)
 {
-    struct PMTM_timer_group * group = group_head;
-    int id = 0;
-
-    while (group != NULL && group_id != id) {
-        group = group->next;
-        ++id;
+    if (group_id < 0 || (size_t) group_id >= group_table.count) {
+        return NULL;
     }
-
-    return group;
+    return group_table.entries[group_id];
 }
 
 /**
@@ -1246,12 +2029,44 @@ struct PMTM_timer * get_timer(PMTM_timer_t timer_id)
 }
 
 
+/**
+ * Find a timer of the given name in a timer list. Under OpenMP only the timers
+ * of the calling thread are considered, as the shared list may hold the timers
+ * of more than one thread.
+ *
+ * @param list       [IN] The timer list to search, see get_timer_list.
+ * @param timer_name [IN] The name of the timer, as passed to PMTM_create_timer.
+ * @returns the timer, or NULL if the list has no such timer.
+ */
+struct PMTM_timer * find_timer(const struct PMTM_timer_list * list, const char * timer_name)
+{
+    if (list->table_size == 0) return NULL;
+
+    uint32_t name_hash = hash_name(timer_name);
+#ifdef _OPENMP
+    int thread_id = omp_get_thread_num();
+#endif
+
+    struct PMTM_timer * timer = list->table[name_hash & (list->table_size - 1)];
+    while (timer != NULL) {
+        if (timer->name_hash == name_hash
+#ifdef _OPENMP
+                && timer->thread_id == thread_id
+#endif
+                && timer_name_matches(timer->timer_name, timer_name)) {
+            return timer;
+        }
+        timer = timer->hash_next;
+    }
+    return NULL;
+}
+
 /**
  * Returns whether or not PMTM is in an initialised state.
  */
 uint is_initialised()
 {
-    return (instance_head != NULL
+    return (instance_table.count > 0
             && get_instance(INTERNAL__DEFAULT_INSTANCE)->initialised);
 }
 
@@ -1273,6 +2088,308 @@ const char * get_state_desc(int state)
 }
 #endif
 
+/**
+ * Convert the wallclock ticks accumulated by the given timer into the mean
+ * time per call and its variance, in seconds. The timer must have been
+ * counted at least once.
+ *
+ * @param timer    [IN]  The timer containing the timing results.
+ * @param avg      [OUT] The mean wallclock time.
+ * @param std_dev  [OUT] The variance of the wallclock time.
+ */
+static void get_wc_stats(
+        const struct PMTM_timer * timer,
+        double * avg,
+        double * std_dev)
+{
+    long double mean = (long double) timer->hot.total_wc / timer->hot.timer_count;
+    long double mean_square = (long double) pmtm_timer_square(&timer->hot) / timer->hot.timer_count;
+
+    *avg = mean * PMTM_SECONDS_PER_TICK;
+    *std_dev = (mean_square - mean * mean) * PMTM_SECONDS_PER_TICK * PMTM_SECONDS_PER_TICK;
+}
+
+/**
+ * The powers of ten that are exactly representable as doubles.
+ */
+static const double powers_of_ten[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/**
+ * Scale a positive value by a power of ten and round it to an integer, as
+ * printf would round its decimal digits. The scaling can be out by a few ulps,
+ * so a value that lies close to halfway between two integers could round
+ * either way and is refused.
+ *
+ * @param value   [IN]  The value, positive and finite.
+ * @param shift   [IN]  The power of ten to scale it by.
+ * @param rounded [OUT] The rounded value.
+ * @param scaled  [OUT] The scaled value before rounding.
+ * @returns 0 if successful, 1 if the caller should fall back to printf.
+ */
+static int scale_and_round(double value, int shift, uint64_t * rounded, double * scaled)
+{
+    if (shift > 22 || shift < -22) return 1;
+
+    *scaled = (shift >= 0) ? value * powers_of_ten[shift] : value / powers_of_ten[-shift];
+    if (*scaled >= 1e15) return 1;
+
+    double whole = floor(*scaled);
+    double fraction = *scaled - whole;
+    if (fabs(fraction - 0.5) < 1e-6) return 1;
+
+    *rounded = (uint64_t) whole + (fraction > 0.5);
+    return 0;
+}
+
+/**
+ * Format an unsigned integer as printf's "%" PRIu64 would.
+ *
+ * @param text  [OUT] Where to write the digits, with room for 21 characters.
+ * @param value [IN]  The value to format.
+ * @returns The number of characters written, not counting the terminating nul.
+ */
+size_t format_uint(char * text, uint64_t value)
+{
+    char digits[20];
+    size_t num_digits = 0;
+    size_t idx;
+
+    do {
+        digits[num_digits++] = (char) ('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+
+    for (idx = 0; idx < num_digits; ++idx) {
+        text[idx] = digits[num_digits - 1 - idx];
+    }
+    text[num_digits] = '\0';
+    return num_digits;
+}
+
+/**
+ * Format a signed integer as printf's "%d" or "%" PRId64 would.
+ *
+ * @param text  [OUT] Where to write the digits, with room for 21 characters.
+ * @param value [IN]  The value to format.
+ * @returns The number of characters written, not counting the terminating nul.
+ */
+size_t format_int(char * text, int64_t value)
+{
+    if (value < 0) {
+        text[0] = '-';
+        return 1 + format_uint(text + 1, (uint64_t) 0 - (uint64_t) value);
+    }
+    return format_uint(text, (uint64_t) value);
+}
+
+/**
+ * Format a double as printf's "%12.6E" would, which is how every time in the
+ * output file is printed. Values whose last digit cannot be rounded with
+ * certainty from a double are passed on to sprintf, as are infinities and NaNs,
+ * so the text is always the same as printf's.
+ *
+ * @param text  [OUT] Where to write the text, with room for 32 characters.
+ * @param value [IN]  The value to format.
+ * @returns The number of characters written, not counting the terminating nul.
+ */
+size_t format_sci(char * text, double value)
+{
+    char * next = text;
+    double magnitude = fabs(value);
+    uint64_t mantissa;
+    double scaled;
+    int exponent;
+
+    if (!isfinite(value)) return sprintf(text, "%12.6E", value);
+
+    if (signbit(value)) *next++ = '-';
+
+    if (magnitude == 0) {
+        mantissa = 0;
+        exponent = 0;
+    } else {
+        // log10 only gives a guess at the exponent, so correct it until
+        // there are seven digits before the point.
+
+        exponent = (int) floor(log10(magnitude));
+        if (scale_and_round(magnitude, 6 - exponent, &mantissa, &scaled) != 0) {
+            return sprintf(text, "%12.6E", value);
+        }
+        if (scaled < 1e6) {
+            --exponent;
+        } else if (scaled >= 1e7) {
+            ++exponent;
+        }
+        if (scale_and_round(magnitude, 6 - exponent, &mantissa, &scaled) != 0) {
+            return sprintf(text, "%12.6E", value);
+        }
+        if (mantissa == 10000000) {
+            mantissa = 1000000;
+            ++exponent;
+        }
+    }
+
+    char digits[8];
+    int idx;
+    for (idx = 6; idx >= 0; --idx) {
+        digits[idx] = (char) ('0' + mantissa % 10);
+        mantissa /= 10;
+    }
+
+    *next++ = digits[0];
+    *next++ = '.';
+    memcpy(next, &digits[1], 6);
+    next += 6;
+    *next++ = 'E';
+    *next++ = (exponent < 0) ? '-' : '+';
+
+    if (exponent < 0) exponent = -exponent;
+    if (exponent >= 100) {
+        *next++ = (char) ('0' + exponent / 100);
+    }
+    *next++ = (char) ('0' + exponent / 10 % 10);
+    *next++ = (char) ('0' + exponent % 10);
+    *next = '\0';
+
+    return next - text;
+}
+
+/**
+ * Format a double as printf's "%6.4f" would, as the efficiencies are printed.
+ * Negative and large values, and values that cannot be rounded with certainty,
+ * are left to printf, as the text of a large value has no bound.
+ *
+ * @param text  [OUT] Where to write the text, with room for 32 characters.
+ * @param value [IN]  The value to format.
+ * @returns The number of characters written, not counting the terminating nul,
+ *          or 0 if the value must be printed with printf instead.
+ */
+size_t format_fixed(char * text, double value)
+{
+    uint64_t rounded;
+    double scaled;
+
+    if (!isfinite(value) || signbit(value) || value >= 1e5
+            || scale_and_round(value, 4, &rounded, &scaled) != 0) {
+        return 0;
+    }
+
+    char digits[24];
+    size_t length = format_uint(digits, rounded / 10000);
+    uint64_t fraction = rounded % 10000;
+    int idx;
+
+    digits[length++] = '.';
+    for (idx = 3; idx >= 0; --idx) {
+        digits[length + idx] = (char) ('0' + fraction % 10);
+        fraction /= 10;
+    }
+    length += 4;
+
+    size_t padding = (length < 6) ? 6 - length : 0;
+    memset(text, ' ', padding);
+    memcpy(text + padding, digits, length);
+    text[padding + length] = '\0';
+
+    return padding + length;
+}
+
+/**
+ * Start formatting a line of the output file.
+ *
+ * @param line [OUT] The line.
+ * @param fid  [IN]  The file the line is written to.
+ */
+void line_start(struct PMTM_line * line, FILE * fid)
+{
+    line->fid = fid;
+    line->length = 0;
+}
+
+/**
+ * Make room for the given number of characters in a line, writing out what
+ * it holds so far if need be.
+ */
+static void line_reserve(struct PMTM_line * line, size_t size)
+{
+    if (line->length + size > PMTM_LINE_SIZE) {
+        fwrite(line->text, 1, line->length, line->fid);
+        line->length = 0;
+    }
+}
+
+/**
+ * Add a string to a line.
+ *
+ * @param line [IN] The line.
+ * @param text [IN] The string to add, of any length.
+ */
+void line_put(struct PMTM_line * line, const char * text)
+{
+    size_t length = strlen(text);
+
+    while (length > 0) {
+        line_reserve(line, 1);
+        size_t count = PMTM_LINE_SIZE - line->length;
+        if (count > length) count = length;
+
+        memcpy(line->text + line->length, text, count);
+        line->length += count;
+        text += count;
+        length -= count;
+    }
+}
+
+/** Add a signed integer to a line, as "%d" would print it. */
+void line_put_int(struct PMTM_line * line, int64_t value)
+{
+    line_reserve(line, 32);
+    line->length += format_int(line->text + line->length, value);
+}
+
+/** Add an unsigned integer to a line, as "%" PRIu64 would print it. */
+void line_put_uint(struct PMTM_line * line, uint64_t value)
+{
+    line_reserve(line, 32);
+    line->length += format_uint(line->text + line->length, value);
+}
+
+/** Add a double to a line, as "%12.6E" would print it. */
+void line_put_sci(struct PMTM_line * line, double value)
+{
+    line_reserve(line, 32);
+    line->length += format_sci(line->text + line->length, value);
+}
+
+/** Add a double to a line, as "%6.4f" would print it. */
+void line_put_fixed(struct PMTM_line * line, double value)
+{
+    line_reserve(line, 32);
+    size_t length = format_fixed(line->text + line->length, value);
+    if (length == 0) {
+        fwrite(line->text, 1, line->length, line->fid);
+        fprintf(line->fid, "%6.4f", value);
+        line->length = 0;
+    }
+    line->length += length;
+}
+
+/**
+ * Finish a line, adding the newline and writing it out to its file.
+ *
+ * @param line [IN] The line.
+ */
+void line_end(struct PMTM_line * line)
+{
+    line_reserve(line, 1);
+    line->text[line->length++] = '\n';
+    fwrite(line->text, 1, line->length, line->fid);
+    line->length = 0;
+}
+
 /**
  * Print an "Overhead" line to the PMTM output file using the results stored in
  * the given timer.
@@ -1287,14 +2404,56 @@ void print_overhead(
         const struct PMTM_timer * timer,
         uint timer_repeats)
 {
-    double avg = timer->total_wc / timer->timer_count;
-    double std_dev = timer->total_square_wc / timer->timer_count - pow(avg, 2);
+    double avg, std_dev;
+    get_wc_stats(timer, &avg, &std_dev);
 
     avg /= timer_repeats;
     std_dev /= timer_repeats;
 
-    fprintf(instance->fid, "Overhead, (, 0, ), %s, =, %12.6E, (, %12.6E, )\n",
-            timer->timer_name, avg, std_dev);
+    struct PMTM_line line;
+    line_start(&line, instance->fid);
+    line_put(&line, "Overhead, (, 0, ), ");
+    line_put(&line, timer->timer_name);
+    line_put(&line, ", =, ");
+    line_put_sci(&line, avg);
+    line_put(&line, ", (, ");
+    line_put_sci(&line, std_dev);
+    line_put(&line, ", )");
+    line_end(&line);
+}
+
+/**
+ * Print the "Overhead" line for reading the clock, followed by the name of the
+ * clock backend in use and its measured resolution.
+ *
+ * @param instance      [IN] The instance to whose output file we are writing.
+ * @param timer         [IN] The timer containing the overhead timing results.
+ * @param timer_repeats [IN] The number of clock reads in each timed block.
+ */
+void print_clock_overhead(
+        const struct PMTM_instance * instance,
+        const struct PMTM_timer * timer,
+        uint timer_repeats)
+{
+    double avg, std_dev;
+    get_wc_stats(timer, &avg, &std_dev);
+
+    avg /= timer_repeats;
+    std_dev /= timer_repeats;
+
+    struct PMTM_line line;
+    line_start(&line, instance->fid);
+    line_put(&line, "Overhead, (, 0, ), ");
+    line_put(&line, timer->timer_name);
+    line_put(&line, ", =, ");
+    line_put_sci(&line, avg);
+    line_put(&line, ", (, ");
+    line_put_sci(&line, std_dev);
+    line_put(&line, ", ), clock, ");
+    line_put(&line, get_clock_name(get_clock_id()));
+    line_put(&line, ", resolution, ");
+    line_put_sci(&line, get_clock_resolution());
+    line_end(&line);
 }
 
 /**
@@ -1308,53 +2467,98 @@ void print_timer(
         const struct PMTM_instance * instance,
         struct PMTM_timer * timer)
 {
-    double avg_time = 0;
-    double std_dev = 0;
-    int pause_per_block = 0;
-
-    if (timer->timer_count != 0) {
-        avg_time = timer->total_wc / timer->timer_count;
-        std_dev = timer->total_square_wc / timer->timer_count - pow(avg_time, 2);
-        pause_per_block = timer->pause_count / timer->timer_count;
-    }
-
-    char rank_text[20];
+    char rank_text[48];
 
     if (timer->rank != -1) {
+        size_t length = format_int(rank_text, timer->rank);
+        rank_text[length++] = '.';
 #ifdef _OPENMP
-        sprintf(rank_text, "%d.%d", timer->rank, timer->thread_id);
+        format_int(rank_text + length, timer->thread_id);
 #else
-        sprintf(rank_text, "%d.0", timer->rank);
+        strcpy(rank_text + length, "0");
 #endif
     } else {
         switch (timer->timer_type) {
-            case INTERNAL__TIMER_NONE: sprintf(rank_text, "%d.0", 0); break;
+            case INTERNAL__TIMER_NONE: strcpy(rank_text, "0.0"); break;
             case INTERNAL__TIMER_AVG:  sprintf(rank_text, "%s", "Rank Average"); break;
             case INTERNAL__TIMER_MAX:  sprintf(rank_text, "%s", "Rank Maximum"); break;
             case INTERNAL__TIMER_MIN:  sprintf(rank_text, "%s", "Rank Minimum"); break;
             default:          sprintf(rank_text, "%s", "Unknown Type"); break;
         }
     }
-   
-#ifndef HW_COUNTERS 
-    fprintf(instance->fid,
-            "Timer, : (, %s, ), %s, =, %12.6E, (, %12.6E, ), count, %d, paused, %d\n",
-            rank_text, timer->timer_name, avg_time, std_dev,
-            timer->timer_count, pause_per_block);
-#else
-    fprintf(instance->fid,
-            "Timer, : (, %s, ), %s, =, %12.6E, (, %12.6E, ), count, %d, paused, %d",
-            rank_text, timer->timer_name, avg_time, std_dev,
-            timer->timer_count, pause_per_block);
+
+    print_timer_line(instance, timer, rank_text);
+}
+
+/**
+ * Print a "Timer" line to the PMTM output file using the results stored in the
+ * given timer, labelled with the given text in place of its rank.
+ *
+ * @param instance  [IN] The instance to whose output file we are writing.
+ * @param timer     [IN] The timer containing the timing results.
+ * @param rank_text [IN] The label of the line, e.g. "0.1" or "Rank Average".
+ */
+void print_timer_line(
+        const struct PMTM_instance * instance,
+        struct PMTM_timer * timer,
+        const char * rank_text)
+{
+    double avg_time = 0;
+    double std_dev = 0;
+    uint64_t pause_per_block = 0;
+
+    if (timer->hot.timer_count != 0) {
+        get_wc_stats(timer, &avg_time, &std_dev);
+        pause_per_block = timer->hot.pause_count / timer->hot.timer_count;
+    }
+
+    struct PMTM_line line;
+    line_start(&line, instance->fid);
+    line_put(&line, "Timer, : (, ");
+    line_put(&line, rank_text);
+    line_put(&line, ", ), ");
+    line_put(&line, timer->timer_name);
+    line_put(&line, ", =, ");
+    line_put_sci(&line, avg_time);
+    line_put(&line, ", (, ");
+    line_put_sci(&line, std_dev);
+    line_put(&line, ", ), count, ");
+    line_put_uint(&line, timer->hot.timer_count);
+    line_put(&line, ", paused, ");
+    line_put_uint(&line, pause_per_block);
+
+#ifdef HW_COUNTERS
     int counter_idx;
     for (counter_idx = 0; counter_idx < get_num_hw_counters(); ++counter_idx) {
-        fprintf(instance->fid, ", hw_counter, %s, %d",
-                get_counter_name(counter_idx), timer->total_counters[counter_idx]);
+        line_put(&line, ", hw_counter, ");
+        line_put(&line, get_counter_name(counter_idx));
+        line_put(&line, ", ");
+        line_put_int(&line, (int) timer->total_counters[counter_idx]);
     }
-    fputs("\n");
 #endif
 
-    timer->is_printed = INTERNAL__TRUE;
+    /* An efficiency (CPU time / wallclock time) well below one shows a thread
+     * that was blocked or descheduled, e.g. by oversubscription. The process
+     * CPU time says nothing about a single thread, so only timers reading the
+     * thread CPU clock report it. */
+    if ((timer->hot.measure & INTERNAL__MEASURE_THREAD_CPU) && (timer->hot.measure & INTERNAL__MEASURE_WC)) {
+        double avg_cpu = 0;
+        double efficiency = 0;
+
+        if (timer->hot.timer_count != 0) {
+            avg_cpu = (double) timer->hot.total_cpu / timer->hot.timer_count * PMTM_SECONDS_PER_TICK;
+        }
+        if (timer->hot.total_wc > 0) {
+            efficiency = (double) timer->hot.total_cpu / timer->hot.total_wc;
+        }
+
+        line_put(&line, ", cpu, ");
+        line_put_sci(&line, avg_cpu);
+        line_put(&line, ", efficiency, ");
+        line_put_fixed(&line, efficiency);
+    }
+
+    line_end(&line);
 }
 
 /**
@@ -1434,15 +2638,20 @@ print_parameter_array(
         return;
     }
 
-    const char * format_string = "Parameter, : (, %d, ), %s, =, %s\n";
-
     int last_displacement = -1;
     uint value_idx;
     for (value_idx = 0; value_idx < num_values; ++value_idx) {
         int displacement = displacements[value_idx];
         if (displacement != last_displacement) {
-            const char * parameter_value = &parameter_values[displacement];
-            fprintf(instance->fid, format_string, value_idx, parameter_name, parameter_value);
+            struct PMTM_line line;
+            line_start(&line, instance->fid);
+            line_put(&line, "Parameter, : (, ");
+            line_put_int(&line, (int) value_idx);
+            line_put(&line, ", ), ");
+            line_put(&line, parameter_name);
+            line_put(&line, ", =, ");
+            line_put(&line, &parameter_values[displacement]);
+            line_end(&line);
         }
         last_displacement = displacement;
     }
@@ -1492,6 +2701,13 @@ store_parameter_value(
             return 0;
         }
         construct_parameter(param, parameter_name, parameter_value, instance->rank);
+
+        if (index_parameter(instance, instance->num_parameters - 1, param->parameter_name) != 0) {
+            destruct_parameter(param);
+            --(instance->num_parameters);
+            pmtm_warn("Failed to store parameter: %s", parameter_name);
+            return 0;
+        }
     } else {
         free(param->parameter_value);
         
@@ -1515,43 +2731,218 @@ struct parameter *
 new_parameter(
         struct PMTM_instance * instance)
 {
-    struct parameter * param = (struct parameter *)
-        add_array_element((void **) &instance->parameters, instance->num_parameters, sizeof(struct parameter));
+    if (grow_array((void **) &instance->parameters, &instance->parameters_capacity,
+                   instance->num_parameters + 1, sizeof(struct parameter)) != 0) {
+        return NULL;
+    }
+
+    struct parameter * param = &instance->parameters[instance->num_parameters];
+    ++(instance->num_parameters);
+
+    return param;
+}
+
+/**
+ * Add the parameter at the given position in the parameters array of an
+ * instance to its parameter_index, under the given name. The index is kept at
+ * most half full and is rebuilt at twice the size when it would become fuller.
+ *
+ * @param instance       [IN] The instance holding the parameter.
+ * @param param_idx      [IN] The position of the parameter in the parameters
+ *                            array.
+ * @param parameter_name [IN] The name of the parameter.
+ * @returns 0 if successful, -1 if the index could not be grown.
+ */
+int
+index_parameter(
+        struct PMTM_instance * instance,
+        size_t param_idx,
+        const char * parameter_name)
+{
+    if (2 * (param_idx + 1) > instance->parameter_index_size) {
+        size_t new_size = (instance->parameter_index_size > 0) ? 2 * instance->parameter_index_size : 16;
+        while (new_size < 2 * (param_idx + 1)) new_size *= 2;
+
+        size_t * new_index = calloc(new_size, sizeof(size_t));
+        if (new_index == NULL) {
+            return -1;
+        }
+
+        size_t slot_idx;
+        for (slot_idx = 0; slot_idx < instance->parameter_index_size; ++slot_idx) {
+            size_t position = instance->parameter_index[slot_idx];
+            if (position == 0) continue;
+
+            size_t slot = hash_name(instance->parameters[position - 1].parameter_name) & (new_size - 1);
+            while (new_index[slot] != 0) slot = (slot + 1) & (new_size - 1);
+            new_index[slot] = position;
+        }
+
+        free(instance->parameter_index);
+        instance->parameter_index = new_index;
+        instance->parameter_index_size = new_size;
+    }
+
+    size_t slot = hash_name(parameter_name) & (instance->parameter_index_size - 1);
+    while (instance->parameter_index[slot] != 0) {
+        slot = (slot + 1) & (instance->parameter_index_size - 1);
+    }
+    instance->parameter_index[slot] = param_idx + 1;
+
+    return 0;
+}
+
+/**
+ * Retrieve the parameter structure stored in the given instance with the given
+ * parameter name.
+ *
+ * @param instance       [IN] The instance from which to retrieve the parameter.
+ * @param parameter_name [IN] The name of the parameter to retrieve.
+ * @returns a pointer to the matching parameter or NULL if no matching parameter
+ * was found.
+ */
+
+struct parameter *
+get_parameter(
+        const struct PMTM_instance * instance,
+        const char * parameter_name)
+{
+    if (instance->parameter_index_size == 0) {
+        return NULL;
+    }
+
+    const size_t mask = instance->parameter_index_size - 1;
+    size_t slot = hash_name(parameter_name) & mask;
+    while (instance->parameter_index[slot] != 0) {
+        struct parameter * param = &instance->parameters[instance->parameter_index[slot] - 1];
+        if (strcmp(param->parameter_name, parameter_name) == 0) {
+            return param;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return NULL;
+}
+
+/**
+ * Hash a (group, timer) name pair for a name dictionary.
+ *
+ * @param group_name [IN] The name of the timer group.
+ * @param timer_name [IN] The name of the timer.
+ * @returns the hash of the pair.
+ */
+static uint32_t hash_name_pair(const char * group_name, const char * timer_name)
+{
+    return (hash_name(group_name) * 16777619u) ^ hash_name(timer_name);
+}
+
+/**
+ * Look up the global ID of a (group, timer) name pair.
+ *
+ * @param dictionary [IN] The dictionary to search.
+ * @param group_name [IN] The name of the timer group.
+ * @param timer_name [IN] The name of the timer.
+ * @returns the ID of the pair, or -1 if it is not in the dictionary.
+ */
+long
+find_name(
+        const struct PMTM_name_dictionary * dictionary,
+        const char * group_name,
+        const char * timer_name)
+{
+    if (dictionary->index_size == 0) {
+        return -1;
+    }
+
+    const uint32_t hash = hash_name_pair(group_name, timer_name);
+    const size_t mask = dictionary->index_size - 1;
+    size_t slot = hash & mask;
+    while (dictionary->index[slot] != 0) {
+        const struct PMTM_name * name = &dictionary->names[dictionary->index[slot] - 1];
+        if (name->hash == hash
+                && strcmp(name->timer_name, timer_name) == 0
+                && strcmp(name->group_name, group_name) == 0) {
+            return (long) (dictionary->index[slot] - 1);
+        }
+        slot = (slot + 1) & mask;
+    }
+    return -1;
+}
+
+/**
+ * Add a (group, timer) name pair to a dictionary, giving it the next ID. The
+ * caller should check that the pair is not already there with find_name.
+ *
+ * @param dictionary [IN/OUT] The dictionary to add to.
+ * @param group_name [IN]     The name of the timer group.
+ * @param timer_name [IN]     The name of the timer.
+ * @param timer_type [IN]     The type of the timer.
+ * @returns the ID of the pair, or -1 if the memory could not be allocated.
+ */
+long
+add_name(
+        struct PMTM_name_dictionary * dictionary,
+        const char * group_name,
+        const char * timer_name,
+        PMTM_timer_type_t timer_type)
+{
+    const size_t name_id = dictionary->num_names;
 
-    if (param == NULL) {
-        return NULL;
+    if (grow_array((void **) &dictionary->names, &dictionary->capacity,
+                   name_id + 1, sizeof(struct PMTM_name)) != 0) {
+        return -1;
     }
-    ++(instance->num_parameters);
 
-    return param;
+    // Keep the index at most half full, rebuilding it at twice the size.
+    if (2 * (name_id + 1) > dictionary->index_size) {
+        size_t new_size = (dictionary->index_size > 0) ? 2 * dictionary->index_size : 64;
+        size_t * new_index = calloc(new_size, sizeof(size_t));
+        if (new_index == NULL) {
+            return -1;
+        }
+
+        size_t idx;
+        for (idx = 0; idx < name_id; ++idx) {
+            size_t slot = dictionary->names[idx].hash & (new_size - 1);
+            while (new_index[slot] != 0) slot = (slot + 1) & (new_size - 1);
+            new_index[slot] = idx + 1;
+        }
+
+        free(dictionary->index);
+        dictionary->index = new_index;
+        dictionary->index_size = new_size;
+    }
+
+    struct PMTM_name * name = &dictionary->names[name_id];
+    copy_string(&name->group_name, group_name);
+    copy_string(&name->timer_name, timer_name);
+    name->hash = hash_name_pair(group_name, timer_name);
+    name->timer_type = timer_type;
+
+    size_t slot = name->hash & (dictionary->index_size - 1);
+    while (dictionary->index[slot] != 0) {
+        slot = (slot + 1) & (dictionary->index_size - 1);
+    }
+    dictionary->index[slot] = name_id + 1;
+
+    ++(dictionary->num_names);
+    return (long) name_id;
 }
 
 /**
- * Retrieve the parameter structure stored in the given instance with the given
- * parameter name.
+ * Decide whether a timer with a sample mode should time the block it is being
+ * started for. This is kept out of line, with the sample mode, so that timers
+ * without one only touch their hot line.
  *
- * @param instance       [IN] The instance from which to retrieve the parameter.
- * @param parameter_name [IN] The name of the parameter to retrieve.
- * @returns a pointer to the matching parameter or NULL if no matching parameter
- * was found.
+ * @param timer [IN] The hot fields of the timer being started.
+ * @returns INTERNAL__TRUE if the block should be timed.
  */
-
-struct parameter *
-get_parameter(
-        const struct PMTM_instance * instance,
-        const char * parameter_name)
+PMTM_BOOL pmtm_sample_timer(struct PMTM_timer_hot * timer)
 {
-    struct parameter * param = NULL;
-    
-    uint param_idx;
-    for (param_idx = 0; param_idx < instance->num_parameters; ++param_idx) {
-        struct parameter * tmp_param = &instance->parameters[param_idx];
-        if (strcmp(tmp_param->parameter_name, parameter_name) == 0) {
-            param = tmp_param;
-            break;
-        }
-    }
-    return param;
+    struct PMTM_timer * full_timer = (struct PMTM_timer *) timer;
+    uint64_t sample = full_timer->num_samples++;
+
+    return (full_timer->max_samples == SAMPLES_UNLIMITED || sample < full_timer->max_samples)
+        && sample % full_timer->frequency == 0;
 }
 
 /**
@@ -1562,18 +2953,7 @@ get_parameter(
  */
 void start_timer(struct PMTM_timer * timer)
 {
-    if (timer->num_samples < timer->max_samples
-            && timer->num_samples % timer->frequency == 0) {
-        timer->ignore = INTERNAL__FALSE;
-    } else {
-        timer->ignore = INTERNAL__TRUE;
-    }
-
-    if (timer->ignore == INTERNAL__FALSE) {
-        timer->current_wc  = 0;
-        timer->current_cpu = 0;
-        set_timers(&timer->last_cpu, &timer->last_wc);
-        
+    if (pmtm_fast_start(&timer->hot)) {
 #ifdef HW_COUNTERS
         set_counters(timer->start_counters);
 #endif
@@ -1598,23 +2978,7 @@ void start_timer(struct PMTM_timer * timer)
  */
 void stop_timer(struct PMTM_timer * timer)
 {
-    if (timer->ignore == INTERNAL__FALSE) {
-        double cpu_time, wc_time;
-        set_timers(&cpu_time, &wc_time);
-
-        /* Add last time block to current sum. */
-        timer->current_wc  += (wc_time  - timer->last_wc);
-        timer->current_cpu += (cpu_time - timer->last_cpu);
-
-        /* Add elapsed time to sum and squared sum. */
-        timer->total_wc         += timer->current_wc;
-        timer->total_square_wc  += pow(timer->current_wc, 2);
-        timer->total_cpu        += timer->current_cpu;
-        timer->total_square_cpu += pow(timer->current_cpu, 2);
-
-        /* Add to the number of times this timer has been counted. */
-        ++timer->timer_count;
-        
+    if (pmtm_fast_stop(&timer->hot)) {
 #ifdef HW_COUNTERS
         set_counters(timer->stop_counters);
         
@@ -1626,8 +2990,6 @@ void stop_timer(struct PMTM_timer * timer)
 #endif
     }
 
-    ++timer->num_samples;
-
 #ifdef PMTM_DEBUG
     if (timer->state != TIMER_ACTIVE) {
         const char * this_state = get_state_desc(timer->state);
@@ -1647,15 +3009,7 @@ void stop_timer(struct PMTM_timer * timer)
  */
 void pause_timer(struct PMTM_timer * timer)
 {
-    if (timer->ignore == INTERNAL__FALSE) {
-        double cpu_time, wc_time;
-        set_timers(&cpu_time, &wc_time);
-
-        /* Add last time block to current sum. */
-        timer->current_wc  += (wc_time  - timer->last_wc);
-        timer->current_cpu += (cpu_time - timer->last_cpu);
-        ++timer->pause_count;
-    }
+    pmtm_fast_pause(&timer->hot);
 
 #ifdef PMTM_DEBUG
     if (timer->state != TIMER_ACTIVE) {
@@ -1676,9 +3030,7 @@ void pause_timer(struct PMTM_timer * timer)
  */
 void continue_timer(struct PMTM_timer * timer)
 {
-    if (timer->ignore == INTERNAL__FALSE) {
-        set_timers(&timer->last_cpu, &timer->last_wc);
-    }
+    pmtm_fast_continue(&timer->hot);
 
 #ifdef PMTM_DEBUG
     if (timer->state != TIMER_PAUSED) {
@@ -1692,17 +3044,18 @@ void continue_timer(struct PMTM_timer * timer)
 }
 
 /**
- * Return the CPU time since this timer was started.
+ * Return the CPU time since this timer was last started or continued, or zero
+ * if the timer does not measure CPU time.
  *
  * @param timer [IN] The timer for whose CPU time to return.
  * @returns the cpu time.
  */
 double get_cpu_time(struct PMTM_timer * timer)
 {
-    double cpu_time, wc_time;
-    set_timers(&cpu_time, &wc_time);
-
-    return (cpu_time - timer->last_cpu);
+    if (!(timer->hot.measure & INTERNAL__MEASURE_CPU)) {
+        return 0;
+    }
+    return (pmtm_fast_read_cpu_clock(&timer->hot) - timer->mark.cpu) * PMTM_SECONDS_PER_TICK;
 }
 
 /**
@@ -1722,12 +3075,13 @@ double get_total_cpu_time(struct PMTM_timer * timer)
                 timer->timer_name, this_state, good_state);
     }
 #endif
-    return timer->total_cpu;
+    return timer->hot.total_cpu * PMTM_SECONDS_PER_TICK;
 }
 
 /**
- * Return the CPU time stored in a timer of the last block timed. If compiled
- * in debug mode will also check that the timer is correctly stopped.
+ * Return the CPU time stored in a timer of the last block timed, or of the
+ * current block up to its last pause. If compiled in debug mode will also check
+ * that the timer is correctly stopped.
  *
  * @param timer [IN] The timer for whose CPU time to return.
  * @returns the cpu time.
@@ -1742,21 +3096,26 @@ double get_last_cpu_time(struct PMTM_timer * timer)
                 timer->timer_name, this_state, good_state);
     }
 #endif
-    return timer->current_cpu;
+    pmtm_tick_t block = timer->hot.block_cpu;
+    if (timer->hot.phase == PMTM_PHASE_RUNNING) {
+        block += timer->mark.cpu;
+    }
+    return block * PMTM_SECONDS_PER_TICK;
 }
 
 /**
- * Return the wallclock time since this timer was started.
+ * Return the wallclock time since this timer was last started or continued, or
+ * zero if the timer does not measure wallclock time.
  *
  * @param timer [IN] The timer for whose wallclock time to return.
  * @returns the wall clock time.
  */
 double get_wc_time(struct PMTM_timer * timer)
 {
-    double cpu_time, wc_time;
-    set_timers(&cpu_time, &wc_time);
-
-    return (wc_time - timer->last_wc);
+    if (!(timer->hot.measure & INTERNAL__MEASURE_WC)) {
+        return 0;
+    }
+    return (read_clock() - timer->mark.wc) * PMTM_SECONDS_PER_TICK;
 }
 
 /**
@@ -1776,12 +3135,13 @@ double get_total_wc_time(struct PMTM_timer * timer)
                 timer->timer_name, this_state, good_state);
     }
 #endif
-    return timer->total_wc;
+    return timer->hot.total_wc * PMTM_SECONDS_PER_TICK;
 }
 
 /**
- * Return the wallclock time stored in a timer of the last block timed. If
- * compiled in debug mode will also check that the timer is correctly stopped.
+ * Return the wallclock time stored in a timer of the last block timed, or of
+ * the current block up to its last pause. If compiled in debug mode will also
+ * check that the timer is correctly stopped.
  *
  * @param timer [IN] The timer for whose wallclock time to return.
  * @returns the wall clock time.
@@ -1796,90 +3156,462 @@ double get_last_wc_time(struct PMTM_timer * timer)
                 timer->timer_name, this_state, good_state);
     }
 #endif
-    return timer->current_wc;
+    pmtm_tick_t block = timer->hot.block_wc;
+    if (timer->hot.phase == PMTM_PHASE_RUNNING) {
+        block += timer->mark.wc;
+    }
+    return block * PMTM_SECONDS_PER_TICK;
 }
 
 /**
- * Print an array of timers, one on each line, all with the same timer name but
- * with different timer values. This is used to print the timers for all ranks.
+ * Print one of the summary lines of a node, labelled "Node <node> <stat>".
+ */
+static void print_node_timer(
+        const struct PMTM_instance * instance,
+        int node,
+        struct PMTM_timer * timer,
+        const char * stat)
+{
+    char rank_text[32];
+    sprintf(rank_text, "Node %d %s", node, stat);
+    print_timer_line(instance, timer, rank_text);
+}
+
+/**
+ * Print the average, maximum and minimum lines of a timer over all ranks, or
+ * over the ranks of one node, as its type asks for.
  *
- * @param instance     [IN] The instance to whose output file we are printing.
- * @param totalthreads [IN] The total number of threads represented in timer_array.
- * @param timer_array  [IN] The array of timers to print.
- * @param timer_name   [IN] The name of the timers.
- * @param timer_type   [IN] The type of the timers.
+ * @param instance   [IN] The instance to whose output file we are printing.
+ * @param node       [IN] The node the timers ran on, or -1 for all ranks.
+ * @param timer_type [IN] The type of the timers.
+ * @param avg_timer  [IN] The sums of the timers, made with type PMTM_TIMER_AVG.
+ * @param max_timer  [IN] The timer with the most wallclock time, made with type
+ *                        PMTM_TIMER_MAX.
+ * @param min_timer  [IN] The timer with the least wallclock time, made with
+ *                        type PMTM_TIMER_MIN.
  */
-void print_timer_array(
+void print_timer_summary(
         const struct PMTM_instance * instance,
-        uint totalthreads,
-        struct PMTM_timer * timer_array,
-        const char * timer_name,
-        PMTM_timer_type_t timer_type)
+        int node,
+        PMTM_timer_type_t timer_type,
+        struct PMTM_timer * avg_timer,
+        struct PMTM_timer * max_timer,
+        struct PMTM_timer * min_timer)
 {
     if (instance->fid == NULL) {
         return;
     }
-    
-    if (timer_type == PMTM_TIMER_INT) {
-      return;
+
+    if ((timer_type & PMTM_TIMER_AVG) || (timer_type & PMTM_TIMER_AVO)) {
+        if (node < 0) print_timer(instance, avg_timer);
+        else print_node_timer(instance, node, avg_timer, "Average");
     }
 
-    struct PMTM_timer avg_timer;
-    struct PMTM_timer max_timer;
-    struct PMTM_timer min_timer;
+    if (timer_type & PMTM_TIMER_MAX) {
+        if (node < 0) print_timer(instance, max_timer);
+        else print_node_timer(instance, node, max_timer, "Maximum");
+    }
 
-    construct_timer(&avg_timer, timer_name, PMTM_TIMER_AVG);
-    construct_timer(&max_timer, timer_name, PMTM_TIMER_MAX);
-    construct_timer(&min_timer, timer_name, PMTM_TIMER_MIN);
+    if (timer_type & PMTM_TIMER_MIN) {
+        if (node < 0) print_timer(instance, min_timer);
+        else print_node_timer(instance, node, min_timer, "Minimum");
+    }
+}
+
+/**
+ * Start the average, maximum and minimum of some timers, before any timers
+ * are added to them with summarise_timer_array.
+ *
+ * @param measure   [IN]  The clocks read by the timers.
+ * @param avg_timer [OUT] The sums of the timers, constructed by the caller.
+ * @param max_timer [OUT] The timer with the most wallclock time, constructed by the caller.
+ * @param min_timer [OUT] The timer with the least wallclock time, constructed by the caller.
+ */
+void start_timer_summary(
+        uint32_t measure,
+        struct PMTM_timer * avg_timer,
+        struct PMTM_timer * max_timer,
+        struct PMTM_timer * min_timer)
+{
+    pmtm_set_timer_square(&avg_timer->hot, 0);
+    max_timer->hot.total_wc = 0;
+    min_timer->hot.total_wc = UINT64_MAX;
 
-    avg_timer.total_square_wc = 0;
-    max_timer.total_wc = DBL_MIN;
-    min_timer.total_wc = DBL_MAX;
+    avg_timer->hot.measure = measure;
+    max_timer->hot.measure = measure;
+    min_timer->hot.measure = measure;
+}
 
+/**
+ * Add an array of timers to their average, maximum and minimum, as
+ * print_timer_summary prints them for the type of the timers.
+ *
+ * @param totalthreads [IN]     The number of timers in timer_array.
+ * @param timer_array  [IN]     The timers.
+ * @param timer_type   [IN]     The type of the timers.
+ * @param avg_timer    [IN/OUT] The sums of the timers, see start_timer_summary.
+ * @param max_timer    [IN/OUT] The timer with the most wallclock time.
+ * @param min_timer    [IN/OUT] The timer with the least wallclock time.
+ */
+void summarise_timer_array(
+        uint totalthreads,
+        struct PMTM_timer * timer_array,
+        PMTM_timer_type_t timer_type,
+        struct PMTM_timer * avg_timer,
+        struct PMTM_timer * max_timer,
+        struct PMTM_timer * min_timer)
+{
     uint rank_idx;
 
     for (rank_idx = 0; rank_idx < totalthreads; ++rank_idx) {
-	struct PMTM_timer * rank_timer = &timer_array[rank_idx];
-	
-         if ((timer_type != PMTM_TIMER_MMA) && (timer_type != PMTM_TIMER_AVO)) {
-	    print_timer(instance, rank_timer);
- 	}
+        struct PMTM_timer * rank_timer = &timer_array[rank_idx];
 
         if (timer_type & PMTM_TIMER_AVG) {
-            avg_timer.total_wc += rank_timer->total_wc;
-            avg_timer.total_square_wc += rank_timer->total_square_wc;
-            avg_timer.timer_count += rank_timer->timer_count;
+            avg_timer->hot.total_wc += rank_timer->hot.total_wc;
+            pmtm_set_timer_square(&avg_timer->hot, pmtm_timer_square(&avg_timer->hot) + pmtm_timer_square(&rank_timer->hot));
+            avg_timer->hot.total_cpu += rank_timer->hot.total_cpu;
+            avg_timer->hot.timer_count += rank_timer->hot.timer_count;
         }
 
         if (timer_type & PMTM_TIMER_MAX) {
-            if (rank_timer->total_wc > max_timer.total_wc) {
-                max_timer.total_wc = rank_timer->total_wc;
-                max_timer.total_square_wc = rank_timer->total_square_wc;
-                max_timer.timer_count = rank_timer->timer_count;
+            if (rank_timer->hot.total_wc > max_timer->hot.total_wc) {
+                max_timer->hot.total_wc = rank_timer->hot.total_wc;
+                pmtm_set_timer_square(&max_timer->hot, pmtm_timer_square(&rank_timer->hot));
+                max_timer->hot.total_cpu = rank_timer->hot.total_cpu;
+                max_timer->hot.timer_count = rank_timer->hot.timer_count;
             }
         }
 
         if (timer_type & PMTM_TIMER_MIN) {
-            if (rank_timer->total_wc < min_timer.total_wc) {
-                min_timer.total_wc = rank_timer->total_wc;
-                min_timer.total_square_wc = rank_timer->total_square_wc;
-                min_timer.timer_count = rank_timer->timer_count;
+            if (rank_timer->hot.total_wc < min_timer->hot.total_wc) {
+                min_timer->hot.total_wc = rank_timer->hot.total_wc;
+                pmtm_set_timer_square(&min_timer->hot, pmtm_timer_square(&rank_timer->hot));
+                min_timer->hot.total_cpu = rank_timer->hot.total_cpu;
+                min_timer->hot.timer_count = rank_timer->hot.timer_count;
             }
         }
     }
+}
 
-    if ((timer_type & PMTM_TIMER_AVG) || (timer_type & PMTM_TIMER_AVO)) {
-        print_timer(instance, &avg_timer);
+/**
+ * Check whether two values agree within a relative tolerance of the larger.
+ *
+ * @param value     [IN] The value to compare.
+ * @param reference [IN] The value to compare it with.
+ * @param tolerance [IN] The relative tolerance, 0 for exactly equal values.
+ * @returns 1 if they agree, or 0 if not.
+ */
+static int values_agree(double value, double reference, double tolerance)
+{
+    return fabs(value - reference) <= tolerance * fmax(fabs(value), fabs(reference));
+}
+
+/**
+ * Check whether the values of two timers agree within a relative tolerance, so
+ * that their lines can be collapsed into one. The counts and what they measure
+ * must be the same, and the wallclock and CPU times, the sum of the squared
+ * wallclock times and any hardware counters within the tolerance of the
+ * larger, which with the same counts compares every value printed.
+ *
+ * @param timer     [IN] The timer to compare.
+ * @param reference [IN] The timer to compare it with.
+ * @param tolerance [IN] The relative tolerance, 0 for exactly equal times.
+ * @returns 1 if they agree, or 0 if not.
+ */
+static int timers_agree(
+        const struct PMTM_timer * timer,
+        const struct PMTM_timer * reference,
+        double tolerance)
+{
+#ifdef _OPENMP
+    if (timer->thread_id != reference->thread_id) return 0;
+#endif
+    if (timer->hot.timer_count != reference->hot.timer_count
+            || timer->hot.pause_count != reference->hot.pause_count
+            || timer->hot.measure != reference->hot.measure) {
+        return 0;
     }
 
-    if (timer_type & PMTM_TIMER_MAX) {
-        print_timer(instance, &max_timer);
+    if (!values_agree((double) timer->hot.total_wc, (double) reference->hot.total_wc, tolerance)
+            || !values_agree((double) timer->hot.total_cpu, (double) reference->hot.total_cpu, tolerance)
+            || !values_agree((double) pmtm_timer_square(&timer->hot),
+                             (double) pmtm_timer_square(&reference->hot), tolerance)) {
+        return 0;
     }
 
-    if (timer_type & PMTM_TIMER_MIN) {
-        print_timer(instance, &min_timer);
+#ifdef HW_COUNTERS
+    int counter_idx;
+    for (counter_idx = 0; counter_idx < get_num_hw_counters(); ++counter_idx) {
+        if (!values_agree((double) timer->total_counters[counter_idx],
+                          (double) reference->total_counters[counter_idx], tolerance)) {
+            return 0;
+        }
+    }
+#endif
+
+    return 1;
+}
+
+/**
+ * Print the lines of the current range of rank_lines, labelled with the range
+ * of ranks, e.g. "0-1023.0", and the values of its first rank, or as usual if
+ * the range has only one rank.
+ *
+ * @param lines [INOUT] The lines being printed.
+ */
+static void print_rank_range(struct PMTM_rank_lines * lines)
+{
+    uint32_t idx;
+
+    for (idx = 0; idx < lines->run_threads; ++idx) {
+        struct PMTM_timer * timer = &lines->run[idx];
+
+        if (lines->first_rank == lines->last_rank) {
+            print_timer(lines->instance, timer);
+            continue;
+        }
+
+        char rank_text[48];
+        size_t length = format_int(rank_text, lines->first_rank);
+        rank_text[length++] = '-';
+        length += format_int(rank_text + length, lines->last_rank);
+        rank_text[length++] = '.';
+#ifdef _OPENMP
+        format_int(rank_text + length, timer->thread_id);
+#else
+        strcpy(rank_text + length, "0");
+#endif
+        print_timer_line(lines->instance, timer, rank_text);
+    }
+
+    lines->run_threads = 0;
+}
+
+/**
+ * Finish the rank being added to rank_lines: it extends the current range if
+ * it follows it and its timers agree with those of the first rank, otherwise
+ * the range is printed and a new one starts with it.
+ *
+ * @param lines [INOUT] The lines being printed.
+ */
+static void end_rank_block(struct PMTM_rank_lines * lines)
+{
+    uint32_t idx;
+
+    if (lines->block_threads == 0) {
+        return;
+    }
+
+    int agree = (lines->run_threads == lines->block_threads && lines->block_rank == lines->last_rank + 1);
+    for (idx = 0; agree && idx < lines->block_threads; ++idx) {
+        agree = timers_agree(&lines->block[idx], &lines->run[idx], lines->tolerance);
+    }
+
+    if (agree) {
+        lines->last_rank = lines->block_rank;
+    } else {
+        print_rank_range(lines);
+
+        struct PMTM_timer * run = lines->run;
+        lines->run = lines->block;
+        lines->block = run;
+#ifdef HW_COUNTERS
+        hw_counter_t * run_counters = lines->run_counters;
+        lines->run_counters = lines->block_counters;
+        lines->block_counters = run_counters;
+#endif
+        lines->run_threads = lines->block_threads;
+        lines->first_rank = lines->block_rank;
+        lines->last_rank = lines->block_rank;
+    }
+
+    lines->block_threads = 0;
+}
+
+/**
+ * Start printing the lines of each rank of a timer with print_rank_timer,
+ * collapsing consecutive ranks whose timers agree within the collapse
+ * tolerance of the instance into one line.
+ *
+ * @param lines    [OUT] The lines to start.
+ * @param instance [IN]  The instance to whose output file we are printing.
+ */
+void start_rank_lines(
+        struct PMTM_rank_lines * lines,
+        const struct PMTM_instance * instance)
+{
+    memset(lines, 0, sizeof(*lines));
+    lines->instance = instance;
+    lines->tolerance = instance->collapse_tolerance;
+}
+
+/**
+ * Print the line of a timer of one rank, or hold it back to collapse it with
+ * the same timer of the next ranks. The timers must be given in order of rank
+ * and then thread, and end_rank_lines called after the last.
+ *
+ * @param lines [INOUT] The lines being printed.
+ * @param timer [IN]    The timer to print, which is copied.
+ */
+void print_rank_timer(
+        struct PMTM_rank_lines * lines,
+        struct PMTM_timer * timer)
+{
+    if (lines->tolerance < 0) {
+        print_timer(lines->instance, timer);
+        return;
+    }
+
+    if (lines->block_threads > 0 && timer->rank != lines->block_rank) {
+        end_rank_block(lines);
+    }
+
+    if (lines->block_threads == lines->capacity) {
+        uint32_t capacity = (lines->capacity == 0) ? 4 : 2 * lines->capacity;
+        struct PMTM_timer * run = realloc(lines->run, capacity * sizeof(struct PMTM_timer));
+        if (run != NULL) lines->run = run;
+        struct PMTM_timer * block = realloc(lines->block, capacity * sizeof(struct PMTM_timer));
+        if (block != NULL) lines->block = block;
+#ifdef HW_COUNTERS
+        size_t num_counters = get_num_hw_counters();
+        hw_counter_t * run_counters = realloc(lines->run_counters, capacity * num_counters * sizeof(hw_counter_t));
+        if (run_counters != NULL) lines->run_counters = run_counters;
+        hw_counter_t * block_counters = realloc(lines->block_counters, capacity * num_counters * sizeof(hw_counter_t));
+        if (block_counters != NULL) lines->block_counters = block_counters;
+        if (run_counters == NULL || block_counters == NULL) run = NULL;
+        uint32_t idx;
+        for (idx = 0; idx < lines->run_threads; ++idx) {
+            lines->run[idx].total_counters = &lines->run_counters[idx * num_counters];
+        }
+        for (idx = 0; idx < lines->block_threads; ++idx) {
+            lines->block[idx].total_counters = &lines->block_counters[idx * num_counters];
+        }
+#endif
+
+        // Without the memory to hold the timers back they are printed as usual.
+        if (run == NULL || block == NULL) {
+            uint32_t block_idx;
+            print_rank_range(lines);
+            for (block_idx = 0; block_idx < lines->block_threads; ++block_idx) {
+                print_timer(lines->instance, &lines->block[block_idx]);
+            }
+            lines->block_threads = 0;
+            lines->tolerance = -1;
+            print_timer(lines->instance, timer);
+            return;
+        }
+        lines->capacity = capacity;
+    }
+
+    struct PMTM_timer * copy = &lines->block[lines->block_threads];
+    *copy = *timer;
+#ifdef HW_COUNTERS
+    int counter_idx;
+    copy->total_counters = &lines->block_counters[lines->block_threads * get_num_hw_counters()];
+    for (counter_idx = 0; counter_idx < get_num_hw_counters(); ++counter_idx) {
+        copy->total_counters[counter_idx] = timer->total_counters[counter_idx];
+    }
+#endif
+    lines->block_rank = timer->rank;
+    ++lines->block_threads;
+}
+
+/**
+ * Print the lines held back by print_rank_timer and free its memory.
+ *
+ * @param lines [INOUT] The lines being printed.
+ */
+void end_rank_lines(struct PMTM_rank_lines * lines)
+{
+    end_rank_block(lines);
+    print_rank_range(lines);
+
+    free(lines->run);
+    free(lines->block);
+#ifdef HW_COUNTERS
+    free(lines->run_counters);
+    free(lines->block_counters);
+#endif
+    memset(lines, 0, sizeof(*lines));
+}
+
+/**
+ * Print an array of timers, one on each line, all with the same timer name but
+ * with different timer values. This is used to print the timers for all ranks.
+ * The timers must be in order of rank, so that consecutive ranks that agree can
+ * be collapsed into one line.
+ *
+ * @param instance     [IN] The instance to whose output file we are printing.
+ * @param totalthreads [IN] The total number of threads represented in timer_array.
+ * @param timer_array  [IN] The array of timers to print.
+ * @param timer_name   [IN] The name of the timers.
+ * @param timer_type   [IN] The type of the timers.
+ */
+void print_timer_array(
+        const struct PMTM_instance * instance,
+        uint totalthreads,
+        struct PMTM_timer * timer_array,
+        const char * timer_name,
+        PMTM_timer_type_t timer_type)
+{
+    if (instance->fid == NULL) {
+        return;
+    }
+    
+    if (timer_type == PMTM_TIMER_INT) {
+      return;
+    }
+
+    uint rank_idx;
+
+    if ((timer_type != PMTM_TIMER_MMA) && (timer_type != PMTM_TIMER_AVO)) {
+        struct PMTM_rank_lines lines;
+        start_rank_lines(&lines, instance);
+        for (rank_idx = 0; rank_idx < totalthreads; ++rank_idx) {
+            print_rank_timer(&lines, &timer_array[rank_idx]);
+        }
+        end_rank_lines(&lines);
+    }
+
+    print_node_timer_array(instance, -1, totalthreads, timer_array, timer_name, timer_type);
+}
+
+/**
+ * Print the average, maximum and minimum lines of an array of timers, all with
+ * the same timer name, over all ranks or over the ranks of one node.
+ *
+ * @param instance     [IN] The instance to whose output file we are printing.
+ * @param node         [IN] The node the timers ran on, or -1 for all ranks.
+ * @param totalthreads [IN] The total number of threads represented in timer_array.
+ * @param timer_array  [IN] The array of timers to summarise.
+ * @param timer_name   [IN] The name of the timers.
+ * @param timer_type   [IN] The type of the timers.
+ */
+void print_node_timer_array(
+        const struct PMTM_instance * instance,
+        int node,
+        uint totalthreads,
+        struct PMTM_timer * timer_array,
+        const char * timer_name,
+        PMTM_timer_type_t timer_type)
+{
+    if (instance->fid == NULL || totalthreads == 0) {
+        return;
     }
 
+    struct PMTM_timer avg_timer;
+    struct PMTM_timer max_timer;
+    struct PMTM_timer min_timer;
+
+    construct_timer(&avg_timer, timer_name, PMTM_TIMER_AVG);
+    construct_timer(&max_timer, timer_name, PMTM_TIMER_MAX);
+    construct_timer(&min_timer, timer_name, PMTM_TIMER_MIN);
+
+    start_timer_summary(timer_array->hot.measure, &avg_timer, &max_timer, &min_timer);
+    summarise_timer_array(totalthreads, timer_array, timer_type, &avg_timer, &max_timer, &min_timer);
+
+    print_timer_summary(instance, node, timer_type, &avg_timer, &max_timer, &min_timer);
+
     destruct_timer(&avg_timer);
     destruct_timer(&max_timer);
     destruct_timer(&min_timer);
@@ -16,12 +16,14 @@
 
 #include "timers.h"
 #include "pmtm.h"
+#include "pmtm_fast.h"
 
 #ifdef HW_COUNTERS
 #  include "hardware_counters.h"
 #endif
 
 #include <stdio.h>
+#include <stdint.h>
 
 #ifdef	__cplusplus
 extern "C" {
@@ -32,8 +34,22 @@ extern "C" {
 #define FAILED_TIMER_ADD ((PMTM_timer_t) -1)
 #define IO_RANK 0
 
+#define MEASURE_MASK    (INTERNAL__MEASURE_WC | INTERNAL__MEASURE_CPU | INTERNAL__MEASURE_THREAD_CPU)
+#define MEASURE_DEFAULT (INTERNAL__MEASURE_WC | INTERNAL__MEASURE_CPU)
+
+#define SAMPLES_UNLIMITED UINT32_MAX
+
+#define CACHE_LINE_SIZE  64
+#define ARENA_CHUNK_SIZE 16384
+
 
 extern char ** environ;
+extern PMTM_BOOL node_stats;
+extern PMTM_BOOL writer_thread;
+extern PMTM_BOOL collective_write;
+extern PMTM_BOOL rank_files;
+extern size_t stream_buffer;
+extern double collapse_ranks;
 
 #ifdef PMTM_DEBUG
 /**
@@ -62,15 +78,40 @@ struct parameter
 };
 
 
-// OpenMP - All the next structures are linked lists. Previously they were arrays.
-//          By making them linked lists the actual storage no longer moves which
-//          makes it safe to avoid large scale locking in a threaded environment
-//          that the array scheme would need. The actual objects are mostly accessed
-//          via IDs and so the lists really only act as a memory device until the
-//          final print point. None of the base storage is ever really freed until
-//          the library is finalized such that baring the circumstance all pointers
+// OpenMP - The instances and groups are allocated one at a time and found through
+//          the ID tables of pmtm_internal.c, and the timers are kept in linked
+//          lists. Neither moves once created, which makes it safe to avoid large
+//          scale locking in a threaded environment that a single array scheme
+//          would need. None of the base storage is ever really freed until the
+//          library is finalized such that baring the circumstance all pointers
 //          remain valid pretty much throughout.
 
+/**
+ * A (group, timer) name pair in a name dictionary.
+ */
+struct PMTM_name
+{
+    char * group_name;              /**< The name of the timer group. */
+    char * timer_name;              /**< The name of the timer. */
+    uint32_t hash;                  /**< The hash of the pair, see hash_name_pair. */
+    PMTM_timer_type_t timer_type;   /**< The PMTM_TIMER_* type of the first timer given the name, which decides how it is output. */
+};
+
+/**
+ * The (group, timer) name pairs that all ranks have agreed on a global ID for,
+ * which is the position of the pair in the names array. Timers are sent to
+ * the IO_RANK with these IDs rather than their names. Every rank holds the same
+ * dictionary, which only grows (see exchange_names in pmtm_timer_output.c).
+ */
+struct PMTM_name_dictionary
+{
+    size_t num_names;               /**< The number of names in the names array. */
+    size_t capacity;                /**< The number of names the names array has room for. */
+    struct PMTM_name * names;       /**< The names, indexed by ID. */
+    size_t * index;                 /**< Open addressing hash table from name pair to ID + 1, 0 if empty. */
+    size_t index_size;              /**< The number of slots in index, a power of two. */
+};
+
 /**
  * This structure represents a PMTM instance. This structure keeps track of
  * whether this instance has been fully initialised and other useful info, such
@@ -78,8 +119,6 @@ struct parameter
  */
 struct PMTM_instance
 {
-    struct PMTM_instance * next;    /**< The next instance on the list. */
-
     int initialised;                /**< Whether the instance is in an initialised state. */
     char * application_name;        /**< The name of the application to write to the output file. */
     char * file_name;               /**< The name of the output file to create. */
@@ -87,9 +126,113 @@ struct PMTM_instance
     int nranks;                     /**< The number of ranks in the MPI communicator, 1 if compiled in serial mode. */
     int rank;                       /**< The rank this instance was created on, 0 if compiled in serial mode. */
     size_t num_groups;              /**< The number of timer groups in the group_ids array. */
+    size_t groups_capacity;         /**< The number of groups the group_ids array has room for. */
     PMTM_timer_group_t * group_ids; /**< The timer groups associated with this instance. */
     size_t num_parameters;          /**< The number of parameters that have been stored in this instance. */
+    size_t parameters_capacity;     /**< The number of parameters the parameters array has room for. */
     struct parameter * parameters;  /**< The array holding the parameters stored. */
+    size_t * parameter_index;       /**< Open addressing hash table from parameter name to position in parameters + 1, 0 if empty. */
+    size_t parameter_index_size;    /**< The number of slots in parameter_index, a power of two. */
+    struct PMTM_name_dictionary names; /**< The global IDs of the timer names output so far. */
+    struct PMTM_pending_output * pending_output; /**< The output started by PMTM_timer_output_begin, or NULL. */
+    char * rank_file_name;          /**< The output file of the IO_RANK that the rank files are named after, on every rank, or NULL if they are not written. */
+    uint32_t rank_file_sections;    /**< The number of outputs written to the rank files so far. */
+    double collapse_tolerance;      /**< The relative tolerance within which the lines of consecutive ranks are collapsed, on the IO_RANK, or negative to print every rank. */
+};
+
+/**
+ * Which ranks send a line of their own for each timer when only a sample of
+ * them is gathered (PMTM_SAMPLE_RANKS), while the statistics are still taken
+ * over all ranks. The slowest and fastest ranks of each timer
+ * (PMTM_OUTLIER_RANKS) are printed as well.
+ */
+struct PMTM_rank_sample
+{
+    int every;                      /**< Every how many ranks a rank is sampled, 0 for none by number, or negative to gather every rank. */
+    int per_node;                   /**< Whether the lowest rank of each node is sampled. */
+    int outliers;                   /**< The number of slowest and of fastest ranks printed for each timer. */
+};
+
+#define PMTM_MAX_OUTLIERS 100    /**< The most slowest and fastest ranks PMTM_OUTLIER_RANKS can ask for. */
+
+extern struct PMTM_rank_sample rank_sample;
+
+/**
+ * The lines of one timer name being printed a rank at a time by
+ * print_rank_timer. Consecutive ranks whose timers agree with those of the
+ * first rank of the current range are collapsed into one line for the range, so
+ * the timers of the first rank are held in run and those of the rank being
+ * added in block until they can be compared.
+ */
+struct PMTM_rank_lines
+{
+    const struct PMTM_instance * instance; /**< The instance to whose output file we are printing. */
+    double tolerance;               /**< The relative tolerance within which ranks agree, or negative to print every rank. */
+    struct PMTM_timer * run;        /**< The timers of the first rank of the current range, one for each thread. */
+    struct PMTM_timer * block;      /**< The timers of the rank being added so far. */
+    uint32_t run_threads;           /**< The number of timers in run, 0 if there is no range. */
+    uint32_t block_threads;         /**< The number of timers in block. */
+    uint32_t capacity;              /**< The number of timers run and block each have room for. */
+    int first_rank;                 /**< The first rank of the current range. */
+    int last_rank;                  /**< The last rank of the current range. */
+    int block_rank;                 /**< The rank being added. */
+#ifdef HW_COUNTERS
+    hw_counter_t * run_counters;    /**< The counters of the timers in run. */
+    hw_counter_t * block_counters;  /**< The counters of the timers in block. */
+#endif
+};
+
+#define PMTM_LINE_SIZE 512
+#define PMTM_OUTPUT_BUFFER_SIZE (1 << 20)
+
+/**
+ * A line of the output file being formatted with the line_put functions, which
+ * print the numbers as printf would but without parsing a format. A line longer
+ * than PMTM_LINE_SIZE is written out a piece at a time.
+ */
+struct PMTM_line
+{
+    FILE * fid;                     /**< The file the line is written to. */
+    size_t length;                  /**< The number of characters in text. */
+    char text[PMTM_LINE_SIZE];      /**< The part of the line not yet written. */
+};
+
+/**
+ * A chunk of memory in the arena of a timer list. The header takes the first
+ * cache line of the chunk and the memory handed out by arena_alloc follows it.
+ */
+struct PMTM_arena_chunk
+{
+    struct PMTM_arena_chunk * next;       /**< The chunk allocated before this one or NULL. */
+};
+
+/**
+ * This structure provides a storage for timers for a thread. When this starts up, tail will point at head,
+ * after that it will point at the next element of the last timer in the list. The timers, and their names,
+ * are allocated from the arena of the list. With eight pointer sized fields each list fills one cache line
+ * on 64 bit systems, so threads updating their own lists do not share cache lines.
+ */
+struct PMTM_timer_list
+{
+    struct PMTM_timer * head;             /**< The head of the timer list. */
+    struct PMTM_timer ** tail;            /**< A pointer to the point holding the end of the list. */
+    size_t num_timers;                    /**< The number of timers in the list. */
+    struct PMTM_timer ** table;           /**< Hash table of the timers in the list, chained through hash_next, for find_timer. */
+    size_t table_size;                    /**< The number of buckets in table, a power of two. */
+    struct PMTM_arena_chunk * chunks;     /**< The most recently allocated chunk of the arena. */
+    char * arena_next;                    /**< The next free byte in the current chunk. */
+    char * arena_end;                     /**< The end of the current chunk. */
+};
+
+/**
+ * This structure provides a storage container for the timers. Each thread
+ * adds its timers to its own list without locking; the last list is shared by
+ * any threads without one of their own and is only used under the pmtm lock.
+ */
+struct PMTM_timer_store
+{
+    int threads;                          /**< The number of threads represented. */
+    struct PMTM_timer_list * thread;      /**< An array of threads + 1 timer lists, one for each thread and the shared list. */
 };
 
 /**
@@ -98,42 +241,43 @@ struct PMTM_instance
  */
 struct PMTM_timer_group
 {
-    struct PMTM_timer_group * next;  /**< The next timer group in the list. */
-
     struct PMTM_instance * instance; /**< The instance to which this group is associated. */
     char * group_name;               /**< The name of the timer group. */
+    struct PMTM_timer_store store;   /**< The timers of the group, as each thread created them. */
     size_t num_timers;               /**< The number of timers in the timer_ids array. */
-    struct PMTM_timer ** timer_ids;  /**< The timers associated with this timer group. Threaded timers will only carry one entry for the set. */
+    struct PMTM_timer ** timer_ids;  /**< The timers associated with this timer group, built from store by merge_timer_store. Threaded timers will only carry one entry for the set. */
     size_t total_timers;             /**< The total number of timers represented by the group. All timers in thread groups are counted in this figure. */
+    PMTM_timer_type_t measure;       /**< The clocks read by timers created in this group without any PMTM_MEASURE_* flags. */
 };
 
 /**
  * This structue keeps track of an individual timer. This includes it's name
  * and type as well as all the timing data gathered for this timer.
+ *
+ * The timing data is kept in the hot fields, which new_timer gives a cache
+ * line of their own. The rest of the timer is only used when it is created,
+ * looked up or printed, or by a timer with a sample mode, and without
+ * HW_COUNTERS or PMTM_DEBUG it fits in the following line.
  */
 struct PMTM_timer
 {
-    struct PMTM_timer * next;        /**< The next timer in the global timer list or NULL. */
+    struct PMTM_timer_hot hot;       /**< The fields used by the timer control routines, this must be first. */
+    struct PMTM_timer_mark mark;     /**< The clocks of the last start or continue, this must follow hot. */
+
+    struct PMTM_timer * next;        /**< The next timer in the timer list of the creating thread or NULL. */
     struct PMTM_timer * thread_next; /**< The next timer with the same name as this. Used for group timer_ids. */
 
     char * timer_name;             /**< The name of the timer. This better be unique. */
+    struct PMTM_timer * hash_next; /**< The next timer in the same bucket of the thread timer list table. */
+    uint32_t name_hash;            /**< The hash of the timer name, see hash_name. */
     PMTM_timer_type_t timer_type;  /**< The type of the timer, see the PMTM_TIMER_* constants in pmtm.h. */
-    double last_wc;                /**< The wallclock time at the point this timer was last started/continued. */
-    double last_cpu;               /**< The cpu time at the point this timer was last started/continued. */
-    double current_wc;             /**< The sum of all the start->pause and continue->pause wallclock times. */
-    double current_cpu;            /**< The sum of all the start->pause and continue->pause cpu times. */
-    double total_wc;               /**< The total wallclock time that has been counted. */
-    double total_square_wc;        /**< The total square sum of the wallclock time that has been counted (for stddev). */
-    double total_cpu;              /**< The total cpu time that has been counted. */
-    double total_square_cpu;       /**< The total square sum of the wallclock time that has been counted (for stddev). */
-    int timer_count;               /**< The number of times this timer has been started & stopped. */
-    int pause_count;               /**< The number of times this timer has been paused. */
-    int frequency;                 /**< The frequency at which to take measurements. */
-    int max_samples;               /**< The maximum number of measurements to take. */
-    int num_samples;               /**< The number of times this timer has been stopped. */
-    PMTM_BOOL ignore;              /**< Currently ignore this timer, i.e. if timer_count > max_samples. */
     int rank;                      /**< The rank of the timer, used when gathering all the timers onto rank 0. */
-    PMTM_BOOL is_printed;          /**< Whether or not this timer has been printed. */
+#ifdef _OPENMP
+    int thread_id;                 /**< OpenMP thread id, to allow for result amalgamation during printing, may be. */
+#endif
+    int frequency;                 /**< The frequency at which to take measurements. */
+    uint32_t max_samples;          /**< The maximum number of measurements to take, SAMPLES_UNLIMITED for no maximum. */
+    uint64_t num_samples;          /**< The number of times this timer has been started. Only counted with a sample mode. */
 #ifdef HW_COUNTERS
     hw_counter_t * start_counters; /**< The hardware counters when this timer was started. */
     hw_counter_t * stop_counters;  /**< The hardware counters when this timer was stopped. */
@@ -142,32 +286,77 @@ struct PMTM_timer
 #ifdef PMTM_DEBUG
     enum timer_states state;       /**< The state of the timer, debug mode only. */
 #endif
-#ifdef _OPENMP
-    int thread_id;                 /**< OpenMP thread id, to allow for result amalgamation during printing, may be. */
-#endif
 };
 
+/* The hot fields of a timer must fit in the cache line new_timer aligns them to. */
+typedef char PMTM_timer_hot_fits_line[(sizeof(struct PMTM_timer_hot) <= CACHE_LINE_SIZE) ? 1 : -1];
+
+#define PMTM_WIRE_MAGIC   0x4D544D50u  /**< "PMTM" in the byte order of the sending rank. */
+#define PMTM_WIRE_VERSION 3            /**< Bumped whenever the transfer layout changes. */
 
 /**
- * This structure provides a storage for timers for a thread. When this starts up, tail will point at head,
- * after that it will point at the next element of the last timer in the list.
+ * The header at the start of the timers each rank sends to the IO_RANK for
+ * output. It lets the receiver check that the package was written with the
+ * same transfer layout and byte order before reading any records.
  */
-struct PMTM_timer_list
+struct PMTM_wire_header
 {
-    struct PMTM_timer * head;             /**< The head of the timer list. */
-    struct PMTM_timer ** tail;            /**< A pointer to the point holding the end of the list. */
+    uint32_t magic;          /**< PMTM_WIRE_MAGIC. */
+    uint16_t version;        /**< PMTM_WIRE_VERSION. */
+    uint16_t record_size;    /**< sizeof(struct PMTM_timer_record). */
+    uint32_t num_counters;   /**< The number of hardware counters following each record. */
+    uint32_t num_timers;     /**< The number of timers in the package, each with a name ID and thread count, in name ID order. */
+};
+
+/**
+ * The statistics of one timer of one thread as sent to the IO_RANK for output.
+ * Unlike struct PMTM_timer it holds no pointers or state that only makes sense
+ * on the sending rank, and every field has a fixed width and place so that the
+ * record has no padding. Each record is followed by num_counters int64_t
+ * hardware counter totals (see struct PMTM_wire_header).
+ */
+struct PMTM_timer_record
+{
+    uint64_t total_wc;           /**< The total wallclock ticks. */
+    uint64_t total_cpu;          /**< The total CPU ticks. */
+    uint64_t total_square_wc_hi; /**< The top 64 bits of the sum of the squared wallclock ticks. */
+    uint64_t total_square_wc_lo; /**< The bottom 64 bits of the sum of the squared wallclock ticks. */
+    uint64_t timer_count;        /**< The number of blocks timed. */
+    uint64_t pause_count;        /**< The number of pauses. */
+    int32_t rank;                /**< The rank of the timer. */
+    int32_t thread_id;           /**< The OpenMP thread of the timer, 0 without OpenMP. */
+    uint32_t timer_type;         /**< The PMTM_TIMER_* type of the timer. */
+    uint32_t measure;            /**< The PMTM_MEASURE_* clocks read by the timer. */
 };
 
+/* Records are copied byte for byte, so there must be no padding to leave undefined. */
+typedef char PMTM_timer_record_unpadded[(sizeof(struct PMTM_timer_record) == 6 * 8 + 4 * 4) ? 1 : -1];
+
+#define PMTM_RANK_FILE_MAGIC 0x52544D50u  /**< "PMTR" in the byte order of the writing rank. */
 
 /**
- * This structure provides a storage container for the timers. 
+ * The header of a section of a rank file (PMTM_OPTION_RANK_FILES), which each
+ * output appends. It is followed by names_size bytes of the names of the
+ * timers, as pairs of null terminated strings each followed by the type of the
+ * timer, and then by timers_size bytes holding for each name, in the same
+ * order, the number of threads and one struct PMTM_timer_record (plus any
+ * hardware counters) per thread.
  */
-struct PMTM_timer_store
+struct PMTM_rank_file_header
 {
-    int threads;                          /**< The number of threads represented. */
-    struct PMTM_timer_list * thread;      /**< An array of timer lists, one for each thread. */
+    uint32_t magic;          /**< PMTM_RANK_FILE_MAGIC. */
+    uint16_t version;        /**< PMTM_WIRE_VERSION. */
+    uint16_t record_size;    /**< sizeof(struct PMTM_timer_record). */
+    uint32_t num_counters;   /**< The number of hardware counters following each record. */
+    int32_t rank;            /**< The rank that wrote the section. */
+    int32_t nranks;          /**< The number of ranks. */
+    uint32_t section;        /**< The number of sections written before this one. */
+    uint32_t num_names;      /**< The number of names and timers in the section. */
+    uint32_t names_size;     /**< The size of the names in bytes. */
+    uint32_t timers_size;    /**< The size of the timers in bytes. */
 };
 
+typedef char PMTM_rank_file_header_unpadded[(sizeof(struct PMTM_rank_file_header) == 9 * 4) ? 1 : -1];
 
 
 
@@ -185,6 +374,7 @@ void destruct_instance(struct PMTM_instance * instance);
 void destruct_timer_group(struct PMTM_timer_group * group);
 void destruct_timer(struct PMTM_timer * timer);
 void destruct_parameter(struct parameter * param);
+void destruct_name_dictionary(struct PMTM_name_dictionary * dictionary);
 void finalize();
 /* @} */
 
@@ -193,6 +383,9 @@ void finalize();
 struct PMTM_instance    * get_instance(const PMTM_instance_t instance_id);
 struct PMTM_timer_group * get_timer_group(const PMTM_timer_group_t group_id);
 struct PMTM_timer       * get_timer(const PMTM_timer_t timer_id);
+struct PMTM_timer_list  * get_timer_list(struct PMTM_timer_group * group, PMTM_BOOL * shared);
+struct PMTM_timer       * find_timer(const struct PMTM_timer_list * list, const char * timer_name);
+long                      find_name(const struct PMTM_name_dictionary * dictionary, const char * group_name, const char * timer_name);
 struct parameter        * get_parameter(const struct PMTM_instance * instance, const char * parameter_name);
 const char              * get_parameter_value(const struct PMTM_instance * instance, const char * parameter_name);
 int                       get_instance_count();
@@ -205,26 +398,58 @@ int store_parameter_value(struct PMTM_instance * instance, const char * paramete
 
 /** @name Array allocators
  @{ */
-void * add_array_element(void ** array, int num_elements, size_t element_size);
+int grow_array(void ** array, size_t * capacity, size_t needed, size_t element_size);
 PMTM_instance_t    new_instance();
 PMTM_timer_group_t new_timer_group(struct PMTM_instance * instance);
-PMTM_timer_t       new_timer(struct PMTM_timer_group * group, const char * timer_name);
+PMTM_timer_t       new_timer(struct PMTM_timer_list * list, const char * timer_name);
+int                merge_timer_store(struct PMTM_timer_group * group);
 struct parameter * new_parameter(struct PMTM_instance * instance);
+int                index_parameter(struct PMTM_instance * instance, size_t param_idx, const char * parameter_name);
+long               add_name(struct PMTM_name_dictionary * dictionary, const char * group_name, const char * timer_name, PMTM_timer_type_t timer_type);
+/* @} */
+
+/** @name Formatting functions
+ @{ */
+size_t format_uint(char * text, uint64_t value);
+size_t format_int(char * text, int64_t value);
+size_t format_sci(char * text, double value);
+size_t format_fixed(char * text, double value);
+void line_start(struct PMTM_line * line, FILE * fid);
+void line_put(struct PMTM_line * line, const char * text);
+void line_put_int(struct PMTM_line * line, int64_t value);
+void line_put_uint(struct PMTM_line * line, uint64_t value);
+void line_put_sci(struct PMTM_line * line, double value);
+void line_put_fixed(struct PMTM_line * line, double value);
+void line_end(struct PMTM_line * line);
 /* @} */
 
 /** @name Output functions
  @{ */
 PMTM_error_t PMTM_internal_timer_output(struct PMTM_instance * instance, MPI_Comm PMTM_COMM);
+PMTM_error_t PMTM_internal_timer_output_begin(struct PMTM_instance * instance, MPI_Comm PMTM_COMM);
+PMTM_error_t PMTM_internal_timer_output_end(struct PMTM_instance * instance);
+void unpack_timer_record(const char * record_data, struct PMTM_timer * timer);
 PMTM_BOOL check_parameter(struct PMTM_instance * instance, const char * parameter_name, const char * parameter_value, PMTM_output_type_t output_type, int * count);
 void print_parameter_array(struct PMTM_instance * instance, const char * parameter_name, const char * parameter_values, int num_values, int * displacements);
 void print_timer(const struct PMTM_instance * instance, struct PMTM_timer * timer);
+void print_timer_line(const struct PMTM_instance * instance, struct PMTM_timer * timer, const char * rank_text);
 void print_overhead(const struct PMTM_instance * instance, const struct PMTM_timer * timer, uint timer_repeats);
+void print_clock_overhead(const struct PMTM_instance * instance, const struct PMTM_timer * timer, uint timer_repeats);
+void print_timer_summary(const struct PMTM_instance * instance, int node, PMTM_timer_type_t timer_type, struct PMTM_timer * avg_timer, struct PMTM_timer * max_timer, struct PMTM_timer * min_timer);
+void start_rank_lines(struct PMTM_rank_lines * lines, const struct PMTM_instance * instance);
+void print_rank_timer(struct PMTM_rank_lines * lines, struct PMTM_timer * timer);
+void end_rank_lines(struct PMTM_rank_lines * lines);
 void print_timer_array(const struct PMTM_instance * instance, uint totalthreads, struct PMTM_timer * timer_array, const char * timer_name, PMTM_timer_type_t timer_type);
+void print_node_timer_array(const struct PMTM_instance * instance, int node, uint totalthreads, struct PMTM_timer * timer_array, const char * timer_name, PMTM_timer_type_t timer_type);
+void start_timer_summary(uint32_t measure, struct PMTM_timer * avg_timer, struct PMTM_timer * max_timer, struct PMTM_timer * min_timer);
+void summarise_timer_array(uint totalthreads, struct PMTM_timer * timer_array, PMTM_timer_type_t timer_type, struct PMTM_timer * avg_timer, struct PMTM_timer * max_timer, struct PMTM_timer * min_timer);
 /* @} */
 
 /** @name Timing functions
  @{ */
 PMTM_error_t calc_overhead(const struct PMTM_instance * instance);
+void request_clock(int clock_id, PMTM_BOOL value);
+void choose_clock();
 void start_timer(struct PMTM_timer * timer);
 void stop_timer(struct PMTM_timer * timer);
 void pause_timer(struct PMTM_timer * timer);
@@ -239,10 +464,17 @@ double get_last_wc_time(struct PMTM_timer * timer);
 
 /** @name Miscalaneous functions
  @{ */
+int parse_buffer_size(const char * text, size_t * size);
+size_t get_stream_buffer();
+double get_collapse_tolerance();
+void get_rank_sample(struct PMTM_rank_sample * sample);
+FILE * open_writer(FILE * file);
 void log_flags(const char ** flags, uint num_flags);
 uint is_initialised();
 PMTM_error_t set_file(struct PMTM_instance * instance, const char * file_name);
 PMTM_error_t create_file(struct PMTM_instance * instance, const char * file_name);
+PMTM_error_t suspend_file(struct PMTM_instance * instance, long * size);
+PMTM_error_t resume_file(struct PMTM_instance * instance);
 PMTM_error_t write_file_header(struct PMTM_instance * instance);
 PMTM_error_t get_specific_runtime_variables(const struct PMTM_instance * instance);
 PMTM_error_t output_specific_runtime_variable(const struct PMTM_instance * instance, const char * envVar);
@@ -1,12 +1,12 @@
 /** 
- * @file   pmtm.c
+ * @file   pmtm_timer_output.c
  * @author AWE Plc.
  * 
- * This file defines the working of the PMTM API. Most of the actually work is
- * performed in the pmtm_internal code with these functions forwarding on the
- * calls to there. However, all MPI calls (if the code is compiled with MPI
- * enabled) are restricted to this file, with the pmtm_internal code MPI
- * agnostic.
+ * This file outputs the timers of every rank. The timers are packed into
+ * records, brought together on the IO rank (or written by each rank) and
+ * printed through the pmtm_internal code. All the MPI calls made to output the
+ * timers (if the code is compiled with MPI enabled) are restricted to this
+ * file, with the pmtm_internal code MPI agnostic.
  */
 
 #ifndef SERIAL
@@ -16,9 +16,19 @@
 #include "pmtm.h"
 #include "pmtm_internal.h"
 
+#include <limits.h>
 #include <math.h>
 #include <stdarg.h>
 #include <stdint.h>
+#include <string.h>
+
+#ifndef SERIAL
+#  include <pthread.h>
+#endif
+
+#ifdef _OPENMP
+#  include <omp.h>
+#endif
 
 #ifdef HW_COUNTERS
 #  include "hardware_counters.h"
@@ -37,9 +47,64 @@ extern "C" {
 // in with those in a consistent fashion. The real downside to this addition flexibility
 // is the amount of additional data sent, since all ranks must send all names as well as
 // timers. If that scales badly at any point, tree style reduction probably good to get
-// partial combined results and then do overall merge at the IO_RANK. Probably should
-// use a "send" version of the timer structure as too much data is getting sent on top
-// of the names.
+// partial combined results and then do overall merge at the IO_RANK.
+//
+// The names are only sent once. Before the timers are gathered, exchange_names gives
+// every (group, timer) name pair that some rank has not output before a global ID in
+// the name dictionary of the instance, which all ranks keep identical. Once every
+// name has an ID, which is usually from the second output on, this costs a single
+// reduction.
+//
+// Each rank then sends a package of: a struct PMTM_wire_header, then for each timer
+// its name ID, the number of threads and one struct PMTM_timer_record (plus any
+// hardware counters) per thread. The records only hold the statistics, so they are
+// half the size of a struct PMTM_timer and mean the same thing on every rank, and the
+// IO_RANK files them by ID without looking at any names. The timers of a package are
+// sorted by name ID, so the IO_RANK merges the packages in one pass, and only keeps
+// an entry for each package that sent a name.
+//
+// Only the timers whose type prints a line for each rank are gathered like this. The
+// PMTM_TIMER_MMA and PMTM_TIMER_AVO timers print just the average, maximum and minimum
+// over the ranks, so each rank summarises its own threads in a struct
+// PMTM_timer_summary per name and these are combined by an MPI_Reduce with a user
+// defined operation. A rank without a timer contributes an empty summary, so the
+// timers may still differ between ranks, and the IO_RANK only holds one summary per
+// name whatever the number of ranks. PMTM_TIMER_INT timers are not sent at all.
+//
+// Both steps go through the nodes. The ranks sharing a node send their packages to
+// the node leader, its lowest rank, which merges them into one package for the node
+// with a single entry per name, and only the leaders send to the IO_RANK. The
+// summaries are likewise reduced within each node and then between the leaders. So
+// the IO_RANK receives one message per node rather than per rank, and can print the
+// statistics of each node as well (PMTM_OPTION_NODE_STATS).
+//
+// All of this is still held at the IO_RANK at once. When PMTM_STREAM_BUFFER is set
+// the timers are instead streamed to it by stream_timers, one name and one window of
+// ranks at a time, so that the IO_RANK needs a fixed amount of memory however many
+// ranks there are.
+//
+// PMTM_timer_output_begin and PMTM_timer_output_end split an output in two, so that
+// the ranks can carry on computing while the timers are sent. Begin packages and
+// summarises a snapshot of the timers and posts an MPI_Igatherv and an MPI_Ireduce
+// of them straight to the IO_RANK, and end waits for these and prints the timers.
+// If MPI provides MPI_THREAD_MULTIPLE the IO_RANK does the waiting and formatting
+// on a thread of its own, started by begin, and end only writes out the text.
+//
+// Most of the time the line of every rank is not needed. With PMTM_SAMPLE_RANKS
+// set only a sample of the ranks, every Nth or the lowest of each node, puts its
+// gathered timers in its package, and the others send empty packages. All the
+// timers are summarised as for the collective write, so the statistics are
+// still over every rank, and with PMTM_OUTLIER_RANKS the summaries also carry
+// the records of the slowest and fastest timers of each name, reduced with an
+// MPI_Op of their own, whose lines are printed among those of the sample.
+//
+// Beyond a hundred thousand ranks even a single gather takes minutes. With
+// PMTM_OPTION_RANK_FILES there is no communication at all: each rank appends its
+// timers to a rank file of its own, named after the output file, whose name the
+// IO_RANK shared when the instance was created. The IO_RANK only writes a line
+// saying where they belong in the output file, and pmtm-merge puts the output
+// together after the run, giving the names IDs in the same order as
+// exchange_names would.
 
 // Things to think about:
 //
@@ -52,21 +117,341 @@ extern "C" {
 //
 //    - The printing mechanism does not show the group name if it is differentiated.
 //      Should that happen?
-//
-//    - The unit of transfer between ranks is "struct PMTM_timer". This has some
-//      pointers and other temporary stuff that has no use in a transmission, hence
-//      a slimmed down transfer version might be better to allow for a reduction in
-//      the amount of data sent.
 
-// Potential improvements?:
-//
-//    - Some timers have a min/max/average output form. Currently this is just of printing
-//      benefit, but potentially the MPI's reduction behaviour could get used. The downside
-//      is that this would probably throw away the ability to have mismatched timers and
-//      groups in different ranks, which is one of the big additions from the coding below.
+#define COPY_DATA(dst, src, len) do { memcpy((dst), (src), (len)); } while (0)
+#define COPY_TX(src, len) do { COPY_DATA(txcurr, (src), (len)); txcurr += (len); } while (0)
+
+/**
+ * Fill in the transfer record of a timer.
+ *
+ * @param timer  [IN]  The timer.
+ * @param rank   [IN]  The rank the timer is being sent from.
+ * @param record [OUT] The record to fill in.
+ */
+static void pack_timer_record(const struct PMTM_timer * timer, int rank, struct PMTM_timer_record * record)
+{
+    record->total_wc = timer->hot.total_wc;
+    record->total_cpu = timer->hot.total_cpu;
+    record->total_square_wc_hi = timer->hot.total_square_wc_hi;
+    record->total_square_wc_lo = timer->hot.total_square_wc_lo;
+    record->timer_count = timer->hot.timer_count;
+    record->pause_count = timer->hot.pause_count;
+    record->rank = rank;
+#ifdef _OPENMP
+    record->thread_id = timer->thread_id;
+#else
+    record->thread_id = 0;
+#endif
+    record->timer_type = timer->timer_type;
+    record->measure = timer->hot.measure;
+}
+
+/**
+ * Rebuild a timer for printing from its transfer record. The timer is not
+ * constructed, the caller sets its name and, with HW_COUNTERS, its counters.
+ *
+ * @param record_data [IN]  The record, possibly unaligned.
+ * @param timer       [OUT] The timer to fill in.
+ */
+void unpack_timer_record(const char * record_data, struct PMTM_timer * timer)
+{
+    struct PMTM_timer_record record;
+    memcpy(&record, record_data, sizeof(record));
+
+    memset(timer, 0, sizeof(*timer));
+    timer->hot.total_wc = record.total_wc;
+    timer->hot.total_cpu = record.total_cpu;
+    timer->hot.total_square_wc_hi = record.total_square_wc_hi;
+    timer->hot.total_square_wc_lo = record.total_square_wc_lo;
+    timer->hot.timer_count = record.timer_count;
+    timer->hot.pause_count = record.pause_count;
+    timer->hot.measure = record.measure;
+    timer->hot.phase = PMTM_PHASE_STOPPED;
+    timer->rank = record.rank;
+#ifdef _OPENMP
+    timer->thread_id = record.thread_id;
+#endif
+    timer->timer_type = record.timer_type;
+#ifdef PMTM_DEBUG
+    timer->state = TIMER_STOPPED;
+#endif
+}
+
+/**
+ * @returns the number of hardware counters sent after each timer record.
+ */
+static uint32_t get_num_wire_counters()
+{
+#ifdef HW_COUNTERS
+    return (uint32_t) get_num_hw_events();
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @returns whether timers of the given type only print their average, maximum
+ * and minimum over the ranks, which are reduced rather than gathered.
+ */
+static int is_summary_type(PMTM_timer_type_t timer_type)
+{
+    return (timer_type == PMTM_TIMER_MMA || timer_type == PMTM_TIMER_AVO);
+}
+
+/**
+ * @returns whether timers of the given type print a line for each rank, and so
+ * must be gathered at the IO_RANK.
+ */
+static int is_gathered_type(PMTM_timer_type_t timer_type)
+{
+    return (timer_type != PMTM_TIMER_INT && !is_summary_type(timer_type));
+}
+
+/**
+ * Make sure every (group, timer) name pair of the timers of an instance, on
+ * every rank, has a global ID in the name dictionary of the instance. The names
+ * that some rank has not seen are gathered at the IO_RANK, which gives the new
+ * ones the next IDs in rank order and broadcasts them so that every rank adds
+ * them in the same order. This must be called on all ranks, after the timer
+ * stores have been merged.
+ *
+ * @param instance  [IN] The instance whose timers are being output.
+ * @param PMTM_COMM [IN] The communicator of the instance.
+ * @returns PMTM_SUCCESS, or PMTM_ERROR_FAILED_ALLOCATION on every rank if any
+ * rank ran out of memory, in which case every dictionary is emptied.
+ */
+static PMTM_error_t exchange_names(struct PMTM_instance * instance, MPI_Comm PMTM_COMM)
+{
+    struct PMTM_name_dictionary * dictionary = &instance->names;
+    uint group_idx;
+    uint timer_idx;
+
+    // Pack this rank's new names as pairs of null terminated strings, each
+    // followed by the type of the timer.
+
+    int txcnt = 0;
+
+    for (group_idx = 0; group_idx < instance->num_groups; ++group_idx) {
+        struct PMTM_timer_group * group = get_timer_group(instance->group_ids[group_idx]);
+        for (timer_idx = 0; timer_idx < group->num_timers; ++timer_idx) {
+            struct PMTM_timer * timer = group->timer_ids[timer_idx];
+            if (find_name(dictionary, group->group_name, timer->timer_name) < 0) {
+                txcnt += strlen(group->group_name) + 1 + strlen(timer->timer_name) + 1 + sizeof(PMTM_timer_type_t);
+            }
+        }
+    }
+
+    char *txbuffer = malloc(txcnt + 1);
+    char *txcurr = txbuffer;
+
+    if (txbuffer != NULL) {
+        for (group_idx = 0; group_idx < instance->num_groups; ++group_idx) {
+            struct PMTM_timer_group * group = get_timer_group(instance->group_ids[group_idx]);
+            for (timer_idx = 0; timer_idx < group->num_timers; ++timer_idx) {
+                struct PMTM_timer * timer = group->timer_ids[timer_idx];
+                if (find_name(dictionary, group->group_name, timer->timer_name) < 0) {
+                    COPY_TX(group->group_name, strlen(group->group_name) + 1);
+                    COPY_TX(timer->timer_name, strlen(timer->timer_name) + 1);
+                    COPY_TX(&timer->timer_type, sizeof(PMTM_timer_type_t));
+                }
+            }
+        }
+    }
+
+    int local_fail = (txbuffer == NULL);
+    char *added = txbuffer;
+    int added_cnt = txcnt;
+
+#ifndef SERIAL
+    int totals[2] = { local_fail, txcnt }, global_totals[2];
+    MPI_Allreduce(totals, global_totals, 2, MPI_INT, MPI_SUM, PMTM_COMM);
+
+    if (global_totals[0] > 0 || global_totals[1] == 0) {
+        free(txbuffer);
+        return (global_totals[0] > 0) ? PMTM_ERROR_FAILED_ALLOCATION : PMTM_SUCCESS;
+    }
+
+    int *rxcnts = NULL, *rxdispls = NULL;
+    char *rxbuffer = NULL;
+    int rank;
+
+    if (instance->rank == IO_RANK) {
+        rxcnts = malloc(instance->nranks * sizeof(int));
+        rxdispls = malloc(instance->nranks * sizeof(int));
+        local_fail = (rxcnts == NULL || rxdispls == NULL);
+    }
+
+    // Only the IO_RANK allocates anything before the gathers, so it tells the
+    // others whether it failed.
+    MPI_Bcast(&local_fail, 1, MPI_INT, IO_RANK, PMTM_COMM);
+
+    int total_rxcnt = 0;
+
+    if (!local_fail) {
+        MPI_Gather(&txcnt, 1, MPI_INT, rxcnts, 1, MPI_INT, IO_RANK, PMTM_COMM);
+
+        if (instance->rank == IO_RANK) {
+            for (rank = 0; rank < instance->nranks; rank++) {
+                rxdispls[rank] = total_rxcnt;
+                total_rxcnt += rxcnts[rank];
+            }
+            rxbuffer = malloc(total_rxcnt + 1);
+            local_fail = (rxbuffer == NULL);
+        }
+
+        MPI_Bcast(&local_fail, 1, MPI_INT, IO_RANK, PMTM_COMM);
+    }
+
+    if (local_fail) {
+        free(txbuffer);
+        free(rxcnts);
+        free(rxdispls);
+        free(rxbuffer);
+        return PMTM_ERROR_FAILED_ALLOCATION;
+    }
+
+    MPI_Gatherv(txbuffer, txcnt, MPI_CHAR,
+                rxbuffer, rxcnts, rxdispls, MPI_CHAR, IO_RANK, PMTM_COMM);
+
+    free(txbuffer);
+    free(rxcnts);
+    free(rxdispls);
+
+    // The IO_RANK adds the names it has not seen, in rank order, and sends them
+    // out again in that order.
+
+    added = NULL;
+    added_cnt = 0;
+
+    if (instance->rank == IO_RANK) {
+        const size_t first_new = dictionary->num_names;
+        char *rxcurr = rxbuffer;
+
+        while (!local_fail && rxcurr < rxbuffer + total_rxcnt) {
+            const char *group_name = rxcurr;
+            const char *timer_name = group_name + strlen(group_name) + 1;
+            PMTM_timer_type_t timer_type;
+            rxcurr = (char *) timer_name + strlen(timer_name) + 1;
+            COPY_DATA(&timer_type, rxcurr, sizeof(timer_type));
+            rxcurr += sizeof(timer_type);
+
+            if (find_name(dictionary, group_name, timer_name) < 0) {
+                local_fail = (add_name(dictionary, group_name, timer_name, timer_type) < 0);
+            }
+        }
+        free(rxbuffer);
+
+        size_t name_id;
+        for (name_id = first_new; name_id < dictionary->num_names; ++name_id) {
+            added_cnt += strlen(dictionary->names[name_id].group_name) + 1
+                       + strlen(dictionary->names[name_id].timer_name) + 1 + sizeof(PMTM_timer_type_t);
+        }
+
+        if (!local_fail && (added = malloc(added_cnt + 1)) != NULL) {
+            txcurr = added;
+            for (name_id = first_new; name_id < dictionary->num_names; ++name_id) {
+                COPY_TX(dictionary->names[name_id].group_name, strlen(dictionary->names[name_id].group_name) + 1);
+                COPY_TX(dictionary->names[name_id].timer_name, strlen(dictionary->names[name_id].timer_name) + 1);
+                COPY_TX(&dictionary->names[name_id].timer_type, sizeof(PMTM_timer_type_t));
+            }
+        }
+
+        if (local_fail || added == NULL) {
+            local_fail = 1;
+            added_cnt = -1;
+        }
+    }
+
+    MPI_Bcast(&added_cnt, 1, MPI_INT, IO_RANK, PMTM_COMM);
+
+    if (added_cnt < 0) {
+        destruct_name_dictionary(dictionary);
+        return PMTM_ERROR_FAILED_ALLOCATION;
+    }
+
+    if (instance->rank != IO_RANK) {
+        added = malloc(added_cnt + 1);
+        local_fail = (added == NULL);
+    }
+
+    int any_alloc_fail;
+    MPI_Allreduce(&local_fail, &any_alloc_fail, 1, MPI_INT, MPI_MAX, PMTM_COMM);
+
+    if (any_alloc_fail) {
+        free(added);
+        destruct_name_dictionary(dictionary);
+        return PMTM_ERROR_FAILED_ALLOCATION;
+    }
+
+    MPI_Bcast(added, added_cnt, MPI_CHAR, IO_RANK, PMTM_COMM);
+#endif
+
+    // Add the new names in the order given. The IO_RANK has already done so.
+
+    if (instance->nranks == 1 || instance->rank != IO_RANK) {
+        char *curr = added;
+
+        while (!local_fail && curr < added + added_cnt) {
+            const char *group_name = curr;
+            const char *timer_name = group_name + strlen(group_name) + 1;
+            PMTM_timer_type_t timer_type;
+            curr = (char *) timer_name + strlen(timer_name) + 1;
+            COPY_DATA(&timer_type, curr, sizeof(timer_type));
+            curr += sizeof(timer_type);
+
+            if (find_name(dictionary, group_name, timer_name) < 0) {
+                local_fail = (add_name(dictionary, group_name, timer_name, timer_type) < 0);
+            }
+        }
+    }
+    free(added);
+
+    int any_fail = local_fail;
+#ifndef SERIAL
+    MPI_Allreduce(&local_fail, &any_fail, 1, MPI_INT, MPI_MAX, PMTM_COMM);
+#endif
 
+    if (any_fail) {
+        destruct_name_dictionary(dictionary);
+        return PMTM_ERROR_FAILED_ALLOCATION;
+    }
+    return PMTM_SUCCESS;
+}
+
+/**
+ * A timer to be sent, with the name ID it is sorted on. The position of the
+ * timer in its group breaks ties, so a name a rank has twice keeps its order.
+ */
+struct PMTM_wire_timer {
+    uint32_t name_id;               /**< The ID of the name of the timer. */
+    uint32_t order;                 /**< The position of the timer on the rank. */
+    struct PMTM_timer * timer;      /**< The timer of the first thread. */
+};
+
+static int compare_wire_timers(const void * a, const void * b)
+{
+    const struct PMTM_wire_timer * lhs = a;
+    const struct PMTM_wire_timer * rhs = b;
+
+    if (lhs->name_id != rhs->name_id) return (lhs->name_id < rhs->name_id) ? -1 : 1;
+    if (lhs->order != rhs->order) return (lhs->order < rhs->order) ? -1 : 1;
+    return 0;
+}
 
-static void compute_txamount_and_package(struct PMTM_instance * instance, int *ret_txcnt, char **ret_txbuffer) {
+/**
+ * Package the timers of this rank that print a line for each rank, to be
+ * gathered at the IO_RANK. When only a sample of the ranks is gathered, a rank
+ * outside the sample sends a package of no timers, so their data never leaves
+ * the rank, and the IO_RANK prints them from the summaries.
+ *
+ * @param instance     [IN]  The instance being output.
+ * @param sample       [IN]  The ranks sampled, or NULL to send from every rank.
+ * @param is_leader    [IN]  Whether this rank is the lowest of its node.
+ * @param ret_txcnt    [OUT] The size of the package.
+ * @param ret_txbuffer [OUT] The package, NULL if it could not be allocated.
+ */
+static void compute_txamount_and_package(struct PMTM_instance * instance, const struct PMTM_rank_sample *sample,
+                                         int is_leader, int *ret_txcnt, char **ret_txbuffer) {
 
     // Should we lock something during this count? No, the user manual says all
     // activity should have ceased in threads.
@@ -74,22 +459,54 @@ static void compute_txamount_and_package(struct PMTM_instance * instance, int *r
     uint group_idx;
     uint timer_idx;
 
-    int timers = 0, unique_timers = 0, txcnt =  0;
-    char *txbuffer;
+    const int sampled = (sample == NULL || sample->every < 0
+                         || (sample->every > 0 && instance->rank % sample->every == 0)
+                         || (sample->per_node && is_leader));
+
+    int txcnt =  0;
+    uint32_t num_timers = 0;
+    uint32_t max_timers = 0;
+    uint32_t wire_idx;
+    struct PMTM_wire_timer *wire_timers;
+    char *txbuffer = NULL;
+
+    const uint32_t num_counters = get_num_wire_counters();
+    const size_t record_stride = sizeof(struct PMTM_timer_record) + num_counters * sizeof(int64_t);
+
+    for (group_idx = 0; group_idx < instance->num_groups; ++group_idx) {
+        max_timers += get_timer_group(instance->group_ids[group_idx])->num_timers;
+    }
+
+    wire_timers = malloc(max_timers * sizeof(*wire_timers) + 1);
+    if (wire_timers == NULL) {
+        *ret_txcnt = 0;
+        *ret_txbuffer = NULL;
+        return;
+    }
 
     // Count the space needed
 
+    txcnt += sizeof(struct PMTM_wire_header);
+
     for (group_idx = 0; group_idx < instance->num_groups; ++group_idx) {
         PMTM_timer_group_t group_id = instance->group_ids[group_idx];
         struct PMTM_timer_group * group = get_timer_group(group_id);
 
-        txcnt += sizeof(group->num_timers) + strlen(group->group_name) + 1;
-        txcnt += group->num_timers * sizeof(int);
-        txcnt += group->total_timers * sizeof(struct PMTM_timer);
-
         for (timer_idx = 0; timer_idx < group->num_timers; ++timer_idx) {
             struct PMTM_timer * timer = group->timer_ids[timer_idx];
-            txcnt += strlen(timer->timer_name) + 1;
+            struct PMTM_timer * tim;
+
+            uint32_t name_id = (uint32_t) find_name(&instance->names, group->group_name, timer->timer_name);
+            if (sampled && is_gathered_type(instance->names.names[name_id].timer_type)) {
+                wire_timers[num_timers].name_id = name_id;
+                wire_timers[num_timers].order = num_timers;
+                wire_timers[num_timers].timer = timer;
+                num_timers++;
+                txcnt += 2 * sizeof(uint32_t);
+                for (tim = timer; tim != NULL; tim = tim->thread_next) {
+                    txcnt += record_stride;
+                }
+            }
 
 #ifdef PMTM_DEBUG
             if (timer->state != TIMER_STOPPED) {
@@ -98,222 +515,1986 @@ static void compute_txamount_and_package(struct PMTM_instance * instance, int *r
                 pmtm_warn("Requested wallclock time on timer %s that was in state %s, timer must be in %s state",
                         timer->timer_name, this_state, good_state);
 
-                // Removed abort here as the ranks could get out of sync if the timers don't match otherwise.
+                // Removed abort here as the ranks could get out of sync if the timers don't match otherwise.
+            }
+#endif
+        }
+    }
+
+    // The package is sent in name ID order, so that the IO_RANK can merge the
+    // packages of all the ranks in a single pass.
+
+    qsort(wire_timers, num_timers, sizeof(*wire_timers), compare_wire_timers);
+
+    // Allocate a buffer
+
+    if ((txbuffer = malloc(txcnt)) != NULL) {
+        // Pack data
+
+        char *txcurr = txbuffer;
+
+        struct PMTM_wire_header header;
+        header.magic = PMTM_WIRE_MAGIC;
+        header.version = PMTM_WIRE_VERSION;
+        header.record_size = sizeof(struct PMTM_timer_record);
+        header.num_counters = num_counters;
+        header.num_timers = num_timers;
+        COPY_TX(&header, sizeof(header));
+
+        // Should pack with memcpy to cope with platforms that can't do
+        // unaligned access without SIGSEGV-ing.
+
+        for (wire_idx = 0; wire_idx < num_timers; ++wire_idx) {
+            uint32_t name_id = wire_timers[wire_idx].name_id;
+
+            COPY_TX(&name_id, sizeof(name_id));
+            char *tx_tclocation = txcurr;
+            txcurr += sizeof(uint32_t);
+
+            uint32_t threadcount = 0;
+            struct PMTM_timer * tim;
+            for (tim = wire_timers[wire_idx].timer; tim != NULL; tim = tim->thread_next) {
+                struct PMTM_timer_record record;
+                pack_timer_record(tim, instance->rank, &record);
+                COPY_TX(&record, sizeof(record));
+#ifdef HW_COUNTERS
+                uint32_t counter_idx;
+                for (counter_idx = 0; counter_idx < num_counters; ++counter_idx) {
+                    int64_t counter = tim->total_counters[counter_idx];
+                    COPY_TX(&counter, sizeof(counter));
+                }
+#endif
+                threadcount++;
+            }
+            COPY_DATA(tx_tclocation, &threadcount, sizeof(threadcount));
+        }
+    }
+
+    free(wire_timers);
+
+    *ret_txcnt = txcnt;
+    *ret_txbuffer = txbuffer;
+}
+
+#define NO_KEY UINT64_MAX
+
+/**
+ * One of the timers picked out as the maximum or minimum by a summary. The key
+ * orders the timers as print_timer_array sees them, by rank and then thread, so
+ * that ties are broken the same way.
+ */
+struct PMTM_summary_timer
+{
+    uint64_t key;                /**< (rank << 32) + thread position, NO_KEY if no timer has been picked. */
+    uint64_t total_wc;           /**< The total wallclock ticks of the timer. */
+    uint64_t total_cpu;          /**< The total CPU ticks of the timer. */
+    uint64_t total_square_wc_hi; /**< The top 64 bits of the sum of the squared wallclock ticks. */
+    uint64_t total_square_wc_lo; /**< The bottom 64 bits of the sum of the squared wallclock ticks. */
+    uint64_t timer_count;        /**< The number of blocks timed. */
+};
+
+/**
+ * What print_timer_array needs of all the timers with a name for a summary
+ * timer type: the sums for the average and the timers with the most and least
+ * wallclock time. Summaries are combined pairwise by MPI_Reduce with
+ * summary_op, so the IO_RANK only ever holds one per name. Every field is a
+ * uint64_t so that the MPI datatype is a contiguous run of MPI_UINT64_T.
+ */
+struct PMTM_timer_summary
+{
+    struct PMTM_summary_timer sum; /**< The sums over all the timers, the key is unused. */
+    struct PMTM_summary_timer max; /**< The timer with the most wallclock time. */
+    struct PMTM_summary_timer min; /**< The timer with the least wallclock time. */
+    uint64_t first_key;            /**< The key of the first timer. */
+    uint64_t first_measure;        /**< The clocks read by the first timer, as printed. */
+};
+
+#define SUMMARY_WORDS (sizeof(struct PMTM_timer_summary) / sizeof(uint64_t))
+
+/**
+ * Make a summary of no timers.
+ */
+static void empty_summary(struct PMTM_timer_summary * summary)
+{
+    memset(summary, 0, sizeof(*summary));
+    summary->max.key = NO_KEY;
+    summary->min.key = NO_KEY;
+    summary->min.total_wc = UINT64_MAX;
+    summary->first_key = NO_KEY;
+}
+
+/**
+ * Combine the summary in into the summary inout. The result does not depend on
+ * the order in which summaries are combined.
+ */
+static void combine_summary(const struct PMTM_timer_summary * in, struct PMTM_timer_summary * inout)
+{
+    uint64_t lo = inout->sum.total_square_wc_lo + in->sum.total_square_wc_lo;
+    inout->sum.total_square_wc_hi += in->sum.total_square_wc_hi + (lo < in->sum.total_square_wc_lo);
+    inout->sum.total_square_wc_lo = lo;
+    inout->sum.total_wc += in->sum.total_wc;
+    inout->sum.total_cpu += in->sum.total_cpu;
+    inout->sum.timer_count += in->sum.timer_count;
+
+    if (in->max.key != NO_KEY
+            && (inout->max.key == NO_KEY || in->max.total_wc > inout->max.total_wc
+                || (in->max.total_wc == inout->max.total_wc && in->max.key < inout->max.key))) {
+        inout->max = in->max;
+    }
+
+    if (in->min.key != NO_KEY
+            && (inout->min.key == NO_KEY || in->min.total_wc < inout->min.total_wc
+                || (in->min.total_wc == inout->min.total_wc && in->min.key < inout->min.key))) {
+        inout->min = in->min;
+    }
+
+    if (in->first_key < inout->first_key) {
+        inout->first_key = in->first_key;
+        inout->first_measure = in->first_measure;
+    }
+}
+
+/**
+ * Add a timer to a summary.
+ *
+ * @param summary [IN/OUT] The summary.
+ * @param timer   [IN]     The timer.
+ * @param key     [IN]     The position of the timer, see struct PMTM_summary_timer.
+ */
+static void add_to_summary(struct PMTM_timer_summary * summary, const struct PMTM_timer * timer, uint64_t key)
+{
+    struct PMTM_timer_summary single;
+    struct PMTM_summary_timer picked;
+
+    picked.key = key;
+    picked.total_wc = timer->hot.total_wc;
+    picked.total_cpu = timer->hot.total_cpu;
+    picked.total_square_wc_hi = timer->hot.total_square_wc_hi;
+    picked.total_square_wc_lo = timer->hot.total_square_wc_lo;
+    picked.timer_count = timer->hot.timer_count;
+
+    empty_summary(&single);
+    single.sum = picked;
+    // As in print_timer_array, only a timer with some wallclock time can be the maximum.
+    if (picked.total_wc > 0) single.max = picked;
+    single.min = picked;
+    single.first_key = key;
+    single.first_measure = timer->hot.measure;
+
+    combine_summary(&single, summary);
+}
+
+#ifndef SERIAL
+/**
+ * The MPI_Op combining arrays of summaries.
+ */
+static void summary_op(void * in, void * inout, int * len, MPI_Datatype * datatype)
+{
+    const struct PMTM_timer_summary * in_summaries = in;
+    struct PMTM_timer_summary * inout_summaries = inout;
+    int idx;
+
+    (void) datatype;
+    for (idx = 0; idx < *len; idx++) {
+        combine_summary(&in_summaries[idx], &inout_summaries[idx]);
+    }
+}
+#endif
+
+#ifdef HW_COUNTERS
+#define MAX_OUTLIER_COUNTERS 16 /**< Room for the hardware counters of an outlier, more than hardware_counters.c lists. */
+#endif
+
+/**
+ * One of the slowest or fastest timers of a name (PMTM_OUTLIER_RANKS), with the
+ * key of struct PMTM_summary_timer. Each slot of the summaries keeps a list of
+ * the slowest, by total wallclock time, followed by a list of the fastest,
+ * each best first and padded with empty places, and the lists of all the ranks
+ * are combined by MPI_Reduce with outlier_op.
+ */
+struct PMTM_timer_outlier
+{
+    uint64_t key;                    /**< (rank << 32) + thread position, NO_KEY for an empty place. */
+    struct PMTM_timer_record record; /**< The timer. */
+#ifdef HW_COUNTERS
+    int64_t counters[MAX_OUTLIER_COUNTERS]; /**< The totals of its hardware counters, the first get_num_wire_counters() used. */
+#endif
+};
+
+/**
+ * @returns whether timer a is slower than timer b, ties going to the first.
+ */
+static int is_slower(const struct PMTM_timer_outlier * a, const struct PMTM_timer_outlier * b)
+{
+    return a->record.total_wc > b->record.total_wc
+        || (a->record.total_wc == b->record.total_wc && a->key < b->key);
+}
+
+/**
+ * @returns whether timer a is faster than timer b, ties going to the first.
+ */
+static int is_faster(const struct PMTM_timer_outlier * a, const struct PMTM_timer_outlier * b)
+{
+    return a->record.total_wc < b->record.total_wc
+        || (a->record.total_wc == b->record.total_wc && a->key < b->key);
+}
+
+/**
+ * Add a timer to a list of outliers, in its place if it is among the best.
+ *
+ * @param list         [IN/OUT] The list, best first.
+ * @param num_outliers [IN]     The length of the list.
+ * @param outlier      [IN]     The timer to add, ignored if empty.
+ * @param is_better    [IN]     is_slower or is_faster.
+ */
+static void add_outlier(struct PMTM_timer_outlier * list, int num_outliers, const struct PMTM_timer_outlier * outlier,
+                        int (*is_better)(const struct PMTM_timer_outlier *, const struct PMTM_timer_outlier *))
+{
+    int place = 0;
+
+    if (outlier->key == NO_KEY) return;
+
+    while (place < num_outliers && list[place].key != NO_KEY && !is_better(outlier, &list[place])) {
+        place++;
+    }
+    if (place == num_outliers) return;
+
+    memmove(&list[place + 1], &list[place], (num_outliers - place - 1) * sizeof(*list));
+    list[place] = *outlier;
+}
+
+#ifndef SERIAL
+/**
+ * Combine the slowest and fastest lists of a slot in into those of inout.
+ */
+static void combine_outliers(const struct PMTM_timer_outlier * in, struct PMTM_timer_outlier * inout, int num_outliers)
+{
+    int idx;
+    for (idx = 0; idx < num_outliers; idx++) {
+        add_outlier(inout, num_outliers, &in[idx], is_slower);
+        add_outlier(inout + num_outliers, num_outliers, &in[num_outliers + idx], is_faster);
+    }
+}
+
+/**
+ * The MPI_Op combining arrays of outlier lists. Each element of the datatype
+ * is the two lists of a slot, so the length of the lists is found from its size.
+ */
+static void outlier_op(void * in, void * inout, int * len, MPI_Datatype * datatype)
+{
+    const struct PMTM_timer_outlier * in_outliers = in;
+    struct PMTM_timer_outlier * inout_outliers = inout;
+    int size, num_outliers, idx;
+
+    MPI_Type_size(*datatype, &size);
+    num_outliers = size / (2 * (int) sizeof(struct PMTM_timer_outlier));
+    for (idx = 0; idx < *len; idx++) {
+        combine_outliers(&in_outliers[idx * 2 * num_outliers], &inout_outliers[idx * 2 * num_outliers], num_outliers);
+    }
+}
+#endif
+
+/**
+ * The summaries of the timers with a summary type, reduced at the IO_RANK.
+ * Each name ID with a summary type has a slot in the summaries array.
+ */
+struct Reduced_Timers {
+    size_t num_names;                       /**< The number of entries in slots. */
+    long *slots;                            /**< The slot of each name ID, -1 if it is not summarised. */
+    int num_summaries;                      /**< The number of slots. */
+    struct PMTM_timer_summary *summaries;   /**< This rank's summaries. */
+    struct PMTM_timer_summary *node;        /**< The summaries over the ranks of the node, at the node leaders. */
+    struct PMTM_timer_summary *reduced;     /**< The summaries over all ranks, at the IO_RANK. */
+    int node_stats;                         /**< Whether the summaries of each node are printed. */
+    int num_nodes;                          /**< The number of nodes in all_nodes. */
+    struct PMTM_timer_summary *all_nodes;   /**< The summaries of each node in turn, at the IO_RANK if node_stats is set. */
+    int sampled;                            /**< Whether the gathered types are summarised as only a sample of their ranks is gathered. */
+    int num_outliers;                       /**< The length of each list of slowest and fastest timers, 0 for none. */
+    struct PMTM_timer_outlier *outliers;    /**< This rank's slowest and fastest timers, two lists for each slot. */
+    struct PMTM_timer_outlier *node_outliers;    /**< Those of the ranks of the node, at the node leaders. */
+    struct PMTM_timer_outlier *reduced_outliers; /**< Those of all ranks, at the IO_RANK. */
+};
+
+static void free_reduced_timers(struct Reduced_Timers *rtimers) {
+    free(rtimers->slots);
+    free(rtimers->summaries);
+    free(rtimers->node);
+    free(rtimers->reduced);
+    free(rtimers->all_nodes);
+    free(rtimers->outliers);
+    free(rtimers->node_outliers);
+    free(rtimers->reduced_outliers);
+    memset(rtimers, 0, sizeof(*rtimers));
+}
+
+/**
+ * Give each name with a summary type a slot and summarise this rank's timers
+ * into them. The same slots are chosen on every rank, as the name dictionaries
+ * are the same.
+ *
+ * @param instance  [IN]  The instance being output.
+ * @param rtimers   [OUT] The summaries.
+ * @param is_leader  [IN]  Whether this rank is the leader of its node.
+ * @param num_nodes  [IN]  The number of nodes, only needed at the IO_RANK.
+ * @param node_stats [IN]  Whether the summaries of each node are printed.
+ * @param all_types  [IN]  Whether to summarise the gathered types as well, when
+ *                         their timers are not all gathered.
+ * @param sample     [IN]  The ranks sampled, or NULL if every rank is gathered.
+ *                         With a sample the slowest and fastest timers of the
+ *                         gathered types are kept as well.
+ * @returns 0 if successful, 1 if the memory could not be allocated.
+ */
+static int summarise_timers(struct PMTM_instance *instance, struct Reduced_Timers *rtimers,
+                            int is_leader, int num_nodes, int node_stats, int all_types,
+                            const struct PMTM_rank_sample *sample)
+{
+    const struct PMTM_name_dictionary *dictionary = &instance->names;
+    uint group_idx, timer_idx;
+    size_t name_id;
+    int slot;
+
+    rtimers->node_stats = node_stats;
+    rtimers->sampled = (sample != NULL && sample->every >= 0);
+    rtimers->num_outliers = rtimers->sampled ? sample->outliers : 0;
+#ifdef HW_COUNTERS
+    if (rtimers->num_outliers > 0 && get_num_wire_counters() > MAX_OUTLIER_COUNTERS) {
+        pmtm_warn("Too many hardware counters to keep the slowest and fastest ranks, ignoring PMTM_OUTLIER_RANKS");
+        rtimers->num_outliers = 0;
+    }
+#endif
+    rtimers->num_names = dictionary->num_names;
+    rtimers->slots = malloc((dictionary->num_names + 1) * sizeof(long));
+    if (rtimers->slots == NULL) return 1;
+
+    rtimers->num_summaries = 0;
+    for (name_id = 0; name_id < dictionary->num_names; name_id++) {
+        PMTM_timer_type_t timer_type = dictionary->names[name_id].timer_type;
+        int summarised = is_summary_type(timer_type) || (all_types && is_gathered_type(timer_type));
+        rtimers->slots[name_id] = summarised ? rtimers->num_summaries++ : -1;
+    }
+
+    if (rtimers->num_summaries == 0) return 0;
+
+    rtimers->summaries = malloc(rtimers->num_summaries * sizeof(struct PMTM_timer_summary));
+    if (rtimers->summaries == NULL) return 1;
+    if (is_leader) {
+        rtimers->node = malloc(rtimers->num_summaries * sizeof(struct PMTM_timer_summary));
+        if (rtimers->node == NULL) return 1;
+    }
+    if (instance->rank == IO_RANK) {
+        rtimers->reduced = malloc(rtimers->num_summaries * sizeof(struct PMTM_timer_summary));
+        if (rtimers->reduced == NULL) return 1;
+        if (rtimers->node_stats) {
+            rtimers->num_nodes = num_nodes;
+            rtimers->all_nodes = malloc(num_nodes * rtimers->num_summaries * sizeof(struct PMTM_timer_summary));
+            if (rtimers->all_nodes == NULL) return 1;
+        }
+    }
+
+    if (rtimers->num_outliers > 0) {
+        const size_t outliers_size = rtimers->num_summaries * 2 * rtimers->num_outliers * sizeof(struct PMTM_timer_outlier);
+        rtimers->outliers = malloc(outliers_size);
+        if (rtimers->outliers == NULL) return 1;
+        if (is_leader) {
+            rtimers->node_outliers = malloc(outliers_size);
+            if (rtimers->node_outliers == NULL) return 1;
+        }
+        if (instance->rank == IO_RANK) {
+            rtimers->reduced_outliers = malloc(outliers_size);
+            if (rtimers->reduced_outliers == NULL) return 1;
+        }
+        for (slot = 0; slot < rtimers->num_summaries * 2 * rtimers->num_outliers; slot++) {
+            rtimers->outliers[slot].key = NO_KEY;
+        }
+    }
+
+    for (slot = 0; slot < rtimers->num_summaries; slot++) {
+        empty_summary(&rtimers->summaries[slot]);
+    }
+
+    for (group_idx = 0; group_idx < instance->num_groups; ++group_idx) {
+        struct PMTM_timer_group * group = get_timer_group(instance->group_ids[group_idx]);
+
+        for (timer_idx = 0; timer_idx < group->num_timers; ++timer_idx) {
+            struct PMTM_timer * timer = group->timer_ids[timer_idx];
+            size_t timer_name_id = find_name(dictionary, group->group_name, timer->timer_name);
+            long timer_slot = rtimers->slots[timer_name_id];
+            if (timer_slot < 0) continue;
+
+            struct PMTM_timer_outlier *outliers = NULL;
+            if (rtimers->num_outliers > 0 && is_gathered_type(dictionary->names[timer_name_id].timer_type)) {
+                outliers = &rtimers->outliers[timer_slot * 2 * rtimers->num_outliers];
+            }
+
+            uint64_t key = (uint64_t) instance->rank << 32;
+            struct PMTM_timer * tim;
+            for (tim = timer; tim != NULL; tim = tim->thread_next) {
+                if (outliers != NULL) {
+                    struct PMTM_timer_outlier outlier;
+                    outlier.key = key;
+                    pack_timer_record(tim, instance->rank, &outlier.record);
+#ifdef HW_COUNTERS
+                    uint32_t counter_idx;
+                    memset(outlier.counters, 0, sizeof(outlier.counters));
+                    for (counter_idx = 0; counter_idx < get_num_wire_counters(); ++counter_idx) {
+                        outlier.counters[counter_idx] = tim->total_counters[counter_idx];
+                    }
+#endif
+                    // As for the maximum, only a timer with some wallclock time can be the slowest.
+                    if (outlier.record.total_wc > 0) add_outlier(outliers, rtimers->num_outliers, &outlier, is_slower);
+                    add_outlier(outliers + rtimers->num_outliers, rtimers->num_outliers, &outlier, is_faster);
+                }
+                add_to_summary(&rtimers->summaries[timer_slot], tim, key++);
+            }
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Reduce the summaries of every rank at the IO_RANK, with an MPI datatype and
+ * operation made for struct PMTM_timer_summary. The ranks of each node are
+ * reduced at their leader first, then the leaders are reduced at the IO_RANK,
+ * or gathered there if the summaries of each node are to be printed.
+ */
+static void reduce_timers(struct PMTM_instance *instance, struct Reduced_Timers *rtimers,
+                          MPI_Comm node_comm, MPI_Comm leader_comm)
+{
+    if (rtimers->num_summaries == 0) return;
+
+#ifndef SERIAL
+    MPI_Datatype summary_type;
+    MPI_Op summary_reduce;
+
+    MPI_Type_contiguous(SUMMARY_WORDS, MPI_UINT64_T, &summary_type);
+    MPI_Type_commit(&summary_type);
+    MPI_Op_create(summary_op, 1, &summary_reduce);
+
+    MPI_Reduce(rtimers->summaries, rtimers->node, rtimers->num_summaries,
+               summary_type, summary_reduce, 0, node_comm);
+
+    if (leader_comm != MPI_COMM_NULL) {
+        if (rtimers->node_stats) {
+            MPI_Gather(rtimers->node, rtimers->num_summaries, summary_type,
+                       rtimers->all_nodes, rtimers->num_summaries, summary_type, 0, leader_comm);
+
+            if (instance->rank == IO_RANK) {
+                int node, slot;
+                memcpy(rtimers->reduced, rtimers->all_nodes, rtimers->num_summaries * sizeof(struct PMTM_timer_summary));
+                for (node = 1; node < rtimers->num_nodes; node++) {
+                    for (slot = 0; slot < rtimers->num_summaries; slot++) {
+                        combine_summary(&rtimers->all_nodes[node * rtimers->num_summaries + slot], &rtimers->reduced[slot]);
+                    }
+                }
+            }
+        } else {
+            MPI_Reduce(rtimers->node, rtimers->reduced, rtimers->num_summaries,
+                       summary_type, summary_reduce, 0, leader_comm);
+        }
+    }
+
+    MPI_Op_free(&summary_reduce);
+    MPI_Type_free(&summary_type);
+
+    // The slowest and fastest timers take the same route, but are never
+    // needed for each node.
+
+    if (rtimers->num_outliers > 0) {
+        MPI_Datatype outlier_type;
+        MPI_Op outlier_reduce;
+
+        MPI_Type_contiguous(2 * rtimers->num_outliers * sizeof(struct PMTM_timer_outlier), MPI_BYTE, &outlier_type);
+        MPI_Type_commit(&outlier_type);
+        MPI_Op_create(outlier_op, 1, &outlier_reduce);
+
+        MPI_Reduce(rtimers->outliers, rtimers->node_outliers, rtimers->num_summaries,
+                   outlier_type, outlier_reduce, 0, node_comm);
+        if (leader_comm != MPI_COMM_NULL) {
+            MPI_Reduce(rtimers->node_outliers, rtimers->reduced_outliers, rtimers->num_summaries,
+                       outlier_type, outlier_reduce, 0, leader_comm);
+        }
+
+        MPI_Op_free(&outlier_reduce);
+        MPI_Type_free(&outlier_type);
+    }
+#else
+    memcpy(rtimers->reduced, rtimers->summaries, rtimers->num_summaries * sizeof(struct PMTM_timer_summary));
+    if (rtimers->num_outliers > 0) {
+        memcpy(rtimers->reduced_outliers, rtimers->outliers,
+               rtimers->num_summaries * 2 * rtimers->num_outliers * sizeof(struct PMTM_timer_outlier));
+    }
+#endif
+}
+
+/**
+ * Print the lines of a timer from its summary over all ranks, or over the
+ * ranks of a node, as print_timer_array would from all the timers.
+ */
+static void print_summary(struct PMTM_instance *instance, int node, const struct PMTM_name *name,
+                          const struct PMTM_timer_summary *summary)
+{
+    struct PMTM_timer avg_timer;
+    struct PMTM_timer max_timer;
+    struct PMTM_timer min_timer;
+
+    construct_timer(&avg_timer, name->timer_name, PMTM_TIMER_AVG);
+    construct_timer(&max_timer, name->timer_name, PMTM_TIMER_MAX);
+    construct_timer(&min_timer, name->timer_name, PMTM_TIMER_MIN);
+
+    avg_timer.hot.measure = summary->first_measure;
+    max_timer.hot.measure = summary->first_measure;
+    min_timer.hot.measure = summary->first_measure;
+
+    // print_timer_array only sums the timers for types including the average.
+    if (name->timer_type & PMTM_TIMER_AVG) {
+        avg_timer.hot.total_wc = summary->sum.total_wc;
+        avg_timer.hot.total_cpu = summary->sum.total_cpu;
+        avg_timer.hot.total_square_wc_hi = summary->sum.total_square_wc_hi;
+        avg_timer.hot.total_square_wc_lo = summary->sum.total_square_wc_lo;
+        avg_timer.hot.timer_count = summary->sum.timer_count;
+    }
+
+    if (summary->max.key != NO_KEY) {
+        max_timer.hot.total_wc = summary->max.total_wc;
+        max_timer.hot.total_cpu = summary->max.total_cpu;
+        max_timer.hot.total_square_wc_hi = summary->max.total_square_wc_hi;
+        max_timer.hot.total_square_wc_lo = summary->max.total_square_wc_lo;
+        max_timer.hot.timer_count = summary->max.timer_count;
+    }
+
+    min_timer.hot.total_wc = summary->min.total_wc;
+    min_timer.hot.total_cpu = summary->min.total_cpu;
+    min_timer.hot.total_square_wc_hi = summary->min.total_square_wc_hi;
+    min_timer.hot.total_square_wc_lo = summary->min.total_square_wc_lo;
+    min_timer.hot.timer_count = summary->min.timer_count;
+
+    print_timer_summary(instance, node, name->timer_type, &avg_timer, &max_timer, &min_timer);
+
+    destruct_timer(&avg_timer);
+    destruct_timer(&max_timer);
+    destruct_timer(&min_timer);
+}
+
+/**
+ * The timers received in several packages, each from a rank or from a node,
+ * filed by name ID. Only the packages that sent a name have an entry for it,
+ * so a timer that exists on a few ranks costs a few entries, however many
+ * ranks there are. The entries of a name are in package order, and each points
+ * into its package at the thread count of the timer, which is followed by that
+ * many records.
+ */
+struct Collected_Timers {
+    size_t num_names;     /**< The number of names, one less than the size of name_starts. */
+    int num_packages;     /**< The number of packages the timers came from. */
+    size_t *name_starts;  /**< For each name ID, its first entry, with the end of the entries last. */
+    int *packages;        /**< For each entry, the package it is from. */
+    char **timers;        /**< For each entry, where its timers start in the package. */
+};
+
+
+static void free_collected_timers(struct Collected_Timers *ctimers) {
+    free(ctimers->name_starts);
+    free(ctimers->packages);
+    free(ctimers->timers);
+    ctimers->name_starts = NULL;
+    ctimers->packages = NULL;
+    ctimers->timers = NULL;
+    ctimers->num_names = 0;
+}
+
+/**
+ * Find the timers of a name from one package.
+ *
+ * @returns Where the timers start in the package, or NULL if the package did
+ *          not send the name.
+ */
+static char *find_collected_timers(const struct Collected_Timers *ctimers, size_t name_id, int package)
+{
+    size_t low, high;
+
+    if (name_id >= ctimers->num_names) return NULL;
+
+    low = ctimers->name_starts[name_id];
+    high = ctimers->name_starts[name_id + 1];
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (ctimers->packages[mid] < package) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return (low < ctimers->name_starts[name_id + 1] && ctimers->packages[low] == package) ? ctimers->timers[low] : NULL;
+}
+
+/**
+ * Check the header of a package.
+ *
+ * @param rxrank       [IN] The start of the package.
+ * @param rxcnt        [IN] The size of the package.
+ * @param sender       [IN] What sent the package, e.g. "node", for warnings.
+ * @param index        [IN] The index of the sender, for warnings.
+ * @param num_counters [IN] The number of hardware counters expected.
+ * @param num_timers   [OUT] The number of timers in the package.
+ * @returns 0 if the package can be read, 1 if it should be skipped.
+ */
+static int check_wire_header(const char *rxrank, int rxcnt, const char *sender, int index,
+                             uint32_t num_counters, uint32_t *num_timers)
+{
+    struct PMTM_wire_header header;
+
+    if (rxcnt < (int) sizeof(header)) {
+        pmtm_warn("Timers from %s %d are missing, skipping them", sender, index);
+        return 1;
+    }
+    COPY_DATA(&header, rxrank, sizeof(header));
+
+    if (header.magic != PMTM_WIRE_MAGIC) {
+        pmtm_warn("Timers from %s %d have a different byte order, skipping them", sender, index);
+        return 1;
+    }
+    if (header.version != PMTM_WIRE_VERSION || header.record_size != sizeof(struct PMTM_timer_record)
+            || header.num_counters != num_counters) {
+        pmtm_warn("Timers from %s %d were sent by a different version of PMTM (%d), skipping them",
+                sender, index, (int) header.version);
+        return 1;
+    }
+
+    *num_timers = header.num_timers;
+    return 0;
+}
+
+/**
+ * Where collect_timers has got to in one package: the next timer to be merged.
+ */
+struct Package_Cursor {
+    uint32_t name_id;     /**< The name ID of the next timer. */
+    uint32_t threadcount; /**< The number of thread records of the next timer. */
+    int package;          /**< The package. */
+    uint32_t remaining;   /**< The number of timers left, including the next. */
+    char *next;           /**< The next timer, at its name ID. */
+    char *end;            /**< The end of the package. */
+};
+
+static int cursor_before(const struct Package_Cursor *lhs, const struct Package_Cursor *rhs)
+{
+    return (lhs->name_id != rhs->name_id) ? (lhs->name_id < rhs->name_id) : (lhs->package < rhs->package);
+}
+
+static void sift_cursor_down(struct Package_Cursor *heap, int heap_size, int idx)
+{
+    struct Package_Cursor cursor = heap[idx];
+
+    while (2 * idx + 1 < heap_size) {
+        int child = 2 * idx + 1;
+        if (child + 1 < heap_size && cursor_before(&heap[child + 1], &heap[child])) child++;
+        if (!cursor_before(&heap[child], &cursor)) break;
+        heap[idx] = heap[child];
+        idx = child;
+    }
+    heap[idx] = cursor;
+}
+
+/**
+ * Read the name ID and thread count of the next timer of a package into its
+ * cursor, checking that its records end within the package.
+ *
+ * @returns 1 if the cursor has a timer to merge, 0 if the rest of the package
+ *          is finished or has to be skipped.
+ */
+static int read_cursor(struct Package_Cursor *cursor, size_t num_names, size_t record_stride,
+                       const char *sender, int first)
+{
+    uint32_t name_id, threadcount;
+
+    if (cursor->remaining == 0) return 0;
+
+    if ((size_t) (cursor->end - cursor->next) < sizeof(name_id) + sizeof(threadcount)) {
+        pmtm_warn("Timers from %s %d overrun their package, skipping the rest of it",
+                  sender, cursor->package);
+        return 0;
+    }
+    COPY_DATA(&name_id, cursor->next, sizeof(name_id));
+    COPY_DATA(&threadcount, cursor->next + sizeof(name_id), sizeof(threadcount));
+    if (name_id >= num_names) {
+        pmtm_warn("Timer from %s %d has an unknown name ID %u, skipping it and those after it",
+                  sender, cursor->package, name_id);
+        return 0;
+    }
+    if (!first && name_id < cursor->name_id) {
+        pmtm_warn("Timers from %s %d are not in name order, skipping those after name ID %u",
+                  sender, cursor->package, cursor->name_id);
+        return 0;
+    }
+    if (threadcount > (size_t) (cursor->end - cursor->next - sizeof(name_id) - sizeof(threadcount)) / record_stride) {
+        pmtm_warn("Timer from %s %d with name ID %u has more threads (%u) than its package holds, skipping it and those after it",
+                  sender, cursor->package, name_id, threadcount);
+        return 0;
+    }
+
+    cursor->name_id = name_id;
+    cursor->threadcount = threadcount;
+    return 1;
+}
+
+/**
+ * File the timers of several packages by name ID. Each package is in name ID
+ * order, so they are merged with a heap of the next timer of each package,
+ * which visits the timers in name and then package order and builds the
+ * entries of each name in one pass.
+ *
+ * @param instance     [IN]  The instance being output.
+ * @param rxbuffer     [IN]  The packages.
+ * @param num_packages [IN]  The number of packages.
+ * @param rxdispls     [IN]  Where each package starts in rxbuffer.
+ * @param rxcnts       [IN]  The size of each package.
+ * @param sender       [IN]  What sent the packages, e.g. "node", for warnings.
+ * @param ctimers      [OUT] The timers, pointing into rxbuffer.
+ * @returns 0 if successful, 1 if the memory could not be allocated.
+ */
+static int collect_timers(
+          struct PMTM_instance *instance, char *rxbuffer, int num_packages, int *rxdispls, int *rxcnts,
+          const char *sender, struct Collected_Timers *ctimers) {
+
+    struct Package_Cursor *heap;
+    size_t max_entries = 0, num_entries = 0, name_id;
+    uint32_t last_name_id = 0;
+    int heap_size = 0;
+    int package;
+    uint32_t num_timers;
+
+    const uint32_t num_counters = get_num_wire_counters();
+    const size_t record_stride = sizeof(struct PMTM_timer_record) + num_counters * sizeof(int64_t);
+
+    ctimers->num_names = instance->names.num_names;
+    ctimers->num_packages = num_packages;
+    ctimers->packages = NULL;
+    ctimers->timers = NULL;
+    ctimers->name_starts = calloc(ctimers->num_names + 2, sizeof(*ctimers->name_starts));
+    heap = malloc(num_packages * sizeof(*heap) + 1);
+    if (ctimers->name_starts == NULL || heap == NULL) {
+        free(heap);
+        free_collected_timers(ctimers);
+        return 1;
+    }
+
+    for (package = 0; package < num_packages; package++) {
+        struct Package_Cursor *cursor = &heap[heap_size];
+        char *rxrank = rxbuffer + rxdispls[package];
+
+        if (check_wire_header(rxrank, rxcnts[package], sender, package, num_counters, &num_timers) != 0) {
+            continue;
+        }
+        // Every timer takes at least its name ID and thread count, so a
+        // header claiming more than that is corrupt.
+        if (num_timers > (rxcnts[package] - sizeof(struct PMTM_wire_header)) / (2 * sizeof(uint32_t))) {
+            pmtm_warn("Timers from %s %d claim more timers (%u) than their package holds, skipping them",
+                      sender, package, num_timers);
+            continue;
+        }
+
+        cursor->package = package;
+        cursor->remaining = num_timers;
+        cursor->next = rxrank + sizeof(struct PMTM_wire_header);
+        cursor->end = rxrank + rxcnts[package];
+        if (read_cursor(cursor, ctimers->num_names, record_stride, sender, 1)) {
+            max_entries += num_timers;
+            heap_size++;
+        }
+    }
+
+    ctimers->packages = malloc(max_entries * sizeof(*ctimers->packages) + 1);
+    ctimers->timers = malloc(max_entries * sizeof(*ctimers->timers) + 1);
+    if (ctimers->packages == NULL || ctimers->timers == NULL) {
+        free(heap);
+        free_collected_timers(ctimers);
+        return 1;
+    }
+
+    for (package = heap_size / 2 - 1; package >= 0; package--) {
+        sift_cursor_down(heap, heap_size, package);
+    }
+
+    while (heap_size > 0) {
+        struct Package_Cursor *cursor = &heap[0];
+        char *timers = cursor->next + sizeof(uint32_t);
+
+        // If a package sent a name twice then we've got a clash. Do we really
+        // care? The last one wins, as it always has.
+        if (num_entries > 0 && last_name_id == cursor->name_id
+                && ctimers->packages[num_entries - 1] == cursor->package) {
+            ctimers->timers[num_entries - 1] = timers;
+        } else {
+            ctimers->packages[num_entries] = cursor->package;
+            ctimers->timers[num_entries] = timers;
+            ctimers->name_starts[cursor->name_id + 1]++;
+            last_name_id = cursor->name_id;
+            num_entries++;
+        }
+
+        cursor->next = timers + sizeof(cursor->threadcount) + cursor->threadcount * record_stride;
+        cursor->remaining--;
+        if (!read_cursor(cursor, ctimers->num_names, record_stride, sender, 0)) {
+            heap[0] = heap[--heap_size];
+        }
+        if (heap_size > 0) sift_cursor_down(heap, heap_size, 0);
+    }
+
+    free(heap);
+
+    for (name_id = 0; name_id < ctimers->num_names; name_id++) {
+        ctimers->name_starts[name_id + 1] += ctimers->name_starts[name_id];
+    }
+
+    return 0;
+}
+
+/**
+ * Merge the packages of the ranks of a node into a package for the node. It
+ * has the same layout as the package of a rank, but holds the records of each
+ * name from all the ranks together, in rank order, so the IO_RANK receives
+ * one package and one entry per name from each node.
+ *
+ * @param instance     [IN]  The instance being output.
+ * @param rxbuffer     [IN]  The packages of the ranks of the node.
+ * @param node_size    [IN]  The number of ranks on the node.
+ * @param rxdispls     [IN]  Where each package starts in rxbuffer.
+ * @param rxcnts       [IN]  The size of each package.
+ * @param ret_txcnt    [OUT] The size of the package of the node.
+ * @param ret_txbuffer [OUT] The package of the node, to be freed by the caller.
+ * @returns 0 if successful, 1 if the memory could not be allocated.
+ */
+static int merge_node_timers(struct PMTM_instance *instance, char *rxbuffer, int node_size, int *rxdispls, int *rxcnts,
+                             int *ret_txcnt, char **ret_txbuffer)
+{
+    struct Collected_Timers ctimers = { 0, 0, NULL, NULL, NULL };
+    size_t name_id;
+    uint32_t threadcount;
+    uint32_t num_timers = 0;
+    int txcnt = sizeof(struct PMTM_wire_header);
+    char *txbuffer;
+    char *txcurr;
+    size_t entry;
+
+    const uint32_t num_counters = get_num_wire_counters();
+    const size_t record_stride = sizeof(struct PMTM_timer_record) + num_counters * sizeof(int64_t);
+
+    if (collect_timers(instance, rxbuffer, node_size, rxdispls, rxcnts, "node rank", &ctimers) != 0) {
+        return 1;
+    }
+
+    for (name_id = 0; name_id < ctimers.num_names; name_id++) {
+        if (ctimers.name_starts[name_id] == ctimers.name_starts[name_id + 1]) continue;
+
+        num_timers++;
+        txcnt += 2 * sizeof(uint32_t);
+        for (entry = ctimers.name_starts[name_id]; entry < ctimers.name_starts[name_id + 1]; entry++) {
+            COPY_DATA(&threadcount, ctimers.timers[entry], sizeof(threadcount));
+            txcnt += threadcount * record_stride;
+        }
+    }
+
+    if ((txbuffer = malloc(txcnt)) == NULL) {
+        free_collected_timers(&ctimers);
+        return 1;
+    }
+
+    txcurr = txbuffer;
+
+    struct PMTM_wire_header header;
+    header.magic = PMTM_WIRE_MAGIC;
+    header.version = PMTM_WIRE_VERSION;
+    header.record_size = sizeof(struct PMTM_timer_record);
+    header.num_counters = num_counters;
+    header.num_timers = num_timers;
+    COPY_TX(&header, sizeof(header));
+
+    for (name_id = 0; name_id < ctimers.num_names; name_id++) {
+        if (ctimers.name_starts[name_id] == ctimers.name_starts[name_id + 1]) continue;
+
+        uint32_t wire_id = (uint32_t) name_id;
+        COPY_TX(&wire_id, sizeof(wire_id));
+        char *tx_tclocation = txcurr;
+        txcurr += sizeof(uint32_t);
+
+        uint32_t total_threads = 0;
+        for (entry = ctimers.name_starts[name_id]; entry < ctimers.name_starts[name_id + 1]; entry++) {
+            COPY_DATA(&threadcount, ctimers.timers[entry], sizeof(threadcount));
+            COPY_TX(ctimers.timers[entry] + sizeof(threadcount), threadcount * record_stride);
+            total_threads += threadcount;
+        }
+        COPY_DATA(tx_tclocation, &total_threads, sizeof(total_threads));
+    }
+
+    free_collected_timers(&ctimers);
+
+    *ret_txcnt = txcnt;
+    *ret_txbuffer = txbuffer;
+    return 0;
+}
+
+/**
+ * Put the timers of a name gathered from the nodes into rank order, keeping
+ * the order of the threads of each rank, with a counting sort on the ranks.
+ *
+ * @param nranks      [IN]  The number of ranks.
+ * @param threads     [IN]  The number of timers.
+ * @param timers      [IN]  The timers, in node order.
+ * @param sorted      [OUT] The timers, in rank order.
+ * @param rank_starts [-]   Workspace for nranks + 1 entries.
+ */
+static void sort_timers_by_rank(int nranks, uint32_t threads, const struct PMTM_timer *timers,
+                                struct PMTM_timer *sorted, uint32_t *rank_starts)
+{
+    uint32_t t, count, total = 0;
+    int r;
+
+#define RANK_BUCKET(rank) (((rank) >= 0 && (rank) < nranks) ? (rank) : nranks)
+
+    memset(rank_starts, 0, (nranks + 1) * sizeof(*rank_starts));
+    for (t = 0; t < threads; t++) {
+        rank_starts[RANK_BUCKET(timers[t].rank)]++;
+    }
+    for (r = 0; r <= nranks; r++) {
+        count = rank_starts[r];
+        rank_starts[r] = total;
+        total += count;
+    }
+    for (t = 0; t < threads; t++) {
+        sorted[rank_starts[RANK_BUCKET(timers[t].rank)]++] = timers[t];
+    }
+
+#undef RANK_BUCKET
+}
+
+/**
+ * Print the summary lines of a name from its reduced summaries, over all ranks
+ * and then over each node if their summaries were gathered.
+ *
+ * @returns 1 if the name was summarised, 0 if its timers were gathered.
+ */
+static int print_reduced_name(struct PMTM_instance * instance, const struct Reduced_Timers *rtimers, size_t name_id)
+{
+    struct PMTM_name sampled_name = instance->names.names[name_id];
+    const struct PMTM_name *name = &instance->names.names[name_id];
+    long slot;
+    int node;
+
+    if (name_id >= rtimers->num_names || rtimers->slots[name_id] < 0) return 0;
+
+    // Only a sample of the ranks is printed, so every statistic is.
+    if (rtimers->sampled && is_gathered_type(name->timer_type)) {
+        sampled_name.timer_type = PMTM_TIMER_ALL;
+        name = &sampled_name;
+    }
+
+    slot = rtimers->slots[name_id];
+    if (rtimers->reduced[slot].first_key != NO_KEY) {
+        print_summary(instance, -1, name, &rtimers->reduced[slot]);
+    }
+    if (rtimers->all_nodes != NULL) {
+        for (node = 0; node < rtimers->num_nodes; node++) {
+            const struct PMTM_timer_summary *summary = &rtimers->all_nodes[node * rtimers->num_summaries + slot];
+            if (summary->first_key != NO_KEY) {
+                print_summary(instance, node, name, summary);
+            }
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * A timer of a sampled name to print, with the key of struct
+ * PMTM_summary_timer to put the sampled ranks and the outliers in order.
+ */
+struct PMTM_sampled_timer {
+    uint64_t key;               /**< (rank << 32) + thread position. */
+    int outlier;                /**< Whether the timer is an outlier, which sorts after the same sampled timer. */
+    struct PMTM_timer timer;    /**< The timer. */
+};
+
+static int compare_sampled_timers(const void * a, const void * b)
+{
+    const struct PMTM_sampled_timer * lhs = a;
+    const struct PMTM_sampled_timer * rhs = b;
+
+    if (lhs->key != rhs->key) return (lhs->key < rhs->key) ? -1 : 1;
+    return lhs->outlier - rhs->outlier;
+}
+
+/**
+ * Print the lines of one name whose timers were only gathered from a sample
+ * of the ranks: the lines of the sampled ranks and of the slowest and fastest
+ * ranks, in rank order and each once, then the statistics over all ranks.
+ *
+ * @param instance [IN] The instance being output, whose fid is printed to.
+ * @param ctimers  [IN] The collected timers of the sampled ranks.
+ * @param rtimers  [IN] The reduced summaries and outliers.
+ * @param name_id  [IN] The name to print.
+ * @returns 0 if successful, 1 if the memory could not be allocated.
+ */
+static int print_sampled_name(struct PMTM_instance * instance, const struct Collected_Timers *ctimers,
+                              const struct Reduced_Timers *rtimers, size_t name_id)
+{
+    const struct PMTM_name *name = &instance->names.names[name_id];
+    const long slot = rtimers->slots[name_id];
+    const int num_outliers = rtimers->num_outliers;
+    const struct PMTM_timer_outlier *outliers = NULL;
+    struct PMTM_sampled_timer *timers;
+    uint32_t threads = 0, threadcount, t, idx;
+    size_t entry, first_entry = 0, end_entry = 0;
+    int outlier_idx;
+
+    const uint32_t num_counters = get_num_wire_counters();
+    const size_t record_stride = sizeof(struct PMTM_timer_record) + num_counters * sizeof(int64_t);
+
+    if (name_id < ctimers->num_names) {
+        first_entry = ctimers->name_starts[name_id];
+        end_entry = ctimers->name_starts[name_id + 1];
+    }
+    for (entry = first_entry; entry < end_entry; entry++) {
+        COPY_DATA(&threadcount, ctimers->timers[entry], sizeof(threadcount));
+        threads += threadcount;
+    }
+    if (num_outliers > 0) {
+        outliers = &rtimers->reduced_outliers[slot * 2 * num_outliers];
+    }
+
+    timers = malloc((threads + 2 * num_outliers) * sizeof(*timers) + 1);
+#ifdef HW_COUNTERS
+    hw_counter_t *all_counters = calloc((threads + 2 * num_outliers) * num_counters + 1, sizeof(hw_counter_t));
+    if (timers == NULL || all_counters == NULL) {
+        free(all_counters);
+        free(timers);
+        return 1;
+    }
+#else
+    if (timers == NULL) return 1;
+#endif
+
+    threads = 0;
+    for (entry = first_entry; entry < end_entry; entry++) {
+        const char *record = ctimers->timers[entry];
+        int previous_rank = -1;
+        uint32_t position = 0;
+
+        COPY_DATA(&threadcount, record, sizeof(threadcount));
+        record += sizeof(threadcount);
+
+        for (t = 0; t < threadcount; t++, record += record_stride, threads++) {
+            struct PMTM_timer *timer = &timers[threads].timer;
+            unpack_timer_record(record, timer);
+            timer->timer_name = name->timer_name;
+            position = (timer->rank == previous_rank) ? position + 1 : 0;
+            previous_rank = timer->rank;
+            timers[threads].key = ((uint64_t) timer->rank << 32) + position;
+            timers[threads].outlier = 0;
+#ifdef HW_COUNTERS
+            uint32_t counter_idx;
+            timer->total_counters = &all_counters[threads * num_counters];
+            for (counter_idx = 0; counter_idx < num_counters; ++counter_idx) {
+                int64_t counter;
+                COPY_DATA(&counter, record + sizeof(struct PMTM_timer_record) + counter_idx * sizeof(counter), sizeof(counter));
+                timer->total_counters[counter_idx] = counter;
+            }
+#endif
+        }
+    }
+
+    for (outlier_idx = 0; outlier_idx < 2 * num_outliers; outlier_idx++) {
+        if (outliers[outlier_idx].key == NO_KEY) continue;
+        unpack_timer_record((const char *) &outliers[outlier_idx].record, &timers[threads].timer);
+        timers[threads].timer.timer_name = name->timer_name;
+        timers[threads].key = outliers[outlier_idx].key;
+        timers[threads].outlier = 1;
+#ifdef HW_COUNTERS
+        uint32_t counter_idx;
+        timers[threads].timer.total_counters = &all_counters[threads * num_counters];
+        for (counter_idx = 0; counter_idx < num_counters; ++counter_idx) {
+            timers[threads].timer.total_counters[counter_idx] = outliers[outlier_idx].counters[counter_idx];
+        }
+#endif
+        threads++;
+    }
+
+    qsort(timers, threads, sizeof(*timers), compare_sampled_timers);
+
+    if (instance->fid != NULL) {
+        struct PMTM_rank_lines lines;
+        start_rank_lines(&lines, instance);
+        for (idx = 0; idx < threads; idx++) {
+            if (idx > 0 && timers[idx].key == timers[idx - 1].key) continue;
+            print_rank_timer(&lines, &timers[idx].timer);
+        }
+        end_rank_lines(&lines);
+    }
+
+    print_reduced_name(instance, rtimers, name_id);
+
+#ifdef HW_COUNTERS
+    free(all_counters);
+#endif
+    free(timers);
+    return 0;
+}
+
+/**
+ * Print the lines of one name from the collected and reduced timers.
+ *
+ * @param instance       [IN] The instance being output, whose fid is printed to.
+ * @param ctimers        [IN] The collected timers.
+ * @param rtimers        [IN] The reduced summaries.
+ * @param node_stats     [IN] Whether to print the statistics of each node.
+ * @param name_id        [IN] The name to print.
+ * @param rank_starts    [IN] Room for nranks + 1 counts, for the sort.
+ * @param package_starts [IN] Room for num_packages + 1 counts, for where the
+ *                            timers of each entry start.
+ * @returns 0 if successful, 1 if the memory could not be allocated.
+ */
+static int print_collected_name(struct PMTM_instance * instance, struct Collected_Timers *ctimers,
+                                struct Reduced_Timers *rtimers, int node_stats, size_t name_id,
+                                uint32_t *rank_starts, uint32_t *package_starts) {
+
+    const size_t first_entry = ctimers->name_starts[name_id];
+    const size_t end_entry = ctimers->name_starts[name_id + 1];
+    const struct PMTM_name *name = &instance->names.names[name_id];
+    struct PMTM_timer *all_timers = NULL;
+    struct PMTM_timer *rank_timers = NULL;
+    uint32_t threads = 0, threadcount, t;
+    size_t entry;
+    int status = 0;
+
+    const uint32_t num_counters = get_num_wire_counters();
+    const size_t record_stride = sizeof(struct PMTM_timer_record) + num_counters * sizeof(int64_t);
+
+    if (rtimers->sampled && is_gathered_type(name->timer_type)) {
+        return print_sampled_name(instance, ctimers, rtimers, name_id);
+    }
+
+    if (print_reduced_name(instance, rtimers, name_id)) return 0;
+
+    if (first_entry == end_entry) return 0;
+
+    for (entry = first_entry; entry < end_entry; entry++) {
+        COPY_DATA(&threadcount, ctimers->timers[entry], sizeof(threadcount));
+        threads += threadcount;
+    }
+
+    all_timers = malloc(threads * sizeof(struct PMTM_timer) + 1);
+    rank_timers = malloc(threads * sizeof(struct PMTM_timer) + 1);
+#ifdef HW_COUNTERS
+    hw_counter_t *all_counters = malloc(threads * num_counters * sizeof(hw_counter_t) + 1);
+    if (all_counters == NULL) status = 1;
+#endif
+    if (all_timers == NULL || rank_timers == NULL) status = 1;
+
+    if (status == 0) {
+        threads = 0;
+
+        for (entry = first_entry; entry < end_entry; entry++) {
+            const char *record = ctimers->timers[entry];
+            package_starts[entry - first_entry] = threads;
+            COPY_DATA(&threadcount, record, sizeof(threadcount));
+            record += sizeof(threadcount);
+
+            for (t = 0; t < threadcount; t++, record += record_stride) {
+                struct PMTM_timer *timer = &all_timers[threads + t];
+                unpack_timer_record(record, timer);
+                timer->timer_name = name->timer_name;
+#ifdef HW_COUNTERS
+                uint32_t counter_idx;
+                timer->total_counters = &all_counters[(threads + t) * num_counters];
+                for (counter_idx = 0; counter_idx < num_counters; ++counter_idx) {
+                    int64_t counter;
+                    COPY_DATA(&counter, record + sizeof(struct PMTM_timer_record) + counter_idx * sizeof(counter), sizeof(counter));
+                    timer->total_counters[counter_idx] = counter;
+                }
+#endif
+            }
+
+            threads += threadcount;
+        }
+        package_starts[end_entry - first_entry] = threads;
+
+        if (threads > 0) {
+            sort_timers_by_rank(instance->nranks, threads, all_timers, rank_timers, rank_starts);
+            print_timer_array(instance, threads, rank_timers, name->timer_name, rank_timers->timer_type);
+
+            if (node_stats) {
+                for (entry = first_entry; entry < end_entry; entry++) {
+                    uint32_t start = package_starts[entry - first_entry];
+                    print_node_timer_array(instance, ctimers->packages[entry], package_starts[entry - first_entry + 1] - start,
+                                           &all_timers[start], name->timer_name, all_timers->timer_type);
+                }
+            }
+        }
+    }
+
+#ifdef HW_COUNTERS
+    free(all_counters);
+#endif
+    free(all_timers);
+    free(rank_timers);
+
+    return status;
+}
+
+#ifdef _OPENMP
+/**
+ * Print the collected timers with the threads of the IO_RANK, which are idle
+ * while it outputs. The names are formatted in parallel, each into a buffer of
+ * its own, a batch at a time, and the buffers of each batch are written out in
+ * name order, so the file is the same as when printed by one thread.
+ *
+ * @returns 0 if successful, 1 if the memory could not be allocated.
+ */
+static int print_collected_timers_parallel(struct PMTM_instance * instance, struct Collected_Timers *ctimers,
+                                           struct Reduced_Timers *rtimers, int node_stats, int num_threads) {
+
+    const size_t batch_size = 4 * num_threads;
+    char **texts = calloc(batch_size, sizeof(char *));
+    size_t *text_sizes = calloc(batch_size, sizeof(size_t));
+    size_t batch_start, idx;
+    int status = 0;
+
+    if (texts == NULL || text_sizes == NULL) {
+        free(texts);
+        free(text_sizes);
+        return 1;
+    }
+
+    for (batch_start = 0; batch_start < ctimers->num_names && status == 0; batch_start += batch_size) {
+        size_t batch_end = batch_start + batch_size;
+        if (batch_end > ctimers->num_names) batch_end = ctimers->num_names;
+
+#pragma omp parallel num_threads(num_threads) reduction(|:status)
+        {
+            struct PMTM_instance thread_instance = *instance;
+            uint32_t *rank_starts = malloc((instance->nranks + 1) * sizeof(*rank_starts));
+            uint32_t *package_starts = malloc((ctimers->num_packages + 1) * sizeof(*package_starts));
+            long name_id;
+
+            if (rank_starts == NULL || package_starts == NULL) status = 1;
+
+#pragma omp for schedule(dynamic)
+            for (name_id = (long) batch_start; name_id < (long) batch_end; name_id++) {
+                if (status != 0) continue;
+
+                thread_instance.fid = open_memstream(&texts[name_id - batch_start], &text_sizes[name_id - batch_start]);
+                if (thread_instance.fid == NULL) {
+                    status = 1;
+                    continue;
+                }
+                status = print_collected_name(&thread_instance, ctimers, rtimers, node_stats,
+                                              name_id, rank_starts, package_starts);
+                fclose(thread_instance.fid);
+            }
+
+            free(rank_starts);
+            free(package_starts);
+        }
+
+        for (idx = 0; idx < batch_end - batch_start; idx++) {
+            if (status == 0 && texts[idx] != NULL) {
+                fwrite(texts[idx], 1, text_sizes[idx], instance->fid);
+            }
+            free(texts[idx]);
+            texts[idx] = NULL;
+            text_sizes[idx] = 0;
+        }
+    }
+
+    free(texts);
+    free(text_sizes);
+
+    return status;
+}
+#endif
+
+/**
+ * Print the lines of every name from the collected and reduced timers.
+ *
+ * @param instance   [IN] The instance being output, whose fid is printed to.
+ * @param ctimers    [IN] The collected timers.
+ * @param rtimers    [IN] The reduced summaries.
+ * @param node_stats [IN] Whether to print the statistics of each node.
+ * @param parallel   [IN] Whether the names may be formatted by a team of OpenMP
+ *                        threads. Not on the output thread, which must not
+ *                        compete with the threads of the application.
+ * @returns 0 if successful, 1 if the memory could not be allocated.
+ */
+static int print_collected_timers(struct PMTM_instance * instance, struct Collected_Timers *ctimers,
+                                  struct Reduced_Timers *rtimers, int node_stats, int parallel) {
+
+    uint32_t *rank_starts = NULL;
+    uint32_t *package_starts = NULL;
+    size_t name_id;
+    int status = 0;
+
+#ifdef _OPENMP
+    // Formatting in parallel only pays if there are several names to share out.
+
+    int num_threads = (!parallel || omp_in_parallel()) ? 1 : omp_get_max_threads();
+    if (num_threads > 1 && ctimers->num_names > 1 && instance->fid != NULL) {
+        return print_collected_timers_parallel(instance, ctimers, rtimers, node_stats, num_threads);
+    }
+#else
+    (void) parallel;
+#endif
+
+    rank_starts = malloc((instance->nranks + 1) * sizeof(*rank_starts));
+    package_starts = malloc((ctimers->num_packages + 1) * sizeof(*package_starts));
+    if (rank_starts == NULL || package_starts == NULL) {
+        free(rank_starts);
+        free(package_starts);
+        return 1;
+    }
+
+    for (name_id = 0; name_id < ctimers->num_names && status == 0; name_id++) {
+        status = print_collected_name(instance, ctimers, rtimers, node_stats, name_id,
+                                      rank_starts, package_starts);
+    }
+
+    free(rank_starts);
+    free(package_starts);
+
+    return status;
+}
+
+/**
+ * Work out where each package starts in the receive buffer.
+ *
+ * @returns the total size of the packages.
+ */
+static size_t compute_displacements(int num_packages, const int *rxcnts, int *rxdispls)
+{
+    size_t total_rxcnt = 0;
+    int p;
+
+    for (p = 0; p < num_packages; p++) {
+        rxdispls[p] = total_rxcnt;
+        total_rxcnt += rxcnts[p];
+    }
+
+    return total_rxcnt;
+}
+
+#ifndef SERIAL
+/**
+ * Split the ranks into a communicator per node, and a communicator of the
+ * node leaders, the lowest rank of each node. The IO_RANK leads its node and
+ * is rank 0 of both communicators.
+ *
+ * @param PMTM_COMM   [IN]  The communicator being output.
+ * @param node_comm   [OUT] The ranks on the same node as this rank.
+ * @param leader_comm [OUT] The node leaders, MPI_COMM_NULL on the other ranks.
+ */
+static void split_nodes(MPI_Comm PMTM_COMM, MPI_Comm *node_comm, MPI_Comm *leader_comm)
+{
+    int rank, node_rank;
+
+    MPI_Comm_rank(PMTM_COMM, &rank);
+#if MPI_VERSION >= 3
+    MPI_Comm_split_type(PMTM_COMM, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, node_comm);
+#else
+    // Without MPI-3 there is no portable way to find the node, so each rank is
+    // treated as a node of its own.
+    MPI_Comm_split(PMTM_COMM, rank, 0, node_comm);
+#endif
+    MPI_Comm_rank(*node_comm, &node_rank);
+    MPI_Comm_split(PMTM_COMM, (node_rank == 0) ? 0 : MPI_UNDEFINED, rank, leader_comm);
+}
+#endif
+
+#ifndef SERIAL
+
+#define STREAM_TAG_REQUEST 4101
+#define STREAM_TAG_TIMERS  4102
+
+/**
+ * @returns the number of ranks in a window of the stream buffer, for ranks
+ * each needing rank_size bytes. There is always at least one.
+ */
+static size_t stream_window(size_t buffer_size, size_t rank_size, int nranks)
+{
+    size_t window = buffer_size / rank_size;
+
+    if (window < 1) window = 1;
+    if (window > (size_t) nranks) window = nranks;
+    return window;
+}
+
+/**
+ * Stream the timers that print a line for each rank to the IO_RANK a name at a
+ * time, in windows of consecutive ranks. The IO_RANK asks each rank of a window
+ * for its timers of the name, prints their lines and adds them to the running
+ * average, maximum and minimum, then moves on to the next window. The windows
+ * are as wide as the stream buffer allows for the most threads any rank has for
+ * the name, so the memory needed at the IO_RANK is set by the buffer size and
+ * not by the number of ranks. The summarised timers are printed in their place.
+ *
+ * Every rank must call this, and all of them return the same value.
+ *
+ * @param instance    [IN] The instance being output.
+ * @param rtimers     [IN] The reduced summaries.
+ * @param stream_comm [IN] A communicator of its own over the ranks being output.
+ * @param buffer_size [IN] The memory to use for each window at the IO_RANK.
+ * @param txbuffer    [IN] The package of this rank.
+ * @param txcnt       [IN] The size of the package.
+ * @returns 0 if successful, 1 if the memory could not be allocated.
+ */
+static int stream_timers(struct PMTM_instance *instance, struct Reduced_Timers *rtimers,
+                         MPI_Comm stream_comm, size_t buffer_size, char *txbuffer, int txcnt)
+{
+    struct Collected_Timers own = { 0, 0, NULL, NULL, NULL };
+    uint32_t *max_threads = NULL;
+    char *window_buffer = NULL;
+    struct PMTM_timer *window_timers = NULL;
+    MPI_Request *requests = NULL;
+    size_t num_names = instance->names.num_names;
+    size_t name_id;
+    size_t max_window = 1;
+    size_t max_window_bytes = 0;
+    size_t max_window_threads = 0;
+    uint32_t threadcount;
+    int package_displ = 0;
+    int fail = 0;
+
+    const uint32_t num_counters = get_num_wire_counters();
+    const size_t record_stride = sizeof(struct PMTM_timer_record) + num_counters * sizeof(int64_t);
+
+#ifdef HW_COUNTERS
+    hw_counter_t *window_counters = NULL;
+#endif
+
+    // Find the most threads any rank has for each name.
+
+    max_threads = calloc(num_names + 1, sizeof(*max_threads));
+    if (max_threads == NULL || collect_timers(instance, txbuffer, 1, &package_displ, &txcnt, "rank", &own) != 0) {
+        fail = 1;
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &fail, 1, MPI_INT, MPI_MAX, stream_comm);
+
+    if (!fail) {
+        for (name_id = 0; name_id < num_names; name_id++) {
+            const char *own_timers = find_collected_timers(&own, name_id, 0);
+            if (own_timers != NULL) {
+                COPY_DATA(&max_threads[name_id], own_timers, sizeof(threadcount));
             }
-#endif
         }
+        MPI_Allreduce(MPI_IN_PLACE, max_threads, num_names, MPI_UINT32_T, MPI_MAX, stream_comm);
     }
 
-    // Allocate a buffer
+    // Work out the widest window and allocate it at the IO_RANK.
 
-#define COPY_DATA(dst, src, len) do { memcpy((dst), (src), (len)); } while (0)
-#define COPY_TX(src, len) do { COPY_DATA(txcurr, (src), (len)); txcurr += (len); } while (0)
+#define PIECE_SIZE(threads) (sizeof(uint32_t) + (threads) * record_stride)
+#define WINDOW_RANKS(threads) stream_window(buffer_size, PIECE_SIZE(threads) + (threads) * sizeof(struct PMTM_timer), instance->nranks)
 
-    if ((txbuffer = malloc(txcnt)) != NULL) {
-        // Pack data
+    if (!fail && instance->rank == IO_RANK) {
+        for (name_id = 0; name_id < num_names; name_id++) {
+            if (max_threads[name_id] == 0) continue;
 
-        char *txcurr = txbuffer;
+            size_t window = WINDOW_RANKS(max_threads[name_id]);
+            if (window > max_window) max_window = window;
+            if (window * PIECE_SIZE(max_threads[name_id]) > max_window_bytes) {
+                max_window_bytes = window * PIECE_SIZE(max_threads[name_id]);
+            }
+            if (window * max_threads[name_id] > max_window_threads) {
+                max_window_threads = window * max_threads[name_id];
+            }
+        }
 
-        for (group_idx = 0; group_idx < instance->num_groups; ++group_idx) {
-            PMTM_timer_group_t group_id = instance->group_ids[group_idx];
-            struct PMTM_timer_group * group = get_timer_group(group_id);
+        window_buffer = malloc(max_window_bytes + 1);
+        window_timers = malloc(max_window_threads * sizeof(struct PMTM_timer) + 1);
+        requests = malloc(max_window * sizeof(MPI_Request));
+        fail = (window_buffer == NULL || window_timers == NULL || requests == NULL);
+#ifdef HW_COUNTERS
+        window_counters = malloc(max_window_threads * num_counters * sizeof(hw_counter_t) + 1);
+        fail = fail || (window_counters == NULL);
+#endif
+    }
 
-            // Should pack with memcpy to cope with platforms that can't do
-            // unaligned access without SIGSEGV-ing.
+    MPI_Bcast(&fail, 1, MPI_INT, IO_RANK, stream_comm);
 
-            COPY_TX(&group->num_timers, sizeof(group->num_timers));
-            COPY_TX(group->group_name, strlen(group->group_name)+1);
+    for (name_id = 0; name_id < num_names && !fail; name_id++) {
+        const struct PMTM_name *name = &instance->names.names[name_id];
 
-            for (timer_idx = 0; timer_idx < group->num_timers; ++timer_idx) {
-                struct PMTM_timer * timer = group->timer_ids[timer_idx];
+        if (instance->rank == IO_RANK && name_id < rtimers->num_names && rtimers->slots[name_id] >= 0) {
+            const struct PMTM_timer_summary *summary = &rtimers->reduced[rtimers->slots[name_id]];
+            if (summary->first_key != NO_KEY) {
+                print_summary(instance, -1, name, summary);
+            }
+            continue;
+        }
 
-                COPY_TX(timer->timer_name, strlen(timer->timer_name) + 1);
-                char *tx_tclocation = txcurr;
-                txcurr += sizeof(int);
+        if (!is_gathered_type(name->timer_type) || max_threads[name_id] == 0) continue;
 
-                timer->rank = instance->rank;
-                COPY_TX(timer, sizeof(*timer));
+        const size_t piece_size = PIECE_SIZE(max_threads[name_id]);
+        const uint32_t no_threads = 0;
+        const char *own_data = find_collected_timers(&own, name_id, 0);
+        if (own_data == NULL) own_data = (const char *) &no_threads;
 
-                int threadcount = 1;
-#ifdef _OPENMP
-                struct PMTM_timer * tim = timer->thread_next;
+        if (instance->rank != IO_RANK) {
+            // Wait to be asked, so that the IO_RANK only ever holds one window.
+            COPY_DATA(&threadcount, own_data, sizeof(threadcount));
+            MPI_Recv(NULL, 0, MPI_BYTE, IO_RANK, STREAM_TAG_REQUEST, stream_comm, MPI_STATUS_IGNORE);
+            MPI_Send((void *) own_data, PIECE_SIZE(threadcount), MPI_BYTE, IO_RANK, STREAM_TAG_TIMERS, stream_comm);
+            continue;
+        }
 
-                while (tim != NULL) {
-                    tim->rank = instance->rank;
-                    COPY_TX(tim, sizeof(*tim));
-                    tim = tim->thread_next;
-                    threadcount++;
+        const int window = WINDOW_RANKS(max_threads[name_id]);
+        struct PMTM_timer avg_timer;
+        struct PMTM_timer max_timer;
+        struct PMTM_timer min_timer;
+        uint32_t total_threads = 0;
+        int first_rank, r, t;
+
+        construct_timer(&avg_timer, name->timer_name, PMTM_TIMER_AVG);
+        construct_timer(&max_timer, name->timer_name, PMTM_TIMER_MAX);
+        construct_timer(&min_timer, name->timer_name, PMTM_TIMER_MIN);
+
+        // The lines of the last ranks of a window can be collapsed with those
+        // of the next, so they are held back across windows.
+        struct PMTM_rank_lines lines;
+        start_rank_lines(&lines, instance);
+
+        for (first_rank = 0; first_rank < instance->nranks; first_rank += window) {
+            int window_size = (instance->nranks - first_rank < window) ? instance->nranks - first_rank : window;
+            uint32_t threads = 0;
+
+            for (r = 0; r < window_size; r++) {
+                char *piece = window_buffer + r * piece_size;
+                if (first_rank + r == IO_RANK) {
+                    COPY_DATA(&threadcount, own_data, sizeof(threadcount));
+                    COPY_DATA(piece, own_data, PIECE_SIZE(threadcount));
+                    requests[r] = MPI_REQUEST_NULL;
+                } else {
+                    MPI_Irecv(piece, piece_size, MPI_BYTE, first_rank + r, STREAM_TAG_TIMERS, stream_comm, &requests[r]);
+                    MPI_Send(NULL, 0, MPI_BYTE, first_rank + r, STREAM_TAG_REQUEST, stream_comm);
                 }
+            }
+
+            MPI_Waitall(window_size, requests, MPI_STATUSES_IGNORE);
+
+            for (r = 0; r < window_size; r++) {
+                const char *record = window_buffer + r * piece_size;
+                COPY_DATA(&threadcount, record, sizeof(threadcount));
+                record += sizeof(threadcount);
+
+                for (t = 0; t < (int) threadcount; t++, record += record_stride) {
+                    struct PMTM_timer *timer = &window_timers[threads + t];
+                    unpack_timer_record(record, timer);
+                    timer->timer_name = name->timer_name;
+#ifdef HW_COUNTERS
+                    uint32_t counter_idx;
+                    timer->total_counters = &window_counters[(threads + t) * num_counters];
+                    for (counter_idx = 0; counter_idx < num_counters; ++counter_idx) {
+                        int64_t counter;
+                        COPY_DATA(&counter, record + sizeof(struct PMTM_timer_record) + counter_idx * sizeof(counter), sizeof(counter));
+                        timer->total_counters[counter_idx] = counter;
+                    }
 #endif
-                COPY_DATA(tx_tclocation, &threadcount, sizeof(int));
+                    if (instance->fid != NULL) print_rank_timer(&lines, timer);
+                }
+                threads += threadcount;
+            }
+
+            if (threads > 0) {
+                if (total_threads == 0) {
+                    start_timer_summary(window_timers->hot.measure, &avg_timer, &max_timer, &min_timer);
+                }
+                summarise_timer_array(threads, window_timers, name->timer_type, &avg_timer, &max_timer, &min_timer);
+                total_threads += threads;
             }
         }
-    }
 
-    *ret_txcnt = txcnt;
-    *ret_txbuffer = txbuffer;
-}
+        end_rank_lines(&lines);
 
+        if (total_threads > 0) {
+            print_timer_summary(instance, -1, name->timer_type, &avg_timer, &max_timer, &min_timer);
+        }
 
-struct Collected_Timer {
-    struct Collected_Timer *hash_next, *next;
+        destruct_timer(&avg_timer);
+        destruct_timer(&max_timer);
+        destruct_timer(&min_timer);
+    }
 
-    char *group_name;
-    char *timer_name;
+#undef WINDOW_RANKS
+#undef PIECE_SIZE
 
-    // An array of character pointers into the receive buffer. An entry for each rank
-    // pointer or NULL if rank not contributing.
+    free_collected_timers(&own);
+    free(max_threads);
+    free(window_buffer);
+    free(window_timers);
+    free(requests);
+#ifdef HW_COUNTERS
+    free(window_counters);
+#endif
 
-    char **timerset;
-};
+    return fail;
+}
+#endif
 
+#ifndef SERIAL
+/**
+ * Open the output file on every rank for write_timers_collectively. The
+ * IO_RANK closes its stream first, so that all it has printed is in the file,
+ * and sends the size of the file, where the timers start, with its name.
+ *
+ * @param instance  [IN]  The instance being output.
+ * @param PMTM_COMM [IN]  The communicator of the instance.
+ * @param fh        [OUT] The file, open on every rank.
+ * @param base      [OUT] Where the timers start in the file.
+ * @returns 0 if the file is open on every rank, 1 if not, in which case the
+ *          IO_RANK has its stream back and the timers must be gathered.
+ */
+static int open_collective_file(struct PMTM_instance *instance, MPI_Comm PMTM_COMM, MPI_File *fh, MPI_Offset *base)
+{
+    long header[2] = { -1, 0 };
+    char *file_name = NULL;
+    int fail = 0;
 
-static void free_collected_timers(struct Collected_Timer *first) {
-    while (first != NULL) {
-       struct Collected_Timer *del = first;
-       first = first->next;
-       free(del->timerset);
-       free(del);
+    if (instance->rank == IO_RANK) {
+        if (suspend_file(instance, &header[0]) != PMTM_SUCCESS) header[0] = -1;
+        header[1] = (long) strlen(instance->file_name);
+        file_name = instance->file_name;
     }
-}
 
+    MPI_Bcast(header, 2, MPI_LONG, IO_RANK, PMTM_COMM);
 
-static unsigned long hash_timername(const char *group_name, const char *timer_name) {
-    unsigned const char *gn = (unsigned const char *) group_name;
-    unsigned const char *tn = (unsigned const char *) timer_name;
-
-    unsigned long hash = 5381;
-    int c;
+    if (instance->rank != IO_RANK) {
+        file_name = malloc(header[1] + 1);
+        fail = (file_name == NULL);
+    }
+    MPI_Allreduce(MPI_IN_PLACE, &fail, 1, MPI_INT, MPI_MAX, PMTM_COMM);
+
+    if (!fail && header[0] >= 0) {
+        MPI_Bcast(file_name, header[1] + 1, MPI_CHAR, IO_RANK, PMTM_COMM);
+        fail = (MPI_File_open(PMTM_COMM, file_name, MPI_MODE_WRONLY, MPI_INFO_NULL, fh) != MPI_SUCCESS);
+        MPI_Allreduce(MPI_IN_PLACE, &fail, 1, MPI_INT, MPI_MAX, PMTM_COMM);
+        if (fail && *fh != MPI_FILE_NULL) MPI_File_close(fh);
+    } else {
+        fail = 1;
+    }
 
-    while (c = *gn++) hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
-    hash = ((hash << 5) + hash); // Put a zero separator in
-    while (c = *tn++) hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
+    if (instance->rank != IO_RANK) {
+        free(file_name);
+    } else if (fail) {
+        pmtm_warn("Could not open %s with MPI-IO, gathering the timers instead", instance->file_name);
+        if (resume_file(instance) != PMTM_SUCCESS) {
+            pmtm_warn("Could not open %s again, the timers are not written", instance->file_name);
+        }
+    }
 
-    return hash;
+    *fh = fail ? MPI_FILE_NULL : *fh;
+    *base = (MPI_Offset) header[0];
+    return fail;
 }
 
-#define HASHSIZE 1024
+/**
+ * Write the timers to the output file with MPI-IO, each rank writing its own
+ * lines (PMTM_OPTION_COLLECTIVE_WRITE). The file is laid out as if the IO_RANK
+ * had printed everything: for each name, the lines of each rank in rank order,
+ * then the summary lines, which are reduced and written by the IO_RANK. Each
+ * rank formats its lines into memory, the length of each name's lines are
+ * summed over the ranks to place the names, and an MPI_Exscan of them places
+ * each rank's lines within its names.
+ *
+ * @param instance  [IN] The instance being output.
+ * @param rtimers   [IN] The reduced summaries, of every printed name.
+ * @param txbuffer  [IN] This rank's package.
+ * @param txcnt     [IN] The size of txbuffer.
+ * @param PMTM_COMM [IN] The communicator of the instance.
+ * @param fh        [IN] The output file, open on every rank.
+ * @param base      [IN] Where the timers start in the file.
+ * @returns PMTM_SUCCESS, or the same error on every rank.
+ */
+static PMTM_error_t write_timers_collectively(struct PMTM_instance *instance, struct Reduced_Timers *rtimers,
+                                              char *txbuffer, int txcnt, MPI_Comm PMTM_COMM, MPI_File fh, MPI_Offset base)
+{
+    struct Collected_Timers own = { 0, 0, NULL, NULL, NULL };
+    struct PMTM_instance local = *instance;
+    const size_t num_names = instance->names.num_names;
+    uint64_t *lengths = calloc(2 * num_names + 1, sizeof(*lengths));
+    uint64_t *totals = malloc((2 * num_names + 1) * sizeof(*totals));
+    uint64_t *offsets = calloc(num_names + 1, sizeof(*offsets));
+    MPI_Aint *block_displs = malloc((2 * num_names + 1) * sizeof(*block_displs));
+    int *block_lengths = malloc((2 * num_names + 1) * sizeof(*block_lengths));
+    char *text = NULL;
+    size_t text_size = 0;
+    size_t name_id;
+    int package_displ = 0;
+    int fail = 0;
+
+    const uint32_t num_counters = get_num_wire_counters();
+    const size_t record_stride = sizeof(struct PMTM_timer_record) + num_counters * sizeof(int64_t);
 
-static int collect_timers(
-          struct PMTM_instance *instance, char *rxbuffer, size_t rxcnt, int *rxdispls, int *rxcnts,
-          struct Collected_Timer ** ctimers) {
+#ifdef HW_COUNTERS
+    hw_counter_t *counters = malloc(num_counters * sizeof(hw_counter_t) + 1);
+    fail = (counters == NULL);
+#endif
 
-    int rank, i, threadcount;
-    size_t group_timers;
+    fail = fail || lengths == NULL || totals == NULL || offsets == NULL || block_displs == NULL || block_lengths == NULL
+        || collect_timers(instance, txbuffer, 1, &package_displ, &txcnt, "rank", &own) != 0;
 
-    struct Collected_Timer *hash[HASHSIZE];
-    struct Collected_Timer *first = NULL, **curr = &first;
-    struct Collected_Timer *new_timer = NULL;
-    char **timerset;
+    if (!fail) {
+        local.fid = open_memstream(&text, &text_size);
+        fail = (local.fid == NULL);
+    }
 
-    for (i = 0; i < HASHSIZE; i++)
-         hash[i] = NULL;
+    // Print this rank's lines of each name, and at the IO_RANK its summary lines.
 
-    for (rank = 0; rank < instance->nranks; rank++) {
-        char *rxrank = rxbuffer + rxdispls[rank];
-        char *rxrankend = rxrank + rxcnts[rank];
+    if (!fail) {
+        for (name_id = 0; name_id < num_names; name_id++) {
+            const struct PMTM_name *name = &instance->names.names[name_id];
+            const char *record = find_collected_timers(&own, name_id, 0);
+            long start = ftell(local.fid);
 
-        char *group_name = rxrank + sizeof(group_timers);
-        COPY_DATA(&group_timers, rxrank, sizeof(group_timers));
+            if (record != NULL) {
+                uint32_t threadcount, t;
+                COPY_DATA(&threadcount, record, sizeof(threadcount));
+                record += sizeof(threadcount);
 
-        rxrank += sizeof(group_timers) + strlen(group_name) + 1;
+                for (t = 0; t < threadcount; t++, record += record_stride) {
+                    struct PMTM_timer timer;
+                    unpack_timer_record(record, &timer);
+                    timer.timer_name = name->timer_name;
+#ifdef HW_COUNTERS
+                    uint32_t counter_idx;
+                    timer.total_counters = counters;
+                    for (counter_idx = 0; counter_idx < num_counters; ++counter_idx) {
+                        int64_t counter;
+                        COPY_DATA(&counter, record + sizeof(struct PMTM_timer_record) + counter_idx * sizeof(counter), sizeof(counter));
+                        timer.total_counters[counter_idx] = counter;
+                    }
+#endif
+                    print_timer(&local, &timer);
+                }
+            }
+            lengths[name_id] = ftell(local.fid) - start;
 
-        for (i = 0; i < group_timers; i++) {
-             // Should probably check for a block overrun here and implausible threadcount
-             char *timer_name = rxrank;
-             char *timers = rxrank + strlen(timer_name) + 1;
+            if (instance->rank == IO_RANK) {
+                start = ftell(local.fid);
+                print_reduced_name(&local, rtimers, name_id);
+                lengths[num_names + name_id] = ftell(local.fid) - start;
+            }
+        }
 
-             int h = hash_timername(group_name, timer_name) & (HASHSIZE-1);
-             struct Collected_Timer **posn = &hash[h];
-             int cmp = 1;
+        fail = (fclose(local.fid) != 0 || text_size > INT_MAX);
+    }
 
-             while (*posn != NULL) {
-                 cmp = strcmp(group_name, (*posn)->group_name);
-                 if (cmp == 0) cmp = strcmp(timer_name, (*posn)->timer_name);
-                 if (cmp <= 0) break;
-                 posn = &((*posn)->hash_next);
-             }
+    MPI_Allreduce(MPI_IN_PLACE, &fail, 1, MPI_INT, MPI_MAX, PMTM_COMM);
 
-             if (cmp != 0) {
-                 new_timer = malloc(sizeof(struct Collected_Timer));
-                 timerset = calloc(instance->nranks, sizeof(*timerset));
+    if (!fail) {
+        MPI_Datatype file_type;
+        MPI_Offset name_start = base;
+        int num_blocks = 0;
 
-                 if (new_timer == NULL || timerset == NULL) goto memory_abort;
+        MPI_Exscan(lengths, offsets, num_names, MPI_UINT64_T, MPI_SUM, PMTM_COMM);
+        if (instance->rank == 0) memset(offsets, 0, num_names * sizeof(*offsets));
+        MPI_Allreduce(lengths, totals, 2 * num_names, MPI_UINT64_T, MPI_SUM, PMTM_COMM);
 
-                 new_timer->group_name = group_name;
-                 new_timer->timer_name = timer_name;
-                 new_timer->timerset = timerset;
-                 new_timer->hash_next = *posn;
-                 *posn = new_timer;
+        // The text of this rank is in the same order as its blocks in the file.
 
-                 new_timer->next = NULL;
-                 *curr = new_timer;
-                 curr = &new_timer->next;
-             }
+        for (name_id = 0; name_id < num_names; name_id++) {
+            if (lengths[name_id] > 0) {
+                block_displs[num_blocks] = (MPI_Aint) (name_start + offsets[name_id]);
+                block_lengths[num_blocks++] = (int) lengths[name_id];
+            }
+            if (lengths[num_names + name_id] > 0) {
+                block_displs[num_blocks] = (MPI_Aint) (name_start + totals[name_id]);
+                block_lengths[num_blocks++] = (int) lengths[num_names + name_id];
+            }
+            name_start += totals[name_id] + totals[num_names + name_id];
+        }
 
-             // If there is already an entry in the timerset then we've got a clash. Do we
-             // really care?
-             (*posn)->timerset[rank] = timers;
+        // Some MPI-IO implementations reject a filetype without any blocks, so
+        // a rank with nothing to write keeps a plain byte view, but still
+        // takes part in the collective write with a count of zero.
+        if (num_blocks > 0) {
+            MPI_Type_create_hindexed(num_blocks, block_lengths, block_displs, MPI_BYTE, &file_type);
+            MPI_Type_commit(&file_type);
+            MPI_File_set_view(fh, 0, MPI_BYTE, file_type, "native", MPI_INFO_NULL);
+        } else {
+            MPI_File_set_view(fh, 0, MPI_BYTE, MPI_BYTE, "native", MPI_INFO_NULL);
+        }
+        fail = (MPI_File_write_at_all(fh, 0, text, (num_blocks > 0) ? (int) text_size : 0,
+                                      MPI_BYTE, MPI_STATUS_IGNORE) != MPI_SUCCESS) ? 2 : 0;
+        if (num_blocks > 0) {
+            MPI_Type_free(&file_type);
+        }
 
-             COPY_DATA(&threadcount, timers, sizeof(threadcount));
-             rxrank = timers + sizeof(threadcount) + threadcount*sizeof(struct PMTM_timer);
+        MPI_Allreduce(MPI_IN_PLACE, &fail, 1, MPI_INT, MPI_MAX, PMTM_COMM);
+        if (fail && instance->rank == IO_RANK) {
+            pmtm_warn("Failed to write the timers to %s with MPI-IO", instance->file_name);
         }
     }
 
-    *ctimers = first;
-
-    return 0;
-
-memory_abort:
-    if (new_timer != NULL) free(new_timer);
-    if (timerset != NULL) free(timerset);
-
-    free_collected_timers(first);
+    free_collected_timers(&own);
+    free(text);
+    free(lengths);
+    free(totals);
+    free(offsets);
+    free(block_displs);
+    free(block_lengths);
+#ifdef HW_COUNTERS
+    free(counters);
+#endif
 
-    return 1;
+    if (fail == 2) return PMTM_ERROR_CANNOT_CREATE_FILE;
+    return fail ? PMTM_ERROR_FAILED_ALLOCATION : PMTM_SUCCESS;
 }
+#endif
 
-static int print_collected_timers(struct PMTM_instance * instance, struct Collected_Timer *ctimers) {
+/**
+ * Append the timers of this rank to its rank file (PMTM_OPTION_RANK_FILES) as
+ * a section of a struct PMTM_rank_file_header, the names and then the timers,
+ * in the order of the groups and timers of the instance. The IO_RANK also
+ * prints a line saying where the section belongs in the output file. Nothing
+ * is sent to the other ranks, so a rank that fails only fails itself.
+ *
+ * @param instance [IN] The instance whose timers are being output.
+ * @returns PMTM_SUCCESS, PMTM_ERROR_FAILED_ALLOCATION, or
+ *          PMTM_ERROR_CANNOT_CREATE_FILE if the rank file could not be written.
+ */
+static PMTM_error_t write_rank_file(struct PMTM_instance * instance)
+{
+    struct PMTM_rank_file_header header;
+    uint group_idx;
+    uint timer_idx;
+    size_t names_size = 0;
+    size_t timers_size = 0;
+    char *buffer;
+    char *txcurr;
+    char *file_name;
+    FILE *fid;
+    int status = PMTM_SUCCESS;
 
-    struct Collected_Timer *ct = ctimers;
-    struct PMTM_timer *all_timers = NULL;
+    const uint32_t num_counters = get_num_wire_counters();
+    const size_t record_stride = sizeof(struct PMTM_timer_record) + num_counters * sizeof(int64_t);
 
-    while (ct != NULL) {
-        int threads = 0, threadcount;
-        int r, t;
+    header.magic = PMTM_RANK_FILE_MAGIC;
+    header.version = PMTM_WIRE_VERSION;
+    header.record_size = sizeof(struct PMTM_timer_record);
+    header.num_counters = num_counters;
+    header.rank = instance->rank;
+    header.nranks = instance->nranks;
+    header.section = instance->rank_file_sections;
+    header.num_names = 0;
 
-        for (r = 0; r < instance->nranks; r++) {
-            if (ct->timerset[r] != NULL) {
-                COPY_DATA(&threadcount, ct->timerset[r], sizeof(threadcount));
-                threads += threadcount;
+    for (group_idx = 0; group_idx < instance->num_groups; ++group_idx) {
+        struct PMTM_timer_group * group = get_timer_group(instance->group_ids[group_idx]);
+        for (timer_idx = 0; timer_idx < group->num_timers; ++timer_idx) {
+            struct PMTM_timer * timer = group->timer_ids[timer_idx];
+            struct PMTM_timer * tim;
+            if (timer->timer_type == PMTM_TIMER_INT) continue;
+
+            header.num_names++;
+            names_size += strlen(group->group_name) + 1 + strlen(timer->timer_name) + 1 + sizeof(PMTM_timer_type_t);
+            timers_size += sizeof(uint32_t);
+            for (tim = timer; tim != NULL; tim = tim->thread_next) {
+                timers_size += record_stride;
             }
         }
+    }
 
-        all_timers = malloc(threads * sizeof(struct PMTM_timer));
-        if (all_timers == NULL) return 1;
+    if (names_size > UINT32_MAX || timers_size > UINT32_MAX) {
+        pmtm_warn("The timers are too large for a rank file (%lu bytes)", (unsigned long) (names_size + timers_size));
+        return PMTM_ERROR_FAILED_ALLOCATION;
+    }
+    header.names_size = (uint32_t) names_size;
+    header.timers_size = (uint32_t) timers_size;
+
+    buffer = malloc(sizeof(header) + names_size + timers_size);
+    file_name = malloc(strlen(instance->rank_file_name) + 16);
+    if (buffer == NULL || file_name == NULL) {
+        free(buffer);
+        free(file_name);
+        return PMTM_ERROR_FAILED_ALLOCATION;
+    }
 
-        threads = 0;
+    txcurr = buffer;
+    COPY_TX(&header, sizeof(header));
+
+    for (group_idx = 0; group_idx < instance->num_groups; ++group_idx) {
+        struct PMTM_timer_group * group = get_timer_group(instance->group_ids[group_idx]);
+        for (timer_idx = 0; timer_idx < group->num_timers; ++timer_idx) {
+            struct PMTM_timer * timer = group->timer_ids[timer_idx];
+            if (timer->timer_type == PMTM_TIMER_INT) continue;
 
-        for (r = 0; r < instance->nranks; r++) {
-            if (ct->timerset[r] != NULL) {
-                COPY_DATA(&threadcount, ct->timerset[r], sizeof(threadcount));
-                COPY_DATA(all_timers + threads, ct->timerset[r] + sizeof(threadcount),
-                          threadcount * sizeof(struct PMTM_timer));
+            COPY_TX(group->group_name, strlen(group->group_name) + 1);
+            COPY_TX(timer->timer_name, strlen(timer->timer_name) + 1);
+            COPY_TX(&timer->timer_type, sizeof(PMTM_timer_type_t));
+        }
+    }
 
-                threads += threadcount;
+    for (group_idx = 0; group_idx < instance->num_groups; ++group_idx) {
+        struct PMTM_timer_group * group = get_timer_group(instance->group_ids[group_idx]);
+        for (timer_idx = 0; timer_idx < group->num_timers; ++timer_idx) {
+            struct PMTM_timer * timer = group->timer_ids[timer_idx];
+            struct PMTM_timer * tim;
+            uint32_t threadcount = 0;
+            char *tx_tclocation = txcurr;
+            if (timer->timer_type == PMTM_TIMER_INT) continue;
+
+            txcurr += sizeof(threadcount);
+            for (tim = timer; tim != NULL; tim = tim->thread_next) {
+                struct PMTM_timer_record record;
+                pack_timer_record(tim, instance->rank, &record);
+                COPY_TX(&record, sizeof(record));
+#ifdef HW_COUNTERS
+                uint32_t counter_idx;
+                for (counter_idx = 0; counter_idx < num_counters; ++counter_idx) {
+                    int64_t counter = tim->total_counters[counter_idx];
+                    COPY_TX(&counter, sizeof(counter));
+                }
+#endif
+                threadcount++;
             }
+            COPY_DATA(tx_tclocation, &threadcount, sizeof(threadcount));
         }
+    }
 
-        for (t = 0; t < threads; t++) {
-            all_timers[t].timer_name = ct->timer_name;
-        }
+    // The first output of the instance starts the file afresh.
 
-        print_timer_array(instance, threads, all_timers, ct->timer_name, all_timers->timer_type);
+    sprintf(file_name, "%s.%d", instance->rank_file_name, instance->rank);
+    fid = fopen(file_name, (instance->rank_file_sections == 0) ? "w" : "a");
+    if (fid == NULL) {
+        pmtm_warn("Could not open the rank file %s", file_name);
+        status = PMTM_ERROR_CANNOT_CREATE_FILE;
+    } else {
+        if (fwrite(buffer, 1, txcurr - buffer, fid) != (size_t) (txcurr - buffer)) {
+            status = PMTM_ERROR_CANNOT_CREATE_FILE;
+        }
+        if (fclose(fid) != 0) {
+            status = PMTM_ERROR_CANNOT_CREATE_FILE;
+        }
+        if (status != PMTM_SUCCESS) {
+            pmtm_warn("Failed to write the rank file %s", file_name);
+        }
+    }
 
-        ct = ct->next;
+    if (instance->rank == IO_RANK && instance->fid != NULL) {
+        struct PMTM_line line;
+        line_start(&line, instance->fid);
+        line_put(&line, "Rank Files, =, ");
+        line_put_int(&line, instance->nranks);
+        line_put(&line, ", ");
+        line_put_uint(&line, instance->rank_file_sections);
+        line_put(&line, ", ");
+        line_put(&line, instance->rank_file_name);
+        line_end(&line);
     }
 
-    return 0;
+    instance->rank_file_sections++;
+
+    free(buffer);
+    free(file_name);
+    return status;
 }
 
 // MPI Error propagation macro. Please set PMTM_COMM.
@@ -325,14 +2506,32 @@ PMTM_error_t PMTM_internal_timer_output(struct PMTM_instance * instance, MPI_Com
     int malloc_fail = 0;
 
     char *txbuffer = NULL;
+    char *nodebuffer = NULL;
     int *rxcnts = NULL;
     int *rxdispls = NULL;
     char *rxbuffer = NULL;
-    struct Collected_Timer *ctimers = NULL;
+    struct Collected_Timers ctimers = { 0, 0, NULL, NULL, NULL };
+    struct Reduced_Timers rtimers = { 0, NULL, 0, NULL, NULL, NULL, 0, 0, NULL, 0, 0, NULL, NULL, NULL };
     int txcnt;
+    int nodecnt = 0;
+    int num_packages = 1;
+    int is_leader = 1;
+    int print_nodes = node_stats;
+    int collective = 0;
+    size_t stream_size = 0;
+    struct PMTM_rank_sample sample = { -1, 0, 0 };
+    uint group_idx;
     size_t total_rxcnt =  0;
 
 #ifndef SERIAL
+    MPI_Comm node_comm = MPI_COMM_NULL;
+    MPI_Comm leader_comm = MPI_COMM_NULL;
+    MPI_Comm stream_comm = MPI_COMM_NULL;
+    MPI_File fh = MPI_FILE_NULL;
+    MPI_Offset base = 0;
+    int node_rank;
+    int node_size;
+    unsigned long long settings[6];
 
 #define PROPAGATE_ABORT(test, error) do { \
     int local_fail = ((test) ? 1 : 0), global_fail; \
@@ -348,70 +2547,203 @@ PMTM_error_t PMTM_internal_timer_output(struct PMTM_instance * instance, MPI_Com
 
 #endif
 
-    // Work out the total number of timers, the number of unique timers
-    // that have several thread instances, and work out the amount of space
-    // needed to send everything.
+    // Finish any output started by PMTM_timer_output_begin first, then merge
+    // the timers of each group and make sure they all have a name ID.
+
+    malloc_fail = (PMTM_internal_timer_output_end(instance) != PMTM_SUCCESS);
+
+    for (group_idx = 0; group_idx < instance->num_groups; ++group_idx) {
+        if (merge_timer_store(get_timer_group(instance->group_ids[group_idx])) != 0) {
+            malloc_fail = 1;
+        }
+    }
+
+    // Rank files are written without any communication, so each rank fails
+    // on its own.
+
+    if (instance->rank_file_name != NULL) {
+        return malloc_fail ? PMTM_ERROR_FAILED_ALLOCATION : write_rank_file(instance);
+    }
 
-    compute_txamount_and_package(instance, &txcnt, &txbuffer);
+    PROPAGATE_ABORT(malloc_fail, PMTM_ERROR_FAILED_ALLOCATION);
+
+    status = exchange_names(instance, PMTM_COMM);
+    if (status != PMTM_SUCCESS) goto abort;
 
 #ifndef SERIAL
+    // The options are read from .pmtmrc by the IO_RANK, so it decides for all.
+
     if (instance->rank == IO_RANK) {
-       rxcnts = malloc(sizeof(*rxcnts) * (instance->nranks+1)); // +1 ?
-       rxdispls = malloc(sizeof(*rxdispls) * (instance->nranks+1)); // +1 ?
+        stream_size = get_stream_buffer();
+        get_rank_sample(&sample);
+        if (sample.every >= 0 && stream_size > 0) {
+            pmtm_warn("PMTM_STREAM_BUFFER is ignored when sampling the ranks");
+            stream_size = 0;
+        }
+        if (stream_size > 0 && print_nodes) {
+            pmtm_warn("PMTM_OPTION_NODE_STATS is ignored when streaming the timers");
+            print_nodes = 0;
+        }
+        collective = collective_write && instance->fid != NULL && instance->fid != stdout;
+#ifdef NOLOCAL
+        collective = 0;
+#endif
+        if (collective && sample.every >= 0) {
+            pmtm_warn("PMTM_OPTION_COLLECTIVE_WRITE is ignored when sampling the ranks");
+            collective = 0;
+        }
+        if (collective && instance->collapse_tolerance >= 0) {
+            pmtm_warn("PMTM_OPTION_COLLECTIVE_WRITE is ignored when collapsing the rank lines");
+            collective = 0;
+        }
+        if (collective && stream_size > 0) {
+            pmtm_warn("PMTM_STREAM_BUFFER is ignored when writing the timers collectively");
+            stream_size = 0;
+        }
+        settings[0] = print_nodes;
+        settings[1] = stream_size;
+        settings[2] = collective;
+        settings[3] = (unsigned long long) (sample.every + 1);
+        settings[4] = sample.per_node;
+        settings[5] = sample.outliers;
+    }
+    MPI_Bcast(settings, 6, MPI_UNSIGNED_LONG_LONG, IO_RANK, PMTM_COMM);
+    print_nodes = (int) settings[0];
+    stream_size = (size_t) settings[1];
+    collective = (int) settings[2];
+    sample.every = (int) settings[3] - 1;
+    sample.per_node = (int) settings[4];
+    sample.outliers = (int) settings[5];
+
+    // The timers are gathered after all if the file cannot be opened with MPI-IO.
+
+    if (collective) {
+        collective = !open_collective_file(instance, PMTM_COMM, &fh, &base);
+    }
+
+    // Group the ranks by node. Each node leader gathers and merges the timers
+    // of its node, and only the leaders send to the IO_RANK.
 
-       malloc_fail = (rxcnts == NULL || rxdispls == NULL);
+    split_nodes(PMTM_COMM, &node_comm, &leader_comm);
+    MPI_Comm_rank(node_comm, &node_rank);
+    MPI_Comm_size(node_comm, &node_size);
+    is_leader = (node_rank == 0);
+
+    if (is_leader) {
+        MPI_Comm_size(leader_comm, &num_packages);
     }
 #endif
 
-    PROPAGATE_ABORT(txbuffer == NULL || malloc_fail, PMTM_ERROR_FAILED_ALLOCATION);
+    // Summarise the timers that only print their average, maximum and minimum,
+    // which are reduced rather than gathered, or all of them if each rank
+    // writes its own lines or only a sample of the ranks is gathered.
 
-    // Transmit the package sizes to the IO_RANK.
+    malloc_fail = summarise_timers(instance, &rtimers, is_leader, num_packages, print_nodes,
+                                   collective || sample.every >= 0, &sample);
+
+    // Work out the total number of timers, the number of unique timers
+    // that have several thread instances, and work out the amount of space
+    // needed to send everything else, from the sampled ranks.
 
-    total_rxcnt = txcnt;
+    compute_txamount_and_package(instance, &sample, is_leader, &txcnt, &txbuffer);
 
 #ifndef SERIAL
-    MPI_Gather(&txcnt, sizeof(*rxcnts), MPI_BYTE,
-               rxcnts, sizeof(*rxcnts), MPI_BYTE, IO_RANK, PMTM_COMM);
+    if (is_leader && stream_size == 0 && !collective) {
+       int max_packages = (node_size > num_packages) ? node_size : num_packages;
+       rxcnts = malloc(sizeof(*rxcnts) * (max_packages + 1));
+       rxdispls = malloc(sizeof(*rxdispls) * (max_packages + 1));
 
-    total_rxcnt =  0;
+       malloc_fail = malloc_fail || (rxcnts == NULL || rxdispls == NULL);
+    }
+#endif
 
-    if (instance->rank == IO_RANK) {
-        int r;
+    PROPAGATE_ABORT(txbuffer == NULL || malloc_fail, PMTM_ERROR_FAILED_ALLOCATION);
 
-        for (r = 0; r < instance->nranks; r++) {
-            size_t current_rxcnt = rxcnts[r];
-            rxdispls[r] = total_rxcnt;
-            total_rxcnt += current_rxcnt;
+#ifndef SERIAL
+    reduce_timers(instance, &rtimers, node_comm, leader_comm);
+
+    if (collective) {
+        status = write_timers_collectively(instance, &rtimers, txbuffer, txcnt, PMTM_COMM, fh, base);
+        if (status != PMTM_SUCCESS) goto abort;
+    } else if (stream_size > 0) {
+        // Stream the timers to the IO_RANK a name and a window of ranks at a
+        // time, on a communicator of our own so as not to match any of the
+        // application's messages.
+
+        MPI_Comm_dup(PMTM_COMM, &stream_comm);
+        malloc_fail = stream_timers(instance, &rtimers, stream_comm, stream_size, txbuffer, txcnt);
+    } else {
+        // Gather the packages of the ranks of each node at its leader, and merge
+        // them into one package for the node.
+
+        MPI_Gather(&txcnt, 1, MPI_INT, rxcnts, 1, MPI_INT, 0, node_comm);
+
+        if (is_leader) {
+            total_rxcnt = compute_displacements(node_size, rxcnts, rxdispls);
+            rxbuffer = (total_rxcnt <= INT_MAX) ? malloc(total_rxcnt) : NULL;
+            malloc_fail = (rxbuffer == NULL);
         }
-    }
-#endif
 
-    // Gather data at IO_RANK
+        PROPAGATE_ABORT(malloc_fail, PMTM_ERROR_FAILED_ALLOCATION);
 
-    rxbuffer = txbuffer;
+        MPI_Gatherv(txbuffer, txcnt, MPI_BYTE,
+                    rxbuffer, rxcnts, rxdispls, MPI_BYTE, 0, node_comm);
 
-#ifndef SERIAL
-    if (instance->rank == IO_RANK) {
-        rxbuffer = malloc(total_rxcnt);
-        malloc_fail = (rxbuffer == NULL);
-    }
+        if (is_leader) {
+            malloc_fail = merge_node_timers(instance, rxbuffer, node_size, rxdispls, rxcnts, &nodecnt, &nodebuffer);
+            free(rxbuffer);
+            rxbuffer = NULL;
+        }
 
-    PROPAGATE_ABORT(malloc_fail, PMTM_ERROR_FAILED_ALLOCATION);
+        PROPAGATE_ABORT(malloc_fail, PMTM_ERROR_FAILED_ALLOCATION);
 
-    MPI_Gatherv(txbuffer, txcnt, MPI_BYTE,
-                rxbuffer, rxcnts, rxdispls, MPI_BYTE, IO_RANK, PMTM_COMM);
+        // Gather the packages of the nodes at IO_RANK. MPI_Gatherv can only
+        // place them in the first 2 GB, beyond that they must be streamed.
 
-    // Make sense of and combine up the data for printing...
+        if (is_leader) {
+            MPI_Gather(&nodecnt, 1, MPI_INT, rxcnts, 1, MPI_INT, 0, leader_comm);
 
-    if (instance->rank == IO_RANK) {
-#endif
-        malloc_fail = collect_timers(instance, rxbuffer, total_rxcnt, rxdispls, rxcnts, &ctimers);
+            if (instance->rank == IO_RANK) {
+                total_rxcnt = compute_displacements(num_packages, rxcnts, rxdispls);
+                if (total_rxcnt > INT_MAX) {
+                    pmtm_warn("The timers are too large to gather at once (%lu bytes), set PMTM_STREAM_BUFFER to stream them",
+                              (unsigned long) total_rxcnt);
+                } else {
+                    rxbuffer = malloc(total_rxcnt);
+                }
+                malloc_fail = (rxbuffer == NULL);
+            }
+        }
+
+        PROPAGATE_ABORT(malloc_fail, PMTM_ERROR_FAILED_ALLOCATION);
+
+        if (is_leader) {
+            MPI_Gatherv(nodebuffer, nodecnt, MPI_BYTE,
+                        rxbuffer, rxcnts, rxdispls, MPI_BYTE, 0, leader_comm);
+        }
+
+        // Make sense of and combine up the data for printing...
+
+        if (instance->rank == IO_RANK) {
+            malloc_fail = collect_timers(instance, rxbuffer, num_packages, rxdispls, rxcnts, "node", &ctimers);
+
+            if (!malloc_fail) {
+                malloc_fail = print_collected_timers(instance, &ctimers, &rtimers, print_nodes, 1);
+                free_collected_timers(&ctimers);
+            }
+        }
+    }
+#else
+    reduce_timers(instance, &rtimers, PMTM_COMM, PMTM_COMM);
+
+    {
+        int serial_displ = 0;
+        malloc_fail = collect_timers(instance, txbuffer, 1, &serial_displ, &txcnt, "rank", &ctimers);
 
         if (!malloc_fail) {
-            malloc_fail = print_collected_timers(instance, ctimers);
-            free_collected_timers(ctimers);
+            malloc_fail = print_collected_timers(instance, &ctimers, &rtimers, print_nodes, 1);
+            free_collected_timers(&ctimers);
         }
-#ifndef SERIAL
     }
 #endif
 
@@ -419,16 +2751,289 @@ PMTM_error_t PMTM_internal_timer_output(struct PMTM_instance * instance, MPI_Com
 
 abort:
     if (txbuffer != NULL) free(txbuffer);
+    if (nodebuffer != NULL) free(nodebuffer);
+    free_reduced_timers(&rtimers);
 
 #ifndef SERIAL
-    if (rxbuffer != NULL && rxbuffer != txbuffer) free(rxbuffer);
+    if (rxbuffer != NULL) free(rxbuffer);
     if (rxcnts != NULL) free(rxcnts);
     if (rxdispls != NULL) free(rxdispls);
+    if (stream_comm != MPI_COMM_NULL) MPI_Comm_free(&stream_comm);
+    if (fh != MPI_FILE_NULL) {
+        MPI_File_close(&fh);
+        if (instance->rank == IO_RANK && resume_file(instance) != PMTM_SUCCESS) {
+            pmtm_warn("Could not open %s again after writing the timers", instance->file_name);
+        }
+    }
+    if (leader_comm != MPI_COMM_NULL) MPI_Comm_free(&leader_comm);
+    if (node_comm != MPI_COMM_NULL) MPI_Comm_free(&node_comm);
 #endif
 
     return status;
 }
 
+#ifndef SERIAL
+/**
+ * An output started by PMTM_internal_timer_output_begin and not yet finished
+ * by PMTM_internal_timer_output_end. It holds the snapshot of the timers and
+ * the buffers of the gather and reduction until they complete.
+ */
+struct PMTM_pending_output {
+    struct PMTM_instance instance;      /**< A copy of the instance being output, for the thread. */
+    char *txbuffer;                     /**< This rank's package. */
+    int txcnt;                          /**< The size of txbuffer. */
+    int *rxcnts;                        /**< The size of each rank's package, at the IO_RANK. */
+    int *rxdispls;                      /**< Where each rank's package starts in rxbuffer, at the IO_RANK. */
+    char *rxbuffer;                     /**< The packages of every rank, at the IO_RANK. */
+    struct Reduced_Timers rtimers;      /**< The summaries being reduced. */
+    MPI_Datatype summary_type;          /**< The datatype of a struct PMTM_timer_summary, if there are any. */
+    MPI_Op summary_reduce;              /**< The operation combining them. */
+    MPI_Request requests[2];            /**< The gather and the reduction. */
+    int has_thread;                     /**< Whether thread is printing the timers. */
+    pthread_t thread;                   /**< The thread printing the timers, at the IO_RANK. */
+    char *text;                         /**< The timers printed by thread. */
+    size_t text_size;                   /**< The length of text. */
+    int status;                         /**< 0 if the timers were printed, 1 if the memory ran out. */
+};
+
+static void free_pending_output(struct PMTM_pending_output *pending)
+{
+    free(pending->txbuffer);
+    free(pending->rxcnts);
+    free(pending->rxdispls);
+    free(pending->rxbuffer);
+    free(pending->text);
+    free_reduced_timers(&pending->rtimers);
+    if (pending->summary_reduce != MPI_OP_NULL) MPI_Op_free(&pending->summary_reduce);
+    if (pending->summary_type != MPI_DATATYPE_NULL) MPI_Type_free(&pending->summary_type);
+    free(pending);
+}
+
+/**
+ * Wait for the gather and reduction of an output to complete and print the
+ * timers to the given file, at the IO_RANK.
+ *
+ * @param pending  [IN] The output.
+ * @param fid      [IN] The file to print to.
+ * @param parallel [IN] Whether the timers may be formatted by a team of OpenMP
+ *                      threads, see print_collected_timers.
+ * @returns 0 if successful, 1 if the memory could not be allocated.
+ */
+static int finish_pending_output(struct PMTM_pending_output *pending, FILE *fid, int parallel)
+{
+    struct PMTM_instance instance = pending->instance;
+    struct Collected_Timers ctimers = { 0, 0, NULL, NULL, NULL };
+    int status;
+
+    MPI_Waitall(2, pending->requests, MPI_STATUSES_IGNORE);
+
+    instance.fid = fid;
+    status = collect_timers(&instance, pending->rxbuffer, instance.nranks,
+                            pending->rxdispls, pending->rxcnts, "rank", &ctimers);
+    if (status == 0) {
+        status = print_collected_timers(&instance, &ctimers, &pending->rtimers, 0, parallel);
+        free_collected_timers(&ctimers);
+    }
+    return status;
+}
+
+/**
+ * The thread started at the IO_RANK by PMTM_internal_timer_output_begin, which
+ * prints the timers into memory once they have arrived, for
+ * PMTM_internal_timer_output_end to write to the file.
+ */
+static void *output_thread(void *arg)
+{
+    struct PMTM_pending_output *pending = arg;
+    FILE *text_fid = open_memstream(&pending->text, &pending->text_size);
+
+    if (text_fid == NULL) {
+        MPI_Waitall(2, pending->requests, MPI_STATUSES_IGNORE);
+        pending->status = 1;
+        return NULL;
+    }
+
+    pending->status = finish_pending_output(pending, text_fid, 0);
+    fclose(text_fid);
+    return NULL;
+}
+#endif
+
+/**
+ * Start the output of a snapshot of the timers of an instance. The timers are
+ * packaged and summarised as they are now, and sent to the IO_RANK with an
+ * MPI_Igatherv and an MPI_Ireduce, so that the ranks can carry on while they
+ * are sent. They are printed by PMTM_internal_timer_output_end, or by a thread
+ * of the IO_RANK in the meantime if MPI allows it. An output that is already
+ * pending is finished first.
+ *
+ * Only the sizes of the packages are gathered before returning, so that the
+ * IO_RANK can allocate room for them and all ranks agree on any failure before
+ * anything is in flight. The timers are gathered straight to the IO_RANK, so
+ * PMTM_OPTION_NODE_STATS and PMTM_STREAM_BUFFER do not apply.
+ *
+ * @param instance  [IN] The instance to output.
+ * @param PMTM_COMM [IN] The communicator of the instance.
+ * @returns PMTM_SUCCESS if successful, or one of PMTM_ERROR_* codes if not.
+ */
+PMTM_error_t PMTM_internal_timer_output_begin(struct PMTM_instance * instance, MPI_Comm PMTM_COMM)
+{
+#ifndef SERIAL
+    struct PMTM_pending_output *pending = NULL;
+    PMTM_error_t status;
+    uint group_idx;
+    int malloc_fail = 0, global_fail;
+    int provided;
+
+    // Writing the rank files needs no communication to overlap.
+
+    if (instance->rank_file_name != NULL) {
+        return PMTM_internal_timer_output(instance, PMTM_COMM);
+    }
+
+    // Finish any pending output first. Only the IO_RANK can fail to, so this
+    // is agreed with the failures of the merge.
+
+    malloc_fail = (PMTM_internal_timer_output_end(instance) != PMTM_SUCCESS);
+
+    for (group_idx = 0; group_idx < instance->num_groups; ++group_idx) {
+        if (merge_timer_store(get_timer_group(instance->group_ids[group_idx])) != 0) {
+            malloc_fail = 1;
+        }
+    }
+
+    MPI_Allreduce(&malloc_fail, &global_fail, 1, MPI_INT, MPI_SUM, PMTM_COMM);
+    if (global_fail > 0) return PMTM_ERROR_FAILED_ALLOCATION;
+
+    status = exchange_names(instance, PMTM_COMM);
+    if (status != PMTM_SUCCESS) return status;
+
+    pending = calloc(1, sizeof(*pending));
+    if (pending != NULL) {
+        pending->instance = *instance;
+        pending->summary_type = MPI_DATATYPE_NULL;
+        pending->summary_reduce = MPI_OP_NULL;
+        pending->requests[0] = MPI_REQUEST_NULL;
+        pending->requests[1] = MPI_REQUEST_NULL;
+
+        malloc_fail = summarise_timers(instance, &pending->rtimers, 0, 1, 0, 0, NULL);
+        compute_txamount_and_package(instance, NULL, 1, &pending->txcnt, &pending->txbuffer);
+        malloc_fail = malloc_fail || (pending->txbuffer == NULL);
+
+        if (instance->rank == IO_RANK) {
+            if (node_stats) {
+                pmtm_warn("PMTM_OPTION_NODE_STATS is ignored by PMTM_timer_output_begin");
+            }
+            pending->rxcnts = malloc(sizeof(int) * (instance->nranks + 1));
+            pending->rxdispls = malloc(sizeof(int) * (instance->nranks + 1));
+            malloc_fail = malloc_fail || (pending->rxcnts == NULL || pending->rxdispls == NULL);
+        }
+    } else {
+        malloc_fail = 1;
+    }
+
+    MPI_Allreduce(&malloc_fail, &global_fail, 1, MPI_INT, MPI_SUM, PMTM_COMM);
+    if (global_fail > 0) {
+        if (pending != NULL) free_pending_output(pending);
+        return PMTM_ERROR_FAILED_ALLOCATION;
+    }
+
+    MPI_Gather(&pending->txcnt, 1, MPI_INT, pending->rxcnts, 1, MPI_INT, IO_RANK, PMTM_COMM);
+
+    if (instance->rank == IO_RANK) {
+        size_t total_rxcnt = compute_displacements(instance->nranks, pending->rxcnts, pending->rxdispls);
+        if (total_rxcnt > INT_MAX) {
+            pmtm_warn("The timers are too large to gather at once (%lu bytes), use PMTM_timer_output with PMTM_STREAM_BUFFER set",
+                      (unsigned long) total_rxcnt);
+        } else {
+            pending->rxbuffer = malloc(total_rxcnt);
+        }
+        malloc_fail = (pending->rxbuffer == NULL);
+    }
+
+    MPI_Bcast(&malloc_fail, 1, MPI_INT, IO_RANK, PMTM_COMM);
+    if (malloc_fail) {
+        free_pending_output(pending);
+        return PMTM_ERROR_FAILED_ALLOCATION;
+    }
+
+    // Everything is in place, so send the snapshot. The timers can be started
+    // and stopped again as soon as this returns.
+
+#if MPI_VERSION >= 3
+    MPI_Igatherv(pending->txbuffer, pending->txcnt, MPI_BYTE, pending->rxbuffer,
+                 pending->rxcnts, pending->rxdispls, MPI_BYTE, IO_RANK, PMTM_COMM, &pending->requests[0]);
+#else
+    MPI_Gatherv(pending->txbuffer, pending->txcnt, MPI_BYTE, pending->rxbuffer,
+                pending->rxcnts, pending->rxdispls, MPI_BYTE, IO_RANK, PMTM_COMM);
+#endif
+
+    if (pending->rtimers.num_summaries > 0) {
+        MPI_Type_contiguous(SUMMARY_WORDS, MPI_UINT64_T, &pending->summary_type);
+        MPI_Type_commit(&pending->summary_type);
+        MPI_Op_create(summary_op, 1, &pending->summary_reduce);
+
+#if MPI_VERSION >= 3
+        MPI_Ireduce(pending->rtimers.summaries, pending->rtimers.reduced, pending->rtimers.num_summaries,
+                    pending->summary_type, pending->summary_reduce, IO_RANK, PMTM_COMM, &pending->requests[1]);
+#else
+        MPI_Reduce(pending->rtimers.summaries, pending->rtimers.reduced, pending->rtimers.num_summaries,
+                   pending->summary_type, pending->summary_reduce, IO_RANK, PMTM_COMM);
+#endif
+    }
+
+    // The IO_RANK can only wait for the timers on a thread of its own if MPI
+    // allows calls from several threads at once.
+
+    MPI_Query_thread(&provided);
+    if (instance->rank == IO_RANK && provided == MPI_THREAD_MULTIPLE) {
+        pending->has_thread = (pthread_create(&pending->thread, NULL, output_thread, pending) == 0);
+    }
+
+    instance->pending_output = pending;
+    return PMTM_SUCCESS;
+#else
+    return PMTM_internal_timer_output(instance, PMTM_COMM);
+#endif
+}
+
+/**
+ * Finish the output started by PMTM_internal_timer_output_begin, waiting for
+ * the timers to arrive at the IO_RANK and writing them to the file. Does
+ * nothing if no output is pending. Only the IO_RANK prints the timers, so it
+ * alone can fail, and the other ranks do not wait to hear about it.
+ *
+ * @param instance [IN] The instance being output.
+ * @returns PMTM_SUCCESS if successful, or one of PMTM_ERROR_* codes if not.
+ */
+PMTM_error_t PMTM_internal_timer_output_end(struct PMTM_instance * instance)
+{
+#ifndef SERIAL
+    struct PMTM_pending_output *pending = instance->pending_output;
+    int status = 0;
+
+    if (pending == NULL) return PMTM_SUCCESS;
+    instance->pending_output = NULL;
+
+    if (pending->has_thread) {
+        pthread_join(pending->thread, NULL);
+        status = pending->status;
+        if (status == 0 && instance->fid != NULL && pending->text_size > 0) {
+            fwrite(pending->text, 1, pending->text_size, instance->fid);
+        }
+    } else if (instance->rank == IO_RANK) {
+        status = finish_pending_output(pending, instance->fid, 1);
+    } else {
+        MPI_Waitall(2, pending->requests, MPI_STATUSES_IGNORE);
+    }
+
+    free_pending_output(pending);
+    return status ? PMTM_ERROR_FAILED_ALLOCATION : PMTM_SUCCESS;
+#else
+    return PMTM_SUCCESS;
+#endif
+}
+
 #ifdef	__cplusplus
 }
 #endif
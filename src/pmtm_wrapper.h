@@ -26,6 +26,8 @@ PMTM_error_t F2C( c_pmtm_create_instance, C_PMTM_CREATE_INSTANCE )(PMTM_instance
 PMTM_error_t F2C( c_pmtm_destroy_instance, C_PMTM_DESTROY_INSTANCE )(PMTM_instance_t * instance_id);
 PMTM_error_t F2C( c_pmtm_create_timer_group, C_PMTM_CREATE_TIMER_GROUP )(PMTM_instance_t * instance_id, PMTM_timer_group_t * timer_group_id, const char * group_name, int * group_name_len);
 PMTM_error_t F2C( c_pmtm_create_timer, C_PMTM_CREATE_TIMER )(PMTM_timer_group_t * timer_group_id, PMTM_timer_t * timer_id, const char * timer_name, int * timer_name_len, PMTM_timer_type_t * timer_type);
+PMTM_error_t F2C( c_pmtm_get_or_create_timer, C_PMTM_GET_OR_CREATE_TIMER )(PMTM_timer_group_t * timer_group_id, PMTM_timer_t * timer_id, const char * timer_name, int * timer_name_len, PMTM_timer_type_t * timer_type);
+PMTM_error_t F2C( c_pmtm_set_default_measure, C_PMTM_SET_DEFAULT_MEASURE )(PMTM_timer_group_t * timer_group_id, PMTM_timer_type_t * measure);
 PMTM_error_t F2C( c_pmtm_set_sample_mode, C_PMTM_SET_SAMPLE_MODE )(PMTM_timer_t * timer_id, int * frequency, int * max_samples);
 
 void F2C( c_pmtm_timer_start, C_PMTM_TIMER_START )(PMTM_timer_t * timer_id);
@@ -33,6 +35,8 @@ void F2C( c_pmtm_timer_stop, C_PMTM_TIMER_STOP )(PMTM_timer_t * timer_id);
 void F2C( c_pmtm_timer_pause, C_PMTM_TIMER_PAUSE )(PMTM_timer_t * timer_id);
 void F2C( c_pmtm_timer_continue, C_PMTM_TIMER_CONTINUE )(PMTM_timer_t * timer_id);
 PMTM_error_t F2C( c_pmtm_timer_output, C_PMTM_TIMER_OUTPUT )(PMTM_instance_t * instance_id);
+PMTM_error_t F2C( c_pmtm_timer_output_begin, C_PMTM_TIMER_OUTPUT_BEGIN )(PMTM_instance_t * instance_id);
+PMTM_error_t F2C( c_pmtm_timer_output_end, C_PMTM_TIMER_OUTPUT_END )(PMTM_instance_t * instance_id);
 double F2C( c_pmtm_get_cpu_time, C_PMTM_GET_CPU_TIME )(PMTM_timer_t * timer_id);
 double F2C( c_pmtm_get_last_cpu_time, C_PMTM_GET_LAST_CPU_TIME )(PMTM_timer_t * timer_id);
 double F2C( c_pmtm_get_total_cpu_time, C_PMTM_GET_TOTAL_CPU_TIME )(PMTM_timer_t * timer_id);
@@ -136,6 +140,25 @@ PMTM_error_t F2C( c_pmtm_create_timer, C_PMTM_CREATE_TIMER )(
     return PMTM_create_timer(*timer_group_id, timer_id, c_timer_name, *timer_type);
 }
 
+PMTM_error_t F2C( c_pmtm_get_or_create_timer, C_PMTM_GET_OR_CREATE_TIMER )(
+        PMTM_timer_group_t * timer_group_id,
+        PMTM_timer_t       * timer_id,
+        const char         * timer_name,
+        int                * timer_name_len,
+        PMTM_timer_type_t  * timer_type)
+{
+    char c_timer_name[*timer_name_len + 1];
+    F2C_strcpy(c_timer_name, timer_name, *timer_name_len);
+    return PMTM_get_or_create_timer(*timer_group_id, timer_id, c_timer_name, *timer_type);
+}
+
+PMTM_error_t F2C( c_pmtm_set_default_measure, C_PMTM_SET_DEFAULT_MEASURE )(
+        PMTM_timer_group_t * timer_group_id,
+        PMTM_timer_type_t  * measure)
+{
+    return PMTM_set_default_measure(*timer_group_id, *measure);
+}
+
 PMTM_error_t F2C( c_pmtm_set_sample_mode, C_PMTM_SET_SAMPLE_MODE )(
         PMTM_timer_t * timer,
         int          * frequency,
@@ -174,6 +197,18 @@ PMTM_error_t F2C( c_pmtm_timer_output, C_PMTM_TIMER_OUTPUT )(
     return PMTM_timer_output(*instance_id);
 }
 
+PMTM_error_t F2C( c_pmtm_timer_output_begin, C_PMTM_TIMER_OUTPUT_BEGIN )(
+        PMTM_instance_t * instance_id)
+{
+    return PMTM_timer_output_begin(*instance_id);
+}
+
+PMTM_error_t F2C( c_pmtm_timer_output_end, C_PMTM_TIMER_OUTPUT_END )(
+        PMTM_instance_t * instance_id)
+{
+    return PMTM_timer_output_end(*instance_id);
+}
+
 double F2C( c_pmtm_get_cpu_time, C_PMTM_GET_CPU_TIME )(
         PMTM_timer_t * timer_id)
 {
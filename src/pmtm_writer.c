@@ -0,0 +1,275 @@
+/**
+ * @file   pmtm_writer.c
+ * @author AWE Plc.
+ *
+ * The writer thread of the output file (PMTM_OPTION_WRITER_THREAD). Everything
+ * PMTM prints goes through instance->fid, so open_writer puts a stream of its
+ * own in its place, which copies what is printed into large buffers. A full
+ * buffer is handed to a thread that writes it to the file while the application
+ * fills the next one, so the application only ever copies memory and never
+ * waits for the file system. Closing the stream hands over the last buffer,
+ * waits for the thread to write everything and closes the file.
+ *
+ * The buffers are passed to the thread through a lock-free queue with a single
+ * producer and a single consumer, a list whose head is the buffer the thread
+ * wrote last, and the thread passes the buffers it has written back through a
+ * lock-free stack. Two buffers are enough while the file keeps up; more are
+ * only allocated when it falls behind. A semaphore wakes the thread, as posting
+ * one never blocks.
+ */
+
+#define _GNU_SOURCE
+
+#include "pmtm.h"
+#include "pmtm_internal.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GLIBC__)
+#  include <pthread.h>
+#  include <sched.h>
+#  include <semaphore.h>
+#  define HAVE_WRITER_THREAD
+#endif
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#ifdef HAVE_WRITER_THREAD
+
+#define WRITER_BUFFER_SIZE (1 << 20)
+
+/**
+ * A buffer of text to be written to the file.
+ */
+struct writer_buffer {
+    struct writer_buffer * next;    /**< The next buffer in the queue or the stack. */
+    size_t used;                    /**< The number of bytes of data filled. */
+    char data[WRITER_BUFFER_SIZE];  /**< The text. */
+};
+
+/**
+ * The state of a writer, the cookie of its stream. Only head and the file are
+ * used by the thread, and only tail, current and spare by the application.
+ */
+struct writer {
+    FILE * file;                        /**< The output file. */
+    pthread_t thread;                   /**< The thread writing to it. */
+    sem_t ready;                        /**< Posted once for each buffer queued, and once more when closing. */
+    struct writer_buffer * head;        /**< The buffer written last, its next is the next to write. */
+    struct writer_buffer * tail;        /**< The buffer queued last. */
+    struct writer_buffer * current;     /**< The buffer being filled. */
+    struct writer_buffer * spare;       /**< Written buffers ready to be filled again. */
+    struct writer_buffer * recycled;    /**< Written buffers handed back by the thread. */
+    int failed;                         /**< Set by the thread if a write failed. */
+};
+
+/**
+ * The thread writing the queued buffers to the file, in order, until it is
+ * woken with nothing queued.
+ */
+static void * write_buffers(void * arg)
+{
+    struct writer * writer = arg;
+
+    while (1) {
+        while (sem_wait(&writer->ready) != 0 && errno == EINTR);
+
+        struct writer_buffer * next = __atomic_load_n(&writer->head->next, __ATOMIC_ACQUIRE);
+        if (next == NULL) break;
+
+        if (!writer->failed && fwrite(next->data, 1, next->used, writer->file) != next->used) {
+            writer->failed = 1;
+        }
+
+        struct writer_buffer * written = writer->head;
+        writer->head = next;
+
+        struct writer_buffer * top = __atomic_load_n(&writer->recycled, __ATOMIC_RELAXED);
+        do {
+            written->next = top;
+        } while (!__atomic_compare_exchange_n(&writer->recycled, &top, written, 0,
+                                              __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    }
+
+    return NULL;
+}
+
+/**
+ * Queue a buffer for the thread to write and wake it.
+ */
+static void queue_buffer(struct writer * writer, struct writer_buffer * buffer)
+{
+    buffer->next = NULL;
+    __atomic_store_n(&writer->tail->next, buffer, __ATOMIC_RELEASE);
+    writer->tail = buffer;
+    sem_post(&writer->ready);
+}
+
+/**
+ * Get an empty buffer, reusing one the thread has written if there is one.
+ * A new buffer is allocated if not, and only if that fails does this wait for
+ * the thread, which always has a buffer queued when this is called.
+ */
+static struct writer_buffer * get_buffer(struct writer * writer)
+{
+    struct writer_buffer * buffer;
+
+    if (writer->spare == NULL) {
+        writer->spare = __atomic_exchange_n(&writer->recycled, NULL, __ATOMIC_ACQUIRE);
+    }
+
+    if (writer->spare == NULL) {
+        buffer = malloc(sizeof(*buffer));
+        while (buffer == NULL && writer->spare == NULL) {
+            sched_yield();
+            writer->spare = __atomic_exchange_n(&writer->recycled, NULL, __ATOMIC_ACQUIRE);
+        }
+        if (buffer != NULL) {
+            buffer->used = 0;
+            return buffer;
+        }
+    }
+
+    buffer = writer->spare;
+    writer->spare = buffer->next;
+    buffer->used = 0;
+    return buffer;
+}
+
+static void free_buffers(struct writer_buffer * buffer)
+{
+    while (buffer != NULL) {
+        struct writer_buffer * next = buffer->next;
+        free(buffer);
+        buffer = next;
+    }
+}
+
+/**
+ * The write function of the stream, which copies the text into the current
+ * buffer and hands each buffer that fills over to the thread.
+ */
+static ssize_t writer_write(void * cookie, const char * text, size_t size)
+{
+    struct writer * writer = cookie;
+    size_t remaining = size;
+
+    while (remaining > 0) {
+        size_t space = WRITER_BUFFER_SIZE - writer->current->used;
+        size_t count = (remaining < space) ? remaining : space;
+
+        memcpy(writer->current->data + writer->current->used, text, count);
+        writer->current->used += count;
+        text += count;
+        remaining -= count;
+
+        if (writer->current->used == WRITER_BUFFER_SIZE) {
+            queue_buffer(writer, writer->current);
+            writer->current = get_buffer(writer);
+        }
+    }
+
+    return size;
+}
+
+/**
+ * The close function of the stream, which hands over the last buffer, waits
+ * for the thread to write everything and closes the file.
+ */
+static int writer_close(void * cookie)
+{
+    struct writer * writer = cookie;
+    int status;
+
+    if (writer->current->used > 0) {
+        queue_buffer(writer, writer->current);
+    } else {
+        free(writer->current);
+    }
+
+    sem_post(&writer->ready);
+    pthread_join(writer->thread, NULL);
+
+    status = fclose(writer->file);
+    if (writer->failed) {
+        pmtm_warn("Failed to write some of the output file");
+        status = EOF;
+    }
+
+    free(writer->head);
+    free_buffers(writer->spare);
+    free_buffers(writer->recycled);
+    sem_destroy(&writer->ready);
+    free(writer);
+
+    return status;
+}
+
+/**
+ * Start a writer thread for an output file.
+ *
+ * @param file [IN] The output file, which the writer takes over.
+ * @returns A stream writing to the file through the thread, which closes the
+ *          file when it is closed, or NULL if the thread could not be started,
+ *          in which case the file is left as it is.
+ */
+FILE * open_writer(FILE * file)
+{
+    cookie_io_functions_t functions = { NULL, writer_write, NULL, writer_close };
+    struct writer * writer = calloc(1, sizeof(*writer));
+    FILE * stream = NULL;
+
+    if (writer == NULL) return NULL;
+
+    writer->file = file;
+    writer->head = malloc(sizeof(struct writer_buffer));
+    writer->current = malloc(sizeof(struct writer_buffer));
+    if (writer->head == NULL || writer->current == NULL) goto fail;
+
+    writer->head->next = NULL;
+    writer->head->used = 0;
+    writer->tail = writer->head;
+    writer->current->used = 0;
+
+    if (sem_init(&writer->ready, 0, 0) != 0) goto fail;
+
+    if (pthread_create(&writer->thread, NULL, write_buffers, writer) != 0) {
+        sem_destroy(&writer->ready);
+        goto fail;
+    }
+
+    stream = fopencookie(writer, "w", functions);
+    if (stream == NULL) {
+        sem_post(&writer->ready);
+        pthread_join(writer->thread, NULL);
+        sem_destroy(&writer->ready);
+        goto fail;
+    }
+
+    return stream;
+
+fail:
+    free(writer->head);
+    free(writer->current);
+    free(writer);
+    return NULL;
+}
+
+#else
+
+FILE * open_writer(FILE * file)
+{
+    (void) file;
+    return NULL;
+}
+
+#endif
+
+#ifdef	__cplusplus
+}
+#endif
@@ -7,11 +7,13 @@
  */
 
 #include "timers.h"
+#include "pmtm_defines.h"
 
 #include <sys/time.h>
 #include <sys/times.h>
 #include <sys/resource.h>
 #include <stdlib.h>
+#include <strings.h>
 
 #ifdef	__cplusplus
 extern "C" {
@@ -29,6 +31,76 @@ void set_timers(double * cpu_time, double * elapsed_time)
     *elapsed_time = t.tv_sec + t.tv_usec * 1.0E-6;
 }
 
+/*
+ * Only gettimeofday is available here, so every clock request is served by
+ * it and reported as "gettimeofday". The names of the other clocks are still
+ * known, so that asking for one of them warns that it is not available rather
+ * than that it does not exist.
+ */
+static const char * clock_names[INTERNAL__NUM_CLOCKS + 1] = {
+    "monotonic", "coarse", "tsc", "mpi", "gettimeofday"
+};
+
+/* pmtm_fast.h cannot read these clocks inline. */
+struct pmtm_clock_state pmtm_clock_state = { -1, 0, 0 };
+
+pmtm_tick_t read_cpu_clock()
+{
+    struct rusage r;
+
+    getrusage(RUSAGE_SELF, &r);
+    return (pmtm_tick_t) r.ru_utime.tv_sec * PMTM_TICKS_PER_SECOND + (pmtm_tick_t) r.ru_utime.tv_usec * 1000;
+}
+
+/* There is no portable per thread CPU clock, so use the process one. */
+pmtm_tick_t read_thread_cpu_clock()
+{
+    return read_cpu_clock();
+}
+
+pmtm_tick_t read_clock()
+{
+    struct timeval t;
+
+    gettimeofday(&t, (struct timezone *) NULL);
+    return (pmtm_tick_t) t.tv_sec * PMTM_TICKS_PER_SECOND + (pmtm_tick_t) t.tv_usec * 1000;
+}
+
+int select_clock(int clock_id)
+{
+    (void) clock_id;
+    return INTERNAL__CLOCK_GETTIMEOFDAY;
+}
+
+int get_clock_id()
+{
+    return INTERNAL__CLOCK_GETTIMEOFDAY;
+}
+
+int get_clock_id_from_name(const char * clock_name)
+{
+    int clock_id;
+    for (clock_id = 0; clock_id <= INTERNAL__CLOCK_GETTIMEOFDAY; ++clock_id) {
+        if (strcasecmp(clock_name, clock_names[clock_id]) == 0) {
+            return clock_id;
+        }
+    }
+    return -1;
+}
+
+const char * get_clock_name(int clock_id)
+{
+    if (clock_id < 0 || clock_id > INTERNAL__CLOCK_GETTIMEOFDAY) {
+        return "unknown";
+    }
+    return clock_names[clock_id];
+}
+
+double get_clock_resolution()
+{
+    return 1.0E-6;
+}
+
 #if 0
 // POSIX clock_ version - Need to test
 
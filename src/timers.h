@@ -1,4 +1,4 @@
-/* 
+/*
  * File:   timers.h
  * Author: AWE Plc.
  *
@@ -8,20 +8,69 @@
  * NOTE: This routine mush return both CPU and Elapsed (Wallclock) time. Vendor
  * must supply "system specific code" to do this. The routine included in
  * linux_timers.c is a sample only; alternative implementations are allowed.
+ *
+ * The elapsed time is read from one of a number of clock backends which is
+ * selected once at initialisation (see INTERNAL__CLOCK_* in pmtm_defines.h).
+ * Every backend returns ticks of PMTM_TICKS_PER_SECOND so that times taken
+ * with different backends, or on different ranks, can be combined directly.
+ * An implementation that only has one clock should accept any clock id and
+ * report the id of the clock it actually uses.
  */
 
 #ifndef _PMTM_INCLUDE_TIMERS_H
 #define	_PMTM_INCLUDE_TIMERS_H
 
+#include <stdint.h>
+
 #ifdef	__cplusplus
 extern "C" {
 #endif
 
+typedef uint64_t pmtm_tick_t;
+
+#define PMTM_TICKS_PER_SECOND 1000000000ULL
+#define PMTM_SECONDS_PER_TICK (1.0 / PMTM_TICKS_PER_SECOND)
+
+/* The sum of the squared ticks of a timer. A single block of 2^32 ns, about
+ * 4.3 seconds, already squares to more than 64 bits, so use 128 bits where the
+ * compiler has them. */
+#ifdef __SIZEOF_INT128__
+typedef unsigned __int128 pmtm_square_t;
+#else
+typedef long double pmtm_square_t;
+#endif
+
+/* The TSC is converted to nanoseconds as (tsc * tsc_mult) >> PMTM_TSC_SHIFT. */
+#define PMTM_TSC_SHIFT 32
+
+/**
+ * The state of the selected clock backend, which the inline clock read in
+ * pmtm_fast.h uses to read the same clock as read_clock. An implementation
+ * without inline support sets clock_id to -1 so that the library functions
+ * are always called.
+ */
+struct pmtm_clock_state
+{
+    int clock_id;      /**< The INTERNAL__CLOCK_* id of the selected clock. */
+    int use_rdtscp;    /**< Whether the TSC is read with rdtscp rather than rdtsc. */
+    uint64_t tsc_mult; /**< The TSC to nanosecond multiplier. */
+};
+
+extern struct pmtm_clock_state pmtm_clock_state;
+
 void set_timers(double * cpu_time, double * elapsed_time);
+pmtm_tick_t read_cpu_clock();
+pmtm_tick_t read_thread_cpu_clock();
+
+int          select_clock(int clock_id);
+int          get_clock_id();
+int          get_clock_id_from_name(const char * clock_name);
+const char * get_clock_name(int clock_id);
+double       get_clock_resolution();
+pmtm_tick_t  read_clock();
 
 #ifdef	__cplusplus
 }
 #endif
 
 #endif	/* _PMTM_INCLUDE_TIMERS_H */
-
@@ -0,0 +1,763 @@
+/*
+ * File:   pmtm_merge.c
+ * Author: AWE Plc.
+ *
+ * Puts together the output file of a run whose ranks wrote their timers to
+ * rank files (PMTM_OPTION_RANK_FILES). The output file is copied, and in place
+ * of each "Rank Files" line the timers of that section of the rank files are
+ * printed, the line of every rank and the average, maximum and minimum over
+ * the ranks, as PMTM prints them when it gathers the timers.
+ *
+ * The names are given IDs as exchange_names would, the new names of each
+ * section in rank order after those of the sections before. A first pass over
+ * the rank files of a section reads the names and counts the threads of each.
+ * The names are then split into batches whose timers fit in the memory given,
+ * and for each batch the rank files are read again, picking out the timers of
+ * its names. Each thread reads a contiguous range of ranks, so joining the
+ * timers of the threads in thread order puts them in rank order. The names of
+ * a batch are formatted in parallel, each into a buffer of its own, and the
+ * buffers are written out in name order.
+ *
+ * Usage: pmtm-merge [-t threads] [-m megabytes] [-d directory] [-c tolerance] input.pmtm [output.pmtm]
+ *
+ * The rank files are looked for in the directory of input.pmtm unless another
+ * is given, and the output goes to stdout unless output.pmtm is given. The lines
+ * of consecutive ranks are collapsed within the given relative tolerance, or
+ * that of the PMTM_COLLAPSE_RANKS environment variable, as PMTM would.
+ */
+
+#define _GNU_SOURCE
+
+#include "pmtm.h"
+#include "pmtm_internal.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef _OPENMP
+#  include <omp.h>
+#endif
+
+#define MARKER "Rank Files, =, "
+#define DEFAULT_MEGABYTES 1024
+#define LINE_SIZE 160           /* About the length of a formatted line. */
+
+/*
+ * A section of one rank file, read into memory.
+ */
+struct section {
+    struct PMTM_rank_file_header header;
+    char * data;                /* The names and then the timers. */
+    size_t capacity;            /* The size of data. */
+};
+
+/*
+ * The records of one name read by one thread, in rank order.
+ */
+struct name_records {
+    char * data;
+    size_t size;
+    size_t capacity;
+    uint32_t threads;
+};
+
+/*
+ * The names found by one thread in the first pass over a section.
+ */
+struct thread_names {
+    struct PMTM_name_dictionary names;  /* The names not known before the section. */
+    uint64_t * new_threads;             /* For each of those, its number of threads. */
+    size_t new_capacity;
+    uint64_t * known_threads;           /* For each name known before, its number of threads. */
+    uint32_t num_counters;              /* The hardware counters of the sections read, UINT32_MAX if none. */
+    int failed;
+};
+
+/*
+ * The state of a merge.
+ */
+struct merge {
+    const char * directory;             /* Where the rank files are. */
+    size_t budget;                      /* The memory a batch may take. */
+    int num_threads;
+    double tolerance;                   /* Within which the lines of consecutive ranks are collapsed, negative for none. */
+    struct PMTM_name_dictionary names;  /* The IDs of the names, kept from one section to the next. */
+    uint64_t * threads;                 /* For each name, its number of threads in the section. */
+    char * prefix;                      /* The name the rank files are named after. */
+    int nranks;
+    long * offsets;                     /* For each rank, where the next section of its file is searched from. */
+    long * starts;                      /* For each rank, where the section starts, -1 if it has none. */
+    uint32_t num_counters;              /* The hardware counters following each record. */
+};
+
+static const char * program = "pmtm-merge";
+
+static int thread_num(void)
+{
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+static int num_threads(void)
+{
+#ifdef _OPENMP
+    return omp_get_num_threads();
+#else
+    return 1;
+#endif
+}
+
+static int is_summary_type(PMTM_timer_type_t timer_type)
+{
+    return (timer_type == PMTM_TIMER_MMA || timer_type == PMTM_TIMER_AVO);
+}
+
+static size_t record_stride(uint32_t num_counters)
+{
+    return sizeof(struct PMTM_timer_record) + num_counters * sizeof(int64_t);
+}
+
+/*
+ * Build the path of the rank file of a rank, in the directory of the merge.
+ */
+static char * rank_file_path(const struct merge * merge, int rank)
+{
+    const char * base = strrchr(merge->prefix, '/');
+    char * path;
+
+    base = (base != NULL) ? base + 1 : merge->prefix;
+    if (asprintf(&path, "%s/%s.%d", merge->directory, base, rank) < 0) {
+        return NULL;
+    }
+    return path;
+}
+
+/*
+ * Check that the names and timers of a section lie within it.
+ *
+ * @returns 0 if they do, 1 if not.
+ */
+static int check_section(const struct section * section)
+{
+    const struct PMTM_rank_file_header * header = &section->header;
+    const size_t stride = record_stride(header->num_counters);
+    const char * names = section->data;
+    const char * names_end = names + header->names_size;
+    const char * timers = names_end;
+    const char * timers_end = timers + header->timers_size;
+    uint32_t name_idx;
+
+    for (name_idx = 0; name_idx < header->num_names; ++name_idx) {
+        uint32_t threadcount;
+        int string_idx;
+
+        for (string_idx = 0; string_idx < 2; ++string_idx) {
+            const char * end = memchr(names, '\0', names_end - names);
+            if (end == NULL) return 1;
+            names = end + 1;
+        }
+        if ((size_t) (names_end - names) < sizeof(PMTM_timer_type_t)) return 1;
+        names += sizeof(PMTM_timer_type_t);
+
+        if ((size_t) (timers_end - timers) < sizeof(threadcount)) return 1;
+        memcpy(&threadcount, timers, sizeof(threadcount));
+        timers += sizeof(threadcount);
+        if ((size_t) (timers_end - timers) / stride < threadcount) return 1;
+        timers += threadcount * stride;
+    }
+
+    return (names != names_end || timers != timers_end);
+}
+
+/*
+ * Read a section of the rank file of a rank, searching from the given offset
+ * and skipping the sections before it.
+ *
+ * @returns 0 if the section was read, with where it starts and ends in the
+ *          file, or 1 if the file has no such section or cannot be read.
+ */
+static int read_section(const struct merge * merge, int rank, uint32_t section_idx, long offset,
+                        struct section * section, long * start, long * end)
+{
+    struct PMTM_rank_file_header * header = &section->header;
+    char * path = rank_file_path(merge, rank);
+    FILE * fid = (path != NULL) ? fopen(path, "r") : NULL;
+    int status = 1;
+
+    if (fid == NULL || fseek(fid, offset, SEEK_SET) != 0) goto done;
+
+    while (fread(header, sizeof(*header), 1, fid) == 1) {
+        size_t size = (size_t) header->names_size + header->timers_size;
+
+        if (header->magic != PMTM_RANK_FILE_MAGIC || header->version != PMTM_WIRE_VERSION
+                || header->record_size != sizeof(struct PMTM_timer_record) || header->rank != rank) {
+            fprintf(stderr, "%s: %s is not a rank file of this version of PMTM\n", program, path);
+            break;
+        }
+
+        if (header->section < section_idx) {
+            if (fseek(fid, (long) size, SEEK_CUR) != 0) break;
+            offset = ftell(fid);
+            continue;
+        }
+        if (header->section > section_idx) break;
+
+        if (size > section->capacity) {
+            char * data = realloc(section->data, size);
+            if (data == NULL) break;
+            section->data = data;
+            section->capacity = size;
+        }
+        if (fread(section->data, 1, size, fid) == size && check_section(section) == 0) {
+            *start = offset;
+            *end = ftell(fid);
+            status = 0;
+        } else {
+            fprintf(stderr, "%s: section %u of %s is damaged\n", program, section_idx, path);
+        }
+        break;
+    }
+
+done:
+    if (fid != NULL) fclose(fid);
+    free(path);
+    return status;
+}
+
+/*
+ * Step over a name of a section.
+ *
+ * @returns where the next name starts.
+ */
+static const char * next_name(const char * names, const char ** group_name, const char ** timer_name,
+                              PMTM_timer_type_t * timer_type)
+{
+    *group_name = names;
+    names += strlen(names) + 1;
+    *timer_name = names;
+    names += strlen(names) + 1;
+    memcpy(timer_type, names, sizeof(*timer_type));
+    return names + sizeof(*timer_type);
+}
+
+/*
+ * Make room for the counts of a thread up to the given index.
+ *
+ * @returns 0 if successful, 1 if the memory could not be allocated.
+ */
+static int grow_counts(uint64_t ** counts, size_t * capacity, size_t needed)
+{
+    size_t old_capacity = *capacity;
+    if (grow_array((void **) counts, capacity, needed, sizeof(uint64_t)) != 0) return 1;
+    memset(*counts + old_capacity, 0, (*capacity - old_capacity) * sizeof(uint64_t));
+    return 0;
+}
+
+/*
+ * The first pass over a section: find the sections of all the rank files, give
+ * the new names IDs and count the threads of every name.
+ *
+ * @returns 0 if successful, 1 if the memory could not be allocated or the
+ *          rank files have different hardware counters.
+ */
+static int scan_names(struct merge * merge, uint32_t section_idx)
+{
+    struct thread_names * found = calloc(merge->num_threads, sizeof(*found));
+    const size_t num_known = merge->names.num_names;
+    size_t threads_capacity = num_known;
+    int used_threads = 1;
+    int missing = 0;
+    int failed = 0;
+    int thread;
+
+    if (found == NULL) return 1;
+
+#pragma omp parallel num_threads(merge->num_threads) reduction(+:missing)
+    {
+        struct thread_names * mine = &found[thread_num()];
+        struct section section = { { 0 }, NULL, 0 };
+        const int nthreads = num_threads();
+        const int first = (int) ((long long) merge->nranks * thread_num() / nthreads);
+        const int last = (int) ((long long) merge->nranks * (thread_num() + 1) / nthreads);
+        int r;
+
+        if (thread_num() == 0) used_threads = nthreads;
+
+        mine->known_threads = calloc(num_known + 1, sizeof(uint64_t));
+        mine->num_counters = UINT32_MAX;
+        mine->failed = (mine->known_threads == NULL);
+
+        for (r = first; r < last && !mine->failed; ++r) {
+            const char * names;
+            const char * timers;
+            uint32_t name_idx;
+
+            if (read_section(merge, r, section_idx, merge->offsets[r], &section,
+                             &merge->starts[r], &merge->offsets[r]) != 0) {
+                merge->starts[r] = -1;
+                missing++;
+                continue;
+            }
+            if (mine->num_counters == UINT32_MAX) {
+                mine->num_counters = section.header.num_counters;
+            } else if (mine->num_counters != section.header.num_counters) {
+                mine->failed = 1;
+                break;
+            }
+
+            names = section.data;
+            timers = section.data + section.header.names_size;
+            for (name_idx = 0; name_idx < section.header.num_names; ++name_idx) {
+                const char * group_name;
+                const char * timer_name;
+                PMTM_timer_type_t timer_type;
+                uint32_t threadcount;
+                long name_id;
+
+                names = next_name(names, &group_name, &timer_name, &timer_type);
+                memcpy(&threadcount, timers, sizeof(threadcount));
+                timers += sizeof(threadcount) + threadcount * record_stride(section.header.num_counters);
+
+                name_id = find_name(&merge->names, group_name, timer_name);
+                if (name_id >= 0) {
+                    mine->known_threads[name_id] += threadcount;
+                    continue;
+                }
+
+                name_id = find_name(&mine->names, group_name, timer_name);
+                if (name_id < 0) {
+                    name_id = add_name(&mine->names, group_name, timer_name, timer_type);
+                    if (name_id < 0 || grow_counts(&mine->new_threads, &mine->new_capacity, name_id + 1) != 0) {
+                        mine->failed = 1;
+                        break;
+                    }
+                }
+                mine->new_threads[name_id] += threadcount;
+            }
+        }
+
+        free(section.data);
+    }
+
+    // The threads found their names in rank order, so adding them in thread
+    // order gives the new names the IDs exchange_names would.
+
+    if (num_known > 0) memset(merge->threads, 0, num_known * sizeof(uint64_t));
+    merge->num_counters = UINT32_MAX;
+
+    for (thread = 0; thread < used_threads; ++thread) {
+        struct thread_names * mine = &found[thread];
+        size_t name_idx;
+
+        // Every rank file of a run has the same hardware counters.
+
+        if (mine->num_counters != UINT32_MAX) {
+            if (merge->num_counters == UINT32_MAX) {
+                merge->num_counters = mine->num_counters;
+            } else if (merge->num_counters != mine->num_counters) {
+                mine->failed = 1;
+            }
+        }
+
+        failed = failed || mine->failed;
+        if (failed) break;
+
+        for (name_idx = 0; name_idx < num_known; ++name_idx) {
+            merge->threads[name_idx] += mine->known_threads[name_idx];
+        }
+        for (name_idx = 0; name_idx < mine->names.num_names; ++name_idx) {
+            const struct PMTM_name * name = &mine->names.names[name_idx];
+            long name_id = find_name(&merge->names, name->group_name, name->timer_name);
+            if (name_id < 0) {
+                name_id = add_name(&merge->names, name->group_name, name->timer_name, name->timer_type);
+                if (name_id < 0 || grow_counts(&merge->threads, &threads_capacity, name_id + 1) != 0) {
+                    failed = 1;
+                    break;
+                }
+            }
+            merge->threads[name_id] += mine->new_threads[name_idx];
+        }
+    }
+
+    for (thread = 0; thread < merge->num_threads; ++thread) {
+        destruct_name_dictionary(&found[thread].names);
+        free(found[thread].new_threads);
+        free(found[thread].known_threads);
+    }
+    free(found);
+
+    if (merge->num_counters == UINT32_MAX) merge->num_counters = 0;
+
+    if (missing > 0) {
+        fprintf(stderr, "%s: %d of %d rank files have no section %u of %s, their timers are left out\n",
+                program, missing, merge->nranks, section_idx, merge->prefix);
+    }
+
+    return failed;
+}
+
+/*
+ * The second pass over a section: read the records of the names of a batch,
+ * those with IDs from first to last, into a buffer per thread and name.
+ *
+ * @returns 0 if successful, 1 if the memory could not be allocated.
+ */
+static int gather_batch(struct merge * merge, uint32_t section_idx, size_t first, size_t last,
+                        struct name_records * records)
+{
+    const size_t batch_size = last - first;
+    int failed = 0;
+
+#pragma omp parallel num_threads(merge->num_threads) reduction(+:failed)
+    {
+        struct name_records * mine = &records[thread_num() * batch_size];
+        struct section section = { { 0 }, NULL, 0 };
+        const int nthreads = num_threads();
+        const int first_rank = (int) ((long long) merge->nranks * thread_num() / nthreads);
+        const int last_rank = (int) ((long long) merge->nranks * (thread_num() + 1) / nthreads);
+        int r;
+
+        for (r = first_rank; r < last_rank && !failed; ++r) {
+            const char * names;
+            const char * timers;
+            uint32_t name_idx;
+            long start, end;
+
+            if (merge->starts[r] < 0) continue;
+            if (read_section(merge, r, section_idx, merge->starts[r], &section, &start, &end) != 0
+                    || section.header.num_counters != merge->num_counters) continue;
+
+            names = section.data;
+            timers = section.data + section.header.names_size;
+            for (name_idx = 0; name_idx < section.header.num_names; ++name_idx) {
+                const char * group_name;
+                const char * timer_name;
+                PMTM_timer_type_t timer_type;
+                uint32_t threadcount;
+                size_t size;
+                long name_id;
+
+                names = next_name(names, &group_name, &timer_name, &timer_type);
+                memcpy(&threadcount, timers, sizeof(threadcount));
+                timers += sizeof(threadcount);
+                size = threadcount * record_stride(merge->num_counters);
+
+                name_id = find_name(&merge->names, group_name, timer_name);
+                if (name_id >= (long) first && name_id < (long) last && threadcount > 0) {
+                    struct name_records * name_records = &mine[name_id - first];
+                    if (grow_array((void **) &name_records->data, &name_records->capacity,
+                                   name_records->size + size, 1) != 0) {
+                        failed = 1;
+                        break;
+                    }
+                    memcpy(name_records->data + name_records->size, timers, size);
+                    name_records->size += size;
+                    name_records->threads += threadcount;
+                }
+                timers += size;
+            }
+        }
+
+        free(section.data);
+    }
+
+    return failed;
+}
+
+/*
+ * Print the lines of one name of a batch, from the records of every thread, to
+ * the given file.
+ *
+ * @returns 0 if successful, 1 if the memory could not be allocated.
+ */
+static int print_name(const struct merge * merge, FILE * fid, size_t name_id, size_t batch_size,
+                      const struct name_records * records)
+{
+    const struct PMTM_name * name = &merge->names.names[name_id];
+    struct PMTM_instance instance;
+    struct PMTM_timer * timers;
+    PMTM_timer_type_t timer_type;
+    uint32_t threads = 0;
+    uint32_t t;
+    int thread;
+
+    for (thread = 0; thread < merge->num_threads; ++thread) {
+        threads += records[thread * batch_size].threads;
+    }
+    if (threads == 0) return 0;
+
+    timers = malloc(threads * sizeof(struct PMTM_timer));
+#ifdef HW_COUNTERS
+    hw_counter_t * counters = malloc(threads * merge->num_counters * sizeof(hw_counter_t) + 1);
+    if (counters == NULL) {
+        free(timers);
+        return 1;
+    }
+#endif
+    if (timers == NULL) return 1;
+
+    threads = 0;
+    for (thread = 0; thread < merge->num_threads; ++thread) {
+        const struct name_records * name_records = &records[thread * batch_size];
+        for (t = 0; t < name_records->threads; ++t, ++threads) {
+            const char * record = name_records->data + t * record_stride(merge->num_counters);
+            unpack_timer_record(record, &timers[threads]);
+            timers[threads].timer_name = name->timer_name;
+#ifdef HW_COUNTERS
+            uint32_t counter_idx;
+            timers[threads].total_counters = &counters[threads * merge->num_counters];
+            for (counter_idx = 0; counter_idx < merge->num_counters; ++counter_idx) {
+                int64_t counter;
+                memcpy(&counter, record + sizeof(struct PMTM_timer_record) + counter_idx * sizeof(counter), sizeof(counter));
+                timers[threads].total_counters[counter_idx] = counter;
+            }
+#endif
+        }
+    }
+
+    // As printed by PMTM, the summarised names take the type they were given
+    // first, and the others the type of the timer of the lowest rank.
+
+    timer_type = is_summary_type(name->timer_type) ? name->timer_type : timers[0].timer_type;
+
+    memset(&instance, 0, sizeof(instance));
+    instance.fid = fid;
+    instance.nranks = merge->nranks;
+    instance.collapse_tolerance = merge->tolerance;
+    print_timer_array(&instance, threads, timers, name->timer_name, timer_type);
+
+#ifdef HW_COUNTERS
+    free(counters);
+#endif
+    free(timers);
+    return 0;
+}
+
+/*
+ * Format the names of a batch in parallel, each into a buffer of its own, and
+ * write the buffers out in name order.
+ *
+ * @returns 0 if successful, 1 if the memory could not be allocated.
+ */
+static int print_batch(const struct merge * merge, FILE * output, size_t first, size_t last,
+                       const struct name_records * records)
+{
+    const size_t batch_size = last - first;
+    char ** texts = calloc(batch_size + 1, sizeof(char *));
+    size_t * sizes = calloc(batch_size + 1, sizeof(size_t));
+    long name_idx;
+    int failed = (texts == NULL || sizes == NULL);
+
+    if (!failed) {
+#pragma omp parallel for num_threads(merge->num_threads) schedule(dynamic) reduction(+:failed)
+        for (name_idx = 0; name_idx < (long) batch_size; ++name_idx) {
+            FILE * fid = open_memstream(&texts[name_idx], &sizes[name_idx]);
+            if (fid == NULL) {
+                failed = 1;
+                continue;
+            }
+            failed += print_name(merge, fid, first + name_idx, batch_size, &records[name_idx]);
+            if (fclose(fid) != 0) failed = 1;
+        }
+    }
+
+    for (name_idx = 0; !failed && name_idx < (long) batch_size; ++name_idx) {
+        fwrite(texts[name_idx], 1, sizes[name_idx], output);
+    }
+
+    if (texts != NULL) {
+        for (name_idx = 0; name_idx < (long) batch_size; ++name_idx) {
+            free(texts[name_idx]);
+        }
+    }
+    free(texts);
+    free(sizes);
+    return (failed != 0);
+}
+
+/*
+ * Print the timers of a section of the rank files, a batch of names at a time.
+ *
+ * @returns 0 if successful, 1 if not.
+ */
+static int merge_section(struct merge * merge, FILE * output, uint32_t section_idx)
+{
+    size_t first = 0;
+    size_t thread_size;
+    int failed = 0;
+
+    if (scan_names(merge, section_idx) != 0) return 1;
+
+    thread_size = record_stride(merge->num_counters) + sizeof(struct PMTM_timer) + LINE_SIZE;
+
+    while (first < merge->names.num_names && !failed) {
+        size_t last = first;
+        size_t batch_bytes = 0;
+        size_t idx;
+
+        while (last < merge->names.num_names
+                && (last == first || batch_bytes + merge->threads[last] * thread_size <= merge->budget)) {
+            batch_bytes += merge->threads[last] * thread_size;
+            last++;
+        }
+
+        if (batch_bytes > 0) {
+            const size_t num_records = (last - first) * merge->num_threads;
+            struct name_records * records = calloc(num_records, sizeof(*records));
+
+            failed = (records == NULL)
+                  || gather_batch(merge, section_idx, first, last, records)
+                  || print_batch(merge, output, first, last, records);
+
+            if (records != NULL) {
+                for (idx = 0; idx < num_records; ++idx) {
+                    free(records[idx].data);
+                }
+            }
+            free(records);
+        }
+
+        first = last;
+    }
+
+    return failed;
+}
+
+/*
+ * Start on the rank files named in a "Rank Files" line, carrying on from the
+ * sections already merged if they are the same files.
+ *
+ * @returns 0 if successful, 1 if the memory could not be allocated.
+ */
+static int use_rank_files(struct merge * merge, const char * prefix, int nranks)
+{
+    if (merge->prefix != NULL && strcmp(merge->prefix, prefix) == 0 && merge->nranks == nranks) {
+        return 0;
+    }
+
+    free(merge->prefix);
+    free(merge->offsets);
+    free(merge->starts);
+    merge->prefix = strdup(prefix);
+    merge->nranks = nranks;
+    merge->offsets = calloc(nranks + 1, sizeof(long));
+    merge->starts = calloc(nranks + 1, sizeof(long));
+
+    return (merge->prefix == NULL || merge->offsets == NULL || merge->starts == NULL);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: %s [-t threads] [-m megabytes] [-d directory] [-c tolerance] input.pmtm [output.pmtm]\n", program);
+}
+
+int main(int argc, char ** argv)
+{
+    struct merge merge;
+    char * directory = NULL;
+    char * line = NULL;
+    size_t line_capacity = 0;
+    FILE * input;
+    FILE * output = stdout;
+    long megabytes = DEFAULT_MEGABYTES;
+    int status = 0;
+    int option;
+
+    memset(&merge, 0, sizeof(merge));
+#ifdef _OPENMP
+    merge.num_threads = omp_get_max_threads();
+#else
+    merge.num_threads = 1;
+#endif
+    merge.tolerance = get_collapse_tolerance();
+
+    while ((option = getopt(argc, argv, "t:m:d:c:h")) != -1) {
+        char * end;
+        switch (option) {
+            case 't': merge.num_threads = atoi(optarg); break;
+            case 'm': megabytes = atol(optarg); break;
+            case 'd': merge.directory = optarg; break;
+            case 'c':
+                merge.tolerance = strtod(optarg, &end);
+                if (end == optarg || *end != '\0') merge.tolerance = -1;
+                if (merge.tolerance < 0) {
+                    usage();
+                    return 1;
+                }
+                break;
+            default: usage(); return 1;
+        }
+    }
+    if (optind >= argc || argc - optind > 2 || merge.num_threads < 1 || megabytes < 1) {
+        usage();
+        return 1;
+    }
+#ifndef _OPENMP
+    merge.num_threads = 1;
+#endif
+    merge.budget = (size_t) megabytes << 20;
+
+    input = fopen(argv[optind], "r");
+    if (input == NULL) {
+        fprintf(stderr, "%s: cannot open %s\n", program, argv[optind]);
+        return 1;
+    }
+    if (optind + 1 < argc) {
+        output = fopen(argv[optind + 1], "w");
+        if (output == NULL) {
+            fprintf(stderr, "%s: cannot create %s\n", program, argv[optind + 1]);
+            return 1;
+        }
+    }
+    setvbuf(output, NULL, _IOFBF, PMTM_OUTPUT_BUFFER_SIZE);
+
+    if (merge.directory == NULL) {
+        const char * slash = strrchr(argv[optind], '/');
+        directory = (slash != NULL) ? strndup(argv[optind], slash - argv[optind] + 1) : strdup(".");
+        merge.directory = directory;
+    }
+
+    while (status == 0 && getline(&line, &line_capacity, input) != -1) {
+        int nranks;
+        unsigned int section_idx;
+        int length = 0;
+
+        if (strncmp(line, MARKER, strlen(MARKER)) != 0
+                || sscanf(line + strlen(MARKER), "%d, %u, %n", &nranks, &section_idx, &length) < 2
+                || length == 0 || nranks < 1) {
+            fputs(line, output);
+            continue;
+        }
+
+        char * prefix = line + strlen(MARKER) + length;
+        prefix[strcspn(prefix, "\n")] = '\0';
+
+        if (use_rank_files(&merge, prefix, nranks) != 0 || merge_section(&merge, output, section_idx) != 0) {
+            fprintf(stderr, "%s: cannot merge section %u of %s, out of memory or mixed rank files\n",
+                    program, section_idx, prefix);
+            status = 1;
+        }
+    }
+
+    if (fclose(output) != 0) {
+        fprintf(stderr, "%s: failed to write the output\n", program);
+        status = 1;
+    }
+    fclose(input);
+
+    free(line);
+    free(directory);
+    free(merge.prefix);
+    free(merge.offsets);
+    free(merge.starts);
+    free(merge.threads);
+    destruct_name_dictionary(&merge.names);
+
+    return status;
+}